@@ -0,0 +1,756 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <twpp.hpp>
+
+using namespace Twpp;
+
+namespace {
+
+typedef ReturnCode (TWPP_DETAIL_CALLSTYLE* DsEntry)(Identity* origin, DataGroup dg, Dat dat, Msg msg, void* data);
+
+// IDs assigned by the mock manager
+static constexpr const UInt32 APP_ID = 1;
+static constexpr const UInt32 DS_ID = 2;
+
+static DsEntry g_dsEntry = nullptr;
+static Detail::CallBackFunc g_callBack = nullptr;
+
+extern "C" {
+
+static Handle::Raw TWPP_DETAIL_CALLSTYLE mockAlloc(UInt32 size){
+    return static_cast<Handle::Raw>(std::calloc(1, size));
+}
+
+static void TWPP_DETAIL_CALLSTYLE mockFree(Handle::Raw handle){
+    std::free(handle);
+}
+
+static void* TWPP_DETAIL_CALLSTYLE mockLock(Handle::Raw handle){
+    return handle;
+}
+
+static void TWPP_DETAIL_CALLSTYLE mockUnlock(Handle::Raw){
+    // memory is never moved
+}
+
+static ReturnCode TWPP_DETAIL_CALLSTYLE mockDsmEntry(
+        Identity* origin,
+        Identity* dest,
+        DataGroup dg,
+        Dat dat,
+        Msg msg,
+        void* data
+);
+
+}
+
+static Identity withId(UInt32 id, const Identity& ident, UInt32 extraGroups = 0) noexcept{
+    return Identity(id, ident.version(), ident.protocolMajor(), ident.protocolMinor(),
+                    ident.dataGroupsRaw() | extraGroups, ident.manufacturer(),
+                    ident.productFamily(), ident.productName());
+}
+
+/// The manager part, talks to the application.
+static ReturnCode dsmControl(Identity* origin, Dat dat, Msg msg, void* data){
+    switch (dat){
+        case Dat::Parent:
+            if (msg == Msg::OpenDsm){
+                *origin = withId(APP_ID, *origin, Detail::Dsm2);
+            }
+
+            return ReturnCode::Success;
+
+        case Dat::EntryPoint: {
+            if (msg != Msg::Get){
+                return ReturnCode::Failure;
+            }
+
+            auto& e = *static_cast<Detail::EntryPoint*>(data);
+            e.m_entry = mockDsmEntry;
+            e.m_alloc = mockAlloc;
+            e.m_free = mockFree;
+            e.m_lock = mockLock;
+            e.m_unlock = mockUnlock;
+            return ReturnCode::Success;
+        }
+
+        case Dat::Identity: {
+            auto& ident = *static_cast<Identity*>(data);
+            switch (msg){
+                case Msg::GetDefault:
+                case Msg::GetFirst: {
+                    Identity def;
+                    auto rc = g_dsEntry(origin, DataGroup::Control, Dat::Identity, Msg::Get, &def);
+                    if (success(rc)){
+                        ident = withId(DS_ID, def);
+                    }
+
+                    return rc;
+                }
+
+                case Msg::GetNext:
+                    return ReturnCode::EndOfList;
+
+                case Msg::OpenDs: {
+                    Detail::EntryPoint e;
+                    dsmControl(origin, Dat::EntryPoint, Msg::Get, &e);
+                    auto rc = g_dsEntry(origin, DataGroup::Control, Dat::EntryPoint, Msg::Set, &e);
+                    if (!success(rc)){
+                        return rc;
+                    }
+
+                    return g_dsEntry(origin, DataGroup::Control, Dat::Identity, Msg::OpenDs, data);
+                }
+
+                case Msg::CloseDs:
+                    g_callBack = nullptr;
+                    return g_dsEntry(origin, DataGroup::Control, Dat::Identity, Msg::CloseDs, data);
+
+                default:
+                    return ReturnCode::Failure;
+            }
+        }
+
+        case Dat::Status:
+            *static_cast<Status*>(data) = Status();
+            return ReturnCode::Success;
+
+        default:
+            return ReturnCode::Failure;
+    }
+}
+
+/// Mock manager entry, routes calls between the application and the source in the same process.
+static ReturnCode TWPP_DETAIL_CALLSTYLE mockDsmEntry(
+        Identity* origin,
+        Identity* dest,
+        DataGroup dg,
+        Dat dat,
+        Msg msg,
+        void* data
+){
+    if (origin != nullptr && origin->id() == DS_ID){
+        // source -> application
+        return g_callBack != nullptr ? g_callBack(origin, dest, dg, dat, msg, data) : ReturnCode::Failure;
+    }
+
+    if (dest == nullptr){
+        return dsmControl(origin, dat, msg, data);
+    }
+
+    if (dg == DataGroup::Control && (dat == Dat::Callback2 || dat == Dat::Callback) && msg == Msg::RegisterCallback){
+        g_callBack = dat == Dat::Callback2 ?
+                    static_cast<Detail::CallBack2*>(data)->m_func :
+                    static_cast<Detail::CallBack*>(data)->m_func;
+
+        return ReturnCode::Success;
+    }
+
+    return g_dsEntry(origin, dg, dat, msg, data);
+}
+
+static bool loadSource(const char* path){
+#if defined(TWPP_DETAIL_OS_WIN)
+    auto lib = ::LoadLibraryA(path);
+    if (!lib){
+        return false;
+    }
+
+    g_dsEntry = reinterpret_cast<DsEntry>(::GetProcAddress(lib, "DS_Entry"));
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+    auto lib = ::dlopen(path, RTLD_NOW);
+    if (!lib){
+        return false;
+    }
+
+    g_dsEntry = reinterpret_cast<DsEntry>(::dlsym(lib, "DS_Entry"));
+#else
+#   error "source library loading for your platform here"
+#endif
+
+    return g_dsEntry != nullptr;
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename Fn>
+static double nsPerOp(UInt32 iterations, Fn fn){
+    auto start = Clock::now();
+    for (UInt32 i = 0; i < iterations; i++){
+        fn();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    return static_cast<double>(elapsed.count()) / iterations;
+}
+
+static void report(const char* name, double ns, double bytes = 0){
+    if (bytes > 0){
+        std::printf("%-44s %14.1f ns/op %10.1f MB/s\n", name, ns, bytes / ns * 1000.0);
+    } else {
+        std::printf("%-44s %14.1f ns/op\n", name, ns);
+    }
+}
+
+static volatile UInt32 g_sink;
+
+/// Keeps the compiler from optimizing `value` away, including its computation.
+template<typename T>
+static void doNotOptimize(const T& value){
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+static void benchCapabilityCreate(){
+    report("Capability::createOneValue", nsPerOp(100000, [](){
+        auto cap = Capability::createOneValue<CapType::XferCount>(1);
+        g_sink = static_cast<UInt32>(cap.type());
+    }));
+
+    report("InlineCap::createOneValue", nsPerOp(100000, [](){
+        // the value is not a constant, and the whole container is kept
+        auto cap = InlineCap<CapType::XferCount>::createOneValue(static_cast<Int16>(g_sink));
+        doNotOptimize(cap);
+    }));
+
+    report("Capability::createArray (64 x UInt16)", nsPerOp(100000, [](){
+        auto cap = Capability::createArray<Type::UInt16>(CapType::SupportedCaps, 64);
+        g_sink = static_cast<UInt32>(cap.type());
+    }));
+}
+
+static void benchLock(){
+    Handle h = Detail::alloc(4096);
+    report("Detail::Lock", nsPerOp(1000000, [h](){
+        Detail::Lock<char> lock(h);
+        g_sink = static_cast<UInt32>(lock.data()[0]);
+    }));
+
+    Detail::free(h);
+}
+
+static void benchNegotiation(Source& src){
+    report("Source::capability Get (XferCount)", nsPerOp(100000, [&src](){
+        Capability cap(CapType::XferCount);
+        g_sink = static_cast<UInt32>(src.capability(Msg::Get, cap));
+    }));
+
+    report("Source::capability Set (XferCount)", nsPerOp(100000, [&src](){
+        auto cap = Capability::createOneValue<CapType::XferCount>(-1);
+        g_sink = static_cast<UInt32>(src.capability(Msg::Set, cap));
+    }));
+
+    report("Source::capability Get (XferCount, inline)", nsPerOp(100000, [&src](){
+        InlineCap<CapType::XferCount> cap;
+        g_sink = static_cast<UInt32>(src.capability(Msg::Get, cap));
+    }));
+
+    report("Source::capability Set (XferCount, inline)", nsPerOp(100000, [&src](){
+        auto cap = InlineCap<CapType::XferCount>::createOneValue(-1);
+        g_sink = static_cast<UInt32>(src.capability(Msg::Set, cap));
+    }));
+
+    src.setCapabilityCache(true);
+    report("Source::capability Get (XferCount, cached)", nsPerOp(100000, [&src](){
+        Capability cap(CapType::XferCount);
+        g_sink = static_cast<UInt32>(src.capability(Msg::Get, cap));
+    }));
+
+    report("Source::cachedCapability (XferCount)", nsPerOp(100000, [&src](){
+        auto cap = src.cachedCapability(CapType::XferCount, Msg::Get);
+        g_sink = cap != nullptr ? 1 : 0;
+    }));
+
+    src.setCapabilityCache(false);
+
+    report("Source::negotiate (XferCount, IXferMech)", nsPerOp(10000, [&src](){
+        auto xferCount = Capability::createOneValue<CapType::XferCount>(-1);
+        auto xferMech = Capability::createOneValue<CapType::IXferMech>(XferMech::Native);
+        auto results = src.negotiate(true, xferCount, xferMech);
+        g_sink = static_cast<UInt32>(results[0].returnCode()) + static_cast<UInt32>(results[1].returnCode());
+    }));
+
+    static constexpr auto profile = makeProfile(
+        ProfileValue<CapType::XferCount>(-1),
+        ProfileValue<CapType::IXferMech>(XferMech::Native),
+        ProfileValue<CapType::IPixelType>(PixelType::Rgb) // read-only, skipped
+    );
+
+    auto prepared = profile.prepare();
+    report("Source::applyProfile (3 caps, verified)", nsPerOp(10000, [&](){
+        auto results = src.applyProfile(prepared);
+        g_sink = static_cast<UInt32>(results[0].returnCode()) + (prepared.matches() ? 1 : 0);
+    }));
+
+    report("Source::applyProfile (3 caps)", nsPerOp(10000, [&](){
+        auto results = src.applyProfile(prepared, false);
+        g_sink = static_cast<UInt32>(results[0].returnCode());
+    }));
+
+    report("Source::status (entry dispatch)", nsPerOp(1000000, [&src](){
+        Status status;
+        g_sink = static_cast<UInt32>(src.status(status));
+    }));
+}
+
+static bool setup(Source& src, const Frame& frame, XferMech mech, Int16 pages){
+    ImageLayout layout(frame);
+    auto xferCount = Capability::createOneValue<CapType::XferCount>(pages);
+    auto xferMech = Capability::createOneValue<CapType::IXferMech>(mech);
+    return success(src.imageLayout(Msg::Set, layout)) &&
+            success(src.capability(Msg::Set, xferCount)) &&
+            success(src.capability(Msg::Set, xferMech)) &&
+            success(src.enable(UserInterface(false, false))) &&
+            success(src.waitReady());
+}
+
+template<typename Fn>
+static bool transferAll(Source& src, Fn xfer){
+    PendingXfers pending;
+    do {
+        if (!xfer()){
+            src.pendingXfers(Msg::Reset, pending);
+            return false;
+        }
+
+        if (!success(src.pendingXfers(Msg::EndXfer, pending))){
+            return false;
+        }
+    } while (pending.count() != 0);
+
+    return true;
+}
+
+static void benchTransfer(Source& src){
+    static const Int16 pages = 16;
+    static const struct {
+        const char* name;
+        Frame frame;
+    } sizes[] = {
+        {"1 x 1 in", Frame(0, 0, 1, 1)},
+        {"8.5 x 11 in", Frame(0, 0, 8.5f, 11)},
+        {"17 x 22 in", Frame(0, 0, 17, 22)}
+    };
+
+    char name[64];
+    for (auto& size : sizes){
+        ImageInfo info;
+        std::uint64_t bytes = 0;
+
+        if (!setup(src, size.frame, XferMech::Native, pages) || !success(src.imageInfo(info))){
+            std::printf("%s: native setup failed\n", size.name);
+            return;
+        }
+
+        // native data of the synthetic source are raw RGB rows aligned to 4 bytes
+        std::uint64_t pageBytes = static_cast<std::uint64_t>((info.width() * 24 + 31) / 32 * 4) * info.height();
+
+        auto start = Clock::now();
+        bool ok = transferAll(src, [&](){
+            ImageNativeXfer xfer;
+            if (src.imageNativeXfer(xfer) != ReturnCode::XferDone){
+                return false;
+            }
+
+            bytes += pageBytes;
+            return true;
+        });
+
+        auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        src.disable();
+        if (!ok){
+            std::printf("%s: native transfer failed\n", size.name);
+            return;
+        }
+
+        std::snprintf(name, sizeof(name), "native transfer %s, %dx%d", size.name,
+                      static_cast<int>(info.width()), static_cast<int>(info.height()));
+
+        report(name, ns / pages, static_cast<double>(bytes) / pages);
+
+        if (!setup(src, size.frame, XferMech::Memory, pages)){
+            std::printf("%s: memory setup failed\n", size.name);
+            return;
+        }
+
+        bytes = 0;
+        start = Clock::now();
+        ok = transferAll(src, [&](){
+            return src.imageMemXferStream([&](const ImageMemXfer& strip){
+                bytes += strip.bytesWritten();
+                return true;
+            }) == ReturnCode::XferDone;
+        });
+
+        ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        src.disable();
+        if (!ok){
+            std::printf("%s: memory transfer failed\n", size.name);
+            return;
+        }
+
+        std::snprintf(name, sizeof(name), "memory transfer %s, %dx%d", size.name,
+                      static_cast<int>(info.width()), static_cast<int>(info.height()));
+
+        report(name, ns / pages, static_cast<double>(bytes) / pages);
+    }
+}
+
+static void benchExtImageInfo(Source& src){
+    // ExtImageInfo is only available in state 7, after the transfer
+    if (!setup(src, Frame(0, 0, 1, 1), XferMech::Native, 1)){
+        std::printf("ExtImageInfo setup failed\n");
+        return;
+    }
+
+    ImageNativeXfer xfer;
+    if (src.imageNativeXfer(xfer) == ReturnCode::XferDone){
+        report("Source::extImageInfo (new request)", nsPerOp(100000, [&src](){
+            ExtImageInfo info{InfoId::PageNumber, InfoId::DocumentNumber, InfoId::Frame,
+                              InfoId::BarCodeCount, InfoId::Camera, InfoId::BarCodeText};
+
+            g_sink = static_cast<UInt32>(src.extImageInfo(info));
+        }));
+
+        ExtImageInfo info{InfoId::PageNumber, InfoId::DocumentNumber, InfoId::Frame,
+                          InfoId::BarCodeCount, InfoId::Camera, InfoId::BarCodeText};
+
+        report("Source::extImageInfo (reused request)", nsPerOp(100000, [&](){
+            info.clear();
+            g_sink = static_cast<UInt32>(src.extImageInfo(info));
+        }));
+    } else {
+        std::printf("ExtImageInfo transfer failed\n");
+    }
+
+    PendingXfers pending;
+    src.pendingXfers(Msg::Reset, pending);
+    src.disable();
+}
+
+/// Reference checks, run before the benchmarks, so that fast but wrong code is not measured.
+/// Optimized paths are compared to plain scalar code, or to values written by hand.
+
+static UInt32 g_seed = 0x2545f491;
+
+static UInt8 nextByte() noexcept{
+    g_seed = g_seed * 1103515245u + 12345u;
+    return static_cast<UInt8>(g_seed >> 16);
+}
+
+static bool check(const char* name, bool ok){
+    std::printf("%-44s %14s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool checkKernels(){
+    // not a multiple of any vector width, and not aligned
+    static const UInt32 pixels = 1003;
+    std::unique_ptr<UInt8[]> buffer(new UInt8[pixels * 4 + 1]);
+    std::unique_ptr<UInt8[]> out(new UInt8[pixels * 4 + 1]);
+    std::unique_ptr<UInt8[]> ref(new UInt8[pixels * 4]);
+    auto in = buffer.get() + 1;
+    for (UInt32 i = 0; i < pixels * 4; i++){
+        in[i] = nextByte();
+    }
+
+    bool ok = true;
+    for (UInt32 bytesPerPixel = 3; bytesPerPixel <= 4; bytesPerPixel++){
+        for (UInt32 i = 0; i < pixels * bytesPerPixel; i += bytesPerPixel){
+            std::memcpy(ref.get() + i, in + i, bytesPerPixel);
+            std::swap(ref[i], ref[i + 2]);
+        }
+
+        swapRedBlue(in, out.get() + 1, pixels, bytesPerPixel);
+        ok = std::memcmp(out.get() + 1, ref.get(), pixels * bytesPerPixel) == 0 && ok;
+    }
+
+    ok = check("swapRedBlue matches scalar code", ok);
+
+    for (UInt32 i = 0; i < pixels; i++){
+        ref[i] = static_cast<UInt8>(~in[i]);
+    }
+
+    invertPixels(in, out.get() + 1, pixels);
+    ok = check("invertPixels matches scalar code", std::memcmp(out.get() + 1, ref.get(), pixels) == 0) && ok;
+
+    bool bits = true;
+    for (auto order : {BitOrder::MsbFirst, BitOrder::LsbFirst}){
+        for (UInt32 i = 0; i < pixels; i++){
+            auto byte = in[i / 8];
+            auto bit = order == BitOrder::MsbFirst ? (byte >> (7 - i % 8)) & 1 : (byte >> (i % 8)) & 1;
+            ref[i] = bit != 0 ? 0xFF : 0x00;
+        }
+
+        unpackBits(in, out.get() + 1, pixels, order);
+        bits = std::memcmp(out.get() + 1, ref.get(), pixels) == 0 && bits;
+
+        // packing the unpacked pixels must restore the packed bytes, unused bits cleared
+        packBits(ref.get(), out.get() + 1, pixels, order);
+        UInt32 full = pixels / 8;
+        UInt8 tailMask = order == BitOrder::MsbFirst ?
+                    static_cast<UInt8>(0xFF << (8 - pixels % 8)) :
+                    static_cast<UInt8>(0xFF >> (8 - pixels % 8));
+
+        bits = std::memcmp(out.get() + 1, in, full) == 0 && out[1 + full] == (in[full] & tailMask) && bits;
+    }
+
+    return check("unpackBits and packBits match scalar code", bits) && ok;
+}
+
+// scalar PackBits encoder of a single row
+static void encodePackBits(const UInt8* row, UInt32 size, std::string& out){
+    UInt32 i = 0;
+    while (i < size){
+        UInt32 run = 1;
+        while (i + run < size && run < 128 && row[i + run] == row[i]){
+            run++;
+        }
+
+        if (run > 1){
+            out.push_back(static_cast<char>(1 - static_cast<Int32>(run)));
+            out.push_back(static_cast<char>(row[i]));
+            i += run;
+            continue;
+        }
+
+        UInt32 literal = 1;
+        while (i + literal < size && literal < 128 &&
+               !(i + literal + 1 < size && row[i + literal] == row[i + literal + 1])){
+            literal++;
+        }
+
+        out.push_back(static_cast<char>(literal - 1));
+        out.append(reinterpret_cast<const char*>(row + i), literal);
+        i += literal;
+    }
+}
+
+static bool checkPackBits(){
+    // 13 RGB pixels per row, rows padded to 40 bytes
+    static const UInt32 columns = 13;
+    static const UInt32 rows = 6;
+    static const UInt32 rowBytes = columns * 3;
+    static const UInt32 bytesPerRow = 40;
+
+    UInt8 image[rows * bytesPerRow] = {};
+    std::string compressed;
+    for (UInt32 r = 0; r < rows; r++){
+        for (UInt32 i = 0; i < rowBytes; i++){
+            image[r * bytesPerRow + i] = (i / 5 + r) % 3 == 0 ? 0x55 : nextByte();
+        }
+
+        encodePackBits(image + r * bytesPerRow, rowBytes, compressed);
+    }
+
+    auto size = static_cast<UInt32>(compressed.size());
+    Memory memory(size);
+    std::memcpy(memory.data().data(), compressed.data(), size);
+    ImageMemXfer strip(Compression::PackBits, bytesPerRow, columns, rows, 0, 0, size, std::move(memory));
+
+    ImageInfo info(Fix32(100), Fix32(100), columns, rows, 3, {8, 8, 8}, 24, false, PixelType::Rgb, Compression::PackBits);
+    ImageMemXfer decoded;
+    bool ok = StripDecoder::packBits(info)(strip, nullptr, decoded) &&
+            decoded.bytesWritten() == sizeof(image) &&
+            std::memcmp(decoded.memory().data().data(), image, sizeof(image)) == 0;
+
+    return check("StripDecoder::packBits matches scalar code", ok);
+}
+
+static UInt32 tiffValue(const char* file, UInt16 id){
+    UInt32 ifd;
+    UInt16 count;
+    std::memcpy(&ifd, file + 4, 4);
+    std::memcpy(&count, file + ifd, 2);
+    for (UInt16 i = 0; i < count; i++){
+        auto entry = file + ifd + 2 + i * 12;
+        UInt16 tag;
+        UInt16 type;
+        std::memcpy(&tag, entry, 2);
+        std::memcpy(&type, entry + 2, 2);
+        if (tag == id){
+            if (type == 3){ // Short
+                UInt16 value;
+                std::memcpy(&value, entry + 8, 2);
+                return value;
+            }
+
+            UInt32 value;
+            std::memcpy(&value, entry + 8, 4);
+            return value;
+        }
+    }
+
+    return 0xFFFFFFFF;
+}
+
+static bool checkTiff(){
+    // 8-bit gray, 7 pixels per row padded to 8 bytes
+    static const UInt32 columns = 7;
+    static const UInt32 rows = 4;
+    static const UInt32 bytesPerRow = 8;
+
+    ImageInfo info(Fix32(200), Fix32(200), columns, rows, 1, {8}, 8, false, PixelType::Gray, Compression::None);
+    std::unique_ptr<char[]> file(new char[4096]());
+    Memory memory(bytesPerRow * rows);
+    {
+        auto data = memory.data();
+        for (UInt32 i = 0; i < bytesPerRow * rows; i++){
+            data.data()[i] = static_cast<char>(i);
+        }
+    }
+
+    MemXferSink sink;
+    bool ok = sink.open(file.get(), 4096, info) &&
+            sink.write(ImageMemXfer(Compression::None, bytesPerRow, columns, rows, 0, 0, bytesPerRow * rows, std::move(memory))) &&
+            sink.close();
+
+    UInt16 magic = 0;
+    std::memcpy(&magic, file.get() + 2, 2);
+    ok = ok && magic == 42 && file[0] == file[1] &&
+            tiffValue(file.get(), 256) == columns &&
+            tiffValue(file.get(), 257) == rows &&
+            tiffValue(file.get(), 258) == 8 &&
+            tiffValue(file.get(), 262) == 1 && // BlackIsZero
+            tiffValue(file.get(), 279) == columns * rows;
+
+    auto offset = tiffValue(file.get(), 273);
+    for (UInt32 r = 0; ok && r < rows; r++){
+        for (UInt32 c = 0; c < columns; c++){
+            // rows are packed, the padding byte is dropped
+            ok = ok && offset < 4096 && static_cast<UInt8>(file[offset + r * columns + c]) == r * bytesPerRow + c;
+        }
+    }
+
+    return check("MemXferSink TIFF header and rows", ok);
+}
+
+static bool checkSnapshot(){
+    auto xferCount = Capability::createOneValue<CapType::XferCount>(-7);
+    auto pixelTypes = Capability::createEnumeration<CapType::IPixelType>(
+                {PixelType::BlackWhite, PixelType::Gray, PixelType::Rgb}, 2, 1);
+    auto codes = Capability::createArray<CapType::IBitOrderCodes>({BitOrder::MsbFirst, BitOrder::LsbFirst});
+
+    CapabilitySnapshot snapshot;
+    snapshot.add(xferCount);
+    snapshot.add(pixelTypes);
+    snapshot.add(codes);
+
+    CapabilitySnapshot loaded;
+    auto saved = snapshot.save();
+    bool ok = loaded.load(saved) && loaded.size() == 3;
+
+    auto count = loaded.find(CapType::XferCount);
+    auto types = loaded.find(CapType::IPixelType);
+    auto order = loaded.find(CapType::IBitOrderCodes);
+    ok = ok && count.container() == ConType::OneValue && count.currentItem<Int16>() == -7;
+    if (ok && types.container() == ConType::Enumeration){
+        auto enm = types.enumeration<CapType::IPixelType>();
+        ok = enm.size() == 3 && enm[0] == PixelType::BlackWhite && enm[2] == PixelType::Rgb &&
+                enm.currentIndex() == 2 && enm.defaultIndex() == 1;
+    } else {
+        ok = false;
+    }
+
+    if (ok && order.container() == ConType::Array){
+        auto arr = order.array<CapType::IBitOrderCodes>();
+        ok = arr.size() == 2 && arr[0] == BitOrder::MsbFirst && arr[1] == BitOrder::LsbFirst;
+    } else {
+        ok = false;
+    }
+
+    // corrupted snapshots are rejected, and leave the contents intact
+    auto bad = snapshot.save();
+    bad.lock<char>().data()[6] ^= 1;
+    ok = ok && !loaded.load(bad) && loaded.size() == 3;
+
+    return check("CapabilitySnapshot round trip", ok);
+}
+
+static bool checkCapabilityTable(Source& src){
+    // the synthetic source dispatches capabilities through CapabilityTable
+    Capability query(CapType::IPixelType);
+    bool ok = success(src.capability(Msg::QuerySupport, query)) &&
+            static_cast<MsgSupport>(query.currentItem<Int32>()) == msgSupportGetAll;
+
+    auto pixelType = Capability::createOneValue<CapType::IPixelType>(PixelType::Gray);
+    ok = ok && !success(src.capability(Msg::Set, pixelType));
+
+    auto xferCount = Capability::createOneValue<CapType::XferCount>(7);
+    Capability current(CapType::XferCount);
+    ok = ok && success(src.capability(Msg::Set, xferCount)) &&
+            success(src.capability(Msg::GetCurrent, current)) && current.currentItem<Int16>() == 7;
+
+    Capability reset(CapType::XferCount);
+    ok = ok && success(src.capability(Msg::Reset, reset)) && reset.currentItem<Int16>() == -1;
+
+    Capability unknown(CapType::Author);
+    ok = ok && !success(src.capability(Msg::Get, unknown));
+
+    return check("CapabilityTable dispatch", ok);
+}
+
+static bool checkReferences(Source& src){
+    bool ok = checkKernels();
+    ok = checkPackBits() && ok;
+    ok = checkTiff() && ok;
+    ok = checkSnapshot() && ok;
+    ok = checkCapabilityTable(src) && ok;
+    std::printf("\n");
+    return ok;
+}
+
+}
+
+int main(int argc, char** argv){
+#if defined(TWPP_DETAIL_OS_WIN)
+    const char* path = argc > 1 ? argv[1] : "benchsource.ds";
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+    const char* path = argc > 1 ? argv[1] : "./libbenchsource.so";
+#else
+#   error "default source path for your platform here"
+#endif
+
+    if (!loadSource(path)){
+        std::fprintf(stderr, "could not load source %s\n", path);
+        return 1;
+    }
+
+    Manager mgr(Identity(Version(), DataGroup::Image, "TWPP", "Examples", "TWPP benchmark"));
+    if (!mgr.load(mockDsmEntry) || !success(mgr.open())){
+        std::fprintf(stderr, "could not open mock manager\n");
+        return 1;
+    }
+
+    Source src;
+    if (!success(mgr.defaultSource(src)) || !success(src.open())){
+        std::fprintf(stderr, "could not open source\n");
+        return 1;
+    }
+
+    if (!checkReferences(src)){
+        std::fprintf(stderr, "reference checks failed\n");
+        return 1;
+    }
+
+    benchCapabilityCreate();
+    benchLock();
+    benchNegotiation(src);
+    benchTransfer(src);
+    benchExtImageInfo(src);
+
+    src.close();
+    mgr.close();
+    return 0;
+}
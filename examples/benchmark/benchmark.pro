@@ -0,0 +1,16 @@
+# runs against the synthetic source from benchsource.pro
+# pass the path to the built source as the first argument
+
+QT -= core gui
+
+TARGET = benchmark
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+INCLUDEPATH += $$PWD/../../
+
+win32: LIBS += -luser32
+unix: LIBS += -ldl -pthread
+
+SOURCES += benchmark.cpp
@@ -0,0 +1,380 @@
+#include "benchsource.hpp"
+
+using namespace Twpp;
+
+TWPP_ENTRY(BenchSource)
+
+static constexpr const Identity srcIdent(
+        Version(1, 0, Language::English, Country::CzechRepublic, "v1.0"),
+        DataGroup::Image,
+        "TWPP",
+        "Examples",
+        "TWPP benchmark source"
+    );
+
+// uniform resolution for both axes, RGB 24bpp
+static constexpr UInt32 RESOLUTION = 100;
+static constexpr UInt32 MEM_XFER_PREFERRED = 64 * 1024;
+
+// constant-initialized, building Str255 from a literal at run time is costly
+static constexpr const Str255 CAMERA("bench");
+
+const Identity& BenchSource::defaultIdentity() noexcept{
+    return srcIdent;
+}
+
+Result BenchSource::call(const Identity& origin, DataGroup dg, Dat dat, Msg msg, void* data){
+    try {
+        return Base::call(origin, dg, dat, msg, data);
+    } catch (const CapabilityException&){
+        return badValue();
+    }
+}
+
+template<typename T>
+static Result oneValGetSet(Msg msg, Capability& data, T& value, const T& def){
+    switch (msg){
+        case Msg::Reset:
+            value = def;
+            // fallthrough
+        case Msg::Get:
+        case Msg::GetCurrent:
+            data = Capability::createOneValue(data.type(), value);
+            return {};
+
+        case Msg::GetDefault:
+            data = Capability::createOneValue(data.type(), def);
+            return {};
+
+        case Msg::Set:
+            value = data.currentItem<T>();
+            return {};
+
+        default:
+            return {ReturnCode::Failure, ConditionCode::CapBadOperation};
+    }
+}
+
+template<typename T>
+static Result oneValGetConst(Msg msg, Capability& data, const T& value){
+    switch (msg){
+        case Msg::Get:
+        case Msg::GetCurrent:
+        case Msg::GetDefault:
+            data = Capability::createOneValue(data.type(), value);
+            return {};
+
+        default:
+            return {ReturnCode::Failure, ConditionCode::CapBadOperation};
+    }
+}
+
+Result BenchSource::capXferCount(Msg msg, Capability& data){
+    return oneValGetSet<Int16>(msg, data, m_capXferCount, -1);
+}
+
+Result BenchSource::capXferMech(Msg msg, Capability& data){
+    auto rc = oneValGetSet<XferMech>(msg, data, m_capXferMech, XferMech::Native);
+    if (msg == Msg::Set && m_capXferMech != XferMech::Native && m_capXferMech != XferMech::Memory){
+        m_capXferMech = XferMech::Native;
+        return badValue();
+    }
+
+    return rc;
+}
+
+Result BenchSource::capPixelType(Msg msg, Capability& data){
+    return oneValGetConst(msg, data, PixelType::Rgb);
+}
+
+Result BenchSource::capXResolution(Msg msg, Capability& data){
+    return oneValGetConst(msg, data, Fix32(static_cast<float>(RESOLUTION)));
+}
+
+Result BenchSource::capYResolution(Msg msg, Capability& data){
+    return oneValGetConst(msg, data, Fix32(static_cast<float>(RESOLUTION)));
+}
+
+Result BenchSource::capDeviceOnline(Msg msg, Capability& data){
+    return oneValGetConst(msg, data, Bool(true));
+}
+
+Result BenchSource::capCommon(Msg msg, Capability& data){
+    static const auto table = makeCapabilityTable<BenchSource>(
+        capabilityEntry<CapType::XferCount>(msgSupportGetAllSetReset, &BenchSource::capXferCount),
+        capabilityEntry<CapType::IXferMech>(msgSupportGetAllSetReset, &BenchSource::capXferMech),
+        capabilityEntry<CapType::IPixelType>(msgSupportGetAll, &BenchSource::capPixelType),
+        capabilityEntry<CapType::IXResolution>(msgSupportGetAll, &BenchSource::capXResolution),
+        capabilityEntry<CapType::IYResolution>(msgSupportGetAll, &BenchSource::capYResolution),
+        capabilityEntry<CapType::DeviceOnline>(msgSupportGetAll, &BenchSource::capDeviceOnline)
+    );
+
+    if (msg == Msg::ResetAll){
+        return table.resetAll(*this);
+    }
+
+    return table.dispatch(*this, msg, data);
+}
+
+Result BenchSource::capabilityGet(const Identity&, Capability& data){
+    return capCommon(Msg::Get, data);
+}
+
+Result BenchSource::capabilityGetCurrent(const Identity&, Capability& data){
+    return capCommon(Msg::GetCurrent, data);
+}
+
+Result BenchSource::capabilityGetDefault(const Identity&, Capability& data){
+    return capCommon(Msg::GetDefault, data);
+}
+
+Result BenchSource::capabilityQuerySupport(const Identity&, Capability& data){
+    return capCommon(Msg::QuerySupport, data);
+}
+
+Result BenchSource::capabilityReset(const Identity&, Capability& data){
+    return capCommon(Msg::Reset, data);
+}
+
+Result BenchSource::capabilityResetAll(const Identity&){
+    Capability dummy(CapType::SupportedCaps);
+    return capCommon(Msg::ResetAll, dummy);
+}
+
+Result BenchSource::capabilitySet(const Identity&, Capability& data){
+    return capCommon(Msg::Set, data);
+}
+
+Result BenchSource::eventProcess(const Identity&, Event& event){
+    // no GUI, no events to process
+    event.setMessage(Msg::Null);
+    return {ReturnCode::NotDsEvent, ConditionCode::Success};
+}
+
+Result BenchSource::identityOpenDs(const Identity&){
+    // letter size by default
+    m_frame = Frame(0, 0, 8.5f, 11.0f);
+    return success();
+}
+
+Result BenchSource::identityCloseDs(const Identity&){
+    m_page.reset();
+    m_pagePrepared = 0;
+    return success();
+}
+
+Result BenchSource::pendingXfersGet(const Identity&, PendingXfers& data){
+    data.setCount(m_pendingXfers);
+    return success();
+}
+
+Result BenchSource::pendingXfersEnd(const Identity&, PendingXfers& data){
+    if (m_pendingXfers != 0 && m_pendingXfers != 0xFFFF){
+        m_pendingXfers--;
+    }
+
+    m_memXferYOff = 0;
+    m_pageNumber++;
+    data.setCount(m_pendingXfers);
+    return success();
+}
+
+Result BenchSource::pendingXfersReset(const Identity&, PendingXfers& data){
+    m_pendingXfers = 0;
+    data.setCount(0);
+    return success();
+}
+
+Result BenchSource::setupMemXferGet(const Identity&, SetupMemXfer& data){
+    auto bpr = bytesPerRow();
+    data.setMinSize(bpr);
+    data.setPreferredSize(std::max(bpr, MEM_XFER_PREFERRED / bpr * bpr));
+    data.setMaxSize(pageSize());
+    return success();
+}
+
+Result BenchSource::userInterfaceDisable(const Identity&, UserInterface&){
+    return success();
+}
+
+Result BenchSource::userInterfaceEnable(const Identity&, UserInterface&){
+    m_pendingXfers = m_capXferCount < 0 ? 0xFFFF : static_cast<UInt16>(m_capXferCount);
+    m_memXferYOff = 0;
+    m_pageNumber = 0;
+    preparePage();
+
+    // there is never any UI, enabled and ready in a single step
+    setState(DsState::Enabled);
+    auto notified = notifyXferReady();
+    return Twpp::success(notified) ? success() : bummer();
+}
+
+Result BenchSource::userInterfaceEnableUiOnly(const Identity&, UserInterface&){
+    return {ReturnCode::Failure, ConditionCode::OperationError};
+}
+
+Result BenchSource::imageInfoGet(const Identity&, ImageInfo& data){
+    data.setBitsPerPixel(24);
+    data.setHeight(static_cast<Int32>(rows()));
+    data.setPixelType(PixelType::Rgb);
+    data.setPlanar(false);
+    data.setWidth(static_cast<Int32>(columns()));
+    data.setXResolution(Fix32(static_cast<float>(RESOLUTION)));
+    data.setYResolution(Fix32(static_cast<float>(RESOLUTION)));
+
+    data.setSamplesPerPixel(3);
+    data.bitsPerSample()[0] = 8;
+    data.bitsPerSample()[1] = 8;
+    data.bitsPerSample()[2] = 8;
+
+    return success();
+}
+
+Result BenchSource::imageLayoutGet(const Identity&, ImageLayout& data){
+    data.setDocumentNumber(1);
+    data.setFrameNumber(1);
+    data.setPageNumber(m_pageNumber + 1);
+    data.setFrame(m_frame);
+    return success();
+}
+
+Result BenchSource::imageLayoutGetDefault(const Identity&, ImageLayout& data){
+    data.setDocumentNumber(1);
+    data.setFrameNumber(1);
+    data.setPageNumber(1);
+    data.setFrame(Frame(0, 0, 8.5f, 11.0f));
+    return success();
+}
+
+Result BenchSource::imageLayoutSet(const Identity&, ImageLayout& data){
+    auto frame = data.frame();
+    if (frame.right() <= frame.left() || frame.bottom() <= frame.top()){
+        return badValue();
+    }
+
+    m_frame = frame;
+    return success();
+}
+
+Result BenchSource::imageLayoutReset(const Identity& origin, ImageLayout& data){
+    imageLayoutGetDefault(origin, data);
+    m_frame = data.frame();
+    return success();
+}
+
+Result BenchSource::imageMemXferGet(const Identity&, ImageMemXfer& data){
+    if (!m_pendingXfers){
+        return seqError();
+    }
+
+    auto bpr = bytesPerRow();
+    auto memSize = data.memory().size();
+    if (memSize < bpr){
+        return badValue();
+    }
+
+    auto rows = std::min(memSize / bpr, this->rows() - m_memXferYOff);
+    if (rows == 0){
+        return seqError(); // page already transferred
+    }
+
+    data.setBytesPerRow(bpr);
+    data.setColumns(columns());
+    data.setRows(rows);
+    data.setBytesWritten(rows * bpr);
+    data.setXOffset(0);
+    data.setYOffset(m_memXferYOff);
+    data.setCompression(Compression::None);
+
+    auto lock = data.memory().data();
+    std::copy(m_page.get() + m_memXferYOff * bpr, m_page.get() + (m_memXferYOff + rows) * bpr, lock.data());
+
+    m_memXferYOff += rows;
+    if (m_memXferYOff >= this->rows()){
+        return {ReturnCode::XferDone, ConditionCode::Success};
+    }
+
+    return success();
+}
+
+Result BenchSource::imageNativeXferGet(const Identity&, ImageNativeXfer& data){
+    if (!m_pendingXfers){
+        return seqError();
+    }
+
+    // raw RGB data, a real source would produce a DIB or TIFF
+    auto size = pageSize();
+    data = ImageNativeXfer(size);
+    std::copy(m_page.get(), m_page.get() + size, data.data<char>().data());
+
+    return {ReturnCode::XferDone, ConditionCode::Success};
+}
+
+Result BenchSource::extImageInfoGet(const Identity&, ExtImageInfo& data){
+    for (auto& info : data){
+        switch (info.id()){
+            case InfoId::PageNumber:
+                info.allocSimple<InfoId::PageNumber>();
+                *info.items<InfoId::PageNumber>()[0].data() = m_pageNumber + 1;
+                break;
+
+            case InfoId::DocumentNumber:
+                info.allocSimple<InfoId::DocumentNumber>();
+                *info.items<InfoId::DocumentNumber>()[0].data() = 1;
+                break;
+
+            case InfoId::Frame:
+                info.allocSimple<InfoId::Frame>();
+                *info.items<InfoId::Frame>()[0].data() = m_frame;
+                break;
+
+            case InfoId::BarCodeCount:
+                info.allocSimple<InfoId::BarCodeCount>();
+                *info.items<InfoId::BarCodeCount>()[0].data() = 0;
+                break;
+
+            case InfoId::Camera:
+                info.allocSimple<InfoId::Camera>();
+                *info.items<InfoId::Camera>()[0].data() = CAMERA;
+                break;
+
+            default:
+                info.setReturnCode(ReturnCode::InfoNotSupported);
+                continue;
+        }
+
+        info.setReturnCode(ReturnCode::Success);
+    }
+
+    return success();
+}
+
+UInt32 BenchSource::columns() const noexcept{
+    return static_cast<UInt32>(static_cast<float>(m_frame.right() - m_frame.left()) * RESOLUTION);
+}
+
+UInt32 BenchSource::rows() const noexcept{
+    return static_cast<UInt32>(static_cast<float>(m_frame.bottom() - m_frame.top()) * RESOLUTION);
+}
+
+UInt32 BenchSource::bytesPerRow() const noexcept{
+    return (columns() * 24 + 31) / 32 * 4;
+}
+
+UInt32 BenchSource::pageSize() const noexcept{
+    return bytesPerRow() * rows();
+}
+
+void BenchSource::preparePage(){
+    auto size = pageSize();
+    if (size == m_pagePrepared){
+        return;
+    }
+
+    m_page.reset(new char[size]);
+    for (UInt32 i = 0; i < size; i++){
+        m_page[i] = static_cast<char>(i * 31);
+    }
+
+    m_pagePrepared = size;
+}
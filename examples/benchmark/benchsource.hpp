@@ -0,0 +1,74 @@
+#ifndef BENCHSOURCE_HPP
+#define BENCHSOURCE_HPP
+
+#include <memory>
+
+#include <twpp.hpp>
+
+/// Synthetic data source without any hardware or GUI.
+/// Transfers RGB pages of the size set by ImageLayout frame at a fixed resolution.
+class BenchSource : public Twpp::SourceFromThis<BenchSource> {
+
+public:
+    static const Twpp::Identity& defaultIdentity() noexcept;
+
+    // SourceFromThis interface
+protected:
+    typedef Twpp::SourceFromThis<BenchSource> Base;
+
+    virtual Twpp::Result capabilityGet(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result capabilityGetCurrent(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result capabilityGetDefault(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result capabilityQuerySupport(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result capabilityReset(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result capabilityResetAll(const Twpp::Identity& origin) override;
+    virtual Twpp::Result capabilitySet(const Twpp::Identity& origin, Twpp::Capability& data) override;
+    virtual Twpp::Result eventProcess(const Twpp::Identity& origin, Twpp::Event& data) override;
+    virtual Twpp::Result identityOpenDs(const Twpp::Identity& origin) override;
+    virtual Twpp::Result identityCloseDs(const Twpp::Identity& origin) override;
+    virtual Twpp::Result pendingXfersGet(const Twpp::Identity& origin, Twpp::PendingXfers& data) override;
+    virtual Twpp::Result pendingXfersEnd(const Twpp::Identity& origin, Twpp::PendingXfers& data) override;
+    virtual Twpp::Result pendingXfersReset(const Twpp::Identity& origin, Twpp::PendingXfers& data) override;
+    virtual Twpp::Result setupMemXferGet(const Twpp::Identity& origin, Twpp::SetupMemXfer& data) override;
+    virtual Twpp::Result userInterfaceDisable(const Twpp::Identity& origin, Twpp::UserInterface& data) override;
+    virtual Twpp::Result userInterfaceEnable(const Twpp::Identity& origin, Twpp::UserInterface& data) override;
+    virtual Twpp::Result userInterfaceEnableUiOnly(const Twpp::Identity& origin, Twpp::UserInterface& data) override;
+    virtual Twpp::Result imageInfoGet(const Twpp::Identity& origin, Twpp::ImageInfo& data) override;
+    virtual Twpp::Result imageLayoutGet(const Twpp::Identity& origin, Twpp::ImageLayout& data) override;
+    virtual Twpp::Result imageLayoutGetDefault(const Twpp::Identity& origin, Twpp::ImageLayout& data) override;
+    virtual Twpp::Result imageLayoutSet(const Twpp::Identity& origin, Twpp::ImageLayout& data) override;
+    virtual Twpp::Result imageLayoutReset(const Twpp::Identity& origin, Twpp::ImageLayout& data) override;
+    virtual Twpp::Result imageMemXferGet(const Twpp::Identity& origin, Twpp::ImageMemXfer& data) override;
+    virtual Twpp::Result imageNativeXferGet(const Twpp::Identity& origin, Twpp::ImageNativeXfer& data) override;
+    virtual Twpp::Result extImageInfoGet(const Twpp::Identity& origin, Twpp::ExtImageInfo& data) override;
+
+    virtual Twpp::Result call(const Twpp::Identity& origin, Twpp::DataGroup dg, Twpp::Dat dat, Twpp::Msg msg, void* data) override;
+
+private:
+    Twpp::Result capXferCount(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capXferMech(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capPixelType(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capXResolution(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capYResolution(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capDeviceOnline(Twpp::Msg msg, Twpp::Capability& data);
+    Twpp::Result capCommon(Twpp::Msg msg, Twpp::Capability& data);
+
+    Twpp::UInt32 columns() const noexcept;
+    Twpp::UInt32 rows() const noexcept;
+    Twpp::UInt32 bytesPerRow() const noexcept;
+    Twpp::UInt32 pageSize() const noexcept;
+    void preparePage();
+
+    Twpp::Frame m_frame;
+    std::unique_ptr<char[]> m_page;
+    Twpp::UInt32 m_pagePrepared = 0;
+    Twpp::UInt32 m_memXferYOff = 0;
+    Twpp::UInt32 m_pageNumber = 0;
+    Twpp::UInt16 m_pendingXfers = 0;
+
+    Twpp::Int16 m_capXferCount = -1;
+    Twpp::XferMech m_capXferMech = Twpp::XferMech::Native;
+
+};
+
+#endif // BENCHSOURCE_HPP
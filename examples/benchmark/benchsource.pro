@@ -0,0 +1,21 @@
+# synthetic source loaded by the benchmark, not meant to be installed
+# build together with benchmark.pro, using the same compiler
+
+QT -= core gui
+
+TARGET = benchsource
+win32: TARGET_EXT = .ds
+TEMPLATE = lib
+
+CONFIG += c++11
+DEFINES += TWPP_IS_DS
+INCLUDEPATH += $$PWD/../../
+
+win32: DEF_FILE = exports.def
+
+SOURCES += benchsource.cpp
+
+HEADERS += benchsource.hpp
+
+DISTFILES += \
+    exports.def
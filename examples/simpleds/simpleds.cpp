@@ -389,12 +389,8 @@ Result SimpleDs::pendingXfersReset(const Identity&, PendingXfers& data){
 }
 
 Result SimpleDs::setupMemXferGet(const Identity&, SetupMemXfer& data){
-    auto bpl = bytesPerLine();
-    auto max = bpl * static_cast<UInt32>(header()->biHeight);
-
-    data.setMinSize(bpl);
-    data.setPreferredSize(max);
-    data.setMaxSize(max);
+    // whole rows fitting into the cache, the image is already in memory
+    data = stripSetupMemXfer(bytesPerLine(), static_cast<UInt32>(header()->biHeight));
     return success();
 }
 
@@ -418,6 +414,11 @@ Result SimpleDs::userInterfaceEnable(const Identity&, UserInterface& ui){
     m_pendingXfers = 1;
     m_memXferYOff = 0;
 
+    if (m_capXferMech == XferMech::Native){
+        // allocate the page handle ahead, the image is then written directly into it
+        m_nativeRing.reserve(bmpSize(), 1);
+    }
+
     if (!ui.showUi()){
         // this is an exception when we want to set state explicitly, notifyXferReady can be called only in enabled state
         // with hidden UI, the usual workflow DsState::Enabled -> notifyXferReady() -> DsState::XferReady is a single step
@@ -553,18 +554,14 @@ Result SimpleDs::imageMemXferGet(const Identity& origin, ImageMemXfer& data){
 
     // bottom-up BMP -> top-down memory transfer
     auto begin = bmpEnd() - (bpl * (m_memXferYOff + 1));
+    auto columns = static_cast<UInt32>(dib->biWidth);
     for (UInt32 i = 0; i < rows; i++){
-        // copy bytes
-        std::copy(begin, begin + bpl, out);
+        // BGR BMP -> RGB memory transfer, copies the pixels too
+        swapRedBlue(begin, out, columns);
+        std::copy(begin + columns * 3, begin + bpl, out + columns * 3); // row padding
 
-        char* line = out;
         out += bpl;
         begin -= bpl;
-
-        // BGR BMP -> RGB memory transfer
-        for ( ; line + 3 < out; line += 3){
-            std::swap(line[0], line[2]);
-        }
     }
 
     m_memXferYOff += rows;
@@ -583,7 +580,8 @@ Result SimpleDs::imageNativeXferGet(const Identity&, ImageNativeXfer& data){
     }
 
     // it does not get easier than that if we already have BMP
-    data = ImageNativeXfer(bmpSize());
+    // a real device would write the page directly into the handle
+    data = m_nativeRing.take(bmpSize());
 
     std::copy(bmpBegin(), bmpEnd(), data.data<char>().data());
 
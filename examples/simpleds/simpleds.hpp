@@ -63,6 +63,7 @@ private:
     std::unordered_map<Twpp::CapType, std::function<Twpp::Result(Twpp::Msg msg, Twpp::Capability& data)>> m_caps;
     std::unordered_map<Twpp::CapType, Twpp::MsgSupport> m_query;
 
+    Twpp::ImageNativeXferRing m_nativeRing;
     Twpp::UInt32 m_memXferYOff;
     Twpp::UInt16 m_pendingXfers;
 
@@ -43,11 +43,19 @@ SOFTWARE.
 #include <map>
 #include <string>
 #include <list>
+#include <vector>
 #include <cstring>
 #include <array>
 #include <utility>
 #include <cassert>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 
 #include "twpp/utils.hpp"
 
@@ -60,6 +68,8 @@ SOFTWARE.
 
 #include "twpp/memoryops.hpp"
 #include "twpp/memory.hpp"
+#include "twpp/mappedmemory.hpp"
+#include "twpp/workerpool.hpp"
 
 #include "twpp/enums.hpp"
 #include "twpp/status.hpp"
@@ -72,7 +82,9 @@ SOFTWARE.
 
 #include "twpp/audio.hpp"
 #include "twpp/capability.hpp"
+#include "twpp/capprofile.hpp"
 #include "twpp/customdata.hpp"
+#include "twpp/capsnapshot.hpp"
 #include "twpp/cie.hpp"
 #include "twpp/curveresponse.hpp"
 #include "twpp/event.hpp"
@@ -88,11 +100,32 @@ SOFTWARE.
 #include "twpp/setupfilexfer.hpp"
 #include "twpp/setupmemxfer.hpp"
 #include "twpp/userinterface.hpp"
+#include "twpp/imagekernels.hpp"
+#include "twpp/tiff.hpp"
+#include "twpp/memxfersink.hpp"
+#include "twpp/memxfertuner.hpp"
+#include "twpp/tiles.hpp"
+#include "twpp/stripdecoder.hpp"
+#include "twpp/thumbnail.hpp"
+#include "twpp/pageanalyzer.hpp"
+#include "twpp/colortransform.hpp"
+#include "twpp/imageassembler.hpp"
+#include "twpp/trace.hpp"
+#include "twpp/metrics.hpp"
 
 #if !defined(TWPP_IS_DS)
 #   include "twpp/application.hpp"
+#   include "twpp/batchpipeline.hpp"
+#   include "twpp/session.hpp"
+#   include "twpp/fsindex.hpp"
+#   include "twpp/fsenumerator.hpp"
+#   include "twpp/passthroughchannel.hpp"
+#   include "twpp/devicepool.hpp"
 #else
 #   include "twpp/datasource.hpp"
+#   include "twpp/memfileencoder.hpp"
+#   include "twpp/capabilitytable.hpp"
+#   include "twpp/fsindex.hpp"
 #endif
 
 
@@ -31,8 +31,45 @@ SOFTWARE.
 
 namespace Twpp {
 
+/// Usage counters of the capability cache, see `Source::setCapabilityCache`.
+struct CapabilityCacheStats {
+
+    /// Reads served from the cache.
+    UInt32 hits;
+
+    /// Reads sent to the source.
+    UInt32 misses;
+
+    /// Number of times the cache was cleared.
+    UInt32 invalidations;
+
+};
+
 namespace Detail {
 
+// results of Manager::preload, prepared by the background thread
+struct ManagerPreload {
+
+    ManagerPreload(const Identity& appId) noexcept :
+        m_appId(appId){}
+
+    Identity m_appId;
+    Detail::DsmLib m_lib;
+    Detail::DsmEntry m_entry = nullptr;
+    bool m_opened = false;
+    bool m_hasMem = false;
+    Detail::EntryPoint m_mem;
+    bool m_hasDefault = false;
+    Identity m_default;
+
+};
+
+// cached identity of an available source, see Manager::sourceIdentities
+struct SourceIdentity {
+    Identity m_identity;
+    std::size_t m_hash; // IdentityKey::hash of the product
+};
+
 struct ManagerData {
 
     ManagerData(const Identity& appId) noexcept :
@@ -43,6 +80,17 @@ struct ManagerData {
     Detail::DsmLib m_lib;
     Detail::DsmEntry m_entry = nullptr;
 
+    // identities of available sources, see Manager::sourceIdentities
+    std::vector<SourceIdentity> m_identities;
+    bool m_identitiesValid = false;
+
+    // background load, see Manager::preload
+    std::thread m_preloadThread;
+    std::unique_ptr<ManagerPreload> m_preload;
+    bool m_preOpened = false;
+    bool m_hasDefaultId = false;
+    Identity m_defaultId;
+
 #if defined(TWPP_DETAIL_OS_WIN)
     Handle m_rootWindow;
     bool m_ownRootWindow;
@@ -66,19 +114,226 @@ struct SourceData {
     DsState m_state = DsState::Closed;
     Msg m_readyMsg = Msg::Null;
 
+    // capability support cache used by Source::supports and Source::negotiate
+    struct CapSupport {
+        bool m_queried = false;
+        bool m_known = false;
+        MsgSupport m_support = msgSupportEmpty;
+    };
+
+    std::map<CapType, CapSupport> m_capSupport;
+    bool m_capListLoaded = false;
+    bool m_capListValid = false;
+
+    // capability values cache used by Source::call, see Source::setCapabilityCache
+    bool m_capCacheEnabled = false;
+    std::atomic<bool> m_capCacheStale{false};
+    std::map<std::pair<CapType, Msg>, Capability> m_capCache;
+    CapabilityCacheStats m_capCacheStats = CapabilityCacheStats();
+
+    // container handle reused by Source::capability to send InlineCap values
+    Detail::UniqueHandle m_capScratch;
+    UInt32 m_capScratchSize = 0;
+
+    // transfer group cached by Source::call, valid until the source is closed
+    bool m_xferGroupKnown = false;
+    DataGroup m_xferGroup = DataGroup::Image;
+
+    // strip buffers reused by Source::imageMemXferStream, sized by m_memTuner
+    std::unique_ptr<ImageMemXfer[]> m_strips;
+    std::unique_ptr<UInt32[]> m_stripCapacity; // allocated size of each strip buffer
+    UInt32 m_stripCount = 0;
+    MemXferTuner m_memTuner;
+    Detail::WorkerPool m_stripWorker; // runs the consumer of imageMemXferStream
+
 #if defined(TWPP_DETAIL_OS_LINUX)
+    ~SourceData(){
+        if (m_readyFd >= 0){
+            ::close(m_readyFd);
+        }
+    }
+
     std::mutex m_cbMutex;
-    std::condition_variable m_cbCond;
+    int m_readyFd = -1; // eventfd signalled by callbacks
 #elif !defined(TWPP_DETAIL_OS_WIN) && !defined(TWPP_DETAIL_OS_MAC)
 #   error "SourceData for your platform here"
 #endif
 
 };
 
+/// Routes DSM callbacks to open sources by the identity id of the callback origin.
+/// Lookups are lock-free and may run concurrently from several DS threads,
+/// registration is serialized and happens only when a source is opened or closed.
+template<typename Dummy>
+struct CallBackRegistry {
+
+    enum : UInt32 {
+        MaxSources = 32
+    };
+
+    struct Slot {
+        std::atomic<Identity::Id> m_id;
+        std::atomic<SourceData*> m_source;
+    };
+
+    /// Registers an open source.
+    /// \return Whether there was a free slot.
+    static bool add(SourceData* src) noexcept{
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (UInt32 i = 0; i < MaxSources; i++){
+            Slot& slot = g_slots[i];
+            if (slot.m_source.load(std::memory_order_relaxed) == nullptr){
+                slot.m_id.store(src->m_srcId.id(), std::memory_order_relaxed);
+                slot.m_source.store(src, std::memory_order_release);
+                g_last.store(src, std::memory_order_release);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Unregisters a source, does nothing if the source is not registered.
+    static void remove(SourceData* src) noexcept{
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (UInt32 i = 0; i < MaxSources; i++){
+            Slot& slot = g_slots[i];
+            if (slot.m_source.load(std::memory_order_relaxed) == src){
+                slot.m_source.store(nullptr, std::memory_order_release);
+            }
+        }
+
+        if (g_last.load(std::memory_order_relaxed) == src){
+            g_last.store(nullptr, std::memory_order_release);
+        }
+    }
+
+    /// Finds the source a callback belongs to.
+    /// Falls back to the most recently opened source if there is no origin,
+    /// some managers do not pass the source identity to callbacks.
+    /// \return The source, or null if the origin matches no registered source.
+    static SourceData* find(const Identity* origin) noexcept{
+        if (origin == nullptr){
+            return g_last.load(std::memory_order_acquire);
+        }
+
+        auto id = origin->id();
+        for (UInt32 i = 0; i < MaxSources; i++){
+            Slot& slot = g_slots[i];
+            SourceData* src = slot.m_source.load(std::memory_order_acquire);
+            if (src != nullptr && slot.m_id.load(std::memory_order_relaxed) == id &&
+                    slot.m_source.load(std::memory_order_acquire) == src){
+
+                return src;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Whether the source is registered.
+    static bool contains(const SourceData* src) noexcept{
+        for (UInt32 i = 0; i < MaxSources; i++){
+            if (g_slots[i].m_source.load(std::memory_order_acquire) == src){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static Slot g_slots[MaxSources];
+    static std::atomic<SourceData*> g_last;
+    static std::mutex g_mutex;
+
+};
+
+template<typename Dummy>
+typename CallBackRegistry<Dummy>::Slot CallBackRegistry<Dummy>::g_slots[CallBackRegistry<Dummy>::MaxSources];
+
+template<typename Dummy>
+std::atomic<SourceData*> CallBackRegistry<Dummy>::g_last{nullptr};
+
+template<typename Dummy>
+std::mutex CallBackRegistry<Dummy>::g_mutex;
+
+/// Converts wait timeout to milliseconds, -1 meaning infinite.
+template<typename Rep, typename Period>
+static inline Int32 timeoutMillis(const std::chrono::duration<Rep, Period>& timeout) noexcept{
+    auto ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli> >(timeout).count();
+    if (ms <= 0){
+        return 0;
+    }
+
+    if (ms >= static_cast<double>(std::numeric_limits<Int32>::max())){
+        return -1;
+    }
+
+    auto ret = static_cast<Int32>(ms);
+    return static_cast<double>(ret) < ms ? ret + 1 : ret; // round up, do not return early
+}
+
+#if defined(TWPP_DETAIL_OS_LINUX)
+/// Consumes pending notifications of a ready event descriptor.
+static inline void drainReadyHandle(int fd) noexcept{
+    if (fd >= 0){
+        ::eventfd_t value;
+        ::eventfd_read(fd, &value);
+    }
+}
+#endif
+
 }
 
 class Manager;
 
+/// Result of a single capability negotiated by `Source::negotiate`.
+class NegotiationResult {
+
+public:
+    /// Creates a failed result of unknown capability.
+    constexpr NegotiationResult() noexcept :
+        m_cap(), m_setRc(ReturnCode::Failure), m_currentRc(ReturnCode::Failure), m_skipped(false){}
+
+    constexpr NegotiationResult(CapType cap, ReturnCode setRc, ReturnCode currentRc, bool skipped) noexcept :
+        m_cap(cap), m_setRc(setRc), m_currentRc(currentRc), m_skipped(skipped){}
+
+    /// Capability type.
+    constexpr CapType type() const noexcept{
+        return m_cap;
+    }
+
+    /// Result of Msg::Set operation.
+    constexpr ReturnCode returnCode() const noexcept{
+        return m_setRc;
+    }
+
+    /// Result of verifying Msg::GetCurrent operation.
+    /// Failure if the operation was not performed,
+    /// or returned capability of unexpected type.
+    constexpr ReturnCode currentReturnCode() const noexcept{
+        return m_currentRc;
+    }
+
+    /// Whether the capability was not sent to the source at all,
+    /// because it is known to be unsupported.
+    constexpr bool skipped() const noexcept{
+        return m_skipped;
+    }
+
+    /// Whether the capability was set successfully.
+    constexpr operator bool() const noexcept{
+        return success(m_setRc);
+    }
+
+private:
+    CapType m_cap;
+    ReturnCode m_setRc;
+    ReturnCode m_currentRc;
+    bool m_skipped;
+
+};
+
 /// A single TWAIN source.
 /// Source must belong to a manager in order to perform operations on it.
 /// Any valid source instance must be destroyed or at least cleaned by `cleanup`
@@ -95,6 +350,10 @@ class Source {
 public:
     typedef std::function<void()> EventCallBack;
 
+    /// Receives a single strip of memory transfer, see `imageMemXferStream`.
+    /// Returning false stops the transfer.
+    typedef std::function<bool(const ImageMemXfer&)> StripCallBack;
+
     /// Creates an invalid source.
     /// Calling any method on such source results in
     /// undefined behaviour, and possibly segfault.
@@ -142,8 +401,8 @@ public:
                 // fallthrough
             case DsState::Open:
                 close();
-                // reset the ref even if close() fails somehow
-                Static<void>::g_openSource = nullptr;
+                // unregister even if close() fails somehow
+                Detail::CallBackRegistry<void>::remove(d());
                 // fallthrough
             case DsState::Closed:
                 break;
@@ -190,14 +449,30 @@ public:
     // Control ->
 
     /// Opens the source.
-    /// Only up to 1 source may be opened at the same time.
+    /// Several sources may be opened at the same time, their callbacks
+    /// are routed by identity, see `Detail::CallBackRegistry::MaxSources`.
     /// \throw std::bad_alloc
     ReturnCode open(){
-        assert(Static<void>::g_openSource == nullptr);
+        assert(!Detail::CallBackRegistry<void>::contains(d()));
+
+#if defined(TWPP_DETAIL_OS_LINUX)
+        if (d()->m_readyFd < 0){
+            d()->m_readyFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (d()->m_readyFd < 0){
+                return ReturnCode::Failure;
+            }
+        }
+#endif
 
         auto rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::OpenDs, d()->m_srcId);
         if (success(rc)){
-            d()->m_state = DsState::Open;
+            setState(DsState::Open);
+
+            // register before the callback, the source may call it right away
+            if (!Detail::CallBackRegistry<void>::add(d())){
+                close();
+                return ReturnCode::Failure;
+            }
 
             // TWAIN manual is rather confusing on this topic.
             // Their example sends the registration to DSM, operation tripet documentation mentions DS as destination.
@@ -225,7 +500,6 @@ public:
 #else
 #   error "source open setup for your platform here"
 #endif
-            Static<void>::g_openSource = d();
         }
 
         return rc;
@@ -235,8 +509,15 @@ public:
     ReturnCode close(){
         ReturnCode rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::CloseDs, d()->m_srcId);
         if (success(rc)){
-            Static<void>::g_openSource = nullptr;
-            d()->m_state = DsState::Closed;
+            Detail::CallBackRegistry<void>::remove(d());
+            setState(DsState::Closed);
+            d()->m_capSupport.clear();
+            d()->m_capListLoaded = false;
+            d()->m_capListValid = false;
+            d()->m_xferGroupKnown = false;
+            d()->m_capScratch = Detail::UniqueHandle();
+            d()->m_capScratchSize = 0;
+            invalidateCapabilityCache();
         }
 
         return rc;
@@ -255,15 +536,16 @@ public:
         auto oldReadyMsg = d()->m_readyMsg;
 
         d()->m_uiHandle = ui.parent();
-        d()->m_state = DsState::Enabled;
+        setState(DsState::Enabled);
         d()->m_readyMsg = Msg::Null;
+        invalidateCapabilityCache();
 
         auto uiTmp = ui; // allow ui to be const, dsm doesnt take const
         ReturnCode rc = dsm(DataGroup::Control, Dat::UserInterface, uiOnly ? Msg::EnableDsUiOnly : Msg::EnableDs, uiTmp);       
         if (!success(rc) && (ui.showUi() || rc != ReturnCode::CheckStatus)){
             // revert the speculative state move on error
             d()->m_uiHandle = oldUiHandle;
-            d()->m_state = oldState;
+            setState(oldState);
             d()->m_readyMsg = oldReadyMsg;
         }
 
@@ -277,7 +559,8 @@ public:
         UserInterface ui(false, false, d()->m_uiHandle);
         auto rc = dsm(DataGroup::Control, Dat::UserInterface, Msg::DisableDs, ui);
         if (success(rc)){
-            d()->m_state = DsState::Open;
+            setState(DsState::Open);
+            invalidateCapabilityCache();
         }
 
         return rc;
@@ -291,78 +574,39 @@ public:
     /// Call this again after processing device event.
     /// \return {Failure on error, Cancel on CANCEL button, Success on SAVE or SCAN button,
     ///          CheckStatus on device event.}
+    /// \throw std::bad_alloc
     ReturnCode waitReady(){
-        assert(isValid());
-
-        if (d()->m_state != DsState::Enabled){
-            return ReturnCode::Failure;
-        }
-
-#if defined(TWPP_DETAIL_OS_WIN)
-        ::MSG msg;
-        ::memset(&msg, 0, sizeof(msg));
-
-        Event event(&msg, Msg::Null);
-        while (d()->m_readyMsg == Msg::Null){
-            auto val = ::GetMessage(&msg, nullptr, 0, 0);
-            if (val == 0 || val == -1){ // 0 ... WM_QUIT; -1 ... error; otherwise ... success
-                return ReturnCode::Failure;
-            }
-
-            auto rc = dsm(DataGroup::Control, Dat::Event, Msg::ProcessEvent, event);
-            switch (rc){
-                case ReturnCode::NotDsEvent:
-                    ::TranslateMessage(&msg);
-                    ::DispatchMessage(&msg);
-                    // fallthrough
-                case ReturnCode::DsEvent:
-                    if (d()->m_readyMsg == Msg::Null){
-                        d()->m_readyMsg = event.message();
-                    }
-
-                    break;
-
-                default:
-                    return rc;
-            }
-        }
-#elif defined(TWPP_DETAIL_OS_MAC)
-        Detail::NSAutoreleasePool pool;
-
-        while(d()->m_readyMsg == Msg::Null) {
-            Detail::NSLoop::processEvent();
-        }
-
-        pool.release();
-
-#elif defined(TWPP_DETAIL_OS_LINUX)
-        std::unique_lock<std::mutex> lock(d()->m_cbMutex);
-        while (d()->m_readyMsg == Msg::Null){
-            d()->m_cbCond.wait(lock);
-        }
-#else
-#   error "waitReady for your platform here"
-#endif
-        // reset m_readyMsg so that subsequent waitReady calls work correctly
-        auto readyMsg = d()->m_readyMsg;
-        d()->m_readyMsg = Msg::Null;
-
-        switch (readyMsg){
-            case Msg::XferReady: // ok/scan button <=> Msg::EnableDs
-                d()->m_state = DsState::XferReady;
-            case Msg::CloseDsOk: // ok/scan button <=> Msg::EnableDsUiOnly
-                return ReturnCode::Success;
+        std::size_t ready;
+        Source* self = this;
+        return waitAnyFor(&self, 1, ready, -1);
+    }
 
-            case Msg::CloseDsReq: // cancel button
-                return ReturnCode::Cancel;
+    /// Waits on source GUI, blocking at most `timeout`.
+    /// Behaves as `waitReady()`, but gives up once the timeout elapses.
+    /// Large timeouts (more than 2^31 ms) are treated as infinite.
+    /// \param timeout Maximal time to wait.
+    /// \return {Failure on error, Cancel on CANCEL button, Success on SAVE or SCAN button,
+    ///          CheckStatus on device event, NotDsEvent when not ready yet (timeout).}
+    /// \throw std::bad_alloc
+    template<typename Rep, typename Period>
+    ReturnCode waitReady(const std::chrono::duration<Rep, Period>& timeout){
+        std::size_t ready;
+        Source* self = this;
+        return waitAnyFor(&self, 1, ready, Detail::timeoutMillis(timeout));
+    }
 
-            case Msg::DeviceEvent:
-                return ReturnCode::CheckStatus;
+#if defined(TWPP_DETAIL_OS_LINUX)
+    /// Linux only.
+    /// Event file descriptor that becomes readable whenever the source has got
+    /// a message for `waitReady` or `processEvent`, meant for epoll/poll reactors.
+    /// Valid while the source is open, -1 otherwise.
+    /// Call `processEvent` once readable, it also consumes the notification.
+    int readyHandle() const noexcept{
+        assert(isValid());
 
-            default:
-                return ReturnCode::Failure;
-        }
+        return d()->m_readyFd;
     }
+#endif
 
     /// Processes a single GUI event without blocking.
     /// Can be used instead of `waitReady()` to process a single event.
@@ -399,6 +643,7 @@ public:
         d()->m_readyMsg = Msg::Null;
 #   else
         std::unique_lock<std::mutex> lock(d()->m_cbMutex);
+        Detail::drainReadyHandle(d()->m_readyFd);
         auto msg = d()->m_readyMsg;
         d()->m_readyMsg = Msg::Null;
         lock.unlock();
@@ -409,7 +654,7 @@ public:
 #endif
         switch (msg){
             case Msg::XferReady: // ok/scan button <=> Msg::EnableDs
-                d()->m_state = DsState::XferReady;
+                setState(DsState::XferReady);
                 // fallthrough
             case Msg::CloseDsOk: // ok/scan button <=> Msg::EnableDsUiOnly
                 return ReturnCode::Success;
@@ -465,6 +710,310 @@ public:
         return call(DataGroup::Control, msg, inOut);
     }
 
+    /// Sends the inline capability, and copies the result back to inline storage.
+    /// Set and SetConstraint write the contents into a container handle kept by this source,
+    /// which is reused by later calls and grown only for larger containers.
+    /// Other messages send no container, as required by TWAIN.
+    /// \throw std::bad_alloc When the container handle must be grown.
+    /// \throw CapTypeException When the returned capability type does not match.
+    /// \throw CapItemTypeException When the returned item type does not match.
+    /// \throw ContainerException When the returned container does not fit into inline storage.
+    template<CapType cap, UInt32 capacity>
+    ReturnCode capability(Msg msg, InlineCap<cap, capacity>& inOut){
+        assert(isValid());
+
+        auto src = d();
+        Capability twCap(cap);
+        Handle scratch;
+        UInt32 scratchSize = 0;
+        if ((msg == Msg::Set || msg == Msg::SetConstraint) && inOut){
+            scratchSize = inOut.containerSize();
+            if (src->m_capScratchSize < scratchSize){
+                src->m_capScratchSize = 0;
+                src->m_capScratch = Detail::UniqueHandle(Detail::alloc(scratchSize));
+                src->m_capScratchSize = scratchSize;
+            }
+
+            scratchSize = src->m_capScratchSize;
+            inOut.writeContainer(src->m_capScratch.lock<char>().data());
+
+            // lent to the capability until the call returns, lost if reading the result throws
+            scratch = src->m_capScratch.get();
+            src->m_capScratchSize = 0;
+            twCap.m_conType = inOut.container();
+            twCap.m_cont = std::move(src->m_capScratch);
+        }
+
+        auto rc = call(DataGroup::Control, msg, twCap);
+        if (success(rc)){
+            inOut.load(twCap);
+        }
+
+        if (scratch){
+            if (twCap.m_cont.get() == scratch){
+                src->m_capScratch = std::move(twCap.m_cont);
+                src->m_capScratchSize = scratchSize;
+            }
+
+            // otherwise the source replaced the container, and released the original one
+        }
+
+        return rc;
+    }
+
+    /// Whether the source supports the action on the capability.
+    /// Uses SupportedCaps and QuerySupport results cached until the source is closed.
+    /// Capabilities whose support can not be determined are assumed to support everything.
+    /// \param cap Capability type.
+    /// \param action Action to check.
+    bool supports(CapType cap, MsgSupport action = MsgSupport::Set){
+        assert(isValid());
+
+        auto data = d();
+        if (!data->m_capListLoaded){
+            data->m_capListLoaded = true;
+
+            Capability list(CapType::SupportedCaps);
+            if (success(capability(Msg::Get, list))){
+                try {
+                    for (auto item : list.data<CapType::SupportedCaps>()){
+                        data->m_capSupport[item];
+                    }
+
+                    data->m_capListValid = true;
+                } catch (const CapabilityException&){
+                    data->m_capSupport.clear();
+                }
+            }
+        }
+
+        auto it = data->m_capSupport.find(cap);
+        if (it == data->m_capSupport.end()){
+            if (data->m_capListValid){
+                return false;
+            }
+
+            it = data->m_capSupport.emplace(cap, Detail::SourceData::CapSupport()).first;
+        }
+
+        auto& sup = it->second;
+        if (!sup.m_queried){
+            sup.m_queried = true;
+
+            Capability query(cap);
+            if (success(capability(Msg::QuerySupport, query))){
+                try {
+                    sup.m_support = static_cast<MsgSupport>(query.currentItem<Int32>());
+                    sup.m_known = true;
+                } catch (const CapabilityException&){
+                    // malformed answer, assume everything is supported
+                }
+            }
+        }
+
+        return !sup.m_known || (sup.m_support & action) != msgSupportEmpty;
+    }
+
+    /// Enables or disables caching of capability values.
+    /// Once enabled, results of Msg::Get, Msg::GetCurrent and Msg::GetDefault are kept
+    /// for each capability type, and repeated reads return their copies without calling the source.
+    /// Use `cachedCapability` to read the cached containers without copying them.
+    /// The cache is cleared by any other capability operation (Set, Reset, ResetAll, ...),
+    /// by enabling, disabling and closing the source, and by device events.
+    /// Capabilities holding handles are never cached.
+    void setCapabilityCache(bool enabled) noexcept{
+        assert(isValid());
+
+        d()->m_capCacheEnabled = enabled;
+        invalidateCapabilityCache();
+    }
+
+    /// Whether capability values are cached.
+    bool capabilityCache() const noexcept{
+        assert(isValid());
+
+        return d()->m_capCacheEnabled;
+    }
+
+    /// Clears cached capability values.
+    void invalidateCapabilityCache() noexcept{
+        assert(isValid());
+
+        auto data = d();
+        data->m_capCacheStale = false;
+        if (!data->m_capCache.empty()){
+            data->m_capCache.clear();
+            data->m_capCacheStats.invalidations++;
+        }
+    }
+
+    /// Cached value of a capability, queried from the source on a miss.
+    /// Unlike `capability`, which hands out a copy of the cached container,
+    /// this returns the cached container itself, so a hit costs a single lookup.
+    /// The pointer stays valid until the cache is cleared, see `setCapabilityCache`.
+    /// \param type Capability type.
+    /// \param msg Msg::Get, Msg::GetCurrent or Msg::GetDefault.
+    /// \return Cached capability, or nullptr when the cache is disabled,
+    ///         the source failed, or the capability holds handles.
+    /// \throw std::bad_alloc
+    const Capability* cachedCapability(CapType type, Msg msg = Msg::GetCurrent){
+        assert(isValid());
+        assert(msg == Msg::Get || msg == Msg::GetCurrent || msg == Msg::GetDefault);
+
+        auto src = d();
+        if (!src->m_capCacheEnabled){
+            return nullptr;
+        }
+
+        if (src->m_capCacheStale.exchange(false)){
+            invalidateCapabilityCache();
+        }
+
+        auto key = std::make_pair(type, msg);
+        auto it = src->m_capCache.find(key);
+        if (it != src->m_capCache.end()){
+            src->m_capCacheStats.hits++;
+            return &it->second;
+        }
+
+        src->m_capCacheStats.misses++;
+        Capability cap(type);
+        if (!success(dsm(DataGroup::Control, Dat::Capability, msg, cap)) || !cap){
+            return nullptr;
+        }
+
+        try {
+            if (cap.itemType() == Type::Handle){
+                return nullptr;
+            }
+        } catch (const Exception&){
+            return nullptr; // malformed container
+        }
+
+        return &src->m_capCache.emplace(key, std::move(cap)).first->second;
+    }
+
+    /// Usage counters of the capability cache.
+    CapabilityCacheStats capabilityCacheStats() const noexcept{
+        assert(isValid());
+
+        return d()->m_capCacheStats;
+    }
+
+    /// Resets usage counters of the capability cache.
+    void resetCapabilityCacheStats() noexcept{
+        assert(isValid());
+
+        d()->m_capCacheStats = CapabilityCacheStats();
+    }
+
+    /// Strip size tuner of memory transfers, kept for the whole session.
+    /// Used by `imageMemXferStream` and BatchPipeline, pin its size to disable tuning.
+    MemXferTuner& memXferTuner() noexcept{
+        assert(isValid());
+
+        return d()->m_memTuner;
+    }
+
+    /// Sets multiple capabilities at once.
+    /// Capabilities are set in dependency-aware order (units and transfer mechanism first,
+    /// then pixel type and compression, then bit depth and resolution, then the rest),
+    /// capabilities known to be unsupported are skipped, see `supports`.
+    /// Once set, each capability is replaced by its current value if `verify` is true,
+    /// and the container of the request is freed. If the current value cannot be read,
+    /// the request is kept intact and the failure is reported by `NegotiationResult::currentReturnCode`.
+    /// \tparam Caps Capability or Cap<cap> types.
+    /// \param verify Whether to read current values back using Msg::GetCurrent.
+    /// \param caps Capabilities to set.
+    /// \return Per-capability results, in the order of the arguments.
+    /// \throw std::bad_alloc
+    template<typename... Caps>
+    std::array<NegotiationResult, sizeof...(Caps)> negotiate(bool verify, Caps&... caps){
+        static_assert(sizeof...(Caps) != 0, "No capabilities to negotiate.");
+
+        std::array<NegotiationResult, sizeof...(Caps)> results;
+        Capability* ptrs[] = {capPtr(caps)...};
+        Type types[] = {capItemType(caps)...};
+        negotiateImpl(ptrs, types, results.data(), sizeof...(Caps), verify);
+        return results;
+    }
+
+    /// Sets multiple capabilities at once, see the variadic version.
+    /// \param caps Capabilities to set.
+    /// \param results Per-capability results, at least `count` elements.
+    /// \param count Number of capabilities.
+    /// \param verify Whether to read current values back using Msg::GetCurrent.
+    /// \throw std::bad_alloc
+    void negotiate(Capability* caps, NegotiationResult* results, std::size_t count, bool verify = true){
+        std::unique_ptr<Capability*[]> ptrs(new Capability*[count]);
+        std::unique_ptr<Type[]> types(new Type[count]);
+        for (std::size_t i = 0; i < count; i++){
+            ptrs[i] = &caps[i];
+            types[i] = Type::DontCare;
+        }
+
+        negotiateImpl(ptrs.get(), types.get(), results, count, verify);
+    }
+
+    /// Applies a capability profile in one batched pass, see `negotiate`.
+    /// The prepared containers are left intact and are reused by the next call.
+    /// If `verify` is true, current values are read back into `profile.current(i)`,
+    /// and compared to the profile values, see `PreparedProfile::matches`.
+    /// \tparam Values ProfileValue types.
+    /// \param profile Prepared capability profile.
+    /// \param verify Whether to read current values back using Msg::GetCurrent.
+    /// \return Per-capability results, in declaration order.
+    /// \throw std::bad_alloc
+    template<typename... Values>
+    std::array<NegotiationResult, sizeof...(Values)> applyProfile(PreparedProfile<Values...>& profile, bool verify = true){
+        std::array<NegotiationResult, sizeof...(Values)> results;
+        auto requests = profile.requests();
+        Capability* ptrs[sizeof...(Values)];
+        for (std::size_t i = 0; i < sizeof...(Values); i++){
+            ptrs[i] = &requests[i];
+        }
+
+        auto types = PreparedProfile<Values...>::itemTypes();
+        profile.clearMatches();
+        negotiateImpl(ptrs, types.data(), results.data(), sizeof...(Values), verify, &profile.current(0), profile.order());
+        if (verify){
+            profile.verify();
+        }
+
+        return results;
+    }
+
+    /// Applies a single step of a capability profile, see `applyProfile`.
+    /// Spreads a profile over several calls, one capability per call,
+    /// e.g. to interleave it with other work on the TWAIN thread.
+    /// Steps follow the dependency-aware order of `negotiate`, not the declaration order.
+    /// If `verify` is true, `PreparedProfile::matches` is valid once the last step has been applied.
+    /// \tparam Values ProfileValue types.
+    /// \param profile Prepared capability profile.
+    /// \param step Step to apply, less than the number of capabilities in the profile.
+    /// \param verify Whether to read the current value back using Msg::GetCurrent.
+    /// \return Result of the capability applied in this step.
+    template<typename... Values>
+    NegotiationResult applyProfileStep(PreparedProfile<Values...>& profile, std::size_t step, bool verify = true){
+        assert(step < sizeof...(Values));
+        auto idx = profile.order()[step];
+        Capability* ptr = &profile.requests()[idx];
+        auto types = PreparedProfile<Values...>::itemTypes();
+        if (step == 0){
+            profile.clearMatches();
+        }
+
+        // a single capability, already in order
+        static const std::size_t single = 0;
+        NegotiationResult result;
+        negotiateImpl(&ptr, &types[idx], &result, 1, verify, &profile.current(idx), &single);
+        if (verify && step + 1 == sizeof...(Values)){
+            profile.verify();
+        }
+
+        return result;
+    }
+
     ReturnCode customData(Msg msg, CustomData& inOut){
         return call(DataGroup::Control, msg, inOut);
     }
@@ -497,6 +1046,23 @@ public:
         return call(DataGroup::Control, msg, inOut);
     }
 
+    /// Transfer group of the current session.
+    /// Queried from the source only once, results of `xferGroup` are cached until the source is closed.
+    /// Defaults to DataGroup::Image if the source does not report it,
+    /// the default is cached as well and the query is not repeated.
+    DataGroup cachedXferGroup(){
+        auto data = d();
+        if (!data->m_xferGroupKnown){
+            DataGroup xg = DataGroup::Image;
+            if (!success(xferGroup(Msg::Get, xg))){
+                data->m_xferGroupKnown = true;
+                data->m_xferGroup = DataGroup::Image;
+            }
+        }
+
+        return data->m_xferGroup;
+    }
+
     ReturnCode status(Status& out){
         return call(DataGroup::Control, Msg::Get, out);
     }
@@ -538,16 +1104,169 @@ public:
         return call(DataGroup::Image, msg, inOut);
     }
 
-    ReturnCode imageMemFileXfer(ImageMemFileXfer& inOut){
-        return call(DataGroup::Image, Msg::Get, inOut);
-    }
+    ReturnCode imageMemFileXfer(ImageMemFileXfer& inOut){
+        return call(DataGroup::Image, Msg::Get, inOut);
+    }
+
+    ReturnCode imageMemXfer(ImageMemXfer& inOut){
+        return call(DataGroup::Image, Msg::Get, inOut);
+    }
+
+    ReturnCode imageNativeXfer(ImageNativeXfer& out){
+        return call(DataGroup::Image, Msg::Get, out);
+    }
+
+    /// Transfers the whole image in memory mode, handing each strip to the consumer.
+    /// Strip sizes are chosen by `memXferTuner()`, starting with `SetupMemXfer::preferredSize()`.
+    /// Each buffer is allocated once for the largest size of the tuner, and reused by subsequent calls,
+    /// only the current strip size is reported to the source.
+    /// The consumer runs in a worker thread owned by this source, while the next strip is being
+    /// transferred into another buffer; it must not call any methods of this source.
+    /// `pendingXfers(Msg::EndXfer, ...)` or `pendingXfers(Msg::Reset, ...)` must follow
+    /// as if the strips were transferred by `imageMemXfer`.
+    /// \param consumer Function (object) receiving transferred strips in order.
+    /// \param buffers Number of strip buffers, at least 2.
+    /// \return {XferDone once the whole image was transferred and accepted,
+    ///          Cancel when the consumer returned false, even for the last strip,
+    ///          otherwise the result of the failed call.}
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the consumer, the transfer is stopped.
+    ReturnCode imageMemXferStream(const StripCallBack& consumer, UInt32 buffers = 2){
+        assert(isValid());
+
+        SetupMemXfer setup;
+        auto rc = setupMemXfer(setup);
+        if (!success(rc)){
+            return rc;
+        }
+
+        auto data = d();
+        MemXferTuner& tuner = data->m_memTuner;
+        if (!tuner.setup(setup)){
+            return ReturnCode::Failure;
+        }
+
+        if (buffers < 2){
+            buffers = 2;
+        }
+
+        if (!data->m_strips || data->m_stripCount != buffers){
+            data->m_strips.reset(new ImageMemXfer[buffers]);
+            data->m_stripCapacity.reset(new UInt32[buffers]());
+            data->m_stripCount = buffers;
+        }
+
+        if (data->m_stripWorker.size() == 0){
+            data->m_stripWorker.start(1);
+        }
+
+        ImageMemXfer* strips = data->m_strips.get();
+        UInt32* capacity = data->m_stripCapacity.get();
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        UInt32 produced = 0;
+        UInt32 consumed = 0;
+        bool stop = false;
+        std::exception_ptr error;
+
+        // strips are consumed in order by the single worker thread
+        auto consume = [&](UInt32 index){
+            bool skip;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                skip = stop;
+            }
+
+            bool ok = false;
+            std::exception_ptr ex;
+            if (!skip){
+                try {
+                    ok = consumer(strips[index % buffers]);
+                } catch (...){
+                    ex = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            consumed++;
+            if (ex && !error){
+                error = ex;
+            }
+
+            if (!ok){
+                stop = true;
+            }
+
+            cond.notify_all();
+        };
+
+        // the consumer refers to the strips and to this frame, it must be finished before leaving
+        auto drain = [&](){
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&](){ return consumed == produced; });
+        };
+
+        rc = ReturnCode::Success;
+        try {
+            for (;;){
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&](){ return produced - consumed < buffers || stop; });
+                    if (stop){
+                        rc = ReturnCode::Cancel;
+                        break;
+                    }
+                }
+
+                // buffer is not touched by the consumer until its task is posted
+                auto index = produced;
+                ImageMemXfer& strip = strips[index % buffers];
+                auto size = tuner.size();
+                auto& cap = capacity[index % buffers];
+                if (cap < size){
+                    auto alloc = std::max(size, tuner.capacity());
+                    strip.memory() = Memory(alloc);
+                    cap = alloc;
+                }
+
+                Detail::setMemorySize(strip.memory(), size);
+
+                auto start = MemXferTuner::Clock::now();
+                rc = imageMemXfer(strip);
+                if (rc != ReturnCode::Success && rc != ReturnCode::XferDone){
+                    break;
+                }
+
+                tuner.record(strip.bytesWritten(), MemXferTuner::Clock::now() - start);
+
+                {
+                    // the task waits for the lock, `produced` is incremented first
+                    std::lock_guard<std::mutex> lock(mutex);
+                    data->m_stripWorker.post([&consume, index](){ consume(index); });
+                    produced++;
+                }
+
+                if (rc == ReturnCode::XferDone){
+                    break;
+                }
+            }
+        } catch (...){
+            drain();
+            throw;
+        }
+
+        drain();
+        if (error){
+            std::rethrow_exception(error);
+        }
 
-    ReturnCode imageMemXfer(ImageMemXfer& inOut){
-        return call(DataGroup::Image, Msg::Get, inOut);
-    }
+        if (rc == ReturnCode::XferDone && stop){
+            // consumer stopped, possibly upon receiving the last strip
+            rc = ReturnCode::Cancel;
+        }
 
-    ReturnCode imageNativeXfer(ImageNativeXfer& out){
-        return call(DataGroup::Image, Msg::Get, out);
+        return rc;
     }
 
     ReturnCode jpegCompression(Msg msg, JpegCompression& inOut){
@@ -582,8 +1301,50 @@ public:
     // Raw ->
 
     // dg:: control follows
+    /// \throw std::bad_alloc When capability cache is enabled.
     ReturnCode call(DataGroup dg, Msg msg, Capability& data){
-        return dsm(dg, Dat::Capability, msg, data);
+        auto src = d();
+        if (!src->m_capCacheEnabled){
+            return dsm(dg, Dat::Capability, msg, data);
+        }
+
+        if (src->m_capCacheStale.exchange(false)){
+            invalidateCapabilityCache();
+        }
+
+        switch (msg){
+            case Msg::Get:
+            case Msg::GetCurrent:
+            case Msg::GetDefault: {
+                auto key = std::make_pair(data.type(), msg);
+                auto it = src->m_capCache.find(key);
+                if (it != src->m_capCache.end()){
+                    data = it->second.clone();
+                    src->m_capCacheStats.hits++;
+                    return ReturnCode::Success;
+                }
+
+                src->m_capCacheStats.misses++;
+                auto rc = dsm(dg, Dat::Capability, msg, data);
+                if (success(rc) && data){
+                    try {
+                        src->m_capCache.emplace(key, data.clone());
+                    } catch (const Exception&){
+                        // handle items or malformed container, do not cache
+                    }
+                }
+
+                return rc;
+            }
+
+            case Msg::QuerySupport:
+                return dsm(dg, Dat::Capability, msg, data);
+
+            default:
+                // setting a single capability may change others
+                invalidateCapabilityCache();
+                return dsm(dg, Dat::Capability, msg, data);
+        }
     }
 
     /// \throw CapTypeException When input capability type does not match the
@@ -602,7 +1363,12 @@ public:
     }
 
     ReturnCode call(DataGroup dg, Msg msg, DeviceEvent& data){
-        return dsm(dg, Dat::DeviceEvent, msg, data);
+        auto rc = dsm(dg, Dat::DeviceEvent, msg, data);
+        if (success(rc)){
+            invalidateCapabilityCache();
+        }
+
+        return rc;
     }
 
     ReturnCode call(DataGroup dg, Msg msg, FileSystem& data){
@@ -617,22 +1383,19 @@ public:
         auto rc = dsm(dg, Dat::PendingXfers, msg, data);
         if (success(rc)){
             // FIXME: unsure about audio state transitions
-            DataGroup xg = DataGroup::Image;
             switch (msg){
                 case Msg::EndXfer:
-                    xferGroup(Msg::Get, xg);
-                    if (xg == DataGroup::Image && data.count() == 0){
-                        d()->m_state = DsState::Enabled;
+                    if (cachedXferGroup() == DataGroup::Image && data.count() == 0){
+                        setState(DsState::Enabled);
                     } else {
-                        d()->m_state = DsState::XferReady;
+                        setState(DsState::XferReady);
                     }
 
                     break;
 
                 case Msg::Reset:
-                    xferGroup(Msg::Get, xg);
-                    if (xg == DataGroup::Image){
-                        d()->m_state = DsState::Enabled;
+                    if (cachedXferGroup() == DataGroup::Image){
+                        setState(DsState::Enabled);
                     }
 
                     break;
@@ -656,7 +1419,13 @@ public:
     }
 
     ReturnCode call(DataGroup dg, Msg msg, DataGroup& data){
-        return dsm(dg, Dat::XferGroup, msg, data);
+        auto rc = dsm(dg, Dat::XferGroup, msg, data);
+        if (success(rc) && (msg == Msg::Get || msg == Msg::Set)){
+            d()->m_xferGroupKnown = true;
+            d()->m_xferGroup = data;
+        }
+
+        return rc;
     }
 
     ReturnCode call(DataGroup dg, Msg msg, Status& data){
@@ -696,7 +1465,7 @@ public:
     ReturnCode call(DataGroup dg, Msg msg, const ImageFileXfer&){
         ReturnCode rc = dsmPtr(dg, Dat::ImageFileXfer, msg, nullptr);
         if (success(rc)){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         return rc;
@@ -713,7 +1482,7 @@ public:
     ReturnCode call(DataGroup dg, Msg msg, ImageMemFileXfer& data){
         ReturnCode rc = dsm(dg, Dat::ImageMemFileXfer, msg, data);
         if (success(rc) || rc == ReturnCode::XferDone){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         return rc;
@@ -722,7 +1491,7 @@ public:
     ReturnCode call(DataGroup dg, Msg msg, ImageMemXfer& data){
         ReturnCode rc = dsm(dg, Dat::ImageMemXfer, msg, data);
         if (success(rc) || rc == ReturnCode::XferDone){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         return rc;
@@ -732,7 +1501,7 @@ public:
         Handle h;
         ReturnCode rc = dsm(dg, Dat::ImageNativeXfer, msg, h);
         if (rc == ReturnCode::XferDone){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         if (h){
@@ -759,7 +1528,7 @@ public:
         // FIXME: unsure about state transitions
         ReturnCode rc = dsmPtr(dg, Dat::AudioFileXfer, msg, nullptr);
         if (rc == ReturnCode::XferDone){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         return rc;
@@ -773,7 +1542,7 @@ public:
         Handle h;
         ReturnCode rc = dsm(dg, Dat::AudioNativeXfer, msg, h);
         if (success(rc)){
-            d()->m_state = DsState::Xferring;
+            setState(DsState::Xferring);
         }
 
         if (h){
@@ -785,6 +1554,72 @@ public:
     // <- Raw
 
 private:
+    static Capability* capPtr(Capability& cap) noexcept{
+        return &cap;
+    }
+
+    template<CapType cap>
+    static Capability* capPtr(Cap<cap>& c) noexcept{
+        return &c.m_cap;
+    }
+
+    static constexpr Type capItemType(const Capability&) noexcept{
+        return Type::DontCare;
+    }
+
+    template<CapType cap>
+    static constexpr Type capItemType(const Cap<cap>&) noexcept{
+        return Detail::Cap<cap>::twty;
+    }
+
+    /// Rank of a capability in negotiation, lower rank is negotiated first.
+    // current values are read into `current` if set, otherwise they replace the requests;
+    // `order` is the negotiation order, computed here if null
+    void negotiateImpl(Capability* const* caps, const Type* types, NegotiationResult* results, std::size_t count,
+                       bool verify, Capability* current = nullptr, const std::size_t* order = nullptr){
+        std::unique_ptr<std::size_t[]> sorted;
+        if (order == nullptr){
+            sorted.reset(new std::size_t[count]);
+            Detail::negotiationOrder([caps](std::size_t i){
+                return caps[i]->type();
+            }, sorted.get(), count);
+
+            order = sorted.get();
+        }
+
+        for (std::size_t i = 0; i < count; i++){
+            auto idx = order[i];
+            auto& cap = *caps[idx];
+            auto type = cap.type();
+
+            if (!supports(type, MsgSupport::Set)){
+                results[idx] = NegotiationResult(type, ReturnCode::Failure, ReturnCode::Failure, true);
+                continue;
+            }
+
+            auto setRc = capability(Msg::Set, cap);
+            auto currentRc = ReturnCode::Failure;
+            if (verify && success(setRc) && supports(type, MsgSupport::GetCurrent)){
+                // the source allocates the current value, the request is kept unless replaced by it
+                Capability out(type);
+                currentRc = capability(Msg::GetCurrent, out);
+                if (success(currentRc) && types[idx] != Type::DontCare && out && out.itemType() != types[idx]){
+                    currentRc = ReturnCode::Failure;
+                }
+
+                if (current){
+                    current[idx] = success(currentRc) ? std::move(out) : Capability(type);
+                } else if (success(currentRc)){
+                    cap = std::move(out);
+                }
+            } else if (current){
+                current[idx] = Capability(type);
+            }
+
+            results[idx] = NegotiationResult(type, setRc, currentRc, false);
+        }
+    }
+
     Source(Detail::ManagerData* mgr, const Identity& srcId) :
         m_data(new Detail::SourceData(mgr, srcId)){}
 
@@ -796,6 +1631,11 @@ private:
         return m_data.get();
     }
 
+    void setState(DsState state) noexcept{
+        d()->m_state = state;
+        Detail::traceState(d()->m_srcId.id(), state);
+    }
+
     template<typename T>
     ReturnCode dsm(Identity* dest, DataGroup dg, Dat dat, Msg msg, T& data) noexcept{
         return dsmPtr(dest, dg, dat, msg, &data);
@@ -805,7 +1645,8 @@ private:
         assert(isValid());
 
         auto mgr = d()->m_mgr;
-        return mgr->m_entry(&mgr->m_appId, dest, dg, dat, msg, data);
+        Detail::CallProbe probe(dg, dat, msg, data);
+        return probe.done(mgr->m_entry(&mgr->m_appId, dest, dg, dat, msg, data));
     }
 
     template<typename T>
@@ -817,27 +1658,183 @@ private:
         return dsmPtr(&d()->m_srcId, dg, dat, msg, data);
     }
 
-    // header-only, yet we need static variables
-    // templates behave as if defined in at most one source file
-    template<typename>
-    struct Static {
-        static Detail::SourceData* g_openSource;
-    };
+    // waits until any of the enabled sources is ready, timeout in ms, -1 infinite
+    static ReturnCode waitAnyFor(Source* const* sources, std::size_t count, std::size_t& ready, Int32 timeout){
+        typedef std::chrono::steady_clock Clock;
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeout < 0 ? 0 : timeout);
+        auto remaining = [&]() -> Int32 {
+            if (timeout < 0){
+                return -1;
+            }
+
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            return left > 0 ? static_cast<Int32>(left) : 0;
+        };
+
+#if defined(TWPP_DETAIL_OS_MAC)
+        Detail::NSAutoreleasePool pool;
+#elif defined(TWPP_DETAIL_OS_LINUX)
+        std::unique_ptr<::pollfd[]> fds(new ::pollfd[count]);
+#elif !defined(TWPP_DETAIL_OS_WIN)
+#   error "waitAny setup for your platform here"
+#endif
+
+        for (bool first = true; ; first = false){
+            std::size_t enabled = 0;
+            for (std::size_t i = 0; i < count; i++){
+                Source* src = sources[i];
+                assert(src->isValid());
+
+                if (src->d()->m_state != DsState::Enabled){
+                    continue;
+                }
+
+                enabled++;
+                auto msg = src->takeReadyMsg();
+                if (msg != Msg::Null){
+                    ready = i;
+                    return src->readyResult(msg);
+                }
+            }
+
+            if (enabled == 0){
+                return ReturnCode::Failure;
+            }
+
+            auto left = remaining();
+            if (left == 0 && !first){
+                return ReturnCode::NotDsEvent;
+            }
+
+#if defined(TWPP_DETAIL_OS_WIN)
+            ::MSG msg;
+            if (!::PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)){
+                auto val = ::MsgWaitForMultipleObjects(0, nullptr, FALSE, left < 0 ? INFINITE : static_cast<::DWORD>(left), QS_ALLINPUT);
+                if (val == WAIT_TIMEOUT){
+                    return ReturnCode::NotDsEvent;
+                }
+
+                if (val == WAIT_FAILED){
+                    return ReturnCode::Failure;
+                }
+
+                continue;
+            }
+
+            if (msg.message == WM_QUIT){
+                return ReturnCode::Failure;
+            }
+
+            bool dsEvent = false;
+            for (std::size_t i = 0; i < count && !dsEvent; i++){
+                Source* src = sources[i];
+                if (src->d()->m_state != DsState::Enabled){
+                    continue;
+                }
+
+                Event event(&msg, Msg::Null);
+                auto rc = src->dsm(DataGroup::Control, Dat::Event, Msg::ProcessEvent, event);
+                switch (rc){
+                    case ReturnCode::DsEvent:
+                        dsEvent = true;
+                        // fallthrough
+                    case ReturnCode::NotDsEvent:
+                        if (src->d()->m_readyMsg == Msg::Null){
+                            src->d()->m_readyMsg = event.message();
+                        }
+
+                        break;
+
+                    default:
+                        ready = i;
+                        return rc;
+                }
+            }
+
+            if (!dsEvent){
+                ::TranslateMessage(&msg);
+                ::DispatchMessage(&msg);
+            }
+#elif defined(TWPP_DETAIL_OS_MAC)
+            Detail::NSLoop::processEvent(left < 0 ? -1.0 : left / 1000.0);
+#elif defined(TWPP_DETAIL_OS_LINUX)
+            ::nfds_t nfds = 0;
+            for (std::size_t i = 0; i < count; i++){
+                if (sources[i]->d()->m_state == DsState::Enabled){
+                    fds[nfds].fd = sources[i]->d()->m_readyFd;
+                    fds[nfds].events = POLLIN;
+                    fds[nfds].revents = 0;
+                    nfds++;
+                }
+            }
+
+            auto val = ::poll(fds.get(), nfds, left);
+            if (val == 0){
+                return ReturnCode::NotDsEvent;
+            }
+
+            if (val < 0 && errno != EINTR){
+                return ReturnCode::Failure;
+            }
+
+            for (::nfds_t i = 0; i < nfds; i++){
+                if ((fds[i].revents & POLLIN) != 0){
+                    Detail::drainReadyHandle(fds[i].fd);
+                }
+            }
+#else
+#   error "waitAny for your platform here"
+#endif
+        }
+    }
+
+    // reset m_readyMsg so that subsequent waitReady calls work correctly
+    Msg takeReadyMsg() noexcept{
+#if defined(TWPP_DETAIL_OS_LINUX)
+        std::lock_guard<std::mutex> lock(d()->m_cbMutex);
+#elif !defined(TWPP_DETAIL_OS_WIN) && !defined(TWPP_DETAIL_OS_MAC)
+#   error "takeReadyMsg for your platform here"
+#endif
+        auto msg = d()->m_readyMsg;
+        d()->m_readyMsg = Msg::Null;
+        return msg;
+    }
+
+    ReturnCode readyResult(Msg readyMsg) noexcept{
+        switch (readyMsg){
+            case Msg::XferReady: // ok/scan button <=> Msg::EnableDs
+                setState(DsState::XferReady);
+                // fallthrough
+            case Msg::CloseDsOk: // ok/scan button <=> Msg::EnableDsUiOnly
+                return ReturnCode::Success;
+
+            case Msg::CloseDsReq: // cancel button
+                return ReturnCode::Cancel;
+
+            case Msg::DeviceEvent:
+                return ReturnCode::CheckStatus;
+
+            default:
+                return ReturnCode::Failure;
+        }
+    }
 
     template<typename>
     static ReturnCode TWPP_DETAIL_CALLSTYLE callBack(
-            Identity*,
+            Identity* origin,
             Identity*,
             DataGroup,
             Dat,
             Msg msg,
             void*
     ) noexcept{
-        Detail::SourceData* src = Static<void>::g_openSource;
+        Detail::SourceData* src = Detail::CallBackRegistry<void>::find(origin);
         if (src == nullptr){
             return ReturnCode::Failure;
         }
 
+        Detail::traceCallBack(src->m_srcId.id(), msg);
+
 #if defined(TWPP_DETAIL_OS_LINUX)
         std::unique_lock<std::mutex> lock(src->m_cbMutex);
         if (src->m_state != DsState::Enabled){
@@ -847,6 +1844,9 @@ private:
 #   error "callBack preparation for your platform here"
 #endif
         if (msg == Msg::DeviceEvent){
+            // cleared by the next capability operation in the thread of the application
+            src->m_capCacheStale = true;
+
             if (!src->m_devEvent){
                 return ReturnCode::Failure;
             }
@@ -860,7 +1860,7 @@ private:
 #if defined(TWPP_DETAIL_OS_WIN)
             ::PostMessageA(static_cast<HWND>(src->m_mgr->m_rootWindow.raw()), WM_NULL, 0, 0);
 #elif defined(TWPP_DETAIL_OS_LINUX)
-            src->m_cbCond.notify_one();
+            ::eventfd_write(src->m_readyFd, 1);
 #elif defined(TWPP_DETAIL_OS_MAC)
             Detail::NSLoop::postDummy();
 #else
@@ -876,9 +1876,6 @@ private:
 
 };
 
-template<typename Dummy>
-Detail::SourceData* Source::Static<Dummy>::g_openSource = nullptr;
-
 /// TWAIN data source manager.
 /// At most one valid instance may exist at all times.
 /// All corresponding valid sources must be destroyed or cleaned up
@@ -917,6 +1914,7 @@ public:
     void cleanup() noexcept{
         assert(isValid());
 
+        completePreload();
         switch (d()->m_state){
             case DsmState::Open:
                 close();
@@ -939,6 +1937,7 @@ public:
     bool load(bool preferOld = false) noexcept{
         assert(isValid());
 
+        completePreload();
         if (d()->m_state != DsmState::PreSession){
             return false;
         }
@@ -957,12 +1956,72 @@ public:
         return resolved;
     }
 
+    /// Uses an in-process manager entry instead of loading the library,
+    /// e.g. a mock manager for tests and benchmarks.
+    /// Not a TWAIN call.
+    /// \param entry Manager entry function, must stay valid until the manager is unloaded.
+    /// \return Whether this call loaded the manager.
+    bool load(Detail::DsmEntry entry) noexcept{
+        assert(isValid());
+
+        completePreload();
+        if (d()->m_state != DsmState::PreSession || entry == nullptr){
+            return false;
+        }
+
+        d()->m_state = DsmState::Loaded;
+        d()->m_entry = entry;
+        return true;
+    }
+
+    /// Starts loading the manager library in a background thread, off the startup path.
+    /// On Linux, the manager may also be opened and the default source identity prefetched.
+    /// Windows and Mac OS managers must be opened from the thread processing
+    /// their window messages, `open` is ignored there.
+    /// The preload is completed by `waitPreload`, or by any other call of this manager;
+    /// `open` and `defaultSource` then return the prepared results right away.
+    /// Until then, `state()` reports `DsmState::PreSession`.
+    /// Falls back to `load(preferOld)` if the thread could not be started.
+    /// Not a TWAIN call.
+    /// \param open Whether to open the manager as well.
+    /// \param preferOld See `load(bool)`.
+    /// \return Whether the preload was started, false if the manager is not in pre-session state.
+    bool preload(bool open = false, bool preferOld = false) noexcept{
+        assert(isValid());
+
+        if (d()->m_state != DsmState::PreSession || d()->m_preload){
+            return false;
+        }
+
+        try {
+            std::unique_ptr<Detail::ManagerPreload> preload(new Detail::ManagerPreload(d()->m_appId));
+            d()->m_preloadThread = std::thread(preloadRun, preload.get(), open, preferOld);
+            d()->m_preload = std::move(preload);
+        } catch (...){
+            return load(preferOld);
+        }
+
+        return true;
+    }
+
+    /// Waits for the preload started by `preload` to finish.
+    /// Does nothing if there is no preload.
+    /// Not a TWAIN call.
+    /// \return Whether the manager is loaded or open.
+    bool waitPreload() noexcept{
+        assert(isValid());
+
+        completePreload();
+        return d()->m_state != DsmState::PreSession;
+    }
+
     /// Unloads the manager library.
     /// Not a TWAIN call.
     /// \return Whether this call unloaded the library.
     bool unload() noexcept{
         assert(isValid());
 
+        completePreload();
         if (d()->m_state != DsmState::Loaded){
             return false;
         }
@@ -977,6 +2036,13 @@ public:
     ReturnCode open(Handle rootWindow = Handle()) noexcept{
         assert(isValid());
 
+        completePreload();
+        if (d()->m_preOpened){
+            // already opened by preload
+            d()->m_preOpened = false;
+            return ReturnCode::Success;
+        }
+
         if (d()->m_state != DsmState::Loaded){
             return ReturnCode::Failure;
         }
@@ -1001,17 +2067,11 @@ public:
 #   error "manager open setup for your platform here"
 #endif
 
-        auto rc = dsm(nullptr, DataGroup::Control, Dat::Parent, Msg::OpenDsm, rootWindow);
+        bool hasMem;
+        Detail::EntryPoint mem;
+        auto rc = openDsm(d()->m_entry, d()->m_appId, rootWindow, hasMem, mem);
         if (success(rc)){
-            Detail::resetMemFuncs();
-            if (d()->m_appId.isDsmV2()){
-                Detail::EntryPoint e;
-                if (success(dsm(nullptr, DataGroup::Control, Dat::EntryPoint, Msg::Get, e))){
-                    Detail::setMemFuncs(e.m_alloc, e.m_free, e.m_lock, e.m_unlock);
-                }
-            }
-
-            d()->m_state = DsmState::Open;
+            opened(hasMem, mem);
         }
 
         return rc;
@@ -1034,6 +2094,9 @@ public:
         auto rc = dsm(nullptr, DataGroup::Control, Dat::Parent, Msg::CloseDsm, rootWindow);
         if (success(rc)){
             d()->m_state = DsmState::Loaded;
+            d()->m_preOpened = false;
+            d()->m_hasDefaultId = false;
+            invalidateSourceIdentities();
         }
 
         return rc;
@@ -1046,13 +2109,32 @@ public:
     Source createSource(const Str32& productName, const Str32& manufacturer){
         assert(isValid());
 
+        completePreload();
         return Source(d(), Identity(Version(), DataGroup::Control, manufacturer, Str32(), productName));
     }
 
+    /// Creates a valid closed source from its identity,
+    /// e.g. one listed by `sourceIdentities`.
+    /// \throw std::bad_alloc
+    Source createSource(const Identity& identity){
+        assert(isValid());
+
+        completePreload();
+        return Source(d(), identity);
+    }
+
     /// Creates a valid closed default source.
     /// It is almost certain the source may be opened.
     /// \throw std::bad_alloc
     ReturnCode defaultSource(Source& out){
+        completePreload();
+        if (d()->m_hasDefaultId){
+            // prefetched by preload
+            out = Source(d(), d()->m_defaultId);
+            d()->m_hasDefaultId = false;
+            return ReturnCode::Success;
+        }
+
         Identity id;
         auto rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::GetDefault, id);
         if (success(rc)){
@@ -1064,6 +2146,7 @@ public:
 
     /// Sets default source.
     ReturnCode setDefaultSource(Source& in) noexcept{
+        d()->m_hasDefaultId = false;
         return dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::Set, in.d()->m_srcId);
     }
 
@@ -1086,18 +2169,132 @@ public:
         return rc;
     }
 
+    /// Lists identities of all available sources, without creating any `Source`.
+    /// The identities are enumerated once and cached by the manager,
+    /// call `refreshSourceIdentities` to enumerate them again.
+    /// Use `createSource(const Identity&)` to create the source to be opened.
+    /// \tparam Container Container type, e.g. std::list<Identity>.
+    /// \param out The container to be filled with identities.
+    /// \return {RC::Success, RC::Failure if error.}
+    /// \throw std::bad_alloc
+    template<typename Container>
+    ReturnCode sourceIdentities(Container& out){
+        assert(isValid());
+
+        if (!d()->m_identitiesValid){
+            auto rc = refreshSourceIdentities();
+            if (!success(rc)){
+                return rc;
+            }
+        }
+
+        for (auto& entry : d()->m_identities){
+            out.push_back(entry.m_identity);
+        }
+
+        return ReturnCode::Success;
+    }
+
+    /// Enumerates available sources again, replacing the cached identities.
+    /// Sources are enumerated one by one, as Msg::GetFirst and Msg::GetNext require.
+    /// The previous identities are kept on error.
+    /// \return {RC::Success, RC::Failure if error.}
+    /// \throw std::bad_alloc
+    ReturnCode refreshSourceIdentities(){
+        assert(isValid());
+
+        std::vector<Detail::SourceIdentity> ids;
+        Identity id;
+        auto rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::GetFirst, id);
+        while (success(rc)){
+            ids.push_back(Detail::SourceIdentity{id, id.productHash()});
+            rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::GetNext, id);
+        }
+
+        if (rc != ReturnCode::EndOfList){
+            return rc;
+        }
+
+        d()->m_identities = std::move(ids);
+        d()->m_identitiesValid = true;
+        return ReturnCode::Success;
+    }
+
+    /// Looks up the identity of an available source by its product key,
+    /// comparing precomputed hashes first, see `sourceIdentities`.
+    /// \param key Product key of the source.
+    /// \param out Identity of the source, set only if found.
+    /// \return {RC::Success, RC::EndOfList if there is no such source, RC::Failure if error.}
+    /// \throw std::bad_alloc
+    ReturnCode findSourceIdentity(const IdentityKey& key, Identity& out){
+        assert(isValid());
+
+        if (!d()->m_identitiesValid){
+            auto rc = refreshSourceIdentities();
+            if (!success(rc)){
+                return rc;
+            }
+        }
+
+        for (auto& entry : d()->m_identities){
+            if (entry.m_hash == key.hash() && key.matches(entry.m_identity)){
+                out = entry.m_identity;
+                return ReturnCode::Success;
+            }
+        }
+
+        return ReturnCode::EndOfList;
+    }
+
+    /// Drops the cached source identities, the next `sourceIdentities` enumerates them again.
+    /// Closing the manager does this as well.
+    void invalidateSourceIdentities() noexcept{
+        assert(isValid());
+
+        d()->m_identities.clear();
+        d()->m_identitiesValid = false;
+    }
+
     /// Shows a source-selection dialog.
     /// Available only on Windows and MacOS.
     ReturnCode showSourceDialog(Source& out){
         Identity id;
         ReturnCode rc = dsm(nullptr, DataGroup::Control, Dat::Identity, Msg::UserSelect, id);
         if (success(rc)){
+            d()->m_hasDefaultId = false;
             out = Source(d(), id);
         }
 
         return rc;
     }
 
+    /// Waits until any of the sources is ready, blocking at most `timeout`.
+    /// Sources that are not enabled are ignored.
+    /// Otherwise the same rules as for `Source::waitReady` apply,
+    /// all sources must be waited on from the same thread.
+    /// \param sources Sources to wait on.
+    /// \param count Number of sources.
+    /// \param ready Set to the index of the source the return code belongs to.
+    /// \param timeout Maximal time to wait.
+    /// \return {Failure on error or if no source is enabled, Cancel on CANCEL button,
+    ///          Success on SAVE or SCAN button, CheckStatus on device event,
+    ///          NotDsEvent when no source got ready in time.}
+    /// \throw std::bad_alloc
+    template<typename Rep, typename Period>
+    ReturnCode waitAny(Source* const* sources, std::size_t count, std::size_t& ready,
+                       const std::chrono::duration<Rep, Period>& timeout){
+        return Source::waitAnyFor(sources, count, ready, Detail::timeoutMillis(timeout));
+    }
+
+    /// Waits until any of the sources is ready, blocking at most `timeout`.
+    /// See the pointer and count version for details.
+    /// \throw std::bad_alloc
+    template<typename Rep, typename Period>
+    ReturnCode waitAny(std::initializer_list<Source*> sources, std::size_t& ready,
+                       const std::chrono::duration<Rep, Period>& timeout){
+        return Source::waitAnyFor(sources.begin(), sources.size(), ready, Detail::timeoutMillis(timeout));
+    }
+
     /// Obtains the last manager status.
     ReturnCode status(Status& status) noexcept{
         return dsm(nullptr, DataGroup::Control, Dat::Status, Msg::Get, status);
@@ -1156,7 +2353,83 @@ private:
     ReturnCode dsmPtr(Identity* dest, DataGroup dg, Dat dat, Msg msg, void* data){
         assert(isValid());
 
-        return d()->m_entry(&d()->m_appId, dest, dg, dat, msg, data);
+        completePreload();
+        Detail::CallProbe probe(dg, dat, msg, data);
+        return probe.done(d()->m_entry(&d()->m_appId, dest, dg, dat, msg, data));
+    }
+
+    // opens the manager, memory functions of V2 managers are returned in `mem`
+    static ReturnCode openDsm(Detail::DsmEntry entry, Identity& appId, Handle rootWindow,
+                              bool& hasMem, Detail::EntryPoint& mem) noexcept{
+
+        hasMem = false;
+        auto rc = entry(&appId, nullptr, DataGroup::Control, Dat::Parent, Msg::OpenDsm, &rootWindow);
+        if (success(rc) && appId.isDsmV2()){
+            hasMem = success(entry(&appId, nullptr, DataGroup::Control, Dat::EntryPoint, Msg::Get, &mem));
+        }
+
+        return rc;
+    }
+
+    void opened(bool hasMem, const Detail::EntryPoint& mem) noexcept{
+        Detail::resetMemFuncs();
+        if (hasMem){
+            Detail::setMemFuncs(mem.m_alloc, mem.m_free, mem.m_lock, mem.m_unlock);
+        }
+
+        d()->m_state = DsmState::Open;
+    }
+
+    static void preloadRun(Detail::ManagerPreload* preload, bool open, bool preferOld) noexcept{
+        if (!preload->m_lib.load(preferOld)){
+            return;
+        }
+
+        preload->m_entry = preload->m_lib.resolve();
+        if (preload->m_entry == nullptr){
+            preload->m_lib.unload();
+            return;
+        }
+
+#if defined(TWPP_DETAIL_OS_LINUX)
+        if (open){
+            auto rc = openDsm(preload->m_entry, preload->m_appId, Handle(), preload->m_hasMem, preload->m_mem);
+            preload->m_opened = success(rc);
+            if (preload->m_opened){
+                preload->m_hasDefault = success(preload->m_entry(&preload->m_appId, nullptr, DataGroup::Control,
+                                                                 Dat::Identity, Msg::GetDefault, &preload->m_default));
+            }
+        }
+#elif defined(TWPP_DETAIL_OS_WIN) || defined(TWPP_DETAIL_OS_MAC)
+        Detail::unused(open);
+#else
+#   error "manager preload for your platform here"
+#endif
+    }
+
+    // takes over the results of a finished preload
+    void completePreload() noexcept{
+        auto data = d();
+        if (!data->m_preload){
+            return;
+        }
+
+        data->m_preloadThread.join();
+        std::unique_ptr<Detail::ManagerPreload> preload = std::move(data->m_preload);
+        if (preload->m_entry == nullptr){
+            return;
+        }
+
+        data->m_lib = std::move(preload->m_lib);
+        data->m_entry = preload->m_entry;
+        data->m_state = DsmState::Loaded;
+        if (preload->m_opened){
+            data->m_appId = preload->m_appId;
+            opened(preload->m_hasMem, preload->m_mem);
+            data->m_preOpened = true;
+            data->m_hasDefaultId = preload->m_hasDefault;
+            data->m_defaultId = preload->m_default;
+        }
     }
 
     std::unique_ptr<Detail::ManagerData> m_data;
@@ -0,0 +1,290 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_BATCHPIPELINE_HPP
+#define TWPP_DETAIL_FILE_BATCHPIPELINE_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Multi-page transfer loop overlapping page processing with the transfers.
+///
+/// Every page is handed to a worker thread right after it has been transferred,
+/// and `pendingXfers(Msg::EndXfer, ...)` is sent immediately, so the feeder keeps
+/// moving while earlier pages are still being processed. At most `buffers()` pages
+/// are in flight, the next transfer waits until a page has been processed.
+///
+///     BatchPipeline pipeline(2);
+///     src.enable(ui);
+///     src.waitReady();
+///     pipeline.runNative(src, [](ImageNativeXfer& page, UInt32 index){ ... });
+///     src.disable();
+class BatchPipeline {
+
+public:
+    /// Called on a worker thread for every natively transferred page.
+    /// The page may be moved out of the parameter.
+    typedef std::function<void(ImageNativeXfer& page, UInt32 index)> NativeCallBack;
+
+    /// Called on a worker thread with all strips of a page transferred in memory mode.
+    /// The strips may be moved out of the parameter.
+    typedef std::function<void(std::list<ImageMemXfer>& strips, UInt32 index)> MemoryCallBack;
+
+    /// Creates pipeline.
+    /// \param threads Number of worker threads, zero processes pages in place.
+    /// \param maxBuffers Maximal number of pages in flight, zero uses `CapType::MaxBatchBuffers`
+    ///                   of the source, or `threads + 1` if the source does not report it.
+    /// \throw std::system_error
+    explicit BatchPipeline(UInt32 threads = 1, UInt32 maxBuffers = 0) :
+        m_threads(threads), m_maxBuffers(maxBuffers), m_pageLimit(0), m_buffers(0), m_pages(0),
+        m_inFlight(0){
+
+        m_pool.start(threads);
+    }
+
+    /// Waits for all pages in flight.
+    ~BatchPipeline(){
+        m_pool.stop();
+    }
+
+    BatchPipeline(const BatchPipeline&) = delete;
+    BatchPipeline& operator=(const BatchPipeline&) = delete;
+
+    /// Maximal number of pages to transfer, the remaining transfers are reset.
+    /// \param pages Number of pages, zero transfers all pages.
+    void setPageLimit(UInt32 pages) noexcept{
+        m_pageLimit = pages;
+    }
+
+    /// Maximal number of pages to transfer, zero means all pages.
+    UInt32 pageLimit() const noexcept{
+        return m_pageLimit;
+    }
+
+    /// Number of pages in flight used by the last run.
+    UInt32 buffers() const noexcept{
+        return m_buffers;
+    }
+
+    /// Number of pages transferred by the last run.
+    UInt32 pages() const noexcept{
+        return m_pages;
+    }
+
+    /// Transfers all pending pages using native transfers.
+    /// The source must be ready to transfer, see `Source::waitReady`.
+    /// Returns once all pages have been processed.
+    /// \param src Source in DsState::XferReady.
+    /// \param callBack Page consumer.
+    /// \return {XferDone once all requested pages were transferred,
+    ///          otherwise the result of the failed call.}
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the callback, the remaining transfers are reset.
+    ReturnCode runNative(Source& src, const NativeCallBack& callBack){
+        return run(src, [&](ReturnCode& rc) -> std::function<void(UInt32)> {
+            std::shared_ptr<ImageNativeXfer> page(new ImageNativeXfer());
+            rc = src.imageNativeXfer(*page);
+            if (rc != ReturnCode::XferDone){
+                return nullptr;
+            }
+
+            return [&callBack, page](UInt32 index){
+                callBack(*page, index);
+            };
+        });
+    }
+
+    /// Transfers all pending pages using memory transfers.
+    /// Strip buffers are sized by `Source::memXferTuner()`.
+    /// The source must be ready to transfer, see `Source::waitReady`.
+    /// Returns once all pages have been processed.
+    /// \param src Source in DsState::XferReady.
+    /// \param callBack Page consumer.
+    /// \return {XferDone once all requested pages were transferred,
+    ///          otherwise the result of the failed call.}
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the callback, the remaining transfers are reset.
+    ReturnCode runMemory(Source& src, const MemoryCallBack& callBack){
+        SetupMemXfer setup;
+        auto rc = src.setupMemXfer(setup);
+        if (!success(rc)){
+            return rc;
+        }
+
+        MemXferTuner& tuner = src.memXferTuner();
+        if (!tuner.setup(setup)){
+            return ReturnCode::Failure;
+        }
+
+        return run(src, [&](ReturnCode& rc) -> std::function<void(UInt32)> {
+            std::shared_ptr<std::list<ImageMemXfer> > strips(new std::list<ImageMemXfer>());
+            do {
+                ImageMemXfer strip(Compression::None, 0, 0, 0, 0, 0, 0, Memory(tuner.size()));
+                auto start = MemXferTuner::Clock::now();
+                rc = src.imageMemXfer(strip);
+                if (rc != ReturnCode::Success && rc != ReturnCode::XferDone){
+                    return nullptr;
+                }
+
+                tuner.record(strip.bytesWritten(), MemXferTuner::Clock::now() - start);
+
+                strips->push_back(std::move(strip));
+            } while (rc != ReturnCode::XferDone);
+
+            return [&callBack, strips](UInt32 index){
+                callBack(*strips, index);
+            };
+        });
+    }
+
+private:
+    typedef std::function<std::function<void(UInt32)>(ReturnCode&)> Transfer;
+
+    UInt32 effectiveBuffers(Source& src){
+        if (m_maxBuffers != 0){
+            return m_maxBuffers;
+        }
+
+        Capability cap(CapType::MaxBatchBuffers);
+        if (src.supports(CapType::MaxBatchBuffers, MsgSupport::GetCurrent) &&
+                success(src.capability(Msg::GetCurrent, cap))){
+            try {
+                auto buffers = cap.oneValue<CapType::MaxBatchBuffers>().item();
+                if (buffers != 0){
+                    return buffers;
+                }
+            } catch (const CapabilityException&){
+                // not reported as one value
+            }
+        }
+
+        return m_threads + 1;
+    }
+
+    ReturnCode run(Source& src, const Transfer& transfer){
+        m_buffers = effectiveBuffers(src);
+        m_pages = 0;
+        m_error = nullptr;
+
+        ReturnCode rc = ReturnCode::Failure;
+        PendingXfers pending;
+        try {
+            do {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cond.wait(lock, [this]{ return m_inFlight < m_buffers || m_error; });
+                    if (m_error){
+                        src.pendingXfers(Msg::Reset, pending);
+                        break;
+                    }
+                }
+
+                auto process = transfer(rc);
+                if (!process){
+                    break; // source cleanup ends or resets the transfers
+                }
+
+                post(std::move(process), m_pages++);
+
+                if (!success(src.pendingXfers(Msg::EndXfer, pending))){
+                    rc = ReturnCode::Failure;
+                    break;
+                }
+
+                if (m_pageLimit != 0 && m_pages >= m_pageLimit && pending.count() != 0){
+                    src.pendingXfers(Msg::Reset, pending);
+                    break;
+                }
+            } while (pending.count() != 0);
+        } catch (...){
+            wait();
+            throw;
+        }
+
+        wait();
+        if (m_error){
+            std::rethrow_exception(m_error);
+        }
+
+        return rc;
+    }
+
+    void post(std::function<void(UInt32)> process, UInt32 index){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight++;
+        }
+
+        auto task = [this, process, index]{
+            std::exception_ptr error;
+            try {
+                process(index);
+            } catch (...){
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error){
+                m_error = error;
+            }
+
+            m_inFlight--;
+            m_cond.notify_all();
+        };
+
+        try {
+            m_pool.post(std::move(task));
+        } catch (...){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight--;
+            throw;
+        }
+    }
+
+    void wait(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_inFlight == 0; });
+    }
+
+    UInt32 m_threads;
+    UInt32 m_maxBuffers;
+    UInt32 m_pageLimit;
+    UInt32 m_buffers;
+    UInt32 m_pages;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    UInt32 m_inFlight;
+    std::exception_ptr m_error;
+
+    Detail::WorkerPool m_pool;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_BATCHPIPELINE_HPP
@@ -346,9 +346,126 @@ struct IsNumeric {
     static constexpr bool value = std::is_integral<DataType>::value || std::is_same<DataType, Fix32>::value;
 };
 
+// numeric range values as plain integers, Fix32 uses its 16.16 value
+template<typename DataType>
+struct RangeUnits {
+    static constexpr std::int64_t to(DataType value) noexcept{
+        return static_cast<std::int64_t>(value);
+    }
+
+    static constexpr DataType from(std::int64_t value) noexcept{
+        return static_cast<DataType>(value);
+    }
+};
+
+template<>
+struct RangeUnits<Fix32> {
+    static constexpr std::int64_t to(Fix32 value) noexcept{
+        return value.raw();
+    }
+
+    static constexpr Fix32 from(std::int64_t value) noexcept{
+        return Fix32::fromRaw(static_cast<Int32>(value));
+    }
+};
+
+// number of items of range `first, first + step, ...` not greater than `last`
+static inline std::uint64_t rangeCount(std::int64_t first, std::int64_t last, std::int64_t step) noexcept{
+    if (step <= 0 || last < first){
+        return 0;
+    }
+
+    return static_cast<std::uint64_t>(last - first) / static_cast<std::uint64_t>(step) + 1;
+}
+
+// inverse of `a` modulo `m`, `a` and `m` are coprime
+static inline std::uint64_t modInverse(std::uint64_t a, std::uint64_t m) noexcept{
+    std::int64_t t = 0;
+    std::int64_t newT = 1;
+    auto r = static_cast<std::int64_t>(m);
+    auto newR = static_cast<std::int64_t>(a % m);
+    while (newR != 0){
+        auto q = r / newR;
+        auto tmp = t - q * newT;
+        t = newT;
+        newT = tmp;
+
+        tmp = r - q * newR;
+        r = newR;
+        newR = tmp;
+    }
+
+    return static_cast<std::uint64_t>(t < 0 ? t + static_cast<std::int64_t>(m) : t);
+}
+
+// intersection of two non-empty arithmetic progressions given by first and last items and steps,
+// values fit 32 bits, steps are positive
+static inline bool intersectProgressions(std::int64_t a0, std::int64_t a1, std::int64_t sa,
+                                         std::int64_t b0, std::int64_t b1, std::int64_t sb,
+                                         std::int64_t& first, std::int64_t& last, std::int64_t& step) noexcept{
+
+    auto lo = std::max(a0, b0);
+    auto hi = std::min(a1, b1);
+    if (lo > hi){
+        return false;
+    }
+
+    // x = a0 + sa * k, x = b0 (mod sb)
+    auto x = sa;
+    auto y = sb;
+    while (y != 0){
+        auto tmp = x % y;
+        x = y;
+        y = tmp;
+    }
+
+    auto g = x;
+    auto diff = b0 - a0;
+    if (diff % g != 0){
+        return false;
+    }
+
+    auto m = static_cast<std::uint64_t>(sb / g);
+    auto period = static_cast<std::uint64_t>(sa / g) * static_cast<std::uint64_t>(sb);
+    std::uint64_t k = 0;
+    if (m != 1){
+        auto r = (diff / g) % static_cast<std::int64_t>(m);
+        auto ur = static_cast<std::uint64_t>(r < 0 ? r + static_cast<std::int64_t>(m) : r);
+        k = ur * modInverse(static_cast<std::uint64_t>(sa / g), m) % m;
+    }
+
+    // offsets from a0, all common values are `offset + N * period`
+    auto offset = static_cast<std::uint64_t>(sa) * k;
+    auto low = static_cast<std::uint64_t>(lo - a0);
+    auto span = static_cast<std::uint64_t>(hi - a0);
+    if (offset < low){
+        if (period > span){
+            return false;
+        }
+
+        offset += (low - offset + period - 1) / period * period;
+    }
+
+    if (offset > span){
+        return false;
+    }
+
+    first = a0 + static_cast<std::int64_t>(offset);
+    if (period > span - offset){
+        last = first;
+        step = sa;
+    } else {
+        last = first + static_cast<std::int64_t>((span - offset) / period * period);
+        step = static_cast<std::int64_t>(period);
+    }
+
+    return true;
+}
+
 }
 
 class Capability;
+class CapabilitySnapshot;
 
 /// Capability container holding a single value.
 /// \tparam twty ID of the internal data type.
@@ -816,6 +933,117 @@ public:
         return m_data;
     }
 
+    /// Number of values in the range, `min + N * step` not greater than `max`.
+    /// Ranges with non-positive step are empty.
+    std::uint64_t size() const noexcept{
+        typedef Detail::RangeUnits<DataType> Units;
+        return Detail::rangeCount(Units::to(m_data->m_minValue), Units::to(m_data->m_maxValue),
+                                  Units::to(m_data->m_stepSize));
+    }
+
+    /// Value at index `i`, `min + i * step`.
+    /// \param i Index of the value, less than `size()`.
+    DataType operator[](std::uint64_t i) const noexcept{
+        typedef Detail::RangeUnits<DataType> Units;
+        return Units::from(Units::to(m_data->m_minValue) +
+                           static_cast<std::int64_t>(i) * Units::to(m_data->m_stepSize));
+    }
+
+    /// Whether the value is one of the range values.
+    /// \param value Value to check.
+    bool contains(DataType value) const noexcept{
+        typedef Detail::RangeUnits<DataType> Units;
+        auto min = Units::to(m_data->m_minValue);
+        auto step = Units::to(m_data->m_stepSize);
+        auto v = Units::to(value);
+        return v >= min &&
+                v <= Units::to(m_data->m_maxValue) &&
+                step > 0 &&
+                (v - min) % step == 0;
+    }
+
+    /// Range value nearest to the supplied one, halves are rounded up.
+    /// Returns the minimal value if the range is empty.
+    /// \param value Value to look up.
+    DataType nearest(DataType value) const noexcept{
+        typedef Detail::RangeUnits<DataType> Units;
+        auto count = size();
+        if (count == 0){
+            return m_data->m_minValue;
+        }
+
+        auto min = Units::to(m_data->m_minValue);
+        auto step = Units::to(m_data->m_stepSize);
+        auto v = Units::to(value);
+        if (v <= min){
+            return m_data->m_minValue;
+        }
+
+        auto index = static_cast<std::uint64_t>(v - min) / static_cast<std::uint64_t>(step);
+        if (static_cast<std::uint64_t>(v - min) % static_cast<std::uint64_t>(step) * 2 >= static_cast<std::uint64_t>(step)){
+            index++;
+        }
+
+        return (*this)[index < count ? index : count - 1];
+    }
+
+    /// Intersection of this and other range, the values present in both.
+    /// The step of the intersection is the least common multiple of the steps,
+    /// for a single common value it is the step of this range.
+    /// \param other The other range.
+    /// \param min Minimal common value.
+    /// \param max Maximal common value.
+    /// \param step Step of the common values.
+    /// \return Whether there are any common values, outputs are not set otherwise.
+    bool intersect(const Range& other, DataType& min, DataType& max, DataType& step) const noexcept{
+        typedef Detail::RangeUnits<DataType> Units;
+        auto count = size();
+        auto otherCount = other.size();
+        if (count == 0 || otherCount == 0){
+            return false;
+        }
+
+        auto sa = Units::to(m_data->m_stepSize);
+        auto sb = Units::to(other.stepSize());
+        std::int64_t first, last, st;
+        if (!Detail::intersectProgressions(
+                Units::to(minValue()), Units::to((*this)[count - 1]), sa,
+                Units::to(other.minValue()), Units::to(other[otherCount - 1]), sb,
+                first, last, st)){
+            return false;
+        }
+
+        min = Units::from(first);
+        max = Units::from(last);
+        step = Units::from(st);
+        return true;
+    }
+
+    /// Constrains this range to the values present in the other one, e.g. to validate
+    /// Msg::SetConstraint in a data source. Current and default values
+    /// are moved to the nearest remaining values.
+    /// \param other The other range.
+    /// \return Whether there are any common values, this range is not changed otherwise.
+    bool constrain(const Range& other) noexcept{
+        DataType min, max, step;
+        if (!intersect(other, min, max, step)){
+            return false;
+        }
+
+        m_data->m_minValue = min;
+        m_data->m_maxValue = max;
+        m_data->m_stepSize = step;
+        if (!contains(m_data->m_currValue)){
+            m_data->m_currValue = nearest(m_data->m_currValue);
+        }
+
+        if (!contains(m_data->m_defValue)){
+            m_data->m_defValue = nearest(m_data->m_defValue);
+        }
+
+        return true;
+    }
+
     const_iterator begin() const noexcept{
         return cbegin();
     }
@@ -1283,6 +1511,12 @@ class Capability {
     template<Type, bool, typename>
     friend class Detail::CapDataImpl;
 
+    friend class CapabilitySnapshot;
+    friend class Source;
+
+    template<CapType, UInt32>
+    friend class InlineCap;
+
 public:
     /// Creates capability holding OneValue container.
     /// \tparam type ID of the internal data type.
@@ -1652,6 +1886,31 @@ public:
         return m_cont;
     }
 
+    /// Creates a deep copy of this capability and its container.
+    /// \throw std::bad_alloc
+    /// \throw TypeException When the item type is Handle or invalid.
+    /// \throw ContainerException When the container type is invalid.
+    Capability clone() const{
+        if (!m_cont){
+            Capability ret(m_cap);
+            ret.m_conType = m_conType;
+            return ret;
+        }
+
+        auto type = itemType();
+        if (type == Type::Handle){
+            // the item handle would be freed twice
+            throw TypeException();
+        }
+
+        auto size = containerSize(type);
+        Capability ret(m_cap, m_conType, type, size);
+        auto src = m_cont.lock<const char>();
+        auto dst = ret.m_cont.lock<char>();
+        std::memcpy(dst.data(), src.data(), size);
+        return ret;
+    }
+
     /// Contained OneValue container.
     /// \tparam type ID of the internal data type.
     /// \tparam DataType Exported data type.
@@ -1925,6 +2184,49 @@ public:
     }
 
 private:
+    /// Size of the container in bytes, matches sizes used by create* methods.
+    /// \throw TypeException
+    /// \throw ContainerException
+    UInt32 containerSize(Type type) const{
+        return containerSize(m_conType, type, m_cont.lock<const char>().data());
+    }
+
+    /// Size of a container up to its first item, without trailing padding.
+    static constexpr UInt32 containerHeaderSize(ConType conType) noexcept{
+        return conType == ConType::Array ? static_cast<UInt32>(sizeof(Type) + sizeof(UInt32)) :
+               conType == ConType::Enumeration ? static_cast<UInt32>(sizeof(Type) + 3 * sizeof(UInt32)) :
+               static_cast<UInt32>(sizeof(Type));
+    }
+
+    /// Size of a container in bytes, never exceeds sizes used by create* methods.
+    /// \param conType Container type.
+    /// \param type Item type.
+    /// \param data Container data, at least the header of Array and Enumeration containers.
+    /// \throw TypeException
+    /// \throw ContainerException
+    static UInt32 containerSize(ConType conType, Type type, const char* data){
+        auto item = typeSize(type);
+        auto padded = item < sizeof(UInt32) ? static_cast<UInt32>(sizeof(UInt32)) : item;
+        switch (conType){
+            case ConType::OneValue:
+                return sizeof(Type) + padded;
+
+            case ConType::Array:
+                return containerHeaderSize(conType) +
+                        reinterpret_cast<const Detail::ArrayData<UInt8>*>(data)->m_numItems * item;
+
+            case ConType::Enumeration:
+                return containerHeaderSize(conType) +
+                        reinterpret_cast<const Detail::EnumerationData<UInt8>*>(data)->m_numItems * item;
+
+            case ConType::Range:
+                return sizeof(Type) + 5 * padded;
+
+            default:
+                throw ContainerException();
+        }
+    }
+
     /// \throw DataException
     /// \throw ContainerException
     /// \throw ItemTypeException
@@ -1952,7 +2254,7 @@ private:
             throw ItemTypeException();
         }
 
-        return std::move(ret);
+        return ret;
     }
 
     CapType m_cap;
@@ -2223,6 +2525,353 @@ private:
 
 };
 
+/// Capability wrapper class storing small containers inline.
+/// Holds OneValue, and Array and Enumeration containers of up to `capacity` items,
+/// building and reading values does not allocate any handle.
+/// `Source::capability` sends the contents in a handle kept by the source and reused
+/// by later calls, and reads results directly from the returned container.
+/// Use Cap for Range containers and larger Array and Enumeration containers.
+/// \tparam cap Capability type.
+/// \tparam capacity Maximal number of Array and Enumeration items.
+template<CapType cap, UInt32 capacity = 8>
+class InlineCap {
+
+    static_assert(capacity > 0, "capacity may not be 0");
+    static_assert(Detail::Cap<cap>::twty != Type::Handle, "handle items are not supported");
+
+    friend class Source;
+
+public:
+    typedef typename Detail::Cap<cap>::DataType DataType;
+    static constexpr const Type twty = Detail::Cap<cap>::twty;
+    typedef DataType* iterator;
+    typedef const DataType* const_iterator;
+
+    /// Creates capability holding OneValue container.
+    /// \param value Initial value.
+    static InlineCap createOneValue(const DataType& value = DataType()) noexcept{
+        InlineCap ret;
+        ret.m_conType = ConType::OneValue;
+        ret.m_numItems = 1;
+        ret.m_items[0] = value;
+        return ret;
+    }
+
+    /// Creates capability holding Array container.
+    /// \param values Initial values in the array.
+    /// \throw RangeException When there are more than `capacity` values.
+    static InlineCap createArray(std::initializer_list<DataType> values){
+        InlineCap ret;
+        ret.m_conType = ConType::Array;
+        ret.setItems(values.begin(), values.size());
+        return ret;
+    }
+
+    /// Creates capability holding Enumeration container.
+    /// \param values Initial values in the array.
+    /// \param currIndex Index of the currently selected item.
+    /// \param defIndex Index of the default item.
+    /// \throw RangeException When there are more than `capacity` values.
+    static InlineCap createEnumeration(std::initializer_list<DataType> values, UInt32 currIndex = 0, UInt32 defIndex = 0){
+        InlineCap ret;
+        ret.m_conType = ConType::Enumeration;
+        ret.setItems(values.begin(), values.size());
+        ret.m_currIndex = currIndex;
+        ret.m_defIndex = defIndex;
+        return ret;
+    }
+
+    /// Creates capability of the supplied type without any data.
+    /// Useful for retrieving data from data source.
+    InlineCap() noexcept :
+        m_conType(ConType::DontCare), m_numItems(0), m_currIndex(0), m_defIndex(0){}
+
+    /// Capability type.
+    constexpr CapType type() const noexcept{
+        return cap;
+    }
+
+    /// Container type.
+    ConType container() const noexcept{
+        return m_conType;
+    }
+
+    operator bool() const noexcept{
+        return m_numItems != 0 || m_conType == ConType::Array;
+    }
+
+    /// Number of contained items.
+    UInt32 size() const noexcept{
+        return m_numItems;
+    }
+
+    /// Access contained item.
+    DataType& at(UInt32 i) noexcept{
+        return m_items[i];
+    }
+
+    /// Access contained item.
+    const DataType& at(UInt32 i) const noexcept{
+        return m_items[i];
+    }
+
+    /// Index of the currently selected Enumeration item.
+    UInt32 currentIndex() const noexcept{
+        return m_currIndex;
+    }
+
+    /// Sets index of the currently selected Enumeration item.
+    void setCurrentIndex(UInt32 index) noexcept{
+        m_currIndex = index;
+    }
+
+    /// Index of the default Enumeration item.
+    UInt32 defaultIndex() const noexcept{
+        return m_defIndex;
+    }
+
+    /// Sets index of the default Enumeration item.
+    void setDefaultIndex(UInt32 index) noexcept{
+        m_defIndex = index;
+    }
+
+    /// Whether the current item can be retrieved.
+    /// The container must be one of Enumeration and OneValue.
+    bool hasCurrentItem() const noexcept{
+        switch (m_conType){
+            case ConType::OneValue:
+                return true;
+
+            case ConType::Enumeration:
+                return m_currIndex < m_numItems;
+
+            default:
+                return false;
+        }
+    }
+
+    /// Returns a copy of the current item of this capability.
+    /// Can be used only with Enumeration and OneValue containers.
+    /// \throw DataException When there is no current item.
+    /// \throw ContainerException When container is not Enumeration nor OneValue.
+    DataType currentItem() const{
+        switch (m_conType){
+            case ConType::OneValue:
+                return m_items[0];
+
+            case ConType::Enumeration:
+                if (m_currIndex >= m_numItems){
+                    throw DataException();
+                }
+
+                return m_items[m_currIndex];
+
+            default:
+                throw ContainerException();
+        }
+    }
+
+    iterator begin() noexcept{
+        return m_items;
+    }
+
+    const_iterator begin() const noexcept{
+        return cbegin();
+    }
+
+    const_iterator cbegin() const noexcept{
+        return m_items;
+    }
+
+    iterator end() noexcept{
+        return m_items + m_numItems;
+    }
+
+    const_iterator end() const noexcept{
+        return cend();
+    }
+
+    const_iterator cend() const noexcept{
+        return m_items + m_numItems;
+    }
+
+    /// Creates a TWAIN capability holding a copy of this container.
+    /// \throw std::bad_alloc
+    Capability toCapability() const{
+        switch (m_conType){
+            case ConType::OneValue:
+                return Capability::createOneValue<cap>(m_items[0]);
+
+            case ConType::Array: {
+                auto ret = Capability::createArray<cap>(m_numItems);
+                copyItems(ret.template array<cap>().begin());
+                return ret;
+            }
+
+            case ConType::Enumeration: {
+                auto ret = Capability::createEnumeration<cap>(m_numItems, m_currIndex, m_defIndex);
+                copyItems(ret.template enumeration<cap>().begin());
+                return ret;
+            }
+
+            default:
+                return Capability(cap);
+        }
+    }
+
+    /// Replaces the contents with a copy of TWAIN capability.
+    /// An empty capability clears this container.
+    /// \param capability Capability to be copied.
+    /// \throw CapTypeException When input capability type does not match the
+    ///                         capability type of this template class.
+    /// \throw CapItemTypeException When input capability item type does not match
+    ///                             the expected item type of the capability.
+    /// \throw ContainerException When the container is a Range,
+    ///                           or has more than `capacity` items.
+    void assign(Capability capability){
+        load(capability);
+    }
+
+private:
+    /// \throw CapTypeException
+    /// \throw CapItemTypeException
+    /// \throw ContainerException
+    void load(Capability& capability){
+        if (capability.type() != cap){
+            throw CapTypeException(std::move(capability));
+        }
+
+        if (!capability){
+            *this = InlineCap();
+            return;
+        }
+
+        // the container is read under a single lock
+        bool typeMatches;
+        {
+            auto lock = capability.m_cont.lock<const char>();
+            auto data = lock.data();
+            typeMatches = *reinterpret_cast<const Type*>(data) == twty;
+            if (typeMatches){
+                readContainer(capability.container(), data);
+            }
+        }
+
+        if (!typeMatches){
+            throw CapItemTypeException(std::move(capability));
+        }
+    }
+
+    /// \throw ContainerException
+    void readContainer(ConType conType, const char* data){
+        switch (conType){
+            case ConType::OneValue:
+                *this = createOneValue(static_cast<DataType>(reinterpret_cast<const Detail::OneValueData<DataType>*>(data)->m_item));
+                break;
+
+            case ConType::Array: {
+                auto arr = reinterpret_cast<const Detail::ArrayData<DataType>*>(data);
+                assignItems(ConType::Array, arr->m_items, arr->m_numItems);
+                m_currIndex = 0;
+                m_defIndex = 0;
+                break;
+            }
+
+            case ConType::Enumeration: {
+                auto enm = reinterpret_cast<const Detail::EnumerationData<DataType>*>(data);
+                assignItems(ConType::Enumeration, enm->m_items, enm->m_numItems);
+                m_currIndex = enm->m_currIndex;
+                m_defIndex = enm->m_defIndex;
+                break;
+            }
+
+            default:
+                throw ContainerException();
+        }
+    }
+
+    // size of TWAIN container holding the contents, 0 when empty
+    UInt32 containerSize() const noexcept{
+        switch (m_conType){
+            case ConType::OneValue:
+                return sizeof(Detail::OneValueData<DataType>);
+
+            case ConType::Array:
+                return sizeof(Detail::ArrayData<DataType>) - sizeof(DataType) + m_numItems * sizeof(DataType);
+
+            case ConType::Enumeration:
+                return sizeof(Detail::EnumerationData<DataType>) - sizeof(DataType) + m_numItems * sizeof(DataType);
+
+            default:
+                return 0;
+        }
+    }
+
+    // writes TWAIN container holding the contents, `out` has at least `containerSize` bytes
+    void writeContainer(char* out) const noexcept{
+        switch (m_conType){
+            case ConType::OneValue: {
+                auto data = reinterpret_cast<Detail::OneValueData<DataType>*>(out);
+                data->m_itemType = twty;
+                data->m_item = m_items[0];
+                break;
+            }
+
+            case ConType::Array: {
+                auto data = reinterpret_cast<Detail::ArrayData<DataType>*>(out);
+                data->m_itemType = twty;
+                data->m_numItems = m_numItems;
+                copyItems(data->m_items);
+                break;
+            }
+
+            case ConType::Enumeration: {
+                auto data = reinterpret_cast<Detail::EnumerationData<DataType>*>(out);
+                data->m_itemType = twty;
+                data->m_numItems = m_numItems;
+                data->m_currIndex = m_currIndex;
+                data->m_defIndex = m_defIndex;
+                copyItems(data->m_items);
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    /// \throw RangeException
+    void setItems(const DataType* items, std::size_t size){
+        if (size > capacity){
+            throw RangeException();
+        }
+
+        std::copy(items, items + size, m_items);
+        m_numItems = static_cast<UInt32>(size);
+    }
+
+    /// \throw ContainerException
+    void assignItems(ConType conType, const DataType* items, UInt32 size){
+        if (size > capacity){
+            throw ContainerException();
+        }
+
+        m_conType = conType;
+        setItems(items, size);
+    }
+
+    void copyItems(DataType* out) const noexcept{
+        std::copy(m_items, m_items + m_numItems, out);
+    }
+
+    ConType m_conType;
+    UInt32 m_numItems;
+    UInt32 m_currIndex;
+    UInt32 m_defIndex;
+    DataType m_items[capacity];
+
+};
+
 
 namespace Detail {
 
@@ -0,0 +1,309 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_CAPABILITYTABLE_HPP
+#define TWPP_DETAIL_FILE_CAPABILITYTABLE_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// A single row of capability table.
+/// \tparam Source Data source class handling the capability.
+template<typename Source>
+struct CapabilityEntry {
+
+    typedef Result (Source::*Handler)(Msg msg, Capability& data);
+
+    CapType m_cap;
+    Type m_itemType;
+    MsgSupport m_support;
+    Handler m_handler;
+
+};
+
+/// Creates a capability table entry, the item type is taken from capability traits.
+/// \tparam cap Capability type.
+/// \param support Supported actions, reported by Msg::QuerySupport.
+/// \param handler Member function handling the capability.
+template<CapType cap, typename Source>
+static constexpr inline CapabilityEntry<Source> capabilityEntry(MsgSupport support, Result (Source::*handler)(Msg, Capability&)) noexcept{
+    return CapabilityEntry<Source>{cap, Detail::Cap<cap>::twty, support, handler};
+}
+
+/// Table of capabilities supported by a data source.
+/// Entries are kept in a fixed-size std::array, sorted by capability type
+/// with an insertion sort when the table is constructed at run time, and looked up
+/// by binary search. Build the table once, e.g. as a function-local static.
+/// Routes capability operations to member function handlers without any
+/// heap allocation or type erasure, and answers CapType::SupportedCaps
+/// and Msg::QuerySupport directly.
+///
+/// Handlers receive only actions listed in their support flags, Msg::Set
+/// is rejected with BadValue if the item type does not match capability traits.
+/// \tparam Source Data source class handling the capabilities.
+/// \tparam count Number of entries.
+template<typename Source, std::size_t count>
+class CapabilityTable {
+
+public:
+    typedef CapabilityEntry<Source> Entry;
+
+    /// Creates a table from entries in any order.
+    /// Each capability type must be present at most once.
+    explicit CapabilityTable(const std::array<Entry, count>& entries) noexcept :
+        m_entries(entries){
+
+        // insertion sort, tables are small and built once
+        for (std::size_t i = 1; i < count; i++){
+            Entry e = m_entries[i];
+            std::size_t j = i;
+            for ( ; j > 0 && m_entries[j - 1].m_cap > e.m_cap; j--){
+                m_entries[j] = m_entries[j - 1];
+            }
+
+            m_entries[j] = e;
+        }
+    }
+
+    /// Number of entries.
+    constexpr std::size_t size() const noexcept{
+        return count;
+    }
+
+    /// Finds entry of the capability type.
+    /// \return Pointer to the entry, or null if the capability is not in the table.
+    const Entry* find(CapType cap) const noexcept{
+        std::size_t lo = 0;
+        std::size_t hi = count;
+        while (lo < hi){
+            auto mid = lo + (hi - lo) / 2;
+            if (m_entries[mid].m_cap < cap){
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        return lo < count && m_entries[lo].m_cap == cap ? &m_entries[lo] : nullptr;
+    }
+
+    /// Whether the capability is in the table.
+    bool contains(CapType cap) const noexcept{
+        return cap == CapType::SupportedCaps || find(cap) != nullptr;
+    }
+
+    /// Supported actions of the capability.
+    MsgSupport support(CapType cap) const noexcept{
+        if (cap == CapType::SupportedCaps){
+            return msgSupportGetAll;
+        }
+
+        auto e = find(cap);
+        return e ? e->m_support : msgSupportEmpty;
+    }
+
+    /// Routes a capability operation.
+    /// \param source Data source instance.
+    /// \param msg Action to perform.
+    /// \param data Capability data.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the handler.
+    Result dispatch(Source& source, Msg msg, Capability& data) const{
+        auto cap = data.type();
+        if (msg == Msg::QuerySupport){
+            if (!contains(cap)){
+                return {ReturnCode::Failure, ConditionCode::CapUnsupported};
+            }
+
+            data = Capability::createOneValue(cap, support(cap));
+            return {};
+        }
+
+        if (cap == CapType::SupportedCaps){
+            return supportedCaps(msg, data);
+        }
+
+        auto e = find(cap);
+        if (!e){
+            return {ReturnCode::Failure, ConditionCode::CapUnsupported};
+        }
+
+        auto flag = msgFlag(msg);
+        if (flag == msgSupportEmpty || (e->m_support & flag) == msgSupportEmpty){
+            return {ReturnCode::Failure, ConditionCode::CapBadOperation};
+        }
+
+        if (msg == Msg::Set && data && data.itemType() != e->m_itemType){
+            return {ReturnCode::Failure, ConditionCode::BadValue};
+        }
+
+        return (source.*(e->m_handler))(msg, data);
+    }
+
+    /// Resets all capabilities that support Msg::Reset.
+    /// All capabilities are reset even if some of them fail.
+    /// \param source Data source instance.
+    /// \return CheckStatus if any capability could not be reset exactly, or the first failure.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the handler.
+    Result resetAll(Source& source) const{
+        Result ret;
+        for (const auto& e : m_entries){
+            if ((e.m_support & MsgSupport::Reset) != msgSupportEmpty){
+                Capability dummy(e.m_cap);
+                merge(ret, (source.*(e.m_handler))(Msg::Reset, dummy));
+            }
+        }
+
+        return ret;
+    }
+
+    /// Stores current values of all capabilities that support both Msg::GetCurrent and Msg::Set,
+    /// e.g. for `customDataGet`.
+    /// \param source Data source instance.
+    /// \param out Resulting snapshot data.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the handler.
+    Result snapshot(Source& source, CustomData& out) const{
+        CapabilitySnapshot snap;
+        auto flags = MsgSupport::GetCurrent | MsgSupport::Set;
+        for (const auto& e : m_entries){
+            if ((e.m_support & flags) == flags && e.m_itemType != Type::Handle){
+                Capability cap(e.m_cap);
+                if (Twpp::success((source.*(e.m_handler))(Msg::GetCurrent, cap))){
+                    snap.add(cap);
+                }
+            }
+        }
+
+        out = snap.save();
+        return {};
+    }
+
+    /// Sets capabilities from a snapshot created by `snapshot`, e.g. in `customDataSet`.
+    /// Capabilities not in the table are skipped.
+    /// \param source Data source instance.
+    /// \param data Snapshot data.
+    /// \return BadValue if the data is not a valid snapshot,
+    ///         CheckStatus if any capability could not be set exactly, or the first failure.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the handler.
+    Result restore(Source& source, const CustomData& data) const{
+        CapabilitySnapshot snap;
+        if (!snap.load(data)){
+            return {ReturnCode::Failure, ConditionCode::BadValue};
+        }
+
+        Result ret;
+        snap.restore([&](Capability& cap){
+            if (!contains(cap.type())){
+                return;
+            }
+
+            merge(ret, dispatch(source, Msg::Set, cap));
+        });
+
+        return ret;
+    }
+
+    const Entry* begin() const noexcept{
+        return m_entries.data();
+    }
+
+    const Entry* end() const noexcept{
+        return m_entries.data() + count;
+    }
+
+private:
+    // keeps the first failure, otherwise the first CheckStatus
+    static void merge(Result& ret, const Result& rc) noexcept{
+        if (!Twpp::success(rc)){
+            if (Twpp::success(ret)){
+                ret = rc;
+            }
+        } else if (rc.returnCode() == ReturnCode::CheckStatus && ret.returnCode() == ReturnCode::Success){
+            ret = rc;
+        }
+    }
+
+    Result supportedCaps(Msg msg, Capability& data) const{
+        switch (msg){
+            case Msg::Get:
+            case Msg::GetCurrent:
+            case Msg::GetDefault: {
+                bool hasSelf = find(CapType::SupportedCaps) != nullptr;
+                auto size = static_cast<UInt32>(hasSelf ? count : count + 1);
+                data = Capability::createArray<CapType::SupportedCaps>(size);
+
+                auto arr = data.array<CapType::SupportedCaps>();
+                UInt32 i = 0;
+                for (const auto& e : m_entries){
+                    arr[i++] = e.m_cap;
+                }
+
+                if (!hasSelf){
+                    arr[i] = CapType::SupportedCaps;
+                }
+
+                return {};
+            }
+
+            default:
+                return {ReturnCode::Failure, ConditionCode::CapBadOperation};
+        }
+    }
+
+    static MsgSupport msgFlag(Msg msg) noexcept{
+        switch (msg){
+            case Msg::Get: return MsgSupport::Get;
+            case Msg::GetCurrent: return MsgSupport::GetCurrent;
+            case Msg::GetDefault: return MsgSupport::GetDefault;
+            case Msg::Set: return MsgSupport::Set;
+            case Msg::SetConstraint: return MsgSupport::SetConstraint;
+            case Msg::Reset: return MsgSupport::Reset;
+            case Msg::GetHelp: return MsgSupport::GetHelp;
+            case Msg::GetLabel: return MsgSupport::GetLabel;
+            case Msg::GetLabelEnum: return MsgSupport::GetLabelEnum;
+            default: return msgSupportEmpty;
+        }
+    }
+
+    std::array<Entry, count> m_entries;
+
+};
+
+/// Creates a capability table from entries in any order.
+/// \tparam Source Data source class handling the capabilities.
+template<typename Source, typename... Entries>
+static inline CapabilityTable<Source, sizeof...(Entries)> makeCapabilityTable(Entries... entries) noexcept{
+    return CapabilityTable<Source, sizeof...(Entries)>(std::array<CapabilityEntry<Source>, sizeof...(Entries)>{{entries...}});
+}
+
+}
+
+#endif // TWPP_DETAIL_FILE_CAPABILITYTABLE_HPP
+
@@ -0,0 +1,300 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_CAPPROFILE_HPP
+#define TWPP_DETAIL_FILE_CAPPROFILE_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// A single OneValue setting of a capability profile.
+/// The value is checked against the data type of the capability at compile time.
+/// \tparam cap Capability type.
+template<CapType cap>
+class ProfileValue {
+
+public:
+    typedef typename Detail::Cap<cap>::DataType DataType;
+    static constexpr const CapType type = cap;
+    static constexpr const Type twty = Detail::Cap<cap>::twty;
+
+    constexpr explicit ProfileValue(const DataType& value) noexcept :
+        m_value(value){}
+
+    /// The requested value.
+    constexpr const DataType& value() const noexcept{
+        return m_value;
+    }
+
+private:
+    DataType m_value;
+
+};
+
+namespace Detail {
+
+/// Rank of the capability in the dependency-aware order of `Source::negotiate`,
+/// lower ranks are set first.
+static inline unsigned negotiationRank(CapType cap) noexcept{
+    switch (cap){
+        case CapType::IUnits:
+        case CapType::IXferMech:
+        case CapType::FeederEnabled:
+            return 0;
+
+        case CapType::IPixelType:
+        case CapType::ICompression:
+        case CapType::IImageFileFormat:
+        case CapType::AutoFeed:
+        case CapType::DuplexEnabled:
+            return 1;
+
+        case CapType::IBitDepth:
+        case CapType::IBitDepthReduction:
+        case CapType::IXResolution:
+        case CapType::IYResolution:
+        case CapType::ISupportedSizes:
+            return 2;
+
+        case CapType::XferCount:
+            return 4;
+
+        default:
+            return 3;
+    }
+}
+
+/// Stable order of capabilities by `negotiationRank`.
+/// \param typeOf Returns the capability type of an index.
+/// \param order Receives the indexes in negotiation order, `count` elements.
+/// \param count Number of capabilities.
+template<typename CapTypeOf>
+static inline void negotiationOrder(CapTypeOf typeOf, std::size_t* order, std::size_t count) noexcept{
+    for (std::size_t i = 0; i < count; i++){
+        order[i] = i;
+    }
+
+    // insertion sort, batches are small
+    for (std::size_t i = 1; i < count; i++){
+        auto idx = order[i];
+        auto rank = negotiationRank(typeOf(idx));
+        std::size_t j = i;
+        for ( ; j > 0 && negotiationRank(typeOf(order[j - 1])) > rank; j--){
+            order[j] = order[j - 1];
+        }
+
+        order[j] = idx;
+    }
+}
+
+template<typename... Values>
+class ProfileStorage;
+
+template<>
+class ProfileStorage<> {
+
+public:
+    constexpr ProfileStorage() noexcept{}
+
+    void create(Capability*) const noexcept{}
+
+    void matches(Capability*, bool*) const noexcept{}
+
+};
+
+template<typename Value, typename... Rest>
+class ProfileStorage<Value, Rest...> : public ProfileStorage<Rest...> {
+
+    typedef ProfileStorage<Rest...> Base;
+
+public:
+    constexpr ProfileStorage(const Value& value, const Rest&... rest) noexcept :
+        Base(rest...), m_value(value){}
+
+    /// \throw std::bad_alloc
+    void create(Capability* out) const{
+        *out = Capability::createOneValue<Value::type>(m_value.value());
+        Base::create(out + 1);
+    }
+
+    void matches(Capability* current, bool* out) const noexcept{
+        try {
+            *out = *current && current->currentItem<Value::type>() == m_value.value();
+        } catch (const CapabilityException&){
+            *out = false;
+        }
+
+        Base::matches(current + 1, out + 1);
+    }
+
+private:
+    Value m_value;
+
+};
+
+}
+
+template<typename... Values>
+class PreparedProfile;
+
+/// Fixed set of capability values, e.g. a scan preset, declared as a type.
+/// Profiles are literal types, and can be declared `constexpr`:
+///
+///     constexpr auto gray300 = makeProfile(
+///         ProfileValue<CapType::IPixelType>(PixelType::Gray),
+///         ProfileValue<CapType::IXResolution>(Fix32(300)),
+///         ProfileValue<CapType::DuplexEnabled>(true)
+///     );
+///
+/// Use `prepare` to build the TWAIN containers once,
+/// and `Source::applyProfile` to apply them for every job.
+/// \tparam Values ProfileValue types.
+template<typename... Values>
+class CapProfile {
+
+    template<typename...>
+    friend class PreparedProfile;
+
+public:
+    /// Number of capabilities in the profile.
+    static constexpr const std::size_t size = sizeof...(Values);
+
+    constexpr explicit CapProfile(const Values&... values) noexcept :
+        m_values(values...){}
+
+    /// Capability types of the profile, in declaration order.
+    static std::array<CapType, sizeof...(Values)> types() noexcept{
+        return {{Values::type...}};
+    }
+
+    /// Creates all TWAIN containers of this profile.
+    /// \throw std::bad_alloc
+    PreparedProfile<Values...> prepare() const{
+        return PreparedProfile<Values...>(*this);
+    }
+
+private:
+    Detail::ProfileStorage<Values...> m_values;
+
+};
+
+/// Creates a capability profile, see CapProfile.
+/// \param values Capability values.
+template<typename... Values>
+static constexpr inline CapProfile<Values...> makeProfile(const Values&... values) noexcept{
+    return CapProfile<Values...>(values...);
+}
+
+/// Capability profile with all its TWAIN containers allocated.
+/// The containers are created once, and are reused by every `Source::applyProfile`;
+/// current values read back are kept in a second, pre-sized set of capabilities.
+/// The negotiation order is computed once as well.
+/// \tparam Values ProfileValue types.
+template<typename... Values>
+class PreparedProfile {
+
+    friend class Source;
+
+public:
+    /// Number of capabilities in the profile.
+    static constexpr const std::size_t size = sizeof...(Values);
+
+    /// Creates all TWAIN containers of the profile.
+    /// \param profile Capability profile.
+    /// \throw std::bad_alloc
+    explicit PreparedProfile(const CapProfile<Values...>& profile) :
+        m_values(profile.m_values),
+        m_requests{{Capability(Values::type)...}},
+        m_current{{Capability(Values::type)...}}{
+
+        m_values.create(m_requests.data());
+
+        auto types = CapProfile<Values...>::types();
+        Detail::negotiationOrder([&types](std::size_t i){
+            return types[i];
+        }, m_order.data(), sizeof...(Values));
+    }
+
+    PreparedProfile(PreparedProfile&&) = default;
+    PreparedProfile& operator=(PreparedProfile&&) = default;
+
+    /// Whether the current value of the capability at `index`, read back by the
+    /// last verified `Source::applyProfile`, equals the profile value.
+    /// \param index Capability index, in declaration order.
+    bool matches(std::size_t index) const noexcept{
+        return m_matches[index];
+    }
+
+    /// Whether all current values read back by the last verified
+    /// `Source::applyProfile` equal the profile values.
+    bool matches() const noexcept{
+        return std::all_of(m_matches.begin(), m_matches.end(), [](bool match){
+            return match;
+        });
+    }
+
+    /// Current value of the capability at `index`, read back by the last verified
+    /// `Source::applyProfile`. Empty if it was not read.
+    /// \param index Capability index, in declaration order.
+    Capability& current(std::size_t index) noexcept{
+        return m_current[index];
+    }
+
+private:
+    Capability* requests() noexcept{
+        return m_requests.data();
+    }
+
+    void verify() noexcept{
+        m_values.matches(m_current.data(), m_matches.data());
+    }
+
+    void clearMatches() noexcept{
+        m_matches.fill(false);
+    }
+
+    static constexpr std::array<Type, sizeof...(Values)> itemTypes() noexcept{
+        return {{Values::twty...}};
+    }
+
+    // capability indexes in negotiation order
+    const std::size_t* order() const noexcept{
+        return m_order.data();
+    }
+
+    Detail::ProfileStorage<Values...> m_values;
+    std::array<Capability, sizeof...(Values)> m_requests;
+    std::array<Capability, sizeof...(Values)> m_current;
+    std::array<bool, sizeof...(Values)> m_matches = {};
+    std::array<std::size_t, sizeof...(Values)> m_order;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_CAPPROFILE_HPP
@@ -0,0 +1,308 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_CAPSNAPSHOT_HPP
+#define TWPP_DETAIL_FILE_CAPSNAPSHOT_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Contiguous binary snapshot of capabilities, e.g. for CapType::CustomDsData profiles.
+/// Containers are stored as they are laid out in their handles, so saving and restoring
+/// is a single copy per capability, without decoding any items.
+///
+/// Layout, native byte order:
+///     header:  "TWCS", UInt16 version, UInt16 byte order mark 0x0102, UInt32 count, UInt32 total size
+///     records: UInt16 CapType, UInt16 ConType, UInt32 size, container data padded to 4 bytes
+///
+/// Containers with Type::Handle items cannot be stored.
+/// Snapshots are meant to be restored by the source that created them, on the same platform.
+class CapabilitySnapshot {
+
+    enum : UInt32 {
+        HeaderSize = 16,
+        RecordHeaderSize = 8
+    };
+
+public:
+    enum : UInt16 {
+        /// Current version of the format.
+        Version = 1
+    };
+
+    /// Creates an empty snapshot.
+    /// \throw std::bad_alloc
+    CapabilitySnapshot(){
+        clear();
+    }
+
+    /// Removes all capabilities.
+    /// \throw std::bad_alloc
+    void clear(){
+        m_blob.assign(HeaderSize, '\0');
+        m_count = 0;
+        writeHeader();
+    }
+
+    /// Number of stored capabilities.
+    UInt32 size() const noexcept{
+        return m_count;
+    }
+
+    /// Whether there are no stored capabilities.
+    bool empty() const noexcept{
+        return m_count == 0;
+    }
+
+    /// Contents of the snapshot.
+    const char* data() const noexcept{
+        return m_blob.data();
+    }
+
+    /// Size of the snapshot in bytes.
+    UInt32 bytes() const noexcept{
+        return static_cast<UInt32>(m_blob.size());
+    }
+
+    /// Stores a copy of the capability container, empty capabilities are ignored.
+    /// \throw std::bad_alloc
+    /// \throw TypeException When the item type is Handle or invalid.
+    /// \throw ContainerException When the container type is invalid.
+    void add(const Capability& cap){
+        if (!cap){
+            return;
+        }
+
+        auto type = cap.itemType();
+        if (type == Type::Handle){
+            throw TypeException();
+        }
+
+        auto src = cap.m_cont.lock<const char>();
+        auto size = Capability::containerSize(cap.container(), type, src.data());
+
+        char header[RecordHeaderSize];
+        store(header, static_cast<UInt16>(cap.type()));
+        store(header + 2, static_cast<UInt16>(cap.container()));
+        store(header + 4, size);
+
+        m_blob.append(header, RecordHeaderSize);
+        m_blob.append(src.data(), size);
+        m_blob.append(padding(size), '\0');
+        m_count++;
+        writeHeader();
+    }
+
+    /// Creates custom data holding the snapshot, e.g. for `customDataGet`.
+    /// \throw std::bad_alloc
+    CustomData save() const{
+        CustomData out(bytes());
+        std::memcpy(out.lock<char>().data(), m_blob.data(), m_blob.size());
+        return out;
+    }
+
+    /// Replaces the contents by a saved snapshot.
+    /// The snapshot is left unchanged if the data is not valid.
+    /// \param data Snapshot data.
+    /// \param size Size in bytes.
+    /// \return Whether the data is a valid snapshot of this version and platform.
+    /// \throw std::bad_alloc
+    bool load(const void* data, UInt32 size){
+        UInt32 count;
+        if (!validate(static_cast<const char*>(data), size, count)){
+            return false;
+        }
+
+        m_blob.assign(static_cast<const char*>(data), size);
+        m_count = count;
+        return true;
+    }
+
+    /// Replaces the contents by a saved snapshot, e.g. in `customDataSet`.
+    /// \param data Custom data holding the snapshot.
+    /// \return Whether the data is a valid snapshot of this version and platform.
+    /// \throw std::bad_alloc
+    bool load(const CustomData& data){
+        if (data.size() == 0){
+            return false;
+        }
+
+        return load(data.lock<const char>().data(), data.size());
+    }
+
+    /// Restores all stored capabilities in the order they were added.
+    /// Each capability gets a freshly allocated container.
+    /// \param fn Called with every capability, e.g. to pass it to `Source::capability(Msg::Set, ...)`.
+    /// \throw std::bad_alloc
+    template<typename Fn>
+    void restore(Fn fn) const{
+        for (UInt32 i = 0, off = HeaderSize; i < m_count; i++){
+            UInt32 next;
+            Capability cap = record(off, next);
+            fn(cap);
+            off = next;
+        }
+    }
+
+    /// Restores a single stored capability.
+    /// \param type Capability type.
+    /// \return The capability, empty if not stored.
+    /// \throw std::bad_alloc
+    Capability find(CapType type) const{
+        for (UInt32 i = 0, off = HeaderSize; i < m_count; i++){
+            if (static_cast<CapType>(load16(m_blob.data() + off)) == type){
+                UInt32 next;
+                return record(off, next);
+            }
+
+            off += RecordHeaderSize + load32(m_blob.data() + off + 4);
+            off += padding(off);
+        }
+
+        return Capability(type);
+    }
+
+private:
+    static UInt32 padding(UInt32 size) noexcept{
+        return (4 - size % 4) % 4;
+    }
+
+    static void store(char* out, UInt16 value) noexcept{
+        std::memcpy(out, &value, sizeof(value));
+    }
+
+    static void store(char* out, UInt32 value) noexcept{
+        std::memcpy(out, &value, sizeof(value));
+    }
+
+    static UInt16 load16(const char* in) noexcept{
+        UInt16 value;
+        std::memcpy(&value, in, sizeof(value));
+        return value;
+    }
+
+    static UInt32 load32(const char* in) noexcept{
+        UInt32 value;
+        std::memcpy(&value, in, sizeof(value));
+        return value;
+    }
+
+    void writeHeader() noexcept{
+        auto out = &m_blob[0];
+        std::memcpy(out, "TWCS", 4);
+        store(out + 4, static_cast<UInt16>(Version));
+        store(out + 6, static_cast<UInt16>(0x0102));
+        store(out + 8, m_count);
+        store(out + 12, static_cast<UInt32>(m_blob.size()));
+    }
+
+    Capability record(UInt32 off, UInt32& next) const{
+        auto in = m_blob.data() + off;
+        auto size = load32(in + 4);
+        auto data = in + RecordHeaderSize;
+        Type type;
+        std::memcpy(&type, data, sizeof(type));
+
+        Capability cap(static_cast<CapType>(load16(in)), static_cast<ConType>(load16(in + 2)), type, size);
+        std::memcpy(cap.m_cont.lock<char>().data(), data, size);
+
+        next = off + RecordHeaderSize + size;
+        next += padding(next);
+        return cap;
+    }
+
+    static bool validate(const char* in, UInt32 size, UInt32& count) noexcept{
+        if (size < HeaderSize || std::memcmp(in, "TWCS", 4) != 0 || load16(in + 4) != Version ||
+                load16(in + 6) != 0x0102 || load32(in + 12) != size){
+            return false;
+        }
+
+        count = load32(in + 8);
+        UInt32 off = HeaderSize;
+        for (UInt32 i = 0; i < count; i++){
+            if (size - off < RecordHeaderSize){
+                return false;
+            }
+
+            auto con = static_cast<ConType>(load16(in + off + 2));
+            auto len = load32(in + off + 4);
+            off += RecordHeaderSize;
+            if (size - off < len || len < Capability::containerHeaderSize(con) || !validSize(con, in + off, len)){
+                return false;
+            }
+
+            off += len;
+            off += padding(off);
+            if (off > size){
+                return false;
+            }
+        }
+
+        return off == size;
+    }
+
+    static bool validSize(ConType con, const char* in, UInt32 len) noexcept{
+        Type type;
+        std::memcpy(&type, in, sizeof(type));
+        if (type == Type::Handle){
+            return false;
+        }
+
+        try {
+            std::uint64_t items = 1;
+            if (con == ConType::Array || con == ConType::Enumeration){
+                items = load32(in + sizeof(Type));
+            }
+
+            // computed in 64 bits, an overflowing item count must not match
+            auto item = typeSize(type);
+            switch (con){
+                case ConType::OneValue:
+                case ConType::Range:
+                    return Capability::containerSize(con, type, in) == len;
+
+                case ConType::Array:
+                case ConType::Enumeration:
+                    return Capability::containerHeaderSize(con) + items * item == len;
+
+                default:
+                    return false;
+            }
+        } catch (...){
+            return false;
+        }
+    }
+
+    std::string m_blob;
+    UInt32 m_count;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_CAPSNAPSHOT_HPP
@@ -0,0 +1,679 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_COLORTRANSFORM_HPP
+#define TWPP_DETAIL_FILE_COLORTRANSFORM_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+static inline UInt32 iccBe16(const UInt8* p) noexcept{
+    return static_cast<UInt32>(p[0]) << 8 | p[1];
+}
+
+static inline UInt32 iccBe32(const UInt8* p) noexcept{
+    return static_cast<UInt32>(p[0]) << 24 | static_cast<UInt32>(p[1]) << 16 | static_cast<UInt32>(p[2]) << 8 | p[3];
+}
+
+static inline float iccS15Fixed16(const UInt8* p) noexcept{
+    return static_cast<float>(static_cast<Int32>(iccBe32(p))) / 65536.0f;
+}
+
+static constexpr inline UInt32 iccSig(char a, char b, char c, char d) noexcept{
+    return static_cast<UInt32>(static_cast<UInt8>(a)) << 24 | static_cast<UInt32>(static_cast<UInt8>(b)) << 16 |
+            static_cast<UInt32>(static_cast<UInt8>(c)) << 8 | static_cast<UInt8>(d);
+}
+
+/// Tone reproduction curve of an ICC profile, `curv` or `para` tag.
+class IccCurve {
+
+public:
+    IccCurve() noexcept :
+        m_type(-1), m_params{1.0f}, m_count(0){}
+
+    /// Parses the curve tag.
+    /// \return Whether the tag is a valid curve.
+    /// \throw std::bad_alloc
+    bool parse(const UInt8* tag, UInt32 size){
+        if (size < 12){
+            return false;
+        }
+
+        auto sig = iccBe32(tag);
+        if (sig == iccSig('c', 'u', 'r', 'v')){
+            auto count = iccBe32(tag + 8);
+            if (count > (size - 12) / 2){
+                return false;
+            }
+
+            if (count == 0){
+                m_type = 0;
+                m_params[0] = 1.0f;
+            } else if (count == 1){
+                m_type = 0;
+                m_params[0] = static_cast<float>(iccBe16(tag + 12)) / 256.0f;
+            } else {
+                m_type = 5;
+                m_count = count;
+                m_table.reset(new UInt16[count]);
+                for (UInt32 i = 0; i < count; i++){
+                    m_table[i] = static_cast<UInt16>(iccBe16(tag + 12 + 2 * i));
+                }
+            }
+
+            return true;
+        }
+
+        if (sig == iccSig('p', 'a', 'r', 'a')){
+            static const UInt32 paramCounts[5] = {1, 3, 4, 5, 7};
+            auto type = iccBe16(tag + 8);
+            if (type > 4 || size < 12 + 4 * paramCounts[type]){
+                return false;
+            }
+
+            m_type = static_cast<int>(type);
+            for (UInt32 i = 0; i < paramCounts[type]; i++){
+                m_params[i] = iccS15Fixed16(tag + 12 + 4 * i);
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /// Evaluates the curve.
+    /// \param x Device value, 0 to 1.
+    /// \return Linear value, 0 to 1.
+    float operator()(float x) const noexcept{
+        const auto& p = m_params;
+        float y;
+        switch (m_type){
+            case 0:
+                y = gamma(x, p[0]);
+                break;
+
+            case 1:
+                y = x >= -p[2] / p[1] ? gamma(p[1] * x + p[2], p[0]) : 0.0f;
+                break;
+
+            case 2:
+                y = x >= -p[2] / p[1] ? gamma(p[1] * x + p[2], p[0]) + p[3] : p[3];
+                break;
+
+            case 3:
+                y = x >= p[4] ? gamma(p[1] * x + p[2], p[0]) : p[3] * x;
+                break;
+
+            case 4:
+                y = x >= p[4] ? gamma(p[1] * x + p[2], p[0]) + p[5] : p[3] * x + p[6];
+                break;
+
+            case 5: {
+                auto pos = x * static_cast<float>(m_count - 1);
+                auto i = static_cast<UInt32>(pos);
+                if (i >= m_count - 1){
+                    y = m_table[m_count - 1] / 65535.0f;
+                } else {
+                    auto t = pos - static_cast<float>(i);
+                    y = (m_table[i] + t * (static_cast<float>(m_table[i + 1]) - m_table[i])) / 65535.0f;
+                }
+
+                break;
+            }
+
+            default:
+                y = x;
+                break;
+        }
+
+        return y > 0.0f ? (y < 1.0f ? y : 1.0f) : 0.0f;
+    }
+
+private:
+    static float gamma(float x, float g) noexcept{
+        return x > 0.0f ? std::pow(x, g) : 0.0f;
+    }
+
+    int m_type;
+    float m_params[7];
+    UInt32 m_count;
+    std::unique_ptr<UInt16[]> m_table;
+
+};
+
+/// RGB matrix/TRC ICC profile, converts device RGB to PCS XYZ.
+class IccMatrixProfile {
+
+public:
+    /// Parses the profile.
+    /// \return Whether the data is an RGB profile with XYZ colorants and curves.
+    /// \throw std::bad_alloc
+    bool parse(const void* data, UInt32 size){
+        auto p = static_cast<const UInt8*>(data);
+        if (size < 132){
+            return false;
+        }
+
+        auto total = std::min(iccBe32(p), size);
+        if (total < 132 || iccBe32(p + 36) != iccSig('a', 'c', 's', 'p') ||
+                iccBe32(p + 16) != iccSig('R', 'G', 'B', ' ') || iccBe32(p + 20) != iccSig('X', 'Y', 'Z', ' ')){
+            return false;
+        }
+
+        auto count = iccBe32(p + 128);
+        if (count > (total - 132) / 12){
+            return false;
+        }
+
+        static const UInt32 colorants[3] = {
+            iccSig('r', 'X', 'Y', 'Z'), iccSig('g', 'X', 'Y', 'Z'), iccSig('b', 'X', 'Y', 'Z')
+        };
+        static const UInt32 curves[3] = {
+            iccSig('r', 'T', 'R', 'C'), iccSig('g', 'T', 'R', 'C'), iccSig('b', 'T', 'R', 'C')
+        };
+
+        for (int c = 0; c < 3; c++){
+            UInt32 tagSize;
+            auto tag = findTag(p, total, count, colorants[c], tagSize);
+            if (!tag || tagSize < 20 || iccBe32(tag) != iccSig('X', 'Y', 'Z', ' ')){
+                return false;
+            }
+
+            for (int r = 0; r < 3; r++){
+                m_matrix[r][c] = iccS15Fixed16(tag + 8 + 4 * r);
+            }
+
+            tag = findTag(p, total, count, curves[c], tagSize);
+            if (!tag || !m_trc[c].parse(tag, tagSize)){
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Converts device RGB to PCS XYZ, D50.
+    void operator()(const float rgb[3], float xyz[3]) const noexcept{
+        float lin[3] = {m_trc[0](rgb[0]), m_trc[1](rgb[1]), m_trc[2](rgb[2])};
+        for (int r = 0; r < 3; r++){
+            xyz[r] = m_matrix[r][0] * lin[0] + m_matrix[r][1] * lin[1] + m_matrix[r][2] * lin[2];
+        }
+    }
+
+private:
+    static const UInt8* findTag(const UInt8* p, UInt32 total, UInt32 count, UInt32 sig, UInt32& size) noexcept{
+        for (UInt32 i = 0; i < count; i++){
+            auto entry = p + 132 + 12 * i;
+            if (iccBe32(entry) == sig){
+                auto off = iccBe32(entry + 4);
+                size = iccBe32(entry + 8);
+                if (off > total || size > total - off){
+                    return nullptr;
+                }
+
+                return p + off;
+            }
+        }
+
+        return nullptr;
+    }
+
+    float m_matrix[3][3];
+    IccCurve m_trc[3];
+
+};
+
+/// Converts PCS XYZ, D50, to gamma encoded sRGB.
+static inline void xyzD50ToSrgb(const float xyz[3], float rgb[3]) noexcept{
+    // Bradford adapted D50 to sRGB D65 matrix
+    static const float m[3][3] = {
+        { 3.1338561f, -1.6168667f, -0.4906146f},
+        {-0.9787684f,  1.9161415f,  0.0334540f},
+        { 0.0719453f, -0.2289914f,  1.4052427f}
+    };
+
+    for (int r = 0; r < 3; r++){
+        auto v = m[r][0] * xyz[0] + m[r][1] * xyz[1] + m[r][2] * xyz[2];
+        v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+        rgb[r] = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+    }
+}
+
+}
+
+/// Colour transform of 24-bit RGB pixels, precomputed into a 3D lookup table.
+/// The table is built once from any conversion, e.g. an ICC profile, and applied with
+/// tetrahedral interpolation, so a pixel costs four table reads regardless of the conversion.
+///
+/// Only ICC profiles of the RGB matrix/TRC kind are parsed, see `buildIccProfile`.
+/// CieColor data is not interpreted, pass a conversion built from it to `build`.
+///
+/// Table nodes pack three 10-bit channels, AVX2 gathers all channels of a node at once.
+/// Other instruction sets use the scalar code, there are no gathers to vectorize it with.
+class ColorTransform {
+
+public:
+    enum : UInt32 {
+        /// Default number of table nodes along each axis.
+        DefaultGridSize = 17,
+
+        /// Maximal number of table nodes along each axis.
+        MaxGridSize = 65
+    };
+
+    /// Creates an identity transform.
+    /// \throw std::bad_alloc
+    ColorTransform(){
+        build([](const float in[3], float out[3]){
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }, 2);
+    }
+
+    /// Builds the table by sampling a conversion.
+    /// \param fn Conversion `void(const float in[3], float out[3])`, RGB values 0 to 1.
+    /// \param gridSize Number of table nodes along each axis, 2 to MaxGridSize.
+    /// \throw std::bad_alloc
+    template<typename Fn>
+    void build(Fn fn, UInt32 gridSize = DefaultGridSize){
+        gridSize = std::max<UInt32>(2, std::min<UInt32>(gridSize, MaxGridSize));
+        std::unique_ptr<UInt32[]> nodes(new UInt32[gridSize * gridSize * gridSize]);
+
+        auto scale = 1.0f / static_cast<float>(gridSize - 1);
+        UInt32 n = 0;
+        for (UInt32 r = 0; r < gridSize; r++){
+            for (UInt32 g = 0; g < gridSize; g++){
+                for (UInt32 b = 0; b < gridSize; b++){
+                    float in[3] = {r * scale, g * scale, b * scale};
+                    float out[3] = {0.0f, 0.0f, 0.0f};
+                    fn(in, out);
+                    nodes[n++] = node(out[0]) | node(out[1]) << 10 | node(out[2]) << 20;
+                }
+            }
+        }
+
+        // per channel value: node offset along the axis << 9 | fraction 0 to 256
+        for (UInt32 v = 0; v < 256; v++){
+            auto pos = v * (gridSize - 1) * 256 / 255;
+            auto idx = pos >> 8;
+            auto frac = pos & 0xFF;
+            if (idx == gridSize - 1){
+                idx--;
+                frac = 256;
+            }
+
+            m_axis[0][v] = idx * gridSize * gridSize << 9 | frac;
+            m_axis[1][v] = idx * gridSize << 9 | frac;
+            m_axis[2][v] = idx << 9 | frac;
+        }
+
+        m_nodes = std::move(nodes);
+        m_grid = gridSize;
+    }
+
+    /// Builds the table from an RGB matrix/TRC ICC profile, converting to sRGB.
+    /// \param profile Profile data, e.g. from `Source::iccProfile`.
+    /// \param size Size of the data in bytes.
+    /// \param gridSize Number of table nodes along each axis.
+    /// \return Whether the profile is supported, the transform is unchanged otherwise.
+    /// \throw std::bad_alloc
+    bool buildIccProfile(const void* profile, UInt32 size, UInt32 gridSize = DefaultGridSize){
+        Detail::IccMatrixProfile icc;
+        if (!icc.parse(profile, size)){
+            return false;
+        }
+
+        build([&icc](const float in[3], float out[3]){
+            float xyz[3];
+            icc(in, xyz);
+            Detail::xyzD50ToSrgb(xyz, out);
+        }, gridSize);
+
+        return true;
+    }
+
+    /// Number of table nodes along each axis.
+    UInt32 gridSize() const noexcept{
+        return m_grid;
+    }
+
+    /// Transforms 24-bit RGB pixels.
+    /// Source and destination may be the same buffer, otherwise they must not overlap.
+    /// \param src Source pixels.
+    /// \param dst Destination pixels.
+    /// \param pixels Number of pixels.
+    void apply(const UInt8* src, UInt8* dst, UInt32 pixels) const noexcept{
+        UInt32 i = 0;
+#if defined(TWPP_DETAIL_SIMD_AVX2)
+        i = applyAvx2(src, dst, pixels);
+#endif
+        for (; i < pixels; i++){
+            interpolate(src + 3 * i, dst + 3 * i);
+        }
+    }
+
+    /// Transforms rows of 24-bit RGB pixels in place.
+    /// \param data First row.
+    /// \param bytesPerRow Row stride in bytes.
+    /// \param width Number of pixels in a row.
+    /// \param rows Number of rows.
+    void apply(UInt8* data, UInt32 bytesPerRow, UInt32 width, UInt32 rows) const noexcept{
+        for (UInt32 r = 0; r < rows; r++){
+            auto row = data + static_cast<std::size_t>(r) * bytesPerRow;
+            apply(row, row, width);
+        }
+    }
+
+    /// Transforms an uncompressed 24-bit RGB strip in place.
+    /// \param strip Memory transfer strip.
+    /// \param info Image layout, must be chunky RGB with 8 bits per sample.
+    /// \return Whether the strip was transformed; compressed strips,
+    ///         other layouts and strips exceeding their memory are not.
+    bool apply(ImageMemXfer& strip, const ImageInfo& info) const noexcept{
+        if (strip.compression() != Compression::None || info.pixelType() != PixelType::Rgb ||
+                info.samplesPerPixel() != 3 || info.bitsPerPixel() != 24 || info.planar()){
+            return false;
+        }
+
+        for (UInt32 i = 0; i < 3; i++){
+            if (info.bitsPerSample()[i] != 8 && info.bitsPerSample()[i] != 0){
+                return false;
+            }
+        }
+
+        if (strip.bytesPerRow() < 3ull * strip.columns() ||
+                static_cast<std::uint64_t>(strip.rows()) * strip.bytesPerRow() > strip.memory().size()){
+            return false;
+        }
+
+        auto lock = strip.memory().data();
+        apply(reinterpret_cast<UInt8*>(lock.data()), strip.bytesPerRow(), strip.columns(), strip.rows());
+        return true;
+    }
+
+private:
+    static UInt32 node(float v) noexcept{
+        // also maps NaN to zero
+        v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+        return static_cast<UInt32>(v * 1020.0f + 0.5f);
+    }
+
+    void interpolate(const UInt8* in, UInt8* out) const noexcept{
+        auto ar = m_axis[0][in[0]];
+        auto ag = m_axis[1][in[1]];
+        auto ab = m_axis[2][in[2]];
+        auto base = (ar >> 9) + (ag >> 9) + (ab >> 9);
+        Int32 fr = ar & 0x1FF;
+        Int32 fg = ag & 0x1FF;
+        Int32 fb = ab & 0x1FF;
+
+        // tetrahedron walks from the base node along axes by decreasing fraction
+        UInt32 sr = m_grid * m_grid;
+        UInt32 sg = m_grid;
+        UInt32 sb = 1;
+        auto geRg = fr >= fg;
+        auto geRb = fr >= fb;
+        auto geGb = fg >= fb;
+        UInt32 sMax = geRg && geRb ? sr : (!geRg && geGb ? sg : sb);
+        UInt32 sMin = geRb && geGb ? sb : (!geRg && !geRb ? sr : sg);
+        auto f1 = std::max(fr, std::max(fg, fb));
+        auto f3 = std::min(fr, std::min(fg, fb));
+        auto f2 = fr + fg + fb - f1 - f3;
+
+        auto sum = sr + sg + sb;
+        auto n0 = m_nodes[base];
+        auto n1 = m_nodes[base + sMax];
+        auto n2 = m_nodes[base + sum - sMin];
+        auto n3 = m_nodes[base + sum];
+        for (int c = 0; c < 3; c++){
+            auto shift = 10 * c;
+            Int32 c0 = (n0 >> shift) & 0x3FF;
+            Int32 c1 = (n1 >> shift) & 0x3FF;
+            Int32 c2 = (n2 >> shift) & 0x3FF;
+            Int32 c3 = (n3 >> shift) & 0x3FF;
+            auto acc = c0 * 256 + f1 * (c1 - c0) + f2 * (c2 - c1) + f3 * (c3 - c2);
+            out[c] = static_cast<UInt8>((acc + 512) >> 10);
+        }
+    }
+
+#if defined(TWPP_DETAIL_SIMD_AVX2)
+    UInt32 applyAvx2(const UInt8* src, UInt8* dst, UInt32 pixels) const noexcept{
+        auto nodes = reinterpret_cast<const int*>(m_nodes.get());
+        auto sr = _mm256_set1_epi32(static_cast<int>(m_grid * m_grid));
+        auto sg = _mm256_set1_epi32(static_cast<int>(m_grid));
+        auto sb = _mm256_set1_epi32(1);
+        auto sum = _mm256_set1_epi32(static_cast<int>(m_grid * m_grid + m_grid + 1));
+        auto fracMask = _mm256_set1_epi32(0x1FF);
+        auto chMask = _mm256_set1_epi32(0x3FF);
+        auto round = _mm256_set1_epi32(512);
+
+        UInt32 i = 0;
+        for (; i + 8 <= pixels; i += 8){
+            alignas(32) Int32 idx[3][8];
+            auto in = src + 3 * i;
+            for (int p = 0; p < 8; p++){
+                idx[0][p] = in[3 * p];
+                idx[1][p] = in[3 * p + 1];
+                idx[2][p] = in[3 * p + 2];
+            }
+
+            auto ar = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_axis[0]), _mm256_load_si256(reinterpret_cast<const __m256i*>(idx[0])), 4);
+            auto ag = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_axis[1]), _mm256_load_si256(reinterpret_cast<const __m256i*>(idx[1])), 4);
+            auto ab = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_axis[2]), _mm256_load_si256(reinterpret_cast<const __m256i*>(idx[2])), 4);
+            auto base = _mm256_add_epi32(_mm256_add_epi32(_mm256_srli_epi32(ar, 9), _mm256_srli_epi32(ag, 9)), _mm256_srli_epi32(ab, 9));
+            auto fr = _mm256_and_si256(ar, fracMask);
+            auto fg = _mm256_and_si256(ag, fracMask);
+            auto fb = _mm256_and_si256(ab, fracMask);
+
+            // masks of "greater or equal" as negated "less than"
+            auto ltRg = _mm256_cmpgt_epi32(fg, fr);
+            auto ltRb = _mm256_cmpgt_epi32(fb, fr);
+            auto ltGb = _mm256_cmpgt_epi32(fb, fg);
+            auto maxR = _mm256_andnot_si256(_mm256_or_si256(ltRg, ltRb), _mm256_set1_epi32(-1));
+            auto maxG = _mm256_andnot_si256(ltGb, ltRg);
+            auto minB = _mm256_andnot_si256(_mm256_or_si256(ltRb, ltGb), _mm256_set1_epi32(-1));
+            auto minR = _mm256_and_si256(ltRg, ltRb);
+            auto sMax = _mm256_blendv_epi8(_mm256_blendv_epi8(sb, sg, maxG), sr, maxR);
+            auto sMin = _mm256_blendv_epi8(_mm256_blendv_epi8(sg, sr, minR), sb, minB);
+
+            auto f1 = _mm256_max_epi32(fr, _mm256_max_epi32(fg, fb));
+            auto f3 = _mm256_min_epi32(fr, _mm256_min_epi32(fg, fb));
+            auto f2 = _mm256_sub_epi32(_mm256_add_epi32(fr, _mm256_add_epi32(fg, fb)), _mm256_add_epi32(f1, f3));
+
+            auto n0 = _mm256_i32gather_epi32(nodes, base, 4);
+            auto n1 = _mm256_i32gather_epi32(nodes, _mm256_add_epi32(base, sMax), 4);
+            auto n2 = _mm256_i32gather_epi32(nodes, _mm256_sub_epi32(_mm256_add_epi32(base, sum), sMin), 4);
+            auto n3 = _mm256_i32gather_epi32(nodes, _mm256_add_epi32(base, sum), 4);
+
+            alignas(32) Int32 res[3][8];
+            for (int c = 0; c < 3; c++){
+                auto shift = _mm_cvtsi32_si128(10 * c);
+                auto c0 = _mm256_and_si256(_mm256_srl_epi32(n0, shift), chMask);
+                auto c1 = _mm256_and_si256(_mm256_srl_epi32(n1, shift), chMask);
+                auto c2 = _mm256_and_si256(_mm256_srl_epi32(n2, shift), chMask);
+                auto c3 = _mm256_and_si256(_mm256_srl_epi32(n3, shift), chMask);
+                auto acc = _mm256_slli_epi32(c0, 8);
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(f1, _mm256_sub_epi32(c1, c0)));
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(f2, _mm256_sub_epi32(c2, c1)));
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(f3, _mm256_sub_epi32(c3, c2)));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(res[c]), _mm256_srli_epi32(_mm256_add_epi32(acc, round), 10));
+            }
+
+            auto out = dst + 3 * i;
+            for (int p = 0; p < 8; p++){
+                out[3 * p] = static_cast<UInt8>(res[0][p]);
+                out[3 * p + 1] = static_cast<UInt8>(res[1][p]);
+                out[3 * p + 2] = static_cast<UInt8>(res[2][p]);
+            }
+        }
+
+        return i;
+    }
+#endif
+
+    std::unique_ptr<UInt32[]> m_nodes;
+    UInt32 m_grid;
+    UInt32 m_axis[3][256];
+
+};
+
+/// Cache of colour transforms keyed by profile content.
+/// Sources usually send the same profile with every page, the transform is built
+/// for the first page only and shared afterwards. Unsupported profiles are cached
+/// as well, so they are not parsed again either.
+///
+///     auto xform = cache.iccProfile(profile); // IccProfileMemory from Source::iccProfile
+///     if (xform){
+///         xform->apply(strip);
+///     }
+///
+/// The least recently used transforms are dropped once the capacity is reached.
+/// Thread-safe, transforms are built outside of the lock.
+class ColorTransformCache {
+
+public:
+    typedef std::shared_ptr<const ColorTransform> Transform;
+
+    /// Creates an empty cache.
+    /// \param capacity Maximal number of cached transforms.
+    /// \param gridSize Number of table nodes along each axis of new transforms.
+    explicit ColorTransformCache(UInt32 capacity = 8, UInt32 gridSize = ColorTransform::DefaultGridSize) noexcept :
+        m_capacity(std::max<UInt32>(capacity, 1)), m_grid(gridSize), m_hits(0), m_misses(0){}
+
+    /// Transform of an ICC profile.
+    /// \param profile Profile data.
+    /// \param size Size of the data in bytes.
+    /// \return The transform, null if the profile is not supported.
+    /// \throw std::bad_alloc
+    Transform iccProfile(const void* profile, UInt32 size){
+        auto grid = m_grid;
+        return transform(profile, size, [profile, size, grid](ColorTransform& xform){
+            return xform.buildIccProfile(profile, size, grid);
+        });
+    }
+
+    /// Transform of an ICC profile.
+    /// \param profile Profile memory, e.g. from `Source::iccProfile`.
+    /// \return The transform, null if the profile is not supported.
+    /// \throw std::bad_alloc
+    Transform iccProfile(const IccProfileMemory& profile){
+        if (profile.size() == 0){
+            return Transform();
+        }
+
+        auto lock = profile.data();
+        return iccProfile(lock.data(), profile.size());
+    }
+
+    /// Transform for arbitrary key data, e.g. CIE colour parameters.
+    /// \param key Data identifying the transform.
+    /// \param size Size of the key in bytes.
+    /// \param build Called on cache miss, `bool(ColorTransform&)`, returns whether the transform was built.
+    /// \return The transform, null if it could not be built.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the build function.
+    template<typename Fn>
+    Transform transform(const void* key, UInt32 size, Fn build){
+        auto data = static_cast<const char*>(key);
+        auto hash = Detail::strHash(data, size);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it){
+                if (it->m_hash == hash && it->m_key.size() == size && std::memcmp(it->m_key.data(), data, size) == 0){
+                    m_entries.splice(m_entries.begin(), m_entries, it);
+                    m_hits++;
+                    return it->m_transform;
+                }
+            }
+
+            m_misses++;
+        }
+
+        std::shared_ptr<ColorTransform> xform(new ColorTransform());
+        Transform result;
+        if (build(*xform)){
+            result = std::move(xform);
+        }
+
+        Entry entry{hash, std::string(data, size), result};
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.push_front(std::move(entry));
+        while (m_entries.size() > m_capacity){
+            m_entries.pop_back();
+        }
+
+        return result;
+    }
+
+    /// Number of cached transforms.
+    UInt32 size() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<UInt32>(m_entries.size());
+    }
+
+    /// Number of lookups served from the cache.
+    std::uint64_t hits() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    /// Number of lookups that built a transform.
+    std::uint64_t misses() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+    /// Drops all cached transforms, transforms in use stay valid.
+    void clear(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+
+private:
+    struct Entry {
+        std::uint64_t m_hash;
+        std::string m_key;
+        Transform m_transform;
+    };
+
+    mutable std::mutex m_mutex;
+    std::list<Entry> m_entries;
+    UInt32 m_capacity;
+    UInt32 m_grid;
+    std::uint64_t m_hits;
+    std::uint64_t m_misses;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_COLORTRANSFORM_HPP
@@ -75,6 +75,7 @@ private:
 }
 
 /// Rgb response class.
+/// Use `applyResponse` to map image data through the curve.
 class RgbResponse : public Detail::CurveResponse {
 
 public:
@@ -93,6 +94,7 @@ public:
 };
 
 /// Gray response class.
+/// Use `applyResponse` to map image data through the curve.
 class GrayResponse : public Detail::CurveResponse {
 
 public:
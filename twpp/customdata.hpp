@@ -51,7 +51,7 @@ public:
     /// Locks and returns pointer to custom data memory.
     template<typename T = void>
     Data<T> lock() const noexcept{
-        return Data<T>(m_handle);
+        return m_handle.lock<T>();
     }
 
     /// The size of contained memory block.
@@ -40,9 +40,103 @@ struct AppCapability {
     ConType m_conType;
     Handle m_cont;
 
+};
+
+struct AppMemory {
+
+    UInt32 m_flags;
+    UInt32 m_size;
+    void* m_data;
+
+};
+
+struct AppCustomData {
+
+    UInt32 m_size;
+    Handle m_handle;
+
+};
+
+struct AppStatusUtf8 {
+
+    Status m_status;
+    UInt32 m_size;
+    Handle m_string;
+
 };
 TWPP_DETAIL_PACK_END
 
+static inline void disownMemory(Memory& memory) noexcept{
+    auto& mem = reinterpret_cast<AppMemory&>(memory);
+    if (mem.m_flags & Flags::Handle){
+        disown(Handle(static_cast<Handle::Raw>(mem.m_data)));
+    }
+}
+
+/// Disowns every handle the source has placed into a structure of the application,
+/// such handles are freed by the application, and must not stay in the handle pool.
+/// \param dat Type of the structure.
+/// \param data The structure.
+static inline void handOver(Dat dat, void* data) noexcept{
+    switch (dat){
+        case Dat::Capability:
+            disown(static_cast<AppCapability*>(data)->m_cont);
+            break;
+
+        case Dat::ImageNativeXfer:
+        case Dat::AudioNativeXfer:
+            disown(*static_cast<Handle*>(data));
+            break;
+
+        case Dat::CustomData:
+            disown(static_cast<AppCustomData*>(data)->m_handle);
+            break;
+
+        case Dat::StatusUtf8:
+            disown(static_cast<AppStatusUtf8*>(data)->m_string);
+            break;
+
+        case Dat::IccProfile:
+            disownMemory(*static_cast<IccProfileMemory*>(data));
+            break;
+
+        case Dat::ImageMemXfer:
+            disownMemory(static_cast<ImageMemXfer*>(data)->memory());
+            break;
+
+        case Dat::ImageMemFileXfer:
+            disownMemory(static_cast<ImageMemFileXfer*>(data)->memory());
+            break;
+
+        case Dat::JpegCompression: {
+            auto& jpeg = *static_cast<JpegCompression*>(data);
+            for (auto& table : jpeg.quantTable()){
+                disownMemory(table);
+            }
+
+            for (auto& table : jpeg.huffmanDc()){
+                disownMemory(table);
+            }
+
+            for (auto& table : jpeg.huffmanAc()){
+                disownMemory(table);
+            }
+
+            break;
+        }
+
+        case Dat::ExtImageInfo:
+            for (auto& info : reinterpret_cast<ExtImageInfo&>(data)){
+                disownInfo(info);
+            }
+
+            break;
+
+        default:
+            break;
+    }
+}
+
 struct DoNotFreeHandle {
 
     DoNotFreeHandle(Handle handle){
@@ -119,6 +213,869 @@ static constexpr inline bool success(const Result& res) noexcept{
     return success(res.returnCode());
 }
 
+/// Ring of native transfer handles allocated ahead of time.
+/// The data source builds each page directly inside a handle taken from the ring,
+/// and passes it to the application without any staging copy.
+/// Handles taken from the ring are owned by the application once transferred,
+/// the ring must be refilled (possibly from device thread) before the next page.
+/// Thread-safe.
+class ImageNativeXferRing {
+
+public:
+    /// Creates an empty ring without any handles.
+    ImageNativeXferRing() noexcept :
+        m_pageSize(0), m_depth(0), m_head(0), m_count(0){}
+
+    /// Creates a ring and allocates its handles.
+    /// \param pageSize Size of each handle in bytes.
+    /// \param depth Number of handles kept ready.
+    /// \throw std::bad_alloc
+    ImageNativeXferRing(UInt32 pageSize, UInt32 depth) :
+        ImageNativeXferRing(){
+
+        reserve(pageSize, depth);
+    }
+
+    ImageNativeXferRing(const ImageNativeXferRing&) = delete;
+    ImageNativeXferRing& operator=(const ImageNativeXferRing&) = delete;
+
+    /// Changes size of handles and number of handles kept ready, and refills the ring.
+    /// Ready handles of different size are freed.
+    /// \param pageSize Size of each handle in bytes.
+    /// \param depth Number of handles kept ready.
+    /// \throw std::bad_alloc
+    void reserve(UInt32 pageSize, UInt32 depth){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (pageSize != m_pageSize || depth != m_depth){
+            std::unique_ptr<Detail::UniqueHandle[]> handles(depth ? new Detail::UniqueHandle[depth] : nullptr);
+            UInt32 count = 0;
+            if (pageSize == m_pageSize){
+                for ( ; count < m_count && count < depth; count++){
+                    handles[count] = std::move(m_handles[(m_head + count) % m_depth]);
+                }
+            }
+
+            m_handles = std::move(handles);
+            m_pageSize = pageSize;
+            m_depth = depth;
+            m_head = 0;
+            m_count = count;
+        }
+
+        lock.unlock();
+        refill();
+    }
+
+    /// Allocates missing handles, so that `depth` handles are ready.
+    /// Memory functions are not called while holding the internal lock.
+    /// \throw std::bad_alloc
+    void refill(){
+        for (;;){
+            UInt32 pageSize;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_count >= m_depth){
+                    return;
+                }
+
+                pageSize = m_pageSize;
+            }
+
+            Detail::UniqueHandle handle(Detail::alloc(pageSize));
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pageSize != pageSize || m_count >= m_depth){
+                continue; // reserved concurrently, drop the handle
+            }
+
+            m_handles[(m_head + m_count) % m_depth] = std::move(handle);
+            m_count++;
+        }
+    }
+
+    /// Takes a ready handle out of the ring.
+    /// Falls back to a new allocation if the ring is empty,
+    /// or the requested size exceeds size of the ring handles.
+    /// \param size Minimal size of the data in bytes.
+    /// \throw std::bad_alloc
+    ImageNativeXfer take(UInt32 size){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_count != 0 && size <= m_pageSize){
+                auto handle = m_handles[m_head].release();
+                m_head = (m_head + 1) % m_depth;
+                m_count--;
+                return ImageNativeXfer(handle);
+            }
+        }
+
+        return ImageNativeXfer(size);
+    }
+
+    /// Size of each handle in bytes.
+    UInt32 pageSize() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pageSize;
+    }
+
+    /// Number of handles kept ready.
+    UInt32 depth() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_depth;
+    }
+
+    /// Number of handles ready to be taken.
+    UInt32 available() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::unique_ptr<Detail::UniqueHandle[]> m_handles;
+    UInt32 m_pageSize;
+    UInt32 m_depth;
+    UInt32 m_head;
+    UInt32 m_count;
+
+};
+
+/// Single page buffered by AcquisitionRing.
+/// Holds uncompressed rows for memory transfers, or a prepared native transfer.
+class AcquiredPage {
+
+public:
+    /// Creates an empty page.
+    AcquiredPage() noexcept :
+        m_bytesPerRow(0), m_rows(0){}
+
+    /// Creates a page of uncompressed rows, to be filled by the device.
+    /// \param info Image information of the page.
+    /// \param bytesPerRow Number of bytes of each row.
+    /// \param rows Number of rows.
+    /// \throw std::bad_alloc
+    AcquiredPage(const ImageInfo& info, UInt32 bytesPerRow, UInt32 rows) :
+        m_info(info), m_data(new char[static_cast<std::size_t>(bytesPerRow) * rows]),
+        m_bytesPerRow(bytesPerRow), m_rows(rows){}
+
+    /// Creates a page of a native transfer, e.g. a DIB or TIFF taken from ImageNativeXferRing.
+    /// \param info Image information of the page.
+    /// \param native Native transfer data.
+    AcquiredPage(const ImageInfo& info, ImageNativeXfer native) noexcept :
+        m_info(info), m_bytesPerRow(0), m_rows(0), m_native(std::move(native)){}
+
+    /// Creates a page of a thumbnail, e.g. to be transferred before its image
+    /// when CapType::ThumbnailsEnabled is set.
+    /// \param thumb Finished thumbnail.
+    /// \throw std::bad_alloc
+    explicit AcquiredPage(const Thumbnail& thumb) :
+        AcquiredPage(thumb.imageInfo(), thumb.bytesPerRow(), thumb.height()){
+
+        std::memcpy(m_data.get(), thumb.data(), static_cast<std::size_t>(m_bytesPerRow) * m_rows);
+    }
+
+    AcquiredPage(AcquiredPage&&) = default;
+    AcquiredPage& operator=(AcquiredPage&&) = default;
+
+    /// Image information of the page.
+    const ImageInfo& info() const noexcept{
+        return m_info;
+    }
+
+    /// Uncompressed rows, null for native pages.
+    char* data() noexcept{
+        return m_data.get();
+    }
+
+    /// Number of bytes of each row.
+    UInt32 bytesPerRow() const noexcept{
+        return m_bytesPerRow;
+    }
+
+    /// Number of rows.
+    UInt32 rows() const noexcept{
+        return m_rows;
+    }
+
+    /// Native transfer data, empty for pages of rows.
+    ImageNativeXfer& native() noexcept{
+        return m_native;
+    }
+
+private:
+    ImageInfo m_info;
+    std::unique_ptr<char[]> m_data;
+    UInt32 m_bytesPerRow;
+    UInt32 m_rows;
+    ImageNativeXfer m_native;
+
+};
+
+/// Bounded ring of acquired pages, decoupling device capture from TWAIN transfer calls.
+/// A device thread, started e.g. by `userInterfaceEnable`, reads pages ahead and pushes them
+/// into the ring, while the transfer triplets only drain it:
+///
+///     Result userInterfaceEnable(const Identity&, UserInterface&){
+///         setState(DsState::Enabled);
+///         m_ring.start([this](AcquisitionRing& ring){
+///             while (feederLoaded() && ring.push(readPage())){}
+///         }, [this](){
+///             notifyXferReady();
+///         });
+///
+///         return success();
+///     }
+///
+///     Result imageMemXferGet(const Identity&, ImageMemXfer& data){
+///         return m_ring.memXferGet(data);
+///     }
+///
+/// `pendingXfersEnd` and `pendingXfersReset` must be routed to the ring as well,
+/// and `stop` must be called when the source is disabled.
+/// Thread-safe.
+class AcquisitionRing {
+
+public:
+    /// Body of the device thread, returns once there are no more pages.
+    typedef std::function<void(AcquisitionRing&)> Device;
+
+    /// Called from the device thread once the first page is buffered.
+    typedef std::function<void()> ReadyCallBack;
+
+    /// Creates a ring without a device thread.
+    /// \param depth Maximal number of buffered pages.
+    explicit AcquisitionRing(UInt32 depth = 4) :
+        m_pages(new AcquiredPage[depth ? depth : 1]), m_depth(depth ? depth : 1),
+        m_head(0), m_count(0), m_yOff(0), m_running(false), m_stopping(false), m_notified(false){}
+
+    AcquisitionRing(const AcquisitionRing&) = delete;
+    AcquisitionRing& operator=(const AcquisitionRing&) = delete;
+
+    ~AcquisitionRing(){
+        stop();
+    }
+
+    /// Starts the device thread.
+    /// Any previous acquisition is stopped, and its pages are dropped.
+    /// \param device Device thread body, pushes pages into the ring.
+    /// \param ready Called from the device thread once the first page is buffered,
+    ///              usually calls `notifyXferReady`.
+    /// \throw std::system_error
+    void start(Device device, ReadyCallBack ready){
+        stop();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = std::move(ready);
+        m_running = true;
+        m_stopping = false;
+        m_notified = false;
+        try {
+            m_thread = std::thread(&AcquisitionRing::run, this, std::move(device));
+        } catch (...){
+            m_running = false;
+            throw;
+        }
+    }
+
+    /// Stops the device thread, and drops all buffered pages.
+    /// Must not be called from the device thread.
+    void stop() noexcept{
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+
+        m_cond.notify_all();
+        if (m_thread.joinable()){
+            m_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        clear();
+    }
+
+    /// Buffers a page, waits while the ring is full.
+    /// Called from the device thread.
+    /// \param page The page.
+    /// \return Whether the page was buffered, false if the acquisition is being stopped.
+    bool push(AcquiredPage page){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this](){
+            return m_stopping || m_count < m_depth;
+        });
+
+        if (m_stopping){
+            return false;
+        }
+
+        m_pages[(m_head + m_count) % m_depth] = std::move(page);
+        m_count++;
+
+        bool notify = !m_notified;
+        m_notified = true;
+        auto ready = notify ? m_ready : ReadyCallBack();
+        lock.unlock();
+
+        m_cond.notify_all();
+        if (notify && ready){
+            ready();
+        }
+
+        return true;
+    }
+
+    /// Whether the acquisition is being stopped, the device thread should return.
+    bool stopping() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stopping;
+    }
+
+    /// Number of buffered pages.
+    UInt32 buffered() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    /// Waits for the next page.
+    /// \return The oldest buffered page, null if there are no more pages.
+    AcquiredPage* front() noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waitPage(lock);
+        return m_count != 0 ? &m_pages[m_head] : nullptr;
+    }
+
+    /// Drops the oldest buffered page, the device may push another one.
+    void pop() noexcept{
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            popPage();
+        }
+
+        m_cond.notify_all();
+    }
+
+    /// Handles Msg::Get of Dat::ImageInfo, reports the oldest buffered page.
+    Result imageInfoGet(ImageInfo& data) noexcept{
+        auto page = front();
+        if (!page){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        data = page->info();
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Get of Dat::ImageMemXfer, copies rows of the oldest buffered page.
+    Result memXferGet(ImageMemXfer& data){
+        auto page = front();
+        if (!page || !page->data()){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        auto bpr = page->bytesPerRow();
+        auto memSize = data.memory().size();
+        if (bpr == 0 || memSize < bpr){
+            return {ReturnCode::Failure, ConditionCode::BadValue};
+        }
+
+        UInt32 yOff;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            yOff = m_yOff;
+        }
+
+        auto rows = std::min(memSize / bpr, page->rows() - yOff);
+        if (rows == 0){
+            return {ReturnCode::Failure, ConditionCode::SeqError}; // page already transferred
+        }
+
+        data.setBytesPerRow(bpr);
+        data.setColumns(static_cast<UInt32>(page->info().width()));
+        data.setRows(rows);
+        data.setBytesWritten(rows * bpr);
+        data.setXOffset(0);
+        data.setYOffset(yOff);
+        data.setCompression(Compression::None);
+
+        auto src = page->data() + static_cast<std::size_t>(yOff) * bpr;
+        auto lock = data.memory().data();
+        std::copy(src, src + static_cast<std::size_t>(rows) * bpr, lock.data());
+
+        std::lock_guard<std::mutex> stateLock(m_mutex);
+        m_yOff = yOff + rows;
+        if (m_yOff >= page->rows()){
+            return {ReturnCode::XferDone, ConditionCode::Success};
+        }
+
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Get of Dat::ImageNativeXfer, hands over the native data of the oldest buffered page.
+    Result nativeXferGet(ImageNativeXfer& data) noexcept{
+        auto page = front();
+        if (!page || !page->native()){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        data = std::move(page->native());
+        return {ReturnCode::XferDone, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Get of Dat::PendingXfers.
+    /// The count is unknown (0xFFFF) while the device may still push pages.
+    Result pendingXfersGet(PendingXfers& data) noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waitPage(lock);
+        data.setCount(pendingCount());
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::EndXfer of Dat::PendingXfers, drops the transferred page.
+    /// Waits for the next page, or the end of the acquisition.
+    Result pendingXfersEnd(PendingXfers& data) noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        popPage();
+        m_cond.notify_all();
+
+        waitPage(lock);
+        data.setCount(pendingCount());
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Reset of Dat::PendingXfers, stops the device and drops all pages.
+    /// Must not be called from the device thread.
+    Result pendingXfersReset(PendingXfers& data) noexcept{
+        stop();
+        data.setCount(0);
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+private:
+    void run(Device device) noexcept{
+        try {
+            device(*this);
+        } catch (...){
+            // the pages acquired so far are still transferred
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+
+        m_cond.notify_all();
+    }
+
+    // waits until there either is a page, or there will be none
+    void waitPage(std::unique_lock<std::mutex>& lock) noexcept{
+        m_cond.wait(lock, [this](){
+            return m_count != 0 || !m_running || m_stopping;
+        });
+    }
+
+    UInt16 pendingCount() const noexcept{
+        if (m_running && !m_stopping){
+            return 0xFFFF;
+        }
+
+        return static_cast<UInt16>(std::min<UInt32>(m_count, 0xFFFE));
+    }
+
+    void popPage() noexcept{
+        if (m_count != 0){
+            m_pages[m_head] = AcquiredPage();
+            m_head = (m_head + 1) % m_depth;
+            m_count--;
+        }
+
+        m_yOff = 0;
+    }
+
+    void clear() noexcept{
+        while (m_count != 0){
+            popPage();
+        }
+
+        m_head = 0;
+        m_yOff = 0;
+        m_ready = ReadyCallBack();
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    std::unique_ptr<AcquiredPage[]> m_pages;
+    ReadyCallBack m_ready;
+    UInt32 m_depth;
+    UInt32 m_head;
+    UInt32 m_count;
+    UInt32 m_yOff;
+    bool m_running;
+    bool m_stopping;
+    bool m_notified;
+
+};
+
+/// PCM layout of captured audio.
+struct AudioFormat {
+    UInt16 channels;
+    UInt32 sampleRate;
+    UInt16 bitsPerSample;
+
+    /// Number of bytes of one sample of all channels.
+    UInt32 blockAlign() const noexcept{
+        return static_cast<UInt32>(channels) * ((bitsPerSample + 7u) / 8u);
+    }
+};
+
+namespace Detail {
+
+static inline void storeLe(char* out, UInt32 value, UInt32 bytes) noexcept{
+    for (UInt32 i = 0; i < bytes; i++){
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+/// Writes the 44-byte RIFF WAVE header of a PCM clip.
+static inline void waveHeader(char* out, const AudioFormat& format, UInt32 dataBytes) noexcept{
+    auto block = format.blockAlign();
+    std::memcpy(out, "RIFF", 4);
+    storeLe(out + 4, 36 + dataBytes, 4);
+    std::memcpy(out + 8, "WAVEfmt ", 8);
+    storeLe(out + 16, 16, 4);
+    storeLe(out + 20, 1, 2); // PCM
+    storeLe(out + 22, format.channels, 2);
+    storeLe(out + 24, format.sampleRate, 4);
+    storeLe(out + 28, format.sampleRate * block, 4);
+    storeLe(out + 32, block, 2);
+    storeLe(out + 34, format.bitsPerSample, 2);
+    std::memcpy(out + 36, "data", 4);
+    storeLe(out + 40, dataBytes, 4);
+}
+
+}
+
+/// Ring of fixed-size audio chunks for continuous capture with DataGroup::Audio.
+/// A capture thread writes PCM samples into preallocated chunks, while
+/// Dat::AudioNativeXfer hands over one chunk per transfer, as a WAV clip by default.
+/// A partially filled chunk is transferred once it is older than the maximal latency,
+/// so the application receives audio with bounded delay regardless of the chunk size:
+///
+///     Result userInterfaceEnable(const Identity&, UserInterface&){
+///         setState(DsState::Enabled);
+///         m_audio.start([this](AudioCaptureRing& ring){
+///             char samples[960];
+///             while (!ring.stopping() && m_mic.read(samples, sizeof(samples))){
+///                 ring.write(samples, sizeof(samples));
+///             }
+///         }, [this](){
+///             notifyXferReady();
+///         });
+///
+///         return success();
+///     }
+///
+///     Result audioNativeXferGet(const Identity&, AudioNativeXfer& data){
+///         return m_audio.nativeXferGet(data);
+///     }
+///
+/// Capture never allocates nor blocks, samples that do not fit are dropped and counted.
+/// Every transfer allocates a handle and copies the chunk into it, as the application
+/// takes over the handle and frees it, such handles are never recycled by the handle pool.
+/// `pendingXfersGet`, `pendingXfersEnd` and `pendingXfersReset` must be routed to the ring as well,
+/// and `stop` must be called when the source is disabled.
+/// Thread-safe.
+class AudioCaptureRing {
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Body of the capture thread, returns once the capture ends.
+    typedef std::function<void(AudioCaptureRing&)> Device;
+
+    /// Called from the capture thread once the first chunk is available.
+    typedef std::function<void()> ReadyCallBack;
+
+    /// Creates a ring without a capture thread.
+    /// \param format PCM layout of the samples.
+    /// \param chunkSize Maximal number of sample bytes per chunk, rounded down to whole samples.
+    /// \param chunks Number of chunks.
+    /// \param maxLatency Age of a partial chunk after which it is transferred.
+    /// \param wave Whether chunks are transferred as WAV clips, otherwise as raw samples.
+    /// \throw std::bad_alloc
+    explicit AudioCaptureRing(const AudioFormat& format, UInt32 chunkSize = 16384, UInt32 chunks = 8,
+                              std::chrono::milliseconds maxLatency = std::chrono::milliseconds(100), bool wave = true) :
+        m_format(format), m_chunkSize(alignChunk(format, chunkSize)), m_chunks(chunks ? chunks : 1),
+        m_buffer(new char[static_cast<std::size_t>(m_chunkSize) * m_chunks]), m_sizes(new UInt32[m_chunks]),
+        m_latency(maxLatency), m_wave(wave), m_head(0), m_count(0), m_fill(0), m_dropped(0),
+        m_running(false), m_stopping(false), m_notified(false){}
+
+    AudioCaptureRing(const AudioCaptureRing&) = delete;
+    AudioCaptureRing& operator=(const AudioCaptureRing&) = delete;
+
+    ~AudioCaptureRing(){
+        stop();
+    }
+
+    /// Starts the capture thread.
+    /// Any previous capture is stopped, and its chunks are dropped.
+    /// \param device Capture thread body, writes samples into the ring.
+    /// \param ready Called from the capture thread once the first chunk is available,
+    ///              usually calls `notifyXferReady`.
+    /// \throw std::system_error
+    void start(Device device, ReadyCallBack ready){
+        stop();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready = std::move(ready);
+        m_running = true;
+        m_stopping = false;
+        m_notified = false;
+        m_dropped = 0;
+        try {
+            m_thread = std::thread(&AudioCaptureRing::run, this, std::move(device));
+        } catch (...){
+            m_running = false;
+            throw;
+        }
+    }
+
+    /// Stops the capture thread, and drops all buffered samples.
+    /// Must not be called from the capture thread.
+    void stop() noexcept{
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+
+        m_cond.notify_all();
+        if (m_thread.joinable()){
+            m_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_head = 0;
+        m_count = 0;
+        m_fill = 0;
+        m_ready = ReadyCallBack();
+    }
+
+    /// Buffers samples, never blocks.
+    /// Called from the capture thread.
+    /// \param data Samples.
+    /// \param bytes Number of bytes.
+    /// \return Number of buffered bytes, the rest was dropped as all chunks are full.
+    UInt32 write(const void* data, UInt32 bytes) noexcept{
+        auto in = static_cast<const char*>(data);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping){
+            return 0;
+        }
+
+        UInt32 written = 0;
+        auto count = m_count;
+        while (written < bytes && m_count < m_chunks){
+            if (m_fill == 0){
+                m_fillStart = Clock::now();
+            }
+
+            auto len = std::min(bytes - written, m_chunkSize - m_fill);
+            std::memcpy(slot(m_head + m_count) + m_fill, in + written, len);
+            m_fill += len;
+            written += len;
+            if (m_fill == m_chunkSize || Clock::now() - m_fillStart >= m_latency){
+                commit();
+            }
+        }
+
+        m_dropped += bytes - written;
+        if (m_count == count){
+            return written;
+        }
+
+        bool notify = !m_notified;
+        m_notified = true;
+        auto ready = notify ? m_ready : ReadyCallBack();
+        lock.unlock();
+
+        m_cond.notify_all();
+        if (notify && ready){
+            ready();
+        }
+
+        return written;
+    }
+
+    /// Whether the capture is being stopped, the capture thread should return.
+    bool stopping() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stopping;
+    }
+
+    /// Number of complete chunks waiting for transfer.
+    UInt32 buffered() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    /// Number of sample bytes dropped since the capture started.
+    std::uint64_t dropped() const noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+    /// Maximal number of sample bytes per chunk.
+    UInt32 chunkSize() const noexcept{
+        return m_chunkSize;
+    }
+
+    /// Handles Msg::Get of Dat::AudioNativeXfer, hands over the oldest chunk.
+    /// Waits at most the maximal latency for samples once capture has produced any.
+    Result nativeXferGet(AudioNativeXfer& data) noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waitChunk(lock);
+        if (m_count == 0){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        // the writer never touches committed chunks, the head is stable while unlocked
+        auto bytes = m_sizes[m_head % m_chunks];
+        auto src = slot(m_head);
+        lock.unlock();
+
+        UInt32 header = m_wave ? 44 : 0;
+        try {
+            data = AudioNativeXfer(header + bytes);
+        } catch (const std::bad_alloc&){
+            return {ReturnCode::Failure, ConditionCode::LowMemory};
+        }
+
+        auto out = data.data<char>();
+        if (m_wave){
+            Detail::waveHeader(out.data(), m_format, bytes);
+        }
+
+        std::memcpy(out.data() + header, src, bytes);
+
+        lock.lock();
+        m_head = (m_head + 1) % m_chunks;
+        m_count--;
+        return {ReturnCode::XferDone, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Get of Dat::PendingXfers.
+    /// The count is unknown (0xFFFF) while capturing.
+    Result pendingXfersGet(PendingXfers& data) noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        data.setCount(pendingCount());
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::EndXfer of Dat::PendingXfers.
+    /// Waits for the next chunk, at most the maximal latency once capture has produced any.
+    Result pendingXfersEnd(PendingXfers& data) noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waitChunk(lock);
+        data.setCount(pendingCount());
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::Reset of Dat::PendingXfers, stops the capture and drops all samples.
+    /// Must not be called from the capture thread.
+    Result pendingXfersReset(PendingXfers& data) noexcept{
+        stop();
+        data.setCount(0);
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+private:
+    static UInt32 alignChunk(const AudioFormat& format, UInt32 chunkSize) noexcept{
+        auto block = std::max<UInt32>(format.blockAlign(), 1);
+        return std::max(chunkSize - chunkSize % block, block);
+    }
+
+    void run(Device device) noexcept{
+        try {
+            device(*this);
+        } catch (...){
+            // the samples captured so far are still transferred
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_running = false;
+        if (m_fill != 0 && !m_stopping){
+            commit();
+        }
+
+        bool notify = !m_notified && m_count != 0;
+        m_notified = m_notified || notify;
+        auto ready = notify ? m_ready : ReadyCallBack();
+        lock.unlock();
+
+        m_cond.notify_all();
+        if (notify && ready){
+            ready();
+        }
+    }
+
+    char* slot(UInt32 index) noexcept{
+        return m_buffer.get() + static_cast<std::size_t>(index % m_chunks) * m_chunkSize;
+    }
+
+    void commit() noexcept{
+        m_sizes[(m_head + m_count) % m_chunks] = m_fill;
+        m_count++;
+        m_fill = 0;
+    }
+
+    // waits until there is a chunk, a partial chunk is too old, or there will be none
+    void waitChunk(std::unique_lock<std::mutex>& lock) noexcept{
+        while (m_count == 0 && m_running && !m_stopping){
+            if (m_fill == 0){
+                m_cond.wait(lock);
+                continue;
+            }
+
+            auto deadline = m_fillStart + m_latency;
+            if (Clock::now() >= deadline){
+                commit();
+                break;
+            }
+
+            m_cond.wait_until(lock, deadline);
+        }
+    }
+
+    UInt16 pendingCount() const noexcept{
+        if (m_running && !m_stopping){
+            return 0xFFFF;
+        }
+
+        return static_cast<UInt16>(std::min<UInt32>(m_count, 0xFFFE));
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    AudioFormat m_format;
+    UInt32 m_chunkSize;
+    UInt32 m_chunks;
+    std::unique_ptr<char[]> m_buffer;
+    std::unique_ptr<UInt32[]> m_sizes;
+    std::chrono::milliseconds m_latency;
+    bool m_wave;
+    ReadyCallBack m_ready;
+    Clock::time_point m_fillStart;
+    UInt32 m_head;
+    UInt32 m_count;
+    UInt32 m_fill;
+    std::uint64_t m_dropped;
+    bool m_running;
+    bool m_stopping;
+    bool m_notified;
+
+};
+
 
 namespace Detail {
 
@@ -136,6 +1093,93 @@ struct StaticCustomBaseProc<Derived, true> {
     }
 };
 
+/// Bounded lock-free queue of device events, many producers and a single consumer.
+/// A failed push leaves the queue unchanged, the event is dropped.
+template<UInt32 capacity>
+class DeviceEventQueue {
+
+    static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    struct Cell {
+        std::atomic<std::size_t> m_seq;
+        DeviceEvent m_event;
+    };
+
+public:
+    DeviceEventQueue() noexcept :
+        m_head(0), m_tail(0){
+
+        for (UInt32 i = 0; i < capacity; i++){
+            m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    DeviceEventQueue(const DeviceEventQueue&) = delete;
+    DeviceEventQueue& operator=(const DeviceEventQueue&) = delete;
+
+    /// Queues an event, may be called from any thread.
+    /// \return Whether the event was queued, false if the queue is full.
+    bool push(const DeviceEvent& event) noexcept{
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        for (;;){
+            auto& cell = m_cells[pos & (capacity - 1)];
+            auto seq = cell.m_seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0){
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    cell.m_event = event;
+                    cell.m_seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0){
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// The oldest event, null if there is none.
+    /// Consumer only.
+    const DeviceEvent* front() const noexcept{
+        auto pos = m_head.load(std::memory_order_relaxed);
+        auto& cell = m_cells[pos & (capacity - 1)];
+        if (cell.m_seq.load(std::memory_order_acquire) != pos + 1){
+            return nullptr;
+        }
+
+        return &cell.m_event;
+    }
+
+    /// Removes the oldest event.
+    /// Consumer only.
+    /// \param out The event.
+    /// \return Whether there was an event.
+    bool pop(DeviceEvent& out) noexcept{
+        auto pos = m_head.load(std::memory_order_relaxed);
+        auto& cell = m_cells[pos & (capacity - 1)];
+        if (cell.m_seq.load(std::memory_order_acquire) != pos + 1){
+            return false;
+        }
+
+        out = cell.m_event;
+        cell.m_seq.store(pos + capacity, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// Whether there are no completely queued events.
+    bool empty() const noexcept{
+        return front() == nullptr;
+    }
+
+private:
+    Cell m_cells[capacity];
+    std::atomic<std::size_t> m_head;
+    std::atomic<std::size_t> m_tail;
+
+};
+
 TWPP_DETAIL_CREATE_HAS_STATIC_METHOD(defaultIdentity)
 TWPP_DETAIL_CREATE_HAS_STATIC_METHOD(staticCustomBase)
 
@@ -170,6 +1214,16 @@ Result staticCustomBase(Dat dat, Msg msg, void* data);
 /// where the name is a literal, not string:
 ///
 /// TWPP_ENTRY(Source)  // <- no semicolon required
+///
+/// The entry is thread-safe. Opening and closing sources are serialised,
+/// calls of one instance are serialised by a per-instance lock,
+/// and calls of different instances may run concurrently.
+/// Notifications (e.g. `notifyXferReady`) do not take the instance lock,
+/// and may be sent from any thread.
+///
+/// Device events posted by `postDeviceEvent` from device threads are queued without locks,
+/// the application is notified once, and `deviceEventGet` returns them one by one,
+/// consecutive events of the same type collapsed into the latest one, see `coalesceDeviceEvent`.
 /// \tparam Derived The class inheriting from this.
 /// \tparam hasStaticCustomBaseProc {Whether the Derived
 ///     class handles static custom base operations, see above.}
@@ -187,8 +1241,9 @@ public:
 
 protected:
     /// Creates closed instance.
-    constexpr SourceFromThis() noexcept :
-        m_lastStatus(ConditionCode::Bummer), m_state(DsState::Closed){}
+    SourceFromThis() noexcept :
+        m_lastStatus(ConditionCode::Bummer), m_state(DsState::Closed), m_users(0), m_closed(false),
+        m_devEventNotified(false){}
 
     /// The last TWAIN status.
     Status lastStatus() const noexcept{
@@ -212,6 +1267,7 @@ protected:
 
     /// Whether there exists an enabled source.
     static bool hasEnabled() noexcept{
+        std::lock_guard<std::mutex> lock(g_mutex);
         for (auto& src : g_sources){
             if (src.inState(DsState::Enabled, DsState::Xferring)){
                 return true;
@@ -302,6 +1358,41 @@ protected:
         return notifyApp(Msg::XferReady);
     }
 
+    /// Queues a device event for `deviceEventGet`, may be called from any thread without locking.
+    /// The application is notified only if no notification is outstanding,
+    /// bursts of events therefore cause a single callback.
+    /// \param event The event.
+    /// \return Whether the event was queued, false if the queue is full and the event was dropped.
+    bool postDeviceEvent(const DeviceEvent& event) noexcept{
+        if (!m_devEvents.push(event)){
+            return false;
+        }
+
+        if (!m_devEventNotified.exchange(true)){
+            notifyDeviceEvent();
+        }
+
+        return true;
+    }
+
+    /// Whether a newer device event replaces the previous one when both are queued consecutively.
+    /// Default implementation collapses state reports of the same device and type,
+    /// e.g. repeated Type::CheckBattery, and keeps every captured, deleted, added or removed item.
+    /// \param previous The older event.
+    /// \param next The newer event.
+    virtual bool coalesceDeviceEvent(const DeviceEvent& previous, const DeviceEvent& next) const noexcept{
+        typedef DeviceEvent::Type Type;
+
+        auto type = next.type();
+        if (previous.type() != type || type == Type::ImageCaptured || type == Type::ImageDeleted ||
+                type == Type::DeviceAdded || type == Type::DeviceRemoved ||
+                static_cast<UInt16>(type) >= static_cast<UInt16>(Type::CustomEvents)){
+            return false;
+        }
+
+        return previous.deviceName().view() == next.deviceName().view();
+    }
+
 
 
     /// Root of source TWAIN calls.
@@ -572,6 +1663,7 @@ protected:
             /// Get custom data TWAIN call.
             /// Always called in correct state.
             /// Default implementation does nothing.
+            /// CapabilityTable::snapshot or CapabilitySnapshot may be used to create the data.
             /// \param origin Identity of the caller.
             /// \param data Custom data.
             virtual Result customDataGet(const Identity& origin, CustomData& data){
@@ -582,6 +1674,7 @@ protected:
             /// Set custom data TWAIN call.
             /// Always called in correct state.
             /// Default implementation does nothing.
+            /// CapabilityTable::restore or CapabilitySnapshot may be used to apply the data.
             /// \param origin Identity of the caller.
             /// \param data Custom data.
             virtual Result customDataSet(const Identity& origin, CustomData& data){
@@ -603,12 +1696,34 @@ protected:
 
             /// Get device event TWAIN call.
             /// Always called in correct state.
-            /// Default implementation does nothing.
+            /// Default implementation returns the oldest event queued by `postDeviceEvent`,
+            /// and notifies the application again if more events remain.
             /// \param origin Identity of the caller.
             /// \param data Device event data.
             virtual Result deviceEventGet(const Identity& origin, DeviceEvent& data){
-                Detail::unused(origin, data);
-                return badProtocol();
+                Detail::unused(origin);
+                if (!m_devEvents.pop(data)){
+                    // clear first, then re-check: an event pushed before the clear did not notify
+                    m_devEventNotified = false;
+                    if (!m_devEvents.empty() && !m_devEventNotified.exchange(true)){
+                        notifyDeviceEvent();
+                    }
+
+                    return seqError();
+                }
+
+                const DeviceEvent* next;
+                while ((next = m_devEvents.front()) != nullptr && coalesceDeviceEvent(data, *next)){
+                    m_devEvents.pop(data);
+                }
+
+                // events posted meanwhile did not notify, the outstanding notification was this one
+                m_devEventNotified = false;
+                if (!m_devEvents.empty() && !m_devEventNotified.exchange(true)){
+                    notifyDeviceEvent();
+                }
+
+                return success();
             }
 
 
@@ -917,6 +2032,10 @@ protected:
             /// Pass through pass through TWAIN call.
             /// Always called in correct state.
             /// Default implementation does nothing.
+            /// Command and data point directly into application buffers, valid during the call only.
+            /// Bulk payloads arrive as consecutive chunks, see PassThroughChannel; Direction::Set data
+            /// should be handed to the device from the buffer as is, Direction::Get data written into it
+            /// and the amount reported by setDataXfered.
             /// \param origin Identity of the caller.
             /// \param data Pass through data.
             virtual Result passThroughPass(const Identity& origin, PassThrough& data){
@@ -1634,6 +2753,7 @@ protected:
 
             /// Get image native xfer TWAIN call.
             /// Always called in correct state.
+            /// Use ImageNativeXferRing to build pages in handles allocated ahead of time.
             /// \param origin Identity of the caller.
             /// \param data Handle to image native xfer data.
             virtual Result imageNativeXferGet(const Identity& origin, ImageNativeXfer& data) = 0;
@@ -1966,7 +3086,12 @@ private:
                 break;
         }
 
-        auto rc = g_entry(&m_srcId, &m_appId, DataGroup::Control, Dat::Null, msg, nullptr);
+        auto entry = g_entry.load();
+        if (!entry){
+            return ReturnCode::Failure;
+        }
+
+        auto rc = entry(&m_srcId, &m_appId, DataGroup::Control, Dat::Null, msg, nullptr);
         if (Twpp::success(rc)){
             switch (msg){
                 case Msg::XferReady:
@@ -1990,17 +3115,22 @@ private:
         }
 
         try {
-            if (data != nullptr){
-                if (dat == Dat::Capability){
-                    return callCapability(*origin, dg, dat, msg, data);
-                }
+            if (data == nullptr){
+                return call(*origin, dg, dat, msg, data);
+            }
 
-                if (dat == Dat::ImageNativeXfer){
-                    return callImageNativeXfer(*origin, dg, dat, msg, data);
-                }
+            Result rc;
+            if (dat == Dat::Capability){
+                rc = callCapability(*origin, dg, dat, msg, data);
+            } else if (dat == Dat::ImageNativeXfer || dat == Dat::AudioNativeXfer){
+                rc = callNativeXfer(*origin, dg, dat, msg, data);
+            } else {
+                rc = call(*origin, dg, dat, msg, data);
             }
 
-            return call(*origin, dg, dat, msg, data);
+            // handles passed to the APP are going to be freed by the APP
+            Detail::handOver(dat, data);
+            return rc;
         } catch (const std::bad_alloc&){
             return {ReturnCode::Failure, ConditionCode::LowMemory};
         } catch (...){
@@ -2022,7 +3152,7 @@ private:
         return call(origin, dg, dat, msg, data);
     }
 
-    Result callImageNativeXfer(const Identity& origin, DataGroup dg, Dat dat, Msg msg, void* data){
+    Result callNativeXfer(const Identity& origin, DataGroup dg, Dat dat, Msg msg, void* data){
         // same case as capability - make sure incoming handle is not freed
         Handle& handle = *static_cast<Handle*>(data);
         Detail::DoNotFreeHandle doNotFree(handle);
@@ -2034,21 +3164,81 @@ private:
     Identity m_srcId;
     Identity m_appId;
     Status m_lastStatus;
-    DsState m_state;
+    std::atomic<DsState> m_state;
 
+    std::recursive_mutex m_callMutex; // serialises calls of this instance
+    UInt32 m_users; // entry calls using this instance, guarded by g_mutex
+    bool m_closed; // erased once unused, guarded by both m_callMutex and g_mutex
 
-    static typename std::list<Derived>::iterator find(Identity* origin) noexcept{
+    Detail::DeviceEventQueue<64> m_devEvents; // popped under m_callMutex
+    std::atomic<bool> m_devEventNotified; // a notification is outstanding
+
+
+    typedef typename std::list<Derived>::iterator SourceIterator;
+
+    static SourceIterator find(Identity* origin) noexcept{
         if (origin){
-            for (auto it = g_sources.begin(); it != g_sources.end(); ++it){
-                if (it->m_appId.id() == origin->id()){
-                    return it;
-                }
+            auto id = origin->id();
+            if (g_lastHit.m_valid && g_lastHit.m_id == id){
+                return g_lastHit.m_source;
+            }
+
+            auto it = g_index.find(id);
+            if (it != g_index.end()){
+                g_lastHit = LastHit{true, id, it->second};
+                return it->second;
             }
         }
 
         return g_sources.end();
     }
 
+    /// Registers opened source in the lookup index.
+    /// Iterators of std::list remain valid until the element is erased.
+    static void indexSource(SourceIterator src){
+        g_index.emplace(src->m_appId.id(), src);
+    }
+
+    static void unindexSource(SourceIterator src) noexcept{
+        auto it = g_index.find(src->m_appId.id());
+        if (it != g_index.end() && it->second == src){
+            g_index.erase(it);
+        }
+
+        if (g_lastHit.m_valid && g_lastHit.m_source == src){
+            g_lastHit.m_valid = false;
+        }
+    }
+
+    /// Marks a source as being used by an entry call, it is not erased until released.
+    /// Must be called with g_mutex locked.
+    static void acquire(SourceIterator src) noexcept{
+        src->m_users++;
+    }
+
+    /// Releases a source used by an entry call, erases it if it has been closed.
+    static void release(SourceIterator src) noexcept{
+        std::list<Derived> closed; // destroyed without holding the lock
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (--src->m_users == 0 && src->m_closed){
+            closed.splice(closed.end(), g_sources, src);
+            if (g_sources.empty()){
+                resetDsm();
+            }
+        }
+    }
+
+    struct SourceUse {
+        SourceUse(SourceIterator src) noexcept :
+            m_src(src){}
+
+        ~SourceUse(){
+            release(m_src);
+        }
+
+        SourceIterator m_src;
+    };
+
     static void resetDsm(){
         g_entry = nullptr;
 
@@ -2057,16 +3247,19 @@ private:
 #endif
     }
 
-    static Result staticCall(typename std::list<Derived>::iterator src, Identity* origin,
+    static Result staticCall(SourceIterator src, Identity* origin,
                                  DataGroup dg, Dat dat, Msg msg, void* data){
 
 #if defined(TWPP_DETAIL_OS_WIN32)
         if (!g_entry){
-            if (!g_dsm && !g_dsm.load(true)){
-                return bummer();
-            }
+            std::lock_guard<std::mutex> lock(g_mutex);
+            if (!g_entry){
+                if (!g_dsm && !g_dsm.load(true)){
+                    return bummer();
+                }
 
-            g_entry = g_dsm.resolve();
+                g_entry = g_dsm.resolve();
+            }
         }
 #endif
 
@@ -2074,6 +3267,12 @@ private:
             return bummer();
         }
 
+        std::lock_guard<std::recursive_mutex> callLock(src->m_callMutex);
+        if (src->m_closed){
+            // closed by another thread while waiting for the lock
+            return seqError();
+        }
+
         auto rc = src->callRoot(origin, dg, dat, msg, data);
         src->m_lastStatus = rc.status();
 
@@ -2082,10 +3281,10 @@ private:
                 (msg == Msg::OpenDs && !Twpp::success(rc))
             )
         ){
-            g_sources.erase(src);
-            if (g_sources.empty()){
-                resetDsm();
-            }
+            // the source is erased once the last entry call releases it
+            std::lock_guard<std::mutex> lock(g_mutex);
+            unindexSource(src);
+            src->m_closed = true;
         }
 
         return rc;
@@ -2104,8 +3303,19 @@ private:
                     }
 
                     auto& e = *static_cast<Detail::EntryPoint*>(data);
+                    std::lock_guard<std::mutex> lock(g_mutex);
                     g_entry = e.m_entry;
-                    Detail::setMemFuncs(e.m_alloc, e.m_free, e.m_lock, e.m_unlock);
+
+                    // the DSM sends the entry point to every session,
+                    // do not drain the handle pool while other sessions use it
+                    if (Detail::GlobalMemFuncs<void>::alloc != e.m_alloc ||
+                            Detail::GlobalMemFuncs<void>::free != e.m_free ||
+                            Detail::GlobalMemFuncs<void>::lock != e.m_lock ||
+                            Detail::GlobalMemFuncs<void>::unlock != e.m_unlock){
+
+                        Detail::setMemFuncs(e.m_alloc, e.m_free, e.m_lock, e.m_unlock);
+                    }
+
                     return success();
                 }
 
@@ -2117,6 +3327,7 @@ private:
                         return badValue();
                     }
 
+                    std::lock_guard<std::mutex> lock(g_mutex);
                     *static_cast<Status*>(data) = g_lastStatus;
                     return success();
                 }
@@ -2144,8 +3355,27 @@ private:
                     }
 
                     case Msg::OpenDs: {
-                        g_sources.emplace_back();
-                        return staticCall(--g_sources.end(), origin, dg, dat, msg, data);
+                        SourceIterator src;
+                        {
+                            std::lock_guard<std::mutex> lock(g_mutex);
+                            g_sources.emplace_back();
+                            src = --g_sources.end();
+                            acquire(src);
+                        }
+
+                        SourceUse use(src);
+                        auto rc = staticCall(src, origin, dg, dat, msg, data);
+                        if (Twpp::success(rc)){
+                            std::lock_guard<std::mutex> lock(g_mutex);
+                            try {
+                                indexSource(src);
+                            } catch (...){
+                                src->m_closed = true;
+                                throw;
+                            }
+                        }
+
+                        return rc;
                     }
 
                     case Msg::CloseDs:
@@ -2177,30 +3407,59 @@ private:
 public:
     /// TWAIN entry, do not call from data source.
     static ReturnCode entry(Identity* origin, DataGroup dg, Dat dat, Msg msg, void* data) noexcept{
-        auto src = find(origin);
+        Detail::CallProbe probe(dg, dat, msg, data);
+        SourceIterator src;
+        bool found;
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            src = find(origin);
+            found = src != g_sources.end();
+            if (found){
+                acquire(src);
+            }
+        }
+
         try {
-            auto rc = src == g_sources.end() ?
-                        staticControl(origin, dg, dat, msg, data) :
-                        staticCall(src, origin, dg, dat, msg, data);
+            Result rc;
+            if (found){
+                SourceUse use(src);
+                rc = staticCall(src, origin, dg, dat, msg, data);
+            } else {
+                rc = staticControl(origin, dg, dat, msg, data);
+            }
 
-            g_lastStatus = rc.status();
-            return rc.returnCode();
+            setLastStatus(rc.status());
+            return probe.done(rc.returnCode());
         } catch (const std::bad_alloc&) {
-            g_lastStatus = ConditionCode::LowMemory;
-            return ReturnCode::Failure;
+            setLastStatus(ConditionCode::LowMemory);
+            return probe.done(ReturnCode::Failure);
         } catch (...){
             // we can't throw exceptions out of data sources
             // the C interface can't really handle them
             // especially when there are different implementations
-            g_lastStatus = ConditionCode::Bummer;
-            return ReturnCode::Failure;
+            setLastStatus(ConditionCode::Bummer);
+            return probe.done(ReturnCode::Failure);
         }
     }
 
 private:
+    static void setLastStatus(Status status) noexcept{
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_lastStatus = status;
+    }
+
+    struct LastHit {
+        bool m_valid;
+        typename Identity::Id m_id;
+        SourceIterator m_source;
+    };
+
     static std::list<Derived> g_sources;
-    static Detail::DsmEntry g_entry;
-    static Status g_lastStatus;
+    static std::map<typename Identity::Id, SourceIterator> g_index;
+    static LastHit g_lastHit;
+    static std::mutex g_mutex; // guards the registry above and g_lastStatus
+    static std::atomic<Detail::DsmEntry> g_entry;
+    static Status g_lastStatus; // status of the last call, process-wide as any thread may query it
 
 #if defined(TWPP_DETAIL_OS_WIN32)
     static Detail::DsmLib g_dsm; // only old windows dsm requires this
@@ -2212,7 +3471,16 @@ template<typename Derived, bool proc>
 std::list<Derived> SourceFromThis<Derived, proc>::g_sources;
 
 template<typename Derived, bool proc>
-Detail::DsmEntry SourceFromThis<Derived, proc>::g_entry;
+std::map<typename Identity::Id, typename SourceFromThis<Derived, proc>::SourceIterator> SourceFromThis<Derived, proc>::g_index;
+
+template<typename Derived, bool proc>
+typename SourceFromThis<Derived, proc>::LastHit SourceFromThis<Derived, proc>::g_lastHit;
+
+template<typename Derived, bool proc>
+std::mutex SourceFromThis<Derived, proc>::g_mutex;
+
+template<typename Derived, bool proc>
+std::atomic<Detail::DsmEntry> SourceFromThis<Derived, proc>::g_entry;
 
 template<typename Derived, bool proc>
 Status SourceFromThis<Derived, proc>::g_lastStatus = ConditionCode::Bummer;
@@ -0,0 +1,744 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_DEVICEPOOL_HPP
+#define TWPP_DETAIL_FILE_DEVICEPOOL_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Statistics of a single pooled device.
+struct DeviceStats {
+    /// Identity of the source.
+    Identity identity;
+
+    /// Whether the source is open and prepared.
+    bool online;
+
+    /// Whether the source is processing a job.
+    bool busy;
+
+    /// Number of completed jobs.
+    UInt32 jobs;
+
+    /// Number of transferred pages.
+    std::uint64_t pages;
+
+    /// Number of failures, of jobs or of opening the source.
+    UInt32 failures;
+
+    /// Number of times the source was re-opened after a failure.
+    UInt32 reopens;
+
+    /// Moving average of transferred pages per second of busy time.
+    double pagesPerSecond;
+
+    /// Moving average of the failure rate, 0 to 1.
+    double errorRate;
+};
+
+/// Pool of identical sources sharing a single queue of scan jobs.
+/// Every source in the pool is opened and prepared once, e.g. with `Source::applyProfileStep`,
+/// and stays open between jobs, jobs only enable and disable it.
+/// Queued jobs go to the idle source with the best record, sources with fewer failures
+/// and more pages per second are preferred, sources without any record are tried first.
+///
+///     auto profile = std::make_shared<PreparedProfile<...>>(...);
+///     DevicePool pool(appId, [](const Identity& id){
+///         return id.productName() == Str32("FastScan 9000");
+///     }, DevicePool::profileSteps(profile));
+///
+///     auto result = pool.submit(ScanJob(savePage));
+///
+/// As with `ScanSession`, a dedicated thread loads the manager and performs every TWAIN call,
+/// pages of all sources are transferred one at a time in turns, and handed over to worker threads.
+/// A failed source is closed and re-opened later with increasing delays, the other sources keep
+/// scanning meanwhile, and a job that failed before transferring any page is retried on another source.
+/// Opening and preparing a source is spread over turns of the pool thread, each turn performs
+/// either `Source::open` or a single preparation step. Every such step still blocks
+/// the other sources for its duration, keep them short, e.g. one capability per step.
+/// Jobs all accepting sources of which are offline complete with Failure after the offline timeout,
+/// or immediately once the pool is stopping.
+///
+/// DSM calls are recorded by `Metrics` and `Trace` as with any source, the pool additionally records
+/// trace scopes `DevicePool::dispatch`, `DevicePool::reopen`, `DevicePool::prepare`
+/// and `DevicePool::transfer`, and instant events `DevicePool::failed`.
+///
+/// Job settings apply as follows: source names select the devices the job may run on,
+/// the negotiation callback is called before every enable, after the pool preparation.
+/// As with `Manager`, at most one pool, session or valid manager may exist at all times.
+class DevicePool {
+
+public:
+    /// Selects pooled sources from `Manager::sourceIdentities`.
+    typedef std::function<bool(const Identity& identity)> Filter;
+
+    /// Prepares a source once it has been opened, e.g. applies a capability profile.
+    /// Called once per turn of the pool thread with increasing `step`, starting at zero,
+    /// until it returns false. Throwing fails the source.
+    /// \param source Opened source.
+    /// \param step Preparation step.
+    /// \return Whether more steps follow.
+    typedef std::function<bool(Source& source, UInt32 step)> PrepareCallBack;
+
+    /// Prepares sources by a capability profile, one capability per step.
+    /// \tparam Values ProfileValue types.
+    /// \param profile Prepared capability profile, shared by all sources of the pool.
+    /// \throw std::bad_alloc
+    template<typename... Values>
+    static PrepareCallBack profileSteps(std::shared_ptr<PreparedProfile<Values...> > profile){
+        return [profile](Source& source, UInt32 step){
+            source.applyProfileStep(*profile, step, false);
+            return step + 1 < sizeof...(Values);
+        };
+    }
+
+    /// Creates a pool and starts its threads.
+    /// \param appIdentity Application identity.
+    /// \param filter Selects pooled sources, all available sources if empty.
+    /// \param prepare Called after each open of a source, might be empty.
+    /// \param workers Number of page worker threads, zero runs page callbacks on the pool thread.
+    /// \param preferOld Passed to `Manager::load`.
+    /// \throw std::system_error
+    DevicePool(const Identity& appIdentity, Filter filter, PrepareCallBack prepare = PrepareCallBack(),
+               UInt32 workers = 1, bool preferOld = false) :
+        m_appId(appIdentity), m_filter(std::move(filter)), m_prepare(std::move(prepare)),
+        m_preferOld(preferOld), m_workers(workers), m_retryDelay(std::chrono::seconds(1)),
+        m_maxRetryDelay(std::chrono::seconds(60)), m_offlineTimeout(std::chrono::seconds(60)), m_stop(false), m_dsmRc(ReturnCode::Failure), m_dsmReady(false){
+
+        m_thread = std::thread(&DevicePool::run, this);
+    }
+
+    /// Waits for all queued jobs to finish, then closes the sources and the manager.
+    ~DevicePool(){
+        stop();
+    }
+
+    DevicePool(const DevicePool&) = delete;
+    DevicePool& operator=(const DevicePool&) = delete;
+
+    /// Queues a job.
+    /// Jobs submitted after `stop` complete immediately with Failure,
+    /// jobs no pooled source accepts complete with Failure,
+    /// so do jobs all accepting sources of which stay offline, see `setOfflineTimeout`.
+    /// \return Future holding the job result, or an exception thrown
+    ///         by the negotiation or page callbacks.
+    /// \throw std::bad_alloc
+    std::future<ScanJobResult> submit(ScanJob job){
+        Detail::QueuedScanJob queued;
+        queued.m_job = std::make_shared<ScanJob>(std::move(job));
+        queued.m_state = std::make_shared<Detail::ScanJobState>();
+        auto future = queued.m_state->m_promise.get_future();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop){
+            lock.unlock();
+            queued.m_state->release();
+            return future;
+        }
+
+        m_jobs.push_back(Pending{std::move(queued), 0, false, Clock::time_point()});
+        lock.unlock();
+
+        m_cond.notify_all();
+        return future;
+    }
+
+    /// Completes all jobs that have not been started yet with Cancel.
+    /// \return Number of cancelled jobs.
+    std::size_t cancelPending(){
+        std::list<Pending> jobs;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            jobs.swap(m_jobs);
+        }
+
+        for (auto& pending : jobs){
+            pending.m_queued.m_state->m_result = ScanJobResult(ReturnCode::Cancel);
+            pending.m_queued.m_state->release();
+        }
+
+        return jobs.size();
+    }
+
+    /// Number of jobs that have not been started yet.
+    std::size_t pending() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    /// Blocks until the manager has been opened and the sources have been listed.
+    /// Sources are opened afterwards, see `stats`.
+    /// \return Result of `Manager::open`, Failure if the manager could not be loaded.
+    ReturnCode waitManager() const{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_dsmReady; });
+        return m_dsmRc;
+    }
+
+    /// Sets the delays of re-opening failed sources.
+    /// The delay doubles with each failed attempt, up to the maximal delay.
+    void setRetryDelay(std::chrono::milliseconds first, std::chrono::milliseconds max){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retryDelay = first;
+        m_maxRetryDelay = std::max(first, max);
+    }
+
+    /// Sets how long a job waits while all sources accepting it are offline, one minute by default.
+    /// Once the pool is stopping, such jobs complete with Failure immediately.
+    void setOfflineTimeout(std::chrono::milliseconds timeout){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_offlineTimeout = timeout;
+    }
+
+    /// Copies statistics of all pooled devices.
+    /// \tparam Container Container of `DeviceStats`, e.g. `std::list<DeviceStats>`.
+    /// \param out Container the statistics are appended to.
+    /// \throw std::bad_alloc
+    template<typename Container>
+    void stats(Container& out) const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& device : m_devices){
+            out.push_back(device.m_stats);
+        }
+    }
+
+    /// Stops accepting jobs, finishes the queued ones and joins the pool thread.
+    /// Queued jobs no online source may run complete with Failure.
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_cond.notify_all();
+        if (m_thread.joinable()){
+            m_thread.join();
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Pending {
+        Detail::QueuedScanJob m_queued;
+        UInt32 m_attempts;
+        bool m_offline; // all accepting sources are offline since m_offlineSince
+        Clock::time_point m_offlineSince;
+    };
+
+    struct Device {
+        Device(const Identity& identity) :
+            m_stats(), m_pages(0), m_step(0), m_delay(0), m_job(false), m_preparing(false){
+
+            m_stats.identity = identity;
+        }
+
+        Source m_source;
+        DeviceStats m_stats;
+        Pending m_current;
+        Clock::time_point m_started;
+        Clock::time_point m_retryAt;
+        UInt32 m_pages;
+        UInt32 m_step;
+        std::chrono::milliseconds m_delay;
+        bool m_job;
+        bool m_preparing;
+    };
+
+    // moving averages weight the last job by 1/4
+    static double average(double current, double sample, bool first) noexcept{
+        return first ? sample : current + (sample - current) / 4.0;
+    }
+
+    void run(){
+        Manager mgr(m_appId);
+        auto rc = ReturnCode::Failure;
+        if (mgr.load(m_preferOld)){
+            rc = mgr.open();
+        }
+
+        if (success(rc)){
+            std::list<Identity> ids;
+            mgr.sourceIdentities(ids);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& id : ids){
+                if (!m_filter || m_filter(id)){
+                    m_devices.emplace_back(id);
+                }
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dsmRc = rc;
+            m_dsmReady = true;
+        }
+
+        m_cond.notify_all();
+
+        for (;;){
+            if (!success(rc)){
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+                if (m_jobs.empty()){
+                    break;
+                }
+
+                auto pending = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                lock.unlock();
+                pending.m_queued.m_state->release();
+                continue;
+            }
+
+            // at most a single open or preparation step of every offline source per turn
+            bool preparing = false;
+            auto now = Clock::now();
+            for (auto& device : m_devices){
+                if (device.m_preparing){
+                    prepare(device);
+                } else if (!device.m_stats.online && now >= device.m_retryAt){
+                    reopen(mgr, device);
+                }
+
+                preparing = preparing || device.m_preparing;
+            }
+
+            dispatch();
+
+            // one page of every transferring source in turns
+            bool transferring = false;
+            for (auto& device : m_devices){
+                if (device.m_job && device.m_source.state() == DsState::XferReady){
+                    transferPage(device);
+                    transferring = true;
+                }
+            }
+
+            std::list<Source*> waiting;
+            for (auto& device : m_devices){
+                if (device.m_job && device.m_source.state() == DsState::Enabled){
+                    waiting.push_back(&device.m_source);
+                }
+            }
+
+            bool busy = transferring || preparing;
+            if (!waiting.empty()){
+                poll(mgr, waiting, busy ? std::chrono::milliseconds(0) : std::chrono::milliseconds(50));
+            } else if (!transferring){
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_stop && m_jobs.empty()){
+                    break;
+                }
+
+                if (!busy && !dispatchable()){
+                    m_cond.wait_until(lock, nextRetry(), [this]{
+                        return m_stop || dispatchable();
+                    });
+                }
+            }
+        }
+
+        for (auto& device : m_devices){
+            if (device.m_source.isValid()){
+                device.m_source.cleanup();
+            }
+        }
+
+        // pages are freed by the manager memory functions
+        m_workers.stop();
+    }
+
+    void reopen(Manager& mgr, Device& device){
+        Trace::Scope scope("DevicePool::reopen");
+        if (device.m_source.isValid()){
+            device.m_source.cleanup();
+        }
+
+        device.m_source = mgr.createSource(device.m_stats.identity);
+        if (!success(device.m_source.open())){
+            prepared(device, false);
+        } else if (m_prepare){
+            device.m_preparing = true;
+            device.m_step = 0;
+        } else {
+            prepared(device, true);
+        }
+    }
+
+    void prepare(Device& device){
+        Trace::Scope scope("DevicePool::prepare");
+        bool more;
+        try {
+            more = m_prepare(device.m_source, device.m_step++);
+        } catch (...){
+            prepared(device, false);
+            return;
+        }
+
+        if (!more){
+            prepared(device, true);
+        }
+    }
+
+    void prepared(Device& device, bool ok){
+        device.m_preparing = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (ok){
+                if (device.m_delay.count() != 0){
+                    device.m_stats.reopens++;
+                }
+
+                device.m_stats.online = true;
+                device.m_delay = std::chrono::milliseconds(0);
+            } else {
+                device.m_source.cleanup();
+                markFailed(device);
+            }
+        }
+
+        m_cond.notify_all();
+    }
+
+    // with m_mutex locked
+    void markFailed(Device& device){
+        Trace::instant("DevicePool::failed");
+        device.m_stats.online = false;
+        device.m_stats.failures++;
+        device.m_stats.errorRate = average(device.m_stats.errorRate, 1.0, device.m_stats.jobs + device.m_stats.failures == 1);
+        device.m_delay = device.m_delay.count() == 0 ? m_retryDelay : std::min(device.m_delay * 2, m_maxRetryDelay);
+        device.m_retryAt = Clock::now() + device.m_delay;
+    }
+
+    // with m_mutex locked
+    Clock::time_point nextRetry() const{
+        auto next = Clock::now() + std::chrono::seconds(1);
+        for (const auto& device : m_devices){
+            if (!device.m_stats.online){
+                next = std::min(next, device.m_retryAt);
+            }
+        }
+
+        for (const auto& pending : m_jobs){
+            if (pending.m_offline){
+                next = std::min(next, pending.m_offlineSince + m_offlineTimeout);
+            }
+        }
+
+        return next;
+    }
+
+    static bool accepts(const Device& device, const ScanJob& job){
+        return job.productName().length() == 0 ||
+                (device.m_stats.identity.productName() == job.productName() &&
+                 (job.manufacturer().length() == 0 || device.m_stats.identity.manufacturer() == job.manufacturer()));
+    }
+
+    static double score(const DeviceStats& stats) noexcept{
+        if (stats.jobs + stats.failures == 0){
+            return std::numeric_limits<double>::max();
+        }
+
+        return (stats.pagesPerSecond + 1.0) * (1.0 - stats.errorRate);
+    }
+
+    // with m_mutex locked
+    Device* idleDevice(const ScanJob& job){
+        Device* best = nullptr;
+        for (auto& device : m_devices){
+            if (device.m_stats.online && !device.m_job && accepts(device, job) &&
+                    (!best || score(device.m_stats) > score(best->m_stats))){
+                best = &device;
+            }
+        }
+
+        return best;
+    }
+
+    // with m_mutex locked
+    bool dispatchable(){
+        for (const auto& pending : m_jobs){
+            if (idleDevice(*pending.m_queued.m_job)){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // with m_mutex locked, completes jobs no pooled source could ever run,
+    // and jobs all accepting sources of which stayed offline for too long
+    void failUnservable(){
+        auto now = Clock::now();
+        for (auto it = m_jobs.begin(); it != m_jobs.end(); ){
+            const auto& job = *it->m_queued.m_job;
+            bool accepted = false;
+            bool available = false;
+            for (const auto& device : m_devices){
+                if (accepts(device, job)){
+                    accepted = true;
+                    // a stopping pool waits for sources being prepared
+                    available = available || device.m_stats.online || (m_stop && device.m_preparing);
+                }
+            }
+
+            if (available){
+                it->m_offline = false;
+            } else if (accepted && !m_stop && (!it->m_offline || now - it->m_offlineSince < m_offlineTimeout)){
+                if (!it->m_offline){
+                    it->m_offline = true;
+                    it->m_offlineSince = now;
+                }
+            } else {
+                it->m_queued.m_state->m_result = ScanJobResult(ReturnCode::Failure);
+                it->m_queued.m_state->release();
+                it = m_jobs.erase(it);
+                continue;
+            }
+
+            ++it;
+        }
+    }
+
+    void dispatch(){
+        for (;;){
+            Device* device = nullptr;
+            Pending pending;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                failUnservable();
+
+                // first job any idle source may run
+                auto it = m_jobs.begin();
+                for ( ; it != m_jobs.end(); ++it){
+                    device = idleDevice(*it->m_queued.m_job);
+                    if (device){
+                        break;
+                    }
+                }
+
+                if (!device){
+                    return;
+                }
+
+                pending = std::move(*it);
+                m_jobs.erase(it);
+                device->m_job = true;
+                device->m_stats.busy = true;
+            }
+
+            start(*device, std::move(pending));
+        }
+    }
+
+    void start(Device& device, Pending pending){
+        Trace::Scope scope("DevicePool::dispatch");
+        device.m_current = std::move(pending);
+        device.m_pages = 0;
+        device.m_started = Clock::now();
+
+        const ScanJob& job = *device.m_current.m_queued.m_job;
+        try {
+            if (job.negotiation()){
+                job.negotiation()(device.m_source);
+            }
+        } catch (...){
+            device.m_current.m_queued.m_state->fail(std::current_exception());
+            finish(device, ScanJobResult(ReturnCode::Failure), false);
+            return;
+        }
+
+        auto rc = device.m_source.enable(job.userInterface());
+        if (!success(rc) && rc != ReturnCode::CheckStatus){
+            finish(device, ScanJobResult(rc), true);
+        }
+    }
+
+    void poll(Manager& mgr, std::list<Source*>& waiting, std::chrono::milliseconds timeout){
+        std::unique_ptr<Source*[]> sources(new Source*[waiting.size()]);
+        std::size_t count = 0;
+        for (auto src : waiting){
+            sources[count++] = src;
+        }
+
+        std::size_t ready = 0;
+        auto rc = mgr.waitAny(sources.get(), count, ready, timeout);
+        if (rc == ReturnCode::NotDsEvent || rc == ReturnCode::CheckStatus || ready >= count){
+            return;
+        }
+
+        for (auto& device : m_devices){
+            if (&device.m_source != sources[ready]){
+                continue;
+            }
+
+            if (rc == ReturnCode::Cancel){
+                finish(device, ScanJobResult(ReturnCode::Cancel, device.m_pages), false);
+            } else if (rc != ReturnCode::Success){
+                finish(device, ScanJobResult(rc, device.m_pages), true);
+            } else if (device.m_source.state() != DsState::XferReady){
+                finish(device, ScanJobResult(ReturnCode::Failure, device.m_pages), true);
+            } else if (device.m_current.m_queued.m_job->audioCallBack()){
+                DataGroup group = DataGroup::Audio;
+                auto xrc = device.m_source.xferGroup(Msg::Set, group);
+                if (!success(xrc)){
+                    finish(device, ScanJobResult(xrc), true);
+                }
+            }
+
+            break;
+        }
+    }
+
+    void transferPage(Device& device){
+        Trace::Scope scope("DevicePool::transfer");
+        const ScanJob& job = *device.m_current.m_queued.m_job;
+        auto& src = device.m_source;
+
+        ReturnCode rc;
+        if (job.audioCallBack()){
+            AudioNativeXfer chunk;
+            rc = src.audioNativeXfer(chunk);
+            if (rc == ReturnCode::XferDone){
+                Detail::deliverXfer(m_workers, device.m_current.m_queued, std::move(chunk), device.m_pages++);
+            }
+        } else {
+            ImageNativeXfer img;
+            rc = src.imageNativeXfer(img);
+            if (rc == ReturnCode::XferDone){
+                Detail::deliverXfer(m_workers, device.m_current.m_queued, std::move(img), device.m_pages++);
+            }
+        }
+
+        if (rc != ReturnCode::XferDone){
+            // cancelled transfers end normally, others fail the device
+            finish(device, ScanJobResult(rc, device.m_pages), rc != ReturnCode::Cancel);
+            return;
+        }
+
+        PendingXfers pending;
+        if (!success(src.pendingXfers(Msg::EndXfer, pending))){
+            finish(device, ScanJobResult(ReturnCode::Failure, device.m_pages), true);
+            return;
+        }
+
+        if (job.pageLimit() != 0 && device.m_pages >= job.pageLimit() && pending.count() != 0){
+            src.pendingXfers(Msg::Reset, pending);
+            finish(device, ScanJobResult(ReturnCode::XferDone, device.m_pages), false);
+        } else if (pending.count() == 0){
+            finish(device, ScanJobResult(ReturnCode::XferDone, device.m_pages), false);
+        }
+    }
+
+    void finish(Device& device, ScanJobResult result, bool failed){
+        auto& src = device.m_source;
+        if (src.state() >= DsState::Enabled){
+            if (src.state() == DsState::XferReady){
+                PendingXfers pending;
+                src.pendingXfers(Msg::Reset, pending);
+            }
+
+            if (!success(src.disable()) && !failed){
+                failed = true;
+            }
+        }
+
+        auto seconds = std::chrono::duration<double>(Clock::now() - device.m_started).count();
+        auto pending = std::move(device.m_current);
+        device.m_current = Pending();
+        device.m_job = false;
+
+        bool retry = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& stats = device.m_stats;
+            stats.busy = false;
+            stats.pages += device.m_pages;
+            if (failed){
+                markFailed(device);
+
+                // nothing has been delivered yet, another source may succeed
+                retry = device.m_pages == 0 && pending.m_attempts + 1 < MaxAttempts && !m_stop;
+                if (retry){
+                    pending.m_attempts++;
+                    m_jobs.push_front(std::move(pending));
+                }
+            } else {
+                bool first = stats.jobs + stats.failures == 0;
+                stats.jobs++;
+                stats.errorRate = average(stats.errorRate, 0.0, first);
+                if (device.m_pages != 0 && seconds > 0.0){
+                    stats.pagesPerSecond = average(stats.pagesPerSecond, device.m_pages / seconds, stats.pagesPerSecond == 0.0);
+                }
+            }
+        }
+
+        if (failed){
+            src.cleanup();
+        }
+
+        if (!retry){
+            pending.m_queued.m_state->m_result = result;
+            pending.m_queued.m_state->release();
+        }
+
+        m_cond.notify_all();
+    }
+
+    enum : UInt32 {
+        MaxAttempts = 3
+    };
+
+    Identity m_appId;
+    Filter m_filter;
+    PrepareCallBack m_prepare;
+    bool m_preferOld;
+    Detail::WorkerPool m_workers;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cond;
+    std::list<Pending> m_jobs;
+    std::list<Device> m_devices;
+    std::chrono::milliseconds m_retryDelay;
+    std::chrono::milliseconds m_maxRetryDelay;
+    std::chrono::milliseconds m_offlineTimeout;
+    bool m_stop;
+    ReturnCode m_dsmRc;
+    bool m_dsmReady;
+
+    std::thread m_thread;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_DEVICEPOOL_HPP
@@ -139,6 +139,11 @@ extern "C" {
 #   include <objc/NSObjCRuntime.h>
 #   include <CoreServices/CoreServices.h>
 #   include <dlfcn.h>
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/sysctl.h>
 #   include <machine/endian.h>
 }
 #   if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -189,6 +194,8 @@ struct MacStatic {
     static const ::SEL g_sendEvent;
     static const ::id g_app;
     static const ::id g_distantFuture;
+    static const ::Class g_date;
+    static const ::SEL g_dateWithTimeInterval;
 
     static const ::Class g_event;
     static const ::SEL g_otherEventWithType;
@@ -210,6 +217,8 @@ template<typename Dummy> const ::SEL MacStatic<Dummy>::g_postEvent = ::sel_regis
 template<typename Dummy> const ::SEL MacStatic<Dummy>::g_sendEvent = ::sel_registerName("sendEvent:");
 template<typename Dummy> const ::id MacStatic<Dummy>::g_app = msgSend(reinterpret_cast<::id>(::objc_getClass("NSApplication")), ::sel_registerName("sharedApplication"));
 template<typename Dummy> const ::id MacStatic<Dummy>::g_distantFuture = msgSend(reinterpret_cast<::id>(::objc_getClass("NSDate")), ::sel_registerName("distantFuture"));
+template<typename Dummy> const ::Class MacStatic<Dummy>::g_date = ::objc_getClass("NSDate");
+template<typename Dummy> const ::SEL MacStatic<Dummy>::g_dateWithTimeInterval = ::sel_registerName("dateWithTimeIntervalSinceNow:");
 
 template<typename Dummy> const ::Class MacStatic<Dummy>::g_event = ::objc_getClass("NSEvent");
 template<typename Dummy> const ::SEL MacStatic<Dummy>::g_otherEventWithType = ::sel_registerName("otherEventWithType:location:modifierFlags:timestamp:windowNumber:context:subtype:data1:data2:");
@@ -269,6 +278,21 @@ static void processEvent() noexcept{
     msgSend(MacStatic<void>::g_app, MacStatic<void>::g_sendEvent, event);
 }
 
+/// Processes a single event, waiting for it at most `timeout` seconds, negative waits forever.
+/// \return Whether an event was processed.
+static bool processEvent(double timeout) noexcept{
+    auto until = timeout < 0 ? MacStatic<void>::g_distantFuture :
+            msgSend<double>(reinterpret_cast<::id>(MacStatic<void>::g_date), MacStatic<void>::g_dateWithTimeInterval, timeout);
+
+    auto event = msgSend<::NSUInteger, ::id, ::CFRunLoopMode, ::BOOL>(MacStatic<void>::g_app, MacStatic<void>::g_nextEvent, NSAnyEventMask, until, ::kCFRunLoopDefaultMode, YES);
+    if (event == nullptr){
+        return false;
+    }
+
+    msgSend(MacStatic<void>::g_app, MacStatic<void>::g_sendEvent, event);
+    return true;
+}
+
 static void postDummy() noexcept{
     auto event = msgSend<::NSUInteger, ::id, ::NSUInteger, double, ::NSInteger, ::id, short, ::NSInteger, ::NSInteger>
             (reinterpret_cast<::id>(MacStatic<void>::g_event), MacStatic<void>::g_otherEventWithType, NSApplicationDefined, nullptr, 1, 0.0, 0, nullptr, 0, 0, 0);
@@ -288,6 +312,13 @@ static void postDummy() noexcept{
 extern "C" {
 #   include <dlfcn.h>
 #   include <endian.h>
+#   include <errno.h>
+#   include <poll.h>
+#   include <unistd.h>
+#   include <fcntl.h>
+#   include <malloc.h>
+#   include <sys/eventfd.h>
+#   include <sys/mman.h>
 }
 #   if __BYTE_ORDER == __LITTLE_ENDIAN
 #       define TWPP_DETAIL_ENDIAN_LITTLE
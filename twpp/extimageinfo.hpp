@@ -135,6 +135,8 @@ static Handle handleItem(Info& info) noexcept;
 
 static void deleteInfo(Info& info) noexcept;
 
+static void disownInfo(Info& info) noexcept;
+
 }
 
 TWPP_DETAIL_PACK_BEGIN
@@ -144,6 +146,7 @@ class Info {
     friend class ExtImageInfo;
     friend Handle Detail::handleItem(Info& info) noexcept;
     friend void Detail::deleteInfo(Info& info) noexcept;
+    friend void Detail::disownInfo(Info& info) noexcept;
     static constexpr const UInt32 DATA_HANDLE_THRESHOLD = sizeof(UIntPtr);  // NOTE: specification says 4 bytes, yet pointer size makes more sense
 
 public:
@@ -393,6 +396,23 @@ static inline void deleteInfo(Info& info) noexcept{
     }
 }
 
+/// Marks all handles of the info as passed to the other side of the connection.
+static inline void disownInfo(Info& info) noexcept{
+    bool big = isType(info.type()) && info.hasDataHandle();
+    bool handle = info.type() == Type::Handle;
+
+    if (big && handle){
+        Detail::Lock<Handle> lock(handleItem(info));
+        for (UInt16 i = 0; i < info.size(); i++){
+            Detail::disown(lock.data()[i]);
+        }
+    }
+
+    if (big || handle){
+        Detail::disown(handleItem(info));
+    }
+}
+
 struct ExtImageInfoData {
     UInt32 m_numInfos;
     Info m_infos[1];
@@ -500,6 +520,20 @@ public:
         return d()->m_infos + d()->m_numInfos;
     }
 
+    /// Frees data of all entries, keeping the requested info IDs.
+    /// Allows reusing the same request for every page of a batch.
+    void clear() noexcept{
+        assert(isValid());
+
+        for (auto& info : *this){
+            Detail::deleteInfo(info);
+            info.m_itemType = Type::DontCare;
+            info.m_numItems = 0;
+            info.m_returnCode = ReturnCode::Success;
+            info.m_item = 0;
+        }
+    }
+
 private:
     Detail::ExtImageInfoData* d() noexcept{
         return reinterpret_cast<Detail::ExtImageInfoData*>(m_data.get());
@@ -526,6 +560,96 @@ private:
 
 };
 
+/// Lookup of extended image information entries by info ID.
+/// The index is built on first use, entries are decoded only when requested.
+/// Does not own the information, which must outlive the index.
+class ExtImageInfoIndex {
+
+public:
+    /// Creates index of the supplied information.
+    /// \param info Extended image information, must not be resized.
+    explicit ExtImageInfoIndex(ExtImageInfo& info) noexcept :
+        m_info(&info), m_size(0), m_built(false){}
+
+    /// Entry of the info ID, or null if it was not requested.
+    /// \throw std::bad_alloc
+    Info* find(InfoId id){
+        build();
+
+        auto end = m_index.get() + m_size;
+        auto it = std::lower_bound(m_index.get(), end, id, [](const Entry& e, InfoId i){
+            return e.first < i;
+        });
+
+        return it != end && it->first == id ? &m_info->at(it->second) : nullptr;
+    }
+
+    /// Whether the info ID was requested and its data were set by the source.
+    /// \throw std::bad_alloc
+    bool contains(InfoId id){
+        auto info = find(id);
+        return info != nullptr && info->returnCode() == ReturnCode::Success && info->type() != Type::DontCare;
+    }
+
+    /// Decodes a single item of the info ID.
+    /// Handle items must be accessed by `find(id)->items<id>()`.
+    /// \tparam id Information type ID. Data types are set accordingly.
+    /// \param out Decoded item, unchanged if the item is not available.
+    /// \param index Index of the item.
+    /// \return Whether the item was available and decoded.
+    /// \throw std::bad_alloc
+    template<InfoId id>
+    bool value(typename Detail::Ext<id>::DataType& out, UInt16 index = 0){
+        static_assert(Detail::Ext<id>::twty != Type::Handle, "handle items are not supported by value");
+
+        auto info = find(id);
+        if (info == nullptr || info->returnCode() != ReturnCode::Success ||
+                info->type() != Detail::Ext<id>::twty || index >= info->size()){
+            return false;
+        }
+
+        out = *info->items<id>().at(index).data();
+        return true;
+    }
+
+    /// Marks the index to be rebuilt, e.g. after info IDs were changed.
+    void invalidate() noexcept{
+        m_built = false;
+    }
+
+private:
+    typedef std::pair<InfoId, UInt32> Entry;
+
+    void build(){
+        if (m_built){
+            return;
+        }
+
+        auto size = m_info->isValid() ? m_info->size() : 0;
+        if (size != m_size || !m_index){
+            m_index.reset(new Entry[size]);
+            m_size = size;
+        }
+
+        for (UInt32 i = 0; i < size; i++){
+            m_index[i] = Entry(m_info->at(i).id(), i);
+        }
+
+        // the first entry of duplicate IDs is kept by lower_bound
+        std::stable_sort(m_index.get(), m_index.get() + size, [](const Entry& a, const Entry& b){
+            return a.first < b.first;
+        });
+
+        m_built = true;
+    }
+
+    ExtImageInfo* m_info;
+    std::unique_ptr<Entry[]> m_index;
+    UInt32 m_size;
+    bool m_built;
+
+};
+
 }
 
 #endif // TWPP_DETAIL_FILE_EXTIMAGEINFO_HPP
@@ -49,6 +49,23 @@ static constexpr inline UInt16 floatToFrac(float val){
     return static_cast<UInt16>(floatToValue(val) & 0xFFFF);
 }
 
+// wraps around instead of signed overflow
+static constexpr inline Int32 fix32Wrap(std::uint32_t val){
+    return val <= 0x7FFFFFFFu ? static_cast<Int32>(val) : -static_cast<Int32>(~val) - 1;
+}
+
+// divides by 65536, halves are rounded away from zero
+static constexpr inline std::int64_t fix32Round(std::int64_t val){
+    return val >= 0 ? (val + 0x8000) / 0x10000 : -((-val + 0x8000) / 0x10000);
+}
+
+// halves are rounded away from zero
+static constexpr inline std::int64_t fix32RoundDiv(std::int64_t num, std::int64_t den){
+    return (num >= 0) == (den >= 0) ?
+                (num + den / 2) / den :
+                (num - den / 2) / den;
+}
+
 }
 
 TWPP_DETAIL_PACK_BEGIN
@@ -71,6 +88,28 @@ public:
         m_whole(whole), m_frac(frac){}
 
 
+    /// Creates fixed type from its 16.16 fixed point value.
+    static constexpr Fix32 fromRaw(Int32 raw) noexcept{
+        return Fix32(static_cast<Int16>(raw >> 16), static_cast<UInt16>(raw & 0xFFFF));
+    }
+
+    /// Creates fixed type from an integer value.
+    /// The value must fit the whole part.
+    static constexpr Fix32 fromInt(Int32 value) noexcept{
+        return Fix32(static_cast<Int16>(value), 0);
+    }
+
+
+    /// The 16.16 fixed point value, `whole * 65536 + frac`.
+    constexpr Int32 raw() const noexcept{
+        return static_cast<Int32>(m_whole) * 65536 + m_frac;
+    }
+
+    /// The value rounded to the nearest integer, halves away from zero.
+    constexpr Int32 toInt() const noexcept{
+        return static_cast<Int32>(Detail::fix32Round(raw()));
+    }
+
     /// Whole part of this fixed type.
     constexpr Int16 whole() const noexcept{
         return m_whole;
@@ -102,7 +141,7 @@ public:
     }
 
     constexpr Fix32 operator-() const noexcept{
-        return -toFloat();
+        return fromRaw(Detail::fix32Wrap(0u - static_cast<std::uint32_t>(raw())));
     }
 
 private:
@@ -112,24 +151,15 @@ private:
 };
 TWPP_DETAIL_PACK_END
 
-namespace Detail {
-
-static inline constexpr Fix32 fix32AddHelper(Int32 frac, Int16 whole){
-    return frac < 65536 ? Fix32(whole, frac) : Fix32(whole + 1, frac - 65536);
-}
-
-static inline constexpr Fix32 fix32SubHelper(Int32 frac, Int16 whole){
-    return frac >= 0 ? Fix32(whole, frac) : Fix32(whole - 1, frac + 65536);
-}
-
-}
+// all arithmetic is done on the 16.16 value, without floating point conversions
+// results that do not fit wrap around
 
 static inline constexpr bool operator>(Fix32 a, Fix32 b) noexcept{
-    return a.whole() > b.whole() || (a.whole() == b.whole() && a.frac() > b.frac());
+    return a.raw() > b.raw();
 }
 
 static inline constexpr bool operator<(Fix32 a, Fix32 b) noexcept{
-    return a.whole() < b.whole() || (a.whole() == b.whole() && a.frac() < b.frac());
+    return a.raw() < b.raw();
 }
 
 static inline constexpr bool operator>=(Fix32 a, Fix32 b) noexcept{
@@ -149,19 +179,26 @@ static inline constexpr bool operator!=(Fix32 a, Fix32 b) noexcept{
 }
 
 static inline constexpr Fix32 operator+(Fix32 a, Fix32 b) noexcept{
-    return Detail::fix32AddHelper(static_cast<Int32>(a.frac()) + b.frac(), a.whole() + b.whole());
+    return Fix32::fromRaw(Detail::fix32Wrap(static_cast<std::uint32_t>(a.raw()) + static_cast<std::uint32_t>(b.raw())));
 }
 
 static inline constexpr Fix32 operator-(Fix32 a, Fix32 b) noexcept{
-    return Detail::fix32SubHelper(static_cast<Int32>(a.frac()) - b.frac(), a.whole() - b.whole());
+    return Fix32::fromRaw(Detail::fix32Wrap(static_cast<std::uint32_t>(a.raw()) - static_cast<std::uint32_t>(b.raw())));
 }
 
+/// Product rounded to 1/65536, halves away from zero.
 static inline constexpr Fix32 operator*(Fix32 a, Fix32 b) noexcept{
-    return Fix32(static_cast<float>(a) * static_cast<float>(b));
+    return Fix32::fromRaw(Detail::fix32Wrap(static_cast<std::uint32_t>(
+        Detail::fix32Round(static_cast<std::int64_t>(a.raw()) * b.raw())
+    )));
 }
 
-static inline constexpr Fix32 operator/(Fix32 a, Fix32 b) noexcept{ // wonder about zero b
-    return Fix32(static_cast<float>(a) / static_cast<float>(b));
+/// Quotient rounded to 1/65536, halves away from zero.
+/// Division by zero results in zero.
+static inline constexpr Fix32 operator/(Fix32 a, Fix32 b) noexcept{
+    return b.raw() == 0 ? Fix32() : Fix32::fromRaw(Detail::fix32Wrap(static_cast<std::uint32_t>(
+        Detail::fix32RoundDiv(static_cast<std::int64_t>(a.raw()) * 65536, b.raw())
+    )));
 }
 
 static inline Fix32& operator+=(Fix32& a, Fix32 b) noexcept{
@@ -180,6 +217,47 @@ static inline Fix32& operator/=(Fix32& a, Fix32 b) noexcept{ // wonder about zer
     return a = a / b;
 }
 
+/// Converts fixed point values to floats.
+/// \param in Input values.
+/// \param out Output values, at least `count` elements.
+/// \param count Number of values.
+static inline void fix32ToFloat(const Fix32* in, float* out, std::size_t count) noexcept{
+    for (std::size_t i = 0; i < count; i++){
+        out[i] = static_cast<float>(in[i].raw()) * (1.0f / 65536.0f);
+    }
+}
+
+/// Converts floats to fixed point values, rounded to 1/65536.
+/// \param in Input values.
+/// \param out Output values, at least `count` elements.
+/// \param count Number of values.
+static inline void floatToFix32(const float* in, Fix32* out, std::size_t count) noexcept{
+    for (std::size_t i = 0; i < count; i++){
+        out[i] = Fix32::fromRaw(Detail::floatToValue(in[i]));
+    }
+}
+
+/// Converts fixed point values to integers, rounded to the nearest integer, halves away from zero.
+/// \param in Input values.
+/// \param out Output values, at least `count` elements.
+/// \param count Number of values.
+static inline void fix32ToInt(const Fix32* in, Int32* out, std::size_t count) noexcept{
+    for (std::size_t i = 0; i < count; i++){
+        out[i] = in[i].toInt();
+    }
+}
+
+/// Converts integers to fixed point values.
+/// The values must fit the whole part.
+/// \param in Input values.
+/// \param out Output values, at least `count` elements.
+/// \param count Number of values.
+static inline void intToFix32(const Int32* in, Fix32* out, std::size_t count) noexcept{
+    for (std::size_t i = 0; i < count; i++){
+        out[i] = Fix32::fromInt(in[i]);
+    }
+}
+
 namespace Literals {
 
 static inline constexpr Fix32 operator "" _fix(long double val) noexcept{
@@ -0,0 +1,250 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_FSENUMERATOR_HPP
+#define TWPP_DETAIL_FILE_FSENUMERATOR_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Walks the file system of a source into a `FileSystemIndex`.
+/// Every directory is listed with Msg::GetFirstFile and Msg::GetNextFile once,
+/// entries are then browsed from the index without further TWAIN calls.
+/// Listing a directory again refreshes it incrementally, only new and removed entries
+/// change the index, and indexes of unchanged entries stay the same.
+///
+/// `prefetch` walks on a background thread, the index may be read while it grows:
+///
+///     FileSystemEnumerator files(source);
+///     files.prefetch(Str255("/"), true);
+///     ... // show the first entries
+///     files.read([](const FileSystemIndex& index){
+///         for (auto i = index.firstChild(FileSystemIndex::Root); i != FileSystemIndex::None; i = index.nextSibling(i)){
+///             ...
+///         }
+///     });
+///
+/// The source must not be used by other threads while a prefetch is running.
+/// On Windows, the manager may require all calls to come from the thread that opened the source,
+/// use synchronous `list` there, e.g. on the session thread.
+class FileSystemEnumerator {
+
+public:
+    /// Creates an enumerator with an empty index.
+    /// \param source Open source, must outlive the enumerator.
+    /// \throw std::bad_alloc
+    explicit FileSystemEnumerator(Source& source) :
+        m_source(&source), m_rc(ReturnCode::Success), m_cancel(false), m_added(0), m_removed(0){}
+
+    FileSystemEnumerator(const FileSystemEnumerator&) = delete;
+    FileSystemEnumerator& operator=(const FileSystemEnumerator&) = delete;
+
+    /// Cancels a running prefetch.
+    ~FileSystemEnumerator(){
+        cancel();
+    }
+
+    /// Lists a directory on the calling thread.
+    /// \param dir Absolute path of the directory.
+    /// \param recursive Whether to list subdirectories as well.
+    /// \return Success, or the first failing return code.
+    /// \throw std::bad_alloc
+    ReturnCode list(const Str255& dir, bool recursive = false){
+        wait();
+        m_cancel = false;
+        return walk(dir, recursive);
+    }
+
+    /// Lists a directory on a background thread.
+    /// A running prefetch is waited for first.
+    /// \param dir Absolute path of the directory.
+    /// \param recursive Whether to list subdirectories as well.
+    /// \throw std::system_error
+    void prefetch(const Str255& dir, bool recursive = false){
+        wait();
+        m_cancel = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rc = ReturnCode::Success;
+        }
+
+        m_thread = std::thread([this, dir, recursive](){
+            ReturnCode rc;
+            try {
+                rc = walk(dir, recursive);
+            } catch (const std::bad_alloc&){
+                rc = ReturnCode::Failure;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rc = rc;
+        });
+    }
+
+    /// Waits for a running prefetch to finish.
+    /// \return Result of the last prefetch, Success if there was none.
+    ReturnCode wait(){
+        if (m_thread.joinable()){
+            m_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rc;
+    }
+
+    /// Stops a running prefetch after the current TWAIN call, and waits for it.
+    /// Directories that were not fully listed keep their previous entries.
+    void cancel(){
+        m_cancel = true;
+        wait();
+    }
+
+    /// Reads the index, while it may be updated by a prefetch.
+    /// \param fn Called with the index, must not keep references to it.
+    /// \return Result of fn.
+    template<typename Fn>
+    auto read(Fn fn) const -> decltype(fn(std::declval<const FileSystemIndex&>())){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return fn(m_index);
+    }
+
+    /// The index, must not be used while a prefetch is running.
+    const FileSystemIndex& index() const noexcept{
+        return m_index;
+    }
+
+    /// Number of indexed entries.
+    UInt32 entries() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_index.entries();
+    }
+
+    /// Number of entries added by the last listing, e.g. new pictures since the last refresh.
+    UInt32 added() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_added;
+    }
+
+    /// Number of entries removed by the last listing.
+    UInt32 removed() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_removed;
+    }
+
+    /// Drops all indexed entries.
+    /// \throw std::bad_alloc
+    void clear(){
+        wait();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index.clear();
+    }
+
+private:
+    ReturnCode walk(const Str255& root, bool recursive){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_added = 0;
+            m_removed = 0;
+        }
+
+        std::list<Str255> dirs;
+        dirs.push_back(root);
+        while (!dirs.empty()){
+            if (m_cancel){
+                return ReturnCode::Cancel;
+            }
+
+            FileSystem fs(dirs.front(), Str255());
+            dirs.pop_front();
+
+            UInt32 dir;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                dir = m_index.find(fs.inputPath().view());
+                if (dir == FileSystemIndex::None){
+                    dir = m_index.insert(fs.inputPath().view(), FileSystem::Type::Directory);
+                    if (dir == FileSystemIndex::None){
+                        return ReturnCode::Failure; // not an absolute path
+                    }
+                }
+
+                m_index.beginRefresh();
+            }
+
+            auto rc = m_source->fileSystem(Msg::GetFirstFile, fs);
+            bool listed = rc == ReturnCode::Success;
+            if (rc == ReturnCode::Failure){
+                Status status;
+                listed = success(m_source->status(status)) && (status.condition() == ConditionCode::FileNotFound ||
+                            status.condition() == ConditionCode::NoMedia);
+            }
+
+            if (rc == ReturnCode::Success){
+                do {
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        bool added;
+                        auto i = m_index.insert(fs, added);
+                        m_added += added ? 1 : 0;
+                        if (recursive && i != FileSystemIndex::None && FileSystemIndex::isContainer(fs.type())){
+                            dirs.push_back(fs.outputPath());
+                        }
+                    }
+
+                    rc = m_cancel ? ReturnCode::Cancel : m_source->fileSystem(Msg::GetNextFile, fs);
+                } while (rc == ReturnCode::Success);
+
+                listed = rc == ReturnCode::EndOfList;
+                m_source->fileSystem(Msg::GetClose, fs);
+            }
+
+            if (!listed){
+                return rc; // entries of partially listed directories are kept
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_removed += m_index.endRefresh(dir);
+        }
+
+        return ReturnCode::Success;
+    }
+
+    Source* m_source;
+    mutable std::mutex m_mutex;
+    std::thread m_thread;
+    FileSystemIndex m_index;
+    ReturnCode m_rc;
+    std::atomic<bool> m_cancel;
+    UInt32 m_added;
+    UInt32 m_removed;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_FSENUMERATOR_HPP
@@ -0,0 +1,493 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_FSINDEX_HPP
+#define TWPP_DETAIL_FILE_FSINDEX_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Compact index of a device file system, e.g. camera storage.
+/// Entries form a tree rooted at "/", each entry stores only its own name,
+/// so directory paths are shared by all their children,
+/// and paths are looked up by hash without building FileSystem structures.
+/// Removed entries are kept as tombstones, indexes stay valid until `clear`.
+///
+/// Applications fill the index with `FileSystemEnumerator`,
+/// sources may answer Msg::GetFirstFile, Msg::GetNextFile and Msg::GetInfo from a prebuilt index:
+///
+///     Result fileSystemGetFirst(const Identity&, FileSystem& data){
+///         return m_files.getFirst(data);
+///     }
+///
+/// Not thread-safe.
+class FileSystemIndex {
+
+    struct Entry {
+        UInt32 m_parent;
+        UInt32 m_firstChild;
+        UInt32 m_lastChild;
+        UInt32 m_next;
+        UInt32 m_name;
+        UInt32 m_created;
+        UInt32 m_modified;
+        UInt32 m_size;
+        UInt32 m_generation;
+        UInt16 m_nameLength;
+        UInt8 m_createdLength;
+        UInt8 m_modifiedLength;
+        FileSystem::Type m_type;
+        bool m_removed;
+    };
+
+public:
+    enum : UInt32 {
+        /// Index of the root directory.
+        Root = 0,
+
+        /// No entry.
+        None = 0xFFFFFFFF
+    };
+
+    /// Whether entries of the type may contain other entries.
+    static constexpr bool isContainer(FileSystem::Type type) noexcept{
+        return type != FileSystem::Type::Image && type != FileSystem::Type::CameraPreview &&
+                type != FileSystem::Type::Unknown;
+    }
+
+    /// Creates an index containing the root directory only.
+    /// \throw std::bad_alloc
+    FileSystemIndex() :
+        m_size(0), m_capacity(0), m_live(0), m_generation(0){
+
+        clear();
+    }
+
+    FileSystemIndex(FileSystemIndex&&) = default;
+    FileSystemIndex& operator=(FileSystemIndex&&) = default;
+
+    /// Removes all entries but the root directory, invalidates all indexes.
+    /// \throw std::bad_alloc
+    void clear(){
+        m_size = 0;
+        m_live = 0;
+        m_pool.clear();
+        m_lookup.clear();
+        add(None, StrView(), FileSystem::Type::Directory);
+    }
+
+    /// Number of entries, removed entries and the root directory excluded.
+    UInt32 entries() const noexcept{
+        return m_live;
+    }
+
+    /// Finds an entry.
+    /// \param path Absolute path, e.g. "/camera/img0001.jpg".
+    /// \return Entry index, None if not found.
+    UInt32 find(StrView path) const noexcept{
+        auto i = lookup(path);
+        return i != None && !m_entries[i].m_removed ? i : None;
+    }
+
+    /// Adds an entry or updates an existing one, missing parent directories are created.
+    /// \param path Absolute path of the entry.
+    /// \param type Type of the entry.
+    /// \param size Size of the entry in bytes.
+    /// \return Entry index, None if the path is not absolute.
+    /// \throw std::bad_alloc
+    UInt32 insert(StrView path, FileSystem::Type type, UInt32 size = 0){
+        bool added;
+        return insert(path, type, size, added);
+    }
+
+    /// Adds an entry or updates an existing one, missing parent directories are created.
+    /// \param path Absolute path of the entry.
+    /// \param type Type of the entry.
+    /// \param size Size of the entry in bytes.
+    /// \param added Set to whether the entry was not in the index.
+    /// \return Entry index, None if the path is not absolute.
+    /// \throw std::bad_alloc
+    UInt32 insert(StrView path, FileSystem::Type type, UInt32 size, bool& added){
+        added = false;
+        path = trim(path);
+        if (path.empty() || path[0] != '/'){
+            return None;
+        }
+
+        if (path.size() == 1){
+            stamp(Root);
+            return Root;
+        }
+
+        auto i = lookup(path);
+        if (i == None){
+            auto slash = path.size() - 1;
+            while (path[slash] != '/'){
+                slash--;
+            }
+
+            auto parent = insert(StrView(path.data(), slash != 0 ? slash : 1), FileSystem::Type::Directory);
+            i = add(parent, StrView(path.data() + slash + 1, path.size() - slash - 1), type);
+            m_lookup.insert(std::make_pair(path.hash(), i));
+            added = true;
+        } else if (m_entries[i].m_removed){
+            revive(i);
+            added = true;
+        }
+
+        auto& e = m_entries[i];
+        e.m_type = type;
+        e.m_size = size;
+        stamp(i);
+        return i;
+    }
+
+    /// Adds or updates the entry of the output path of a file system operation,
+    /// e.g. Msg::GetFirstFile, including its type, size and time stamps.
+    /// \param data File system data.
+    /// \param added Set to whether the entry was not in the index.
+    /// \return Entry index, None if the path is not absolute.
+    /// \throw std::bad_alloc
+    UInt32 insert(const FileSystem& data, bool& added){
+        auto i = insert(data.outputPath().view(), data.type(), data.size(), added);
+        if (i != None){
+            setString(m_entries[i].m_created, m_entries[i].m_createdLength, data.createdTimeDate().view());
+            setString(m_entries[i].m_modified, m_entries[i].m_modifiedLength, data.modifiedTimeDate().view());
+        }
+
+        return i;
+    }
+
+    /// Removes an entry and all its children.
+    /// \param index Entry index, the root directory only removes its children.
+    void remove(UInt32 index) noexcept{
+        if (index >= m_size){
+            return;
+        }
+
+        for (auto c = m_entries[index].m_firstChild; c != None; c = m_entries[c].m_next){
+            remove(c);
+        }
+
+        if (index != Root && !m_entries[index].m_removed){
+            m_entries[index].m_removed = true;
+            m_live--;
+        }
+    }
+
+    /// Parent directory of an entry, None for the root directory.
+    UInt32 parent(UInt32 index) const noexcept{
+        return m_entries[index].m_parent;
+    }
+
+    /// First child of an entry, None if there is none.
+    UInt32 firstChild(UInt32 index) const noexcept{
+        return live(m_entries[index].m_firstChild);
+    }
+
+    /// Next sibling of an entry, None if there is none.
+    UInt32 nextSibling(UInt32 index) const noexcept{
+        return live(m_entries[index].m_next);
+    }
+
+    /// Name of an entry, empty for the root directory.
+    StrView name(UInt32 index) const noexcept{
+        auto& e = m_entries[index];
+        return StrView(m_pool.data() + e.m_name, e.m_nameLength);
+    }
+
+    /// Type of an entry.
+    FileSystem::Type type(UInt32 index) const noexcept{
+        return m_entries[index].m_type;
+    }
+
+    /// Size of an entry in bytes.
+    UInt32 fileSize(UInt32 index) const noexcept{
+        return m_entries[index].m_size;
+    }
+
+    /// Creation time stamp of an entry, might be empty.
+    StrView createdTimeDate(UInt32 index) const noexcept{
+        auto& e = m_entries[index];
+        return StrView(m_pool.data() + e.m_created, e.m_createdLength);
+    }
+
+    /// Modification time stamp of an entry, might be empty.
+    StrView modifiedTimeDate(UInt32 index) const noexcept{
+        auto& e = m_entries[index];
+        return StrView(m_pool.data() + e.m_modified, e.m_modifiedLength);
+    }
+
+    /// Absolute path of an entry.
+    Str255 path(UInt32 index) const noexcept{
+        char buffer[Str255::maxSize() + 1];
+        Str255 out;
+        out.setData(buffer, buildPath(index, buffer, sizeof(buffer)));
+        return out;
+    }
+
+    /// Fills the output path, type, size and time stamps of an entry.
+    /// \param index Entry index.
+    /// \param out File system data.
+    void fill(UInt32 index, FileSystem& out) const noexcept{
+        auto& e = m_entries[index];
+        Str32 created;
+        Str32 modified;
+        created.setData(m_pool.data() + e.m_created, e.m_createdLength);
+        modified.setData(m_pool.data() + e.m_modified, e.m_modifiedLength);
+
+        out.setOutputPath(path(index));
+        out.setType(e.m_type);
+        out.setSize(e.m_size);
+        out.setCreatedTimeDate(created);
+        out.setModifiedTimeDate(modified);
+    }
+
+    /// Starts a refresh of the direct children of a directory.
+    /// Children that are not inserted again until `endRefresh` are removed.
+    void beginRefresh() noexcept{
+        m_generation++;
+    }
+
+    /// Finishes a refresh, removes children of the directory that were not inserted since `beginRefresh`.
+    /// \param index Directory index.
+    /// \return Number of removed children.
+    UInt32 endRefresh(UInt32 index) noexcept{
+        UInt32 removed = 0;
+        for (auto c = firstChild(index); c != None; c = nextSibling(c)){
+            if (m_entries[c].m_generation != m_generation){
+                remove(c);
+                removed++;
+            }
+        }
+
+        return removed;
+    }
+
+#if defined(TWPP_IS_DS)
+    /// Handles Msg::GetFirstFile, reports the first child of the directory in the input path.
+    /// The context holds the position for Msg::GetNextFile.
+    Result getFirst(FileSystem& data) const noexcept{
+        auto dir = find(data.inputPath().view());
+        if (dir == None || !isContainer(m_entries[dir].m_type)){
+            return {ReturnCode::Failure, ConditionCode::FileNotFound};
+        }
+
+        auto c = firstChild(dir);
+        if (c == None){
+            data.setContext(nullptr);
+            return {ReturnCode::Failure, ConditionCode::FileNotFound};
+        }
+
+        fill(c, data);
+        data.setContext(toContext(c));
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::GetNextFile, reports the next entry of the directory.
+    Result getNext(FileSystem& data) const noexcept{
+        auto c = fromContext(data.context());
+        if (c == None){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        c = nextSibling(c);
+        if (c == None){
+            return {ReturnCode::EndOfList, ConditionCode::Success};
+        }
+
+        fill(c, data);
+        data.setContext(toContext(c));
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::GetClose, releases the context.
+    Result getClose(FileSystem& data) const noexcept{
+        data.setContext(nullptr);
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Handles Msg::GetInfo, reports the entry of the input path.
+    Result getInfo(FileSystem& data) const noexcept{
+        auto i = find(data.inputPath().view());
+        if (i == None){
+            return {ReturnCode::Failure, ConditionCode::FileNotFound};
+        }
+
+        fill(i, data);
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+#endif
+
+private:
+    static StrView trim(StrView path) noexcept{
+        auto size = path.size();
+        while (size > 1 && path[size - 1] == '/'){
+            size--;
+        }
+
+        return StrView(path.data(), size);
+    }
+
+    void* toContext(UInt32 index) const noexcept{
+        return reinterpret_cast<void*>(static_cast<std::uintptr_t>(index) + 1);
+    }
+
+    UInt32 fromContext(void* context) const noexcept{
+        auto i = reinterpret_cast<std::uintptr_t>(context);
+        return i != 0 && i <= m_size ? static_cast<UInt32>(i - 1) : static_cast<UInt32>(None);
+    }
+
+    UInt32 live(UInt32 index) const noexcept{
+        while (index != None && m_entries[index].m_removed){
+            index = m_entries[index].m_next;
+        }
+
+        return index;
+    }
+
+    // searches removed entries as well
+    UInt32 lookup(StrView path) const noexcept{
+        path = trim(path);
+        if (path.size() == 1 && path[0] == '/'){
+            return Root;
+        }
+
+        char buffer[Str255::maxSize() + 1];
+        auto range = m_lookup.equal_range(path.hash());
+        for (auto it = range.first; it != range.second; ++it){
+            auto len = buildPath(it->second, buffer, sizeof(buffer));
+            if (StrView(buffer, len) == path){
+                return it->second;
+            }
+        }
+
+        return None;
+    }
+
+    UInt32 buildPath(UInt32 index, char* out, UInt32 capacity) const noexcept{
+        if (index == Root){
+            out[0] = '/';
+            return 1;
+        }
+
+        // components are written from the end towards the root
+        UInt32 pos = capacity;
+        for (auto i = index; i != Root && i != None; i = m_entries[i].m_parent){
+            auto n = name(i);
+            if (pos < n.size() + 1){
+                break;
+            }
+
+            pos -= n.size();
+            std::memcpy(out + pos, n.data(), n.size());
+            out[--pos] = '/';
+        }
+
+        auto len = capacity - pos;
+        std::memmove(out, out + pos, len);
+        return len;
+    }
+
+    void stamp(UInt32 index) noexcept{
+        m_entries[index].m_generation = m_generation;
+    }
+
+    void revive(UInt32 index) noexcept{
+        for (auto i = index; i != None && m_entries[i].m_removed; i = m_entries[i].m_parent){
+            m_entries[i].m_removed = false;
+            m_live++;
+        }
+    }
+
+    void setString(UInt32& offset, UInt8& length, StrView str){
+        auto len = static_cast<UInt8>(std::min<UInt32>(str.size(), 0xFF));
+        if (len == length && std::memcmp(m_pool.data() + offset, str.data(), len) == 0){
+            return;
+        }
+
+        offset = static_cast<UInt32>(m_pool.size());
+        length = len;
+        m_pool.append(str.data(), len);
+    }
+
+    UInt32 add(UInt32 parent, StrView name, FileSystem::Type type){
+        if (m_size == m_capacity){
+            auto capacity = m_capacity ? m_capacity * 2 : 64;
+            std::unique_ptr<Entry[]> entries(new Entry[capacity]);
+            std::copy(m_entries.get(), m_entries.get() + m_size, entries.get());
+            m_entries = std::move(entries);
+            m_capacity = capacity;
+        }
+
+        auto i = m_size++;
+        auto& e = m_entries[i];
+        e.m_parent = parent;
+        e.m_firstChild = None;
+        e.m_lastChild = None;
+        e.m_next = None;
+        e.m_name = static_cast<UInt32>(m_pool.size());
+        e.m_nameLength = static_cast<UInt16>(name.size());
+        e.m_created = 0;
+        e.m_modified = 0;
+        e.m_createdLength = 0;
+        e.m_modifiedLength = 0;
+        e.m_size = 0;
+        e.m_generation = m_generation;
+        e.m_type = type;
+        e.m_removed = false;
+        m_pool.append(name.data(), name.size());
+
+        if (parent != None){
+            auto& p = m_entries[parent];
+            if (p.m_lastChild == None){
+                p.m_firstChild = i;
+            } else {
+                m_entries[p.m_lastChild].m_next = i;
+            }
+
+            p.m_lastChild = i;
+            m_live++;
+        }
+
+        return i;
+    }
+
+    std::unique_ptr<Entry[]> m_entries;
+    UInt32 m_size;
+    UInt32 m_capacity;
+    UInt32 m_live;
+    UInt32 m_generation;
+    std::string m_pool;
+    std::multimap<std::size_t, UInt32> m_lookup;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_FSINDEX_HPP
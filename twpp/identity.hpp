@@ -229,6 +229,21 @@ public:
         return m_protoMin;
     }
 
+    /// Hash of manufacturer, product family and product name.
+    /// Computed on every call, use IdentityKey to keep it.
+    std::size_t productHash() const noexcept{
+        auto manuf = m_manuf.view();
+        auto family = m_prodFamily.view();
+        auto name = m_prodName.view();
+
+        // lengths separate the strings
+        UInt32 sizes[3] = {manuf.size(), family.size(), name.size()};
+        auto hash = Detail::strHash(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        hash = Detail::strHash(manuf.data(), manuf.size(), hash);
+        hash = Detail::strHash(family.data(), family.size(), hash);
+        return static_cast<std::size_t>(Detail::strHash(name.data(), name.size(), hash));
+    }
+
 private:
     Id m_id;
     Version m_version;
@@ -242,6 +257,95 @@ private:
 };
 TWPP_DETAIL_PACK_END
 
+/// Hashable key of a source product: manufacturer, product family and product name.
+/// The strings are copied once and the hash is precomputed,
+/// so that keyed lookups, e.g. in std::unordered_map, do not allocate nor rehash.
+class IdentityKey {
+
+public:
+    /// Creates key of empty strings.
+    IdentityKey() noexcept :
+        m_hash(Identity().productHash()){}
+
+    /// Creates key of the identity product.
+    explicit IdentityKey(const Identity& identity) noexcept :
+        m_manuf(identity.manufacturer()),
+        m_prodFamily(identity.productFamily()),
+        m_prodName(identity.productName()),
+        m_hash(identity.productHash()){}
+
+    const Str32& manufacturer() const noexcept{
+        return m_manuf;
+    }
+
+    const Str32& productFamily() const noexcept{
+        return m_prodFamily;
+    }
+
+    const Str32& productName() const noexcept{
+        return m_prodName;
+    }
+
+    /// The precomputed hash, equals Identity::productHash.
+    std::size_t hash() const noexcept{
+        return m_hash;
+    }
+
+    /// Whether the identity product matches this key,
+    /// i.e. manufacturer, product family and product name are equal.
+    bool matches(const Identity& identity) const noexcept{
+        return m_prodName.view() == identity.productName().view() &&
+                m_manuf.view() == identity.manufacturer().view() &&
+                m_prodFamily.view() == identity.productFamily().view();
+    }
+
+private:
+    Str32 m_manuf;
+    Str32 m_prodFamily;
+    Str32 m_prodName;
+    std::size_t m_hash;
+
+};
+
+static inline bool operator==(const IdentityKey& a, const IdentityKey& b) noexcept{
+    return a.hash() == b.hash() &&
+            a.productName().view() == b.productName().view() &&
+            a.manufacturer().view() == b.manufacturer().view() &&
+            a.productFamily().view() == b.productFamily().view();
+}
+
+static inline bool operator!=(const IdentityKey& a, const IdentityKey& b) noexcept{
+    return !(a == b);
+}
+
+/// Orders by hash first, the order is arbitrary but consistent.
+static inline bool operator<(const IdentityKey& a, const IdentityKey& b) noexcept{
+    if (a.hash() != b.hash()){
+        return a.hash() < b.hash();
+    }
+
+    auto rc = a.manufacturer().view().compare(b.manufacturer().view());
+    if (rc == 0){
+        rc = a.productFamily().view().compare(b.productFamily().view());
+        if (rc == 0){
+            rc = a.productName().view().compare(b.productName().view());
+        }
+    }
+
+    return rc < 0;
+}
+
+}
+
+namespace std {
+
+template<>
+struct hash<Twpp::IdentityKey> {
+    std::size_t operator()(const Twpp::IdentityKey& key) const noexcept{
+        return key.hash();
+    }
+};
+
 }
 
 #endif // TWPP_DETAIL_FILE_IDENTITY_HPP
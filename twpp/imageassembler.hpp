@@ -0,0 +1,483 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_IMAGEASSEMBLER_HPP
+#define TWPP_DETAIL_FILE_IMAGEASSEMBLER_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Copies bits between MSB-first bit rows, the ranges must not overlap.
+static inline void copyBits(const UInt8* src, UInt32 srcBit, UInt8* dst, UInt32 dstBit, UInt32 bits) noexcept{
+    if (((srcBit | dstBit) & 7) == 0){
+        std::memcpy(dst + (dstBit >> 3), src + (srcBit >> 3), bits >> 3);
+        if (bits & 7){
+            auto mask = static_cast<UInt8>(0xFF00 >> (bits & 7));
+            auto& d = dst[(dstBit + bits) >> 3];
+            d = static_cast<UInt8>((d & ~mask) | (src[(srcBit + bits) >> 3] & mask));
+        }
+
+        return;
+    }
+
+    for (UInt32 i = 0; i < bits; i += 8){
+        auto n = std::min<UInt32>(8, bits - i);
+
+        // n bits from the source, aligned to the top of v
+        auto s = srcBit + i;
+        auto sh = s & 7;
+        UInt32 v = static_cast<UInt32>(src[s >> 3]) << (8 + sh);
+        if (sh + n > 8){
+            v |= static_cast<UInt32>(src[(s >> 3) + 1]) << sh;
+        }
+
+        v = (v >> 8) & (0xFF00u >> n) & 0xFF;
+
+        auto d = dstBit + i;
+        auto dh = d & 7;
+        UInt32 mask = (0xFF00u >> n) & 0xFF;
+        auto& d0 = dst[d >> 3];
+        d0 = static_cast<UInt8>((d0 & ~(mask >> dh)) | (v >> dh));
+        if (dh + n > 8){
+            auto& d1 = dst[(d >> 3) + 1];
+            d1 = static_cast<UInt8>((d1 & ~(mask << (8 - dh))) | ((v << (8 - dh)) & 0xFF));
+        }
+    }
+}
+
+}
+
+/// Assembles segmented pages and merged sides into a single image.
+/// Segments (CapType::Segmented) and sides are written straight into one output buffer
+/// at their final offsets as their strips arrive, no intermediate images are kept.
+/// The buffer is kept for following sheets, `reserve` preallocates it.
+///
+/// Sides are arranged by ImageMerge, as CapType::IImageMerge does in sources that cannot merge.
+/// When the back side goes above or left of the front, the front side is moved in place
+/// once the back side size is known.
+///
+///     ImageAssembler sheet(ImageMerge::FrontOnTop);
+///     sheet.reserve(2 * pageBytes);
+///     sheet.begin();
+///     do {
+///         src.imageInfo(info);
+///         src.extImageInfo(ext);
+///         ExtImageInfoIndex index(ext);
+///         sheet.beginPart(info, ImageAssembler::part(index));
+///         src.imageMemXferStream([&](const ImageMemXfer& strip){
+///             return sheet.write(strip);
+///         });
+///     } while (!sheet.endPart());
+///
+///     save(sheet.imageInfo(), sheet.data());
+///
+/// Supports uncompressed chunky images, all parts of a sheet must have the same pixel format.
+/// Output rows are not padded, areas not covered by any part are zero.
+/// Not thread-safe.
+class ImageAssembler {
+
+public:
+    /// Placement of an image part.
+    struct Part {
+        /// Side of the sheet.
+        PageSide m_side;
+
+        /// Segment number, see InfoId::SegmentNumber.
+        UInt32 m_segment;
+
+        /// Whether this is the last segment of the side, see InfoId::LastSegment.
+        bool m_last;
+    };
+
+    /// Placement of an image part from its extended image information.
+    /// Missing information means an unsegmented front side.
+    /// \param ext Index of extended image information with InfoId::PageSide,
+    ///            InfoId::SegmentNumber and InfoId::LastSegment.
+    /// \throw std::bad_alloc
+    static Part part(ExtImageInfoIndex& ext){
+        Part p{PageSide::Top, 0, true};
+        ext.value<InfoId::PageSide>(p.m_side);
+        ext.value<InfoId::SegmentNumber>(p.m_segment);
+
+        Bool last = true;
+        ext.value<InfoId::LastSegment>(last);
+        p.m_last = last;
+        return p;
+    }
+
+    /// Creates an assembler.
+    /// \param merge Arrangement of sides, None assembles segments of a single side.
+    explicit ImageAssembler(ImageMerge merge = ImageMerge::None) noexcept :
+        m_merge(merge), m_capacity(0){
+
+        begin();
+    }
+
+    /// Allocates the output buffer in advance.
+    /// \param bytes Expected size of the assembled image.
+    /// \throw std::bad_alloc
+    void reserve(std::size_t bytes){
+        if (bytes > m_capacity){
+            grow(bytes);
+        }
+    }
+
+    /// Starts a new sheet, the buffer is reused.
+    void begin() noexcept{
+        m_bpp = 0;
+        m_stride = 0;
+        m_width = 0;
+        m_height = 0;
+        m_side = nullptr;
+        m_front = Side();
+        m_back = Side();
+        m_started = false;
+        m_complete = false;
+    }
+
+    /// Starts an image part, placed after previous segments of its side.
+    /// \param info Image information of the part.
+    /// \param part Placement of the part.
+    /// \return Whether the part can be assembled.
+    /// \throw std::bad_alloc
+    bool beginPart(const ImageInfo& info, const Part& part){
+        return beginPart(info, nullptr, part);
+    }
+
+    /// Starts an image part, segments are placed by their frames relative to the first segment.
+    /// Frames are expected in inches, the TWAIN default of CapType::IUnits.
+    /// \param info Image information of the part.
+    /// \param layout Image layout of the part.
+    /// \param part Placement of the part.
+    /// \return Whether the part can be assembled.
+    /// \throw std::bad_alloc
+    bool beginPart(const ImageInfo& info, const ImageLayout& layout, const Part& part){
+        return beginPart(info, &layout.frame(), part);
+    }
+
+    /// Writes an uncompressed strip or tile of the current part.
+    /// \return Whether the strip was written.
+    /// \throw std::bad_alloc
+    bool write(const ImageMemXfer& strip){
+        if (!m_side || strip.compression() != Compression::None){
+            return false;
+        }
+
+        auto lock = strip.memory().data();
+        return writeRows(reinterpret_cast<const UInt8*>(lock.data()), strip.bytesPerRow(),
+                         strip.xOffset(), strip.yOffset(), strip.columns(), strip.rows());
+    }
+
+    /// Writes rows of the current part following the previously written ones,
+    /// e.g. decoded native or file transfers.
+    /// \param rows Pixel rows.
+    /// \param bytesPerRow Row stride in bytes.
+    /// \param count Number of rows.
+    /// \return Whether the rows were written.
+    /// \throw std::bad_alloc
+    bool write(const void* rows, UInt32 bytesPerRow, UInt32 count){
+        if (!m_side){
+            return false;
+        }
+
+        return writeRows(static_cast<const UInt8*>(rows), bytesPerRow, 0, m_partRows, m_partWidth, count);
+    }
+
+    /// Finishes the current part.
+    /// \return Whether the sheet is complete, all sides received their last segment.
+    bool endPart() noexcept{
+        if (m_side){
+            m_side->m_rows = std::max(m_side->m_rows, m_partY - m_side->m_y + m_partRows);
+            m_side->m_width = std::max(m_side->m_width, m_partX - m_side->m_x + m_partWidth);
+            if (m_partLast){
+                m_side->m_done = true;
+            }
+
+            m_side = nullptr;
+        }
+
+        m_complete = m_front.m_done && (m_merge == ImageMerge::None || m_back.m_done);
+        return m_complete;
+    }
+
+    /// Whether the sheet is complete.
+    bool complete() const noexcept{
+        return m_complete;
+    }
+
+    /// Assembled pixels, `height() * bytesPerRow()` bytes.
+    const UInt8* data() const noexcept{
+        return m_buffer.get();
+    }
+
+    /// Width of the assembled image in pixels.
+    UInt32 width() const noexcept{
+        return m_width;
+    }
+
+    /// Height of the assembled image in pixels.
+    UInt32 height() const noexcept{
+        return m_height;
+    }
+
+    /// Number of bytes of each row.
+    UInt32 bytesPerRow() const noexcept{
+        return m_stride;
+    }
+
+    /// Image information of the assembled image, taken from the first part.
+    ImageInfo imageInfo() const noexcept{
+        auto info = m_info;
+        info.setWidth(static_cast<Int32>(m_width));
+        info.setHeight(static_cast<Int32>(m_height));
+        return info;
+    }
+
+private:
+    struct Side {
+        Side() noexcept :
+            m_x(0), m_y(0), m_width(0), m_rows(0), m_reserved(0), m_firstTop(0.0f), m_firstLeft(0.0f),
+            m_started(false), m_done(false){}
+
+        UInt32 m_x;
+        UInt32 m_y;
+        UInt32 m_width;
+        UInt32 m_rows;
+        UInt32 m_reserved;
+        float m_firstTop;
+        float m_firstLeft;
+        bool m_started;
+        bool m_done;
+    };
+
+    bool beginPart(const ImageInfo& info, const Frame* frame, const Part& part){
+        endPart();
+        if (info.compression() != Compression::None || info.planar() || info.bitsPerPixel() <= 0 || info.width() <= 0){
+            return false;
+        }
+
+        auto bpp = static_cast<UInt32>(info.bitsPerPixel());
+        if (!m_started){
+            m_info = info;
+            m_bpp = bpp;
+            m_started = true;
+        } else if (bpp != m_bpp || info.pixelType() != m_info.pixelType()){
+            return false;
+        }
+
+        bool back = m_merge != ImageMerge::None && part.m_side == PageSide::Bottom;
+        if (!back && m_back.m_started){
+            return false;
+        }
+
+        auto width = static_cast<UInt32>(info.width());
+        auto height = info.height() > 0 ? static_cast<UInt32>(info.height()) : 0;
+        auto& side = back ? m_back : m_front;
+        if (!side.m_started){
+            side.m_started = true;
+            if (frame){
+                side.m_firstTop = static_cast<float>(frame->top());
+                side.m_firstLeft = static_cast<float>(frame->left());
+            }
+
+            if (back){
+                placeBack(width, height);
+            }
+        }
+
+        UInt32 offX = 0;
+        UInt32 offY = side.m_rows;
+        if (frame && part.m_segment != 0){
+            auto dy = (static_cast<float>(frame->top()) - side.m_firstTop) * static_cast<float>(info.yResolution());
+            auto dx = (static_cast<float>(frame->left()) - side.m_firstLeft) * static_cast<float>(info.xResolution());
+            offY = dy > 0.0f ? static_cast<UInt32>(dy + 0.5f) : 0;
+            offX = dx > 0.0f ? static_cast<UInt32>(dx + 0.5f) : 0;
+        }
+
+        m_side = &side;
+        m_partX = side.m_x + offX;
+        m_partY = side.m_y + offY;
+        m_partWidth = width;
+        m_partRows = 0;
+        m_partLast = part.m_last;
+        resize(m_partX + width, m_partY + height);
+        return true;
+    }
+
+    // the front side is complete once the back side starts
+    void placeBack(UInt32 width, UInt32 height){
+        auto frontW = m_front.m_width;
+        auto frontH = m_front.m_rows;
+        switch (m_merge){
+            case ImageMerge::FrontOnTop:
+                m_back.m_y = frontH;
+                break;
+
+            case ImageMerge::FrontOnLeft:
+                m_back.m_x = frontW;
+                break;
+
+            case ImageMerge::FrontOnBottom:
+                m_back.m_reserved = height != 0 ? height : frontH;
+                moveFront(0, m_back.m_reserved);
+                break;
+
+            case ImageMerge::FrontOnRight:
+                moveFront(width, 0);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void moveFront(UInt32 dx, UInt32 dy){
+        auto rows = m_front.m_rows;
+        auto width = m_front.m_width;
+        resize(m_front.m_x + dx + width, m_front.m_y + dy + rows);
+        if (dy != 0){
+            auto first = m_front.m_y;
+            std::memmove(row(first + dy), row(first), static_cast<std::size_t>(rows) * m_stride);
+            std::memset(row(first), 0, static_cast<std::size_t>(std::min(dy, rows)) * m_stride);
+            m_front.m_y += dy;
+        }
+
+        if (dx != 0){
+            std::unique_ptr<UInt8[]> tmp(new UInt8[m_stride + 1]());
+            for (UInt32 r = 0; r < rows; r++){
+                auto line = row(m_front.m_y + r);
+                Detail::copyBits(line, m_front.m_x * m_bpp, tmp.get(), 0, width * m_bpp);
+                clearBits(line, m_front.m_x * m_bpp, std::min(dx, width) * m_bpp);
+                Detail::copyBits(tmp.get(), 0, line, (m_front.m_x + dx) * m_bpp, width * m_bpp);
+            }
+
+            m_front.m_x += dx;
+        }
+    }
+
+    bool writeRows(const UInt8* src, UInt32 bytesPerRow, UInt32 x, UInt32 y, UInt32 columns, UInt32 rows){
+        if (columns > m_partWidth || x > m_partWidth - columns ||
+                static_cast<std::uint64_t>(columns) * m_bpp > static_cast<std::uint64_t>(bytesPerRow) * 8){
+            return false;
+        }
+
+        auto bottom = y + rows;
+        auto sideBottom = m_partY - m_side->m_y + bottom;
+        if (m_side == &m_back && m_merge == ImageMerge::FrontOnBottom && sideBottom > m_back.m_reserved){
+            auto dy = sideBottom - m_back.m_reserved;
+            m_back.m_reserved = sideBottom;
+            moveFront(0, dy);
+        }
+
+        resize(m_partX + x + columns, m_partY + bottom);
+        for (UInt32 r = 0; r < rows; r++){
+            Detail::copyBits(src + static_cast<std::size_t>(r) * bytesPerRow, 0, row(m_partY + y + r), (m_partX + x) * m_bpp, columns * m_bpp);
+        }
+
+        m_partRows = std::max(m_partRows, bottom);
+        return true;
+    }
+
+    UInt8* row(UInt32 r) noexcept{
+        return m_buffer.get() + static_cast<std::size_t>(r) * m_stride;
+    }
+
+    static void clearBits(UInt8* line, UInt32 bit, UInt32 bits) noexcept{
+        static const UInt8 zeros[32] = {};
+        for (UInt32 i = 0; i < bits; i += 256){
+            Detail::copyBits(zeros, 0, line, bit + i, std::min<UInt32>(256, bits - i));
+        }
+    }
+
+    // grows the image to at least the size, keeping its contents
+    void resize(UInt32 width, UInt32 height){
+        width = std::max(width, m_width);
+        height = std::max(height, m_height);
+        auto stride = static_cast<UInt32>((static_cast<std::uint64_t>(width) * m_bpp + 7) / 8);
+        auto bytes = static_cast<std::size_t>(stride) * height;
+        if (bytes > m_capacity){
+            grow(std::max(bytes, 2 * m_capacity));
+        }
+
+        if (stride != m_stride && m_height != 0){
+            // wider rows, moved from the last one so none is overwritten before it is moved
+            for (auto r = m_height; r-- > 0;){
+                auto src = m_buffer.get() + static_cast<std::size_t>(r) * m_stride;
+                auto dst = m_buffer.get() + static_cast<std::size_t>(r) * stride;
+                std::memmove(dst, src, m_stride);
+                std::memset(dst + m_stride, 0, stride - m_stride);
+            }
+        }
+
+        if (height > m_height || stride != m_stride){
+            auto used = static_cast<std::size_t>(stride) * m_height;
+            std::memset(m_buffer.get() + used, 0, bytes - used);
+        }
+
+        m_stride = stride;
+        m_width = width;
+        m_height = height;
+    }
+
+    void grow(std::size_t bytes){
+        std::unique_ptr<UInt8[]> buffer(new UInt8[bytes]);
+        if (m_buffer){
+            std::memcpy(buffer.get(), m_buffer.get(), static_cast<std::size_t>(m_stride) * m_height);
+        }
+
+        m_buffer = std::move(buffer);
+        m_capacity = bytes;
+    }
+
+    ImageMerge m_merge;
+    std::unique_ptr<UInt8[]> m_buffer;
+    std::size_t m_capacity;
+    ImageInfo m_info;
+    UInt32 m_bpp;
+    UInt32 m_stride;
+    UInt32 m_width;
+    UInt32 m_height;
+
+    Side m_front;
+    Side m_back;
+    Side* m_side;
+    UInt32 m_partX;
+    UInt32 m_partY;
+    UInt32 m_partWidth;
+    UInt32 m_partRows;
+    bool m_partLast;
+    bool m_started;
+    bool m_complete;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_IMAGEASSEMBLER_HPP
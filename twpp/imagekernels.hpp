@@ -0,0 +1,817 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_IMAGEKERNELS_HPP
+#define TWPP_DETAIL_FILE_IMAGEKERNELS_HPP
+
+#include "../twpp.hpp"
+
+// Instruction sets are selected at compile time from the compiler target flags,
+// define TWPP_NO_SIMD to use the scalar code only.
+#if !defined(TWPP_NO_SIMD)
+#   if defined(__AVX2__)
+#       define TWPP_DETAIL_SIMD_AVX2 1
+#   endif
+#   if defined(__SSSE3__) || defined(__AVX__)
+#       define TWPP_DETAIL_SIMD_SSSE3 1
+#   endif
+#   if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#       define TWPP_DETAIL_SIMD_SSE2 1
+#   endif
+#   if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#       define TWPP_DETAIL_SIMD_NEON 1
+#   endif
+#endif
+
+#if defined(TWPP_DETAIL_SIMD_AVX2)
+#   include <immintrin.h>
+#elif defined(TWPP_DETAIL_SIMD_SSSE3)
+#   include <tmmintrin.h>
+#elif defined(TWPP_DETAIL_SIMD_SSE2)
+#   include <emmintrin.h>
+#endif
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+#   include <arm_neon.h>
+#endif
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Reverses the order of bits in a byte.
+static inline constexpr UInt8 reverseBits(UInt8 b) noexcept{
+    return static_cast<UInt8>((((b * 0x0802u) & 0x22110u) | ((b * 0x8020u) & 0x88440u)) * 0x10101u >> 16);
+}
+
+/// Value of 1-bit pixel `i` in a packed row.
+static inline bool bitAt(const UInt8* row, UInt32 i, BitOrder order) noexcept{
+    auto shift = order == BitOrder::MsbFirst ? 7 - (i & 7) : (i & 7);
+    return ((row[i >> 3] >> shift) & 1) != 0;
+}
+
+}
+
+/// Swaps red and blue channels of 8-bit chunky pixels, converting BGR(A) to RGB(A) and back.
+/// Source and destination may be the same buffer, otherwise they must not overlap.
+/// \param src Source pixels.
+/// \param dst Destination pixels.
+/// \param pixels Number of pixels.
+/// \param bytesPerPixel Either 3 (RGB) or 4 (RGBA).
+static inline void swapRedBlue(const void* src, void* dst, UInt32 pixels, UInt32 bytesPerPixel = 3) noexcept{
+    assert(bytesPerPixel == 3 || bytesPerPixel == 4);
+
+    auto in = static_cast<const UInt8*>(src);
+    auto out = static_cast<UInt8*>(dst);
+    UInt32 i = 0;
+
+    if (bytesPerPixel == 3){
+#if defined(TWPP_DETAIL_SIMD_NEON)
+        for ( ; i + 16 <= pixels; i += 16){
+            uint8x16x3_t v = vld3q_u8(in + i * 3);
+            uint8x16_t tmp = v.val[0];
+            v.val[0] = v.val[2];
+            v.val[2] = tmp;
+            vst3q_u8(out + i * 3, v);
+        }
+#elif defined(TWPP_DETAIL_SIMD_SSSE3)
+        // 5 pixels per 16 bytes, the last byte is just copied and processed by the next step
+        const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+        for ( ; i * 3 + 16 <= pixels * 3; i += 5){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 3), _mm_shuffle_epi8(v, mask));
+        }
+#endif
+
+        for ( ; i < pixels; i++){
+            const UInt8* p = in + i * 3;
+            UInt8* q = out + i * 3;
+            UInt8 r = p[0];
+            q[1] = p[1];
+            q[0] = p[2];
+            q[2] = r;
+        }
+    } else {
+#if defined(TWPP_DETAIL_SIMD_NEON)
+        for ( ; i + 16 <= pixels; i += 16){
+            uint8x16x4_t v = vld4q_u8(in + i * 4);
+            uint8x16_t tmp = v.val[0];
+            v.val[0] = v.val[2];
+            v.val[2] = tmp;
+            vst4q_u8(out + i * 4, v);
+        }
+#else
+#   if defined(TWPP_DETAIL_SIMD_AVX2)
+        {
+            const __m256i keep = _mm256_set1_epi32(static_cast<int>(0xFF00FF00u));
+            const __m256i low = _mm256_set1_epi32(0x000000FF);
+            for ( ; i + 8 <= pixels; i += 8){
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 4));
+                __m256i r = _mm256_or_si256(_mm256_and_si256(v, keep),
+                        _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(v, 16), low),
+                                        _mm256_slli_epi32(_mm256_and_si256(v, low), 16)));
+
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), r);
+            }
+        }
+#   endif
+#   if defined(TWPP_DETAIL_SIMD_SSE2)
+        {
+            const __m128i keep = _mm_set1_epi32(static_cast<int>(0xFF00FF00u));
+            const __m128i low = _mm_set1_epi32(0x000000FF);
+            for ( ; i + 4 <= pixels; i += 4){
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4));
+                __m128i r = _mm_or_si128(_mm_and_si128(v, keep),
+                        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                                     _mm_slli_epi32(_mm_and_si128(v, low), 16)));
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), r);
+            }
+        }
+#   endif
+#endif
+
+        for ( ; i < pixels; i++){
+            const UInt8* p = in + i * 4;
+            UInt8* q = out + i * 4;
+            UInt8 r = p[0];
+            q[1] = p[1];
+            q[3] = p[3];
+            q[0] = p[2];
+            q[2] = r;
+        }
+    }
+}
+
+/// Copies rows between buffers with independent strides.
+/// Pass pointer to the last row and negative stride to convert
+/// bottom-up images (e.g. DIB) to top-down and back.
+/// The buffers must not overlap.
+/// \param src First source row.
+/// \param srcStride Distance between source rows in bytes.
+/// \param dst First destination row.
+/// \param dstStride Distance between destination rows in bytes.
+/// \param rowBytes Number of bytes to copy from each row.
+/// \param rows Number of rows.
+static inline void copyRows(const void* src, Int32 srcStride, void* dst, Int32 dstStride,
+                            UInt32 rowBytes, UInt32 rows) noexcept{
+    auto in = static_cast<const char*>(src);
+    auto out = static_cast<char*>(dst);
+    for (UInt32 r = 0; r < rows; r++){
+        std::memcpy(out, in, rowBytes);
+        in += srcStride;
+        out += dstStride;
+    }
+}
+
+/// Flips the image vertically in place, converting bottom-up rows to top-down and back.
+/// \param data First row.
+/// \param bytesPerRow Distance between rows in bytes.
+/// \param rows Number of rows.
+static inline void flipRows(void* data, UInt32 bytesPerRow, UInt32 rows) noexcept{
+    if (rows < 2){
+        return;
+    }
+
+    auto top = static_cast<char*>(data);
+    auto bottom = top + static_cast<std::size_t>(bytesPerRow) * (rows - 1);
+    for ( ; top < bottom; top += bytesPerRow, bottom -= bytesPerRow){
+        std::swap_ranges(top, top + bytesPerRow, bottom);
+    }
+}
+
+/// Expands 1-bit pixels to 8-bit ones.
+/// \param src Packed pixels.
+/// \param dst Expanded pixels, one byte per pixel.
+/// \param pixels Number of pixels.
+/// \param order Order of bits in each packed byte, see CapType::IBitOrder.
+/// \param zero Value of pixels whose bit is 0.
+/// \param one Value of pixels whose bit is 1, with PixelFlavor::Chocolate 1 is white.
+static inline void unpackBits(const void* src, void* dst, UInt32 pixels, BitOrder order,
+                              UInt8 zero = 0x00, UInt8 one = 0xFF) noexcept{
+    auto in = static_cast<const UInt8*>(src);
+    auto out = static_cast<UInt8*>(dst);
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    const uint8x16_t bits = order == BitOrder::MsbFirst ?
+            vcombine_u8(vcreate_u8(0x0102040810204080ull), vcreate_u8(0x0102040810204080ull)) :
+            vcombine_u8(vcreate_u8(0x8040201008040201ull), vcreate_u8(0x8040201008040201ull));
+
+    const uint8x16_t zeroV = vdupq_n_u8(zero);
+    const uint8x16_t oneV = vdupq_n_u8(one);
+    for ( ; i + 16 <= pixels; i += 16){
+        uint8x16_t v = vcombine_u8(vdup_n_u8(in[i >> 3]), vdup_n_u8(in[(i >> 3) + 1]));
+        vst1q_u8(out + i, vbslq_u8(vtstq_u8(v, bits), oneV, zeroV));
+    }
+#elif defined(TWPP_DETAIL_SIMD_SSE2)
+    const __m128i bits = order == BitOrder::MsbFirst ?
+            _mm_set1_epi64x(0x0102040810204080ll) :
+            _mm_set1_epi64x(static_cast<long long>(0x8040201008040201ull));
+
+    const __m128i zeroV = _mm_set1_epi8(static_cast<char>(zero));
+    const __m128i oneV = _mm_set1_epi8(static_cast<char>(one));
+    for ( ; i + 16 <= pixels; i += 16){
+        __m128i v = _mm_set_epi64x(static_cast<long long>(in[(i >> 3) + 1] * 0x0101010101010101ull),
+                                   static_cast<long long>(in[i >> 3] * 0x0101010101010101ull));
+
+        __m128i m = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+        __m128i r = _mm_or_si128(_mm_and_si128(m, oneV), _mm_andnot_si128(m, zeroV));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+    }
+#endif
+
+    for ( ; i < pixels; i++){
+        out[i] = Detail::bitAt(in, i, order) ? one : zero;
+    }
+}
+
+/// Packs 8-bit pixels to 1-bit ones.
+/// Unused bits of the last byte are cleared.
+/// \param src Pixels, one byte per pixel.
+/// \param dst Packed pixels, (pixels + 7) / 8 bytes.
+/// \param pixels Number of pixels.
+/// \param order Order of bits in each packed byte, see CapType::IBitOrder.
+/// \param threshold Pixels at least this bright are stored as 1.
+static inline void packBits(const void* src, void* dst, UInt32 pixels, BitOrder order,
+                            UInt8 threshold = 0x80) noexcept{
+    auto in = static_cast<const UInt8*>(src);
+    auto out = static_cast<UInt8*>(dst);
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    const uint8x16_t weights = order == BitOrder::MsbFirst ?
+            vcombine_u8(vcreate_u8(0x0102040810204080ull), vcreate_u8(0x0102040810204080ull)) :
+            vcombine_u8(vcreate_u8(0x8040201008040201ull), vcreate_u8(0x8040201008040201ull));
+
+    const uint8x16_t thr = vdupq_n_u8(threshold);
+    for ( ; i + 16 <= pixels; i += 16){
+        uint8x16_t m = vandq_u8(vcgeq_u8(vld1q_u8(in + i), thr), weights);
+        uint8x8_t sum = vpadd_u8(vget_low_u8(m), vget_high_u8(m));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        out[i >> 3] = vget_lane_u8(sum, 0);
+        out[(i >> 3) + 1] = vget_lane_u8(sum, 1);
+    }
+#elif defined(TWPP_DETAIL_SIMD_SSE2)
+    if (threshold != 0){
+        // unsigned p >= threshold <=> signed (p ^ 0x80) > ((threshold - 1) ^ 0x80)
+        const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+        const __m128i thr = _mm_set1_epi8(static_cast<char>((threshold - 1) ^ 0x80));
+        for ( ; i + 16 <= pixels; i += 16){
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), bias);
+            auto mask = static_cast<UInt32>(_mm_movemask_epi8(_mm_cmpgt_epi8(v, thr)));
+            auto lo = static_cast<UInt8>(mask);
+            auto hi = static_cast<UInt8>(mask >> 8);
+            out[i >> 3] = order == BitOrder::MsbFirst ? Detail::reverseBits(lo) : lo;
+            out[(i >> 3) + 1] = order == BitOrder::MsbFirst ? Detail::reverseBits(hi) : hi;
+        }
+    }
+#endif
+
+    for ( ; i < pixels; i += 8){
+        UInt8 byte = 0;
+        UInt32 count = std::min<UInt32>(8, pixels - i);
+        for (UInt32 b = 0; b < count; b++){
+            if (in[i + b] >= threshold){
+                byte |= static_cast<UInt8>(order == BitOrder::MsbFirst ? 0x80 >> b : 1 << b);
+            }
+        }
+
+        out[i >> 3] = byte;
+    }
+}
+
+/// Inverts all bits, converting between PixelFlavor::Chocolate and PixelFlavor::Vanilla.
+/// Works for any bit depth of unsigned samples.
+/// Source and destination may be the same buffer, otherwise they must not overlap.
+/// \param src Source bytes.
+/// \param dst Destination bytes.
+/// \param bytes Number of bytes.
+static inline void invertPixels(const void* src, void* dst, UInt32 bytes) noexcept{
+    auto in = static_cast<const UInt8*>(src);
+    auto out = static_cast<UInt8*>(dst);
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    for ( ; i + 16 <= bytes; i += 16){
+        vst1q_u8(out + i, vmvnq_u8(vld1q_u8(in + i)));
+    }
+#else
+#   if defined(TWPP_DETAIL_SIMD_AVX2)
+    const __m256i ones256 = _mm256_set1_epi8(static_cast<char>(0xFF));
+    for ( ; i + 32 <= bytes; i += 32){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(v, ones256));
+    }
+#   endif
+#   if defined(TWPP_DETAIL_SIMD_SSE2)
+    const __m128i ones = _mm_set1_epi8(static_cast<char>(0xFF));
+    for ( ; i + 16 <= bytes; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(v, ones));
+    }
+#   endif
+#endif
+
+    for ( ; i < bytes; i++){
+        out[i] = static_cast<UInt8>(~in[i]);
+    }
+}
+
+/// Swaps red and blue channels of every row in a memory transfer strip.
+/// \param strip Uncompressed strip of 8-bit chunky pixels.
+/// \param bytesPerPixel Either 3 (RGB) or 4 (RGBA).
+static inline void swapRedBlue(ImageMemXfer& strip, UInt32 bytesPerPixel = 3) noexcept{
+    assert(strip.compression() == Compression::None);
+
+    auto lock = strip.memory().data();
+    char* row = lock.data();
+    for (UInt32 r = 0; r < strip.rows(); r++, row += strip.bytesPerRow()){
+        swapRedBlue(row, row, strip.columns(), bytesPerPixel);
+    }
+}
+
+/// Flips rows of a memory transfer strip in place.
+/// \param strip Uncompressed strip.
+static inline void flipRows(ImageMemXfer& strip) noexcept{
+    assert(strip.compression() == Compression::None);
+
+    auto lock = strip.memory().data();
+    flipRows(lock.data(), strip.bytesPerRow(), strip.rows());
+}
+
+/// Inverts all bytes written to a memory transfer strip, see `invertPixels`.
+/// \param strip Uncompressed strip.
+static inline void invertPixels(ImageMemXfer& strip) noexcept{
+    assert(strip.compression() == Compression::None);
+
+    auto lock = strip.memory().data();
+    invertPixels(lock.data(), lock.data(), std::min(strip.bytesWritten(), strip.memory().size()));
+}
+
+namespace Detail {
+
+/// Per-channel byte lookup tables of a response curve.
+/// Sub-byte gray samples are expanded to a table of whole bytes,
+/// so that several pixels are mapped by a single lookup.
+class ResponseLut {
+
+public:
+    /// Builds tables for chunky data described by `info`.
+    /// \param curve Response curve with `2^bitsPerSample` elements.
+    /// \param info Image layout, 8 bits per sample, or 1, 2, 4 bits of a single sample.
+    /// \param rgb Whether the curve is RgbResponse (channel per sample) or GrayResponse (channel 1 only).
+    /// \throw RangeException When the layout is not supported.
+    ResponseLut(const CurveResponse& curve, const ImageInfo& info, bool rgb){
+        auto spp = info.samplesPerPixel();
+        auto bpp = info.bitsPerPixel();
+        if (curve.data() == nullptr || spp <= 0 || spp > 4 || bpp <= 0 || bpp % spp != 0 || (info.planar() && spp != 1)){
+            throw RangeException();
+        }
+
+        auto bps = bpp / spp;
+        const Element8* el = curve.data();
+        if (bps == 8){
+            m_channels = static_cast<UInt32>(spp);
+            for (UInt32 c = 0; c < m_channels; c++){
+                for (UInt32 v = 0; v < 256; v++){
+                    switch (rgb ? c : 0){
+                        case 0: m_table[c][v] = el[v].channel1(); break;
+                        case 1: m_table[c][v] = el[v].channel2(); break;
+                        case 2: m_table[c][v] = el[v].channel3(); break;
+                        default: m_table[c][v] = static_cast<UInt8>(v); break; // alpha
+                    }
+                }
+            }
+        } else if (spp == 1 && (bps == 1 || bps == 2 || bps == 4)){
+            m_channels = 1;
+            auto mask = static_cast<UInt32>((1 << bps) - 1);
+            for (UInt32 v = 0; v < 256; v++){
+                UInt32 out = 0;
+                for (Int32 shift = 8 - bps; shift >= 0; shift -= bps){
+                    auto sample = (v >> shift) & mask;
+                    out |= (el[sample].channel1() & mask) << shift;
+                }
+
+                m_table[0][v] = static_cast<UInt8>(out);
+            }
+        } else {
+            throw RangeException();
+        }
+    }
+
+    /// Number of interleaved channels, the data must contain whole pixels of them.
+    UInt32 channels() const noexcept{
+        return m_channels;
+    }
+
+    /// Maps bytes in place.
+    /// \param data Chunky data starting at a pixel boundary.
+    /// \param bytes Number of bytes, a multiple of `channels()`.
+    void apply(void* data, UInt32 bytes) const noexcept{
+        auto p = static_cast<UInt8*>(data);
+        UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON) && defined(__aarch64__)
+        // 256 byte table as four 64 byte TBL lookups per 16 bytes
+        if (m_channels == 1){
+            auto t = tables(0);
+            for ( ; i + 16 <= bytes; i += 16){
+                vst1q_u8(p + i, lookup(t, vld1q_u8(p + i)));
+            }
+        } else if (m_channels == 3){
+            Tables t[3] = {tables(0), tables(1), tables(2)};
+            for ( ; i + 48 <= bytes; i += 48){
+                uint8x16x3_t v = vld3q_u8(p + i);
+                v.val[0] = lookup(t[0], v.val[0]);
+                v.val[1] = lookup(t[1], v.val[1]);
+                v.val[2] = lookup(t[2], v.val[2]);
+                vst3q_u8(p + i, v);
+            }
+        }
+#endif
+
+        switch (m_channels){
+            case 1:
+                for ( ; i + 4 <= bytes; i += 4){
+                    p[i] = m_table[0][p[i]];
+                    p[i + 1] = m_table[0][p[i + 1]];
+                    p[i + 2] = m_table[0][p[i + 2]];
+                    p[i + 3] = m_table[0][p[i + 3]];
+                }
+
+                for ( ; i < bytes; i++){
+                    p[i] = m_table[0][p[i]];
+                }
+
+                break;
+
+            case 3:
+                for ( ; i + 3 <= bytes; i += 3){
+                    p[i] = m_table[0][p[i]];
+                    p[i + 1] = m_table[1][p[i + 1]];
+                    p[i + 2] = m_table[2][p[i + 2]];
+                }
+
+                break;
+
+            default:
+                for ( ; i < bytes; i++){
+                    p[i] = m_table[i % m_channels][p[i]];
+                }
+
+                break;
+        }
+    }
+
+private:
+#if defined(TWPP_DETAIL_SIMD_NEON) && defined(__aarch64__)
+    struct Tables {
+        uint8x16x4_t m_part[4];
+    };
+
+    Tables tables(UInt32 channel) const noexcept{
+        Tables t;
+        for (int k = 0; k < 4; k++){
+            for (int j = 0; j < 4; j++){
+                t.m_part[k].val[j] = vld1q_u8(m_table[channel] + k * 64 + j * 16);
+            }
+        }
+
+        return t;
+    }
+
+    static uint8x16_t lookup(const Tables& t, uint8x16_t v) noexcept{
+        // out-of-range indices leave the previous result untouched
+        const uint8x16_t step = vdupq_n_u8(64);
+        uint8x16_t r = vqtbl4q_u8(t.m_part[0], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, t.m_part[1], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, t.m_part[2], v);
+        v = vsubq_u8(v, step);
+        return vqtbx4q_u8(r, t.m_part[3], v);
+    }
+#endif
+
+    UInt8 m_table[4][256];
+    UInt32 m_channels;
+
+};
+
+static inline void applyResponseRows(const ResponseLut& lut, void* data, UInt32 rowBytes,
+                                     UInt32 bytesPerRow, UInt32 rows, UInt32 threads){
+    auto p = static_cast<char*>(data);
+    if (threads <= 1 || rows < 2){
+        for (UInt32 r = 0; r < rows; r++){
+            lut.apply(p + static_cast<std::size_t>(r) * bytesPerRow, rowBytes);
+        }
+
+        return;
+    }
+
+    threads = std::min(threads, rows);
+    auto band = [&lut, p, rowBytes, bytesPerRow](UInt32 first, UInt32 last){
+        for (UInt32 r = first; r < last; r++){
+            lut.apply(p + static_cast<std::size_t>(r) * bytesPerRow, rowBytes);
+        }
+    };
+
+    std::list<std::thread> workers;
+    auto join = [&workers](){
+        for (auto& worker : workers){
+            worker.join();
+        }
+    };
+
+    UInt32 perThread = (rows + threads - 1) / threads;
+    try {
+        for (UInt32 first = perThread; first < rows; first += perThread){
+            workers.emplace_back(band, first, std::min(rows, first + perThread));
+        }
+    } catch (...){
+        // joinable threads must not be destroyed
+        join();
+        throw;
+    }
+
+    band(0, std::min(rows, perThread));
+    join();
+}
+
+}
+
+/// Applies a response curve to uncompressed chunky data in place, in a single pass over all channels.
+/// \param curve RGB response, channel 1 maps red samples, 2 green and 3 blue, alpha is kept.
+/// \param info Image layout, 8 bits per sample, or 1, 2, 4 bits of a single sample.
+/// \param data Data starting at a pixel boundary.
+/// \param bytes Number of bytes, containing whole pixels.
+/// \throw RangeException When the layout is not supported.
+static inline void applyResponse(const RgbResponse& curve, const ImageInfo& info, void* data, UInt32 bytes){
+    Detail::ResponseLut(curve, info, true).apply(data, bytes);
+}
+
+/// Applies a response curve to uncompressed chunky data in place, in a single pass over all channels.
+/// \param curve Gray response, channel 1 maps all samples.
+/// \param info Image layout, 8 bits per sample, or 1, 2, 4 bits of a single sample.
+/// \param data Data starting at a pixel boundary.
+/// \param bytes Number of bytes, containing whole pixels.
+/// \throw RangeException When the layout is not supported.
+static inline void applyResponse(const GrayResponse& curve, const ImageInfo& info, void* data, UInt32 bytes){
+    Detail::ResponseLut(curve, info, false).apply(data, bytes);
+}
+
+/// Applies a response curve to every row of a memory transfer strip.
+/// \param curve RGB response.
+/// \param info Image layout.
+/// \param strip Uncompressed strip.
+/// \throw RangeException When the layout is not supported.
+static inline void applyResponse(const RgbResponse& curve, const ImageInfo& info, ImageMemXfer& strip){
+    assert(strip.compression() == Compression::None);
+
+    auto lock = strip.memory().data();
+    auto rowBytes = (strip.columns() * static_cast<UInt32>(info.bitsPerPixel()) + 7) / 8;
+    Detail::applyResponseRows(Detail::ResponseLut(curve, info, true), lock.data(), rowBytes, strip.bytesPerRow(), strip.rows(), 1);
+}
+
+/// Applies a response curve to every row of a memory transfer strip.
+/// \param curve Gray response.
+/// \param info Image layout.
+/// \param strip Uncompressed strip.
+/// \throw RangeException When the layout is not supported.
+static inline void applyResponse(const GrayResponse& curve, const ImageInfo& info, ImageMemXfer& strip){
+    assert(strip.compression() == Compression::None);
+
+    auto lock = strip.memory().data();
+    auto rowBytes = (strip.columns() * static_cast<UInt32>(info.bitsPerPixel()) + 7) / 8;
+    Detail::applyResponseRows(Detail::ResponseLut(curve, info, false), lock.data(), rowBytes, strip.bytesPerRow(), strip.rows(), 1);
+}
+
+/// Applies a response curve to a whole page, e.g. pixels of a native transfer, using several threads.
+/// \param curve RGB response.
+/// \param info Image layout, width and height are used too.
+/// \param data First row of pixels.
+/// \param bytesPerRow Distance between rows in bytes.
+/// \param threads Number of threads including the calling one, zero uses all hardware threads.
+/// \throw RangeException When the layout is not supported.
+/// \throw std::system_error When a thread could not be started.
+static inline void applyResponse(const RgbResponse& curve, const ImageInfo& info, void* data,
+                                 UInt32 bytesPerRow, UInt32 threads){
+    auto rowBytes = (static_cast<UInt32>(info.width()) * static_cast<UInt32>(info.bitsPerPixel()) + 7) / 8;
+    auto rows = static_cast<UInt32>(std::abs(info.height()));
+    threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    Detail::applyResponseRows(Detail::ResponseLut(curve, info, true), data, rowBytes, bytesPerRow, rows, threads);
+}
+
+/// Applies a response curve to a whole page, e.g. pixels of a native transfer, using several threads.
+/// \param curve Gray response.
+/// \param info Image layout, width and height are used too.
+/// \param data First row of pixels.
+/// \param bytesPerRow Distance between rows in bytes.
+/// \param threads Number of threads including the calling one, zero uses all hardware threads.
+/// \throw RangeException When the layout is not supported.
+/// \throw std::system_error When a thread could not be started.
+static inline void applyResponse(const GrayResponse& curve, const ImageInfo& info, void* data,
+                                 UInt32 bytesPerRow, UInt32 threads){
+    auto rowBytes = (static_cast<UInt32>(info.width()) * static_cast<UInt32>(info.bitsPerPixel()) + 7) / 8;
+    auto rows = static_cast<UInt32>(std::abs(info.height()));
+    threads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    Detail::applyResponseRows(Detail::ResponseLut(curve, info, false), data, rowBytes, bytesPerRow, rows, threads);
+}
+
+/// Palette expanded to 32-bit entries, bytes R, G, B, A in memory order.
+/// The table is built once and rebuilt by `update` only when the palette changes.
+/// Gray palettes are replicated to all color channels, CMY ones are inverted to RGB.
+class PaletteExpansion {
+
+public:
+    /// Creates an expansion of an empty palette, all entries are opaque black.
+    PaletteExpansion() noexcept :
+        m_palette(), m_valid(false){
+
+        std::fill(m_table, m_table + 256, rgba(0, 0, 0));
+    }
+
+    /// Creates an expansion of the palette.
+    explicit PaletteExpansion(const Palette8& palette) noexcept :
+        PaletteExpansion(){
+
+        update(palette);
+    }
+
+    /// Rebuilds the table if the palette differs from the cached one.
+    /// \return Whether the table was rebuilt.
+    bool update(const Palette8& palette) noexcept{
+        if (m_valid && same(palette)){
+            return false;
+        }
+
+        m_palette = palette;
+        m_valid = true;
+
+        auto& colors = palette.colors();
+        for (UInt16 i = 0; i < 256; i++){
+            if (i >= palette.size()){
+                m_table[i] = rgba(0, 0, 0);
+                continue;
+            }
+
+            const Element8& e = colors[i];
+            switch (palette.type()){
+                case Palette8::Type::Gray:
+                    m_table[i] = rgba(e.channel1(), e.channel1(), e.channel1());
+                    break;
+
+                case Palette8::Type::Cmy:
+                    m_table[i] = rgba(static_cast<UInt8>(255 - e.channel1()),
+                                      static_cast<UInt8>(255 - e.channel2()),
+                                      static_cast<UInt8>(255 - e.channel3()));
+                    break;
+
+                default:
+                    m_table[i] = rgba(e.channel1(), e.channel2(), e.channel3());
+                    break;
+            }
+        }
+
+        return true;
+    }
+
+    /// The expanded table, 256 entries.
+    const UInt32* table() const noexcept{
+        return m_table;
+    }
+
+    /// Expands indexed pixels to RGB or RGBA.
+    /// \param src Indices, MSB first when `bitsPerIndex` is less than 8.
+    /// \param dst Expanded pixels, 3 or 4 bytes per pixel.
+    /// \param pixels Number of pixels.
+    /// \param bitsPerIndex Either 1, 2, 4, or 8.
+    /// \param alpha Whether to write RGBA instead of RGB.
+    void expand(const void* src, void* dst, UInt32 pixels, UInt32 bitsPerIndex = 8, bool alpha = false) const noexcept{
+        assert(bitsPerIndex == 1 || bitsPerIndex == 2 || bitsPerIndex == 4 || bitsPerIndex == 8);
+
+        auto in = static_cast<const UInt8*>(src);
+        auto out = static_cast<UInt8*>(dst);
+        if (pixels == 0){
+            return;
+        }
+
+        if (bitsPerIndex != 8){
+            auto mask = (1u << bitsPerIndex) - 1;
+            auto perByte = 8 / bitsPerIndex;
+            UInt32 bpp = alpha ? 4 : 3;
+            for (UInt32 i = 0; i < pixels; i++){
+                auto shift = 8 - bitsPerIndex * (i % perByte + 1);
+                auto index = (in[i / perByte] >> shift) & mask;
+                std::memcpy(out + i * bpp, &m_table[index], bpp);
+            }
+
+            return;
+        }
+
+        UInt32 i = 0;
+        if (alpha){
+#if defined(TWPP_DETAIL_SIMD_AVX2)
+            for ( ; i + 8 <= pixels; i += 8){
+                __m128i idx8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i));
+                __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_table), _mm256_cvtepu8_epi32(idx8), 4);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), v);
+            }
+#endif
+
+            for ( ; i < pixels; i++){
+                std::memcpy(out + i * 4, &m_table[in[i]], 4);
+            }
+        } else {
+            // overlapping 4 byte stores, the alpha byte is overwritten by the next pixel
+            for ( ; i + 1 < pixels; i++){
+                std::memcpy(out + i * 3, &m_table[in[i]], 4);
+            }
+
+            std::memcpy(out + i * 3, &m_table[in[i]], 3);
+        }
+    }
+
+    /// Expands every row of an indexed memory transfer strip.
+    /// \param strip Uncompressed strip of indices.
+    /// \param dst Expanded rows.
+    /// \param dstBytesPerRow Distance between expanded rows in bytes.
+    /// \param bitsPerIndex Either 1, 2, 4, or 8.
+    /// \param alpha Whether to write RGBA instead of RGB.
+    void expand(const ImageMemXfer& strip, void* dst, UInt32 dstBytesPerRow,
+                UInt32 bitsPerIndex = 8, bool alpha = false) const noexcept{
+
+        assert(strip.compression() == Compression::None);
+
+        auto lock = strip.memory().data();
+        const char* row = lock.data();
+        auto out = static_cast<char*>(dst);
+        for (UInt32 r = 0; r < strip.rows(); r++){
+            expand(row, out, strip.columns(), bitsPerIndex, alpha);
+            row += strip.bytesPerRow();
+            out += dstBytesPerRow;
+        }
+    }
+
+private:
+    static UInt32 rgba(UInt8 r, UInt8 g, UInt8 b) noexcept{
+        const UInt8 bytes[4] = {r, g, b, 0xFF};
+        UInt32 ret;
+        std::memcpy(&ret, bytes, sizeof(ret));
+        return ret;
+    }
+
+    bool same(const Palette8& palette) const noexcept{
+        if (palette.size() != m_palette.size() || palette.type() != m_palette.type()){
+            return false;
+        }
+
+        auto& a = palette.colors();
+        auto& b = m_palette.colors();
+        // the size comes from the source and might exceed the array
+        auto size = std::min<std::size_t>(palette.size(), 256);
+        for (std::size_t i = 0; i < size; i++){
+            if (a[i].channel1() != b[i].channel1() || a[i].channel2() != b[i].channel2() ||
+                    a[i].channel3() != b[i].channel3()){
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Palette8 m_palette;
+    bool m_valid;
+    UInt32 m_table[256];
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_IMAGEKERNELS_HPP
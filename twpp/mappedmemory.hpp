@@ -0,0 +1,276 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_MAPPEDMEMORY_HPP
+#define TWPP_DETAIL_FILE_MAPPEDMEMORY_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Block of memory backed by a memory-mapped temporary file.
+///
+/// Pages are read in lazily on first access, and written out to the file
+/// instead of the swap under memory pressure, so large images do not need to fit in RAM.
+/// The file is deleted once the mapping is destroyed.
+///
+/// Sizes are 64-bit, though TWAIN transfers are limited to `UInt32` bytes.
+/// Memory transfers write strips straight into the mapping through `memory()`,
+/// without any copy, so the page never has to fit in RAM.
+/// Native transfers cannot use a mapping, TWAIN requires the whole page
+/// in a single handle of the memory functions.
+class MappedMemory {
+
+public:
+    /// Creates an empty mapping.
+    MappedMemory() noexcept :
+        m_data(nullptr), m_size(0)
+#if defined(TWPP_DETAIL_OS_WIN)
+      , m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#endif
+    {}
+
+    /// Creates a zero-filled mapping of supplied size.
+    /// \param size Size in bytes.
+    /// \param directory Directory of the temporary file, system temporary directory by default.
+    /// \throw std::system_error When the file could not be created or mapped.
+    explicit MappedMemory(std::uint64_t size, const char* directory = nullptr) :
+        MappedMemory(){
+
+        if (size != 0){
+            map(size, directory);
+        }
+    }
+
+    ~MappedMemory(){
+        unmap();
+    }
+
+    MappedMemory(const MappedMemory&) = delete;
+    MappedMemory& operator=(const MappedMemory&) = delete;
+
+    MappedMemory(MappedMemory&& o) noexcept :
+        MappedMemory(){
+
+        swap(o);
+    }
+
+    MappedMemory& operator=(MappedMemory&& o) noexcept{
+        if (&o != this){
+            unmap();
+            swap(o);
+        }
+
+        return *this;
+    }
+
+    /// The mapped data.
+    char* data() noexcept{
+        return m_data;
+    }
+
+    /// The mapped data.
+    const char* data() const noexcept{
+        return m_data;
+    }
+
+    /// Number of bytes in the mapping.
+    std::uint64_t size() const noexcept{
+        return m_size;
+    }
+
+    operator bool() const noexcept{
+        return m_data != nullptr;
+    }
+
+    /// Memory object pointing to a part of the mapping, e.g. for memory transfers.
+    /// The memory object does NOT take over the ownership of the data.
+    /// \param offset Offset of the part in bytes.
+    /// \param size Size of the part in bytes.
+    /// \throw RangeException When the part is outside of the mapping.
+    Memory memory(std::uint64_t offset, UInt32 size){
+        if (offset > m_size || size > m_size - offset){
+            throw RangeException();
+        }
+
+        return Memory(m_data + offset, size);
+    }
+
+    /// Hints that a part of the mapping is going to be read soon,
+    /// so that only that part is paged in ahead of time.
+    /// Does nothing where not supported.
+    /// \param offset Offset of the part in bytes.
+    /// \param size Size of the part in bytes.
+    void prefetch(std::uint64_t offset, std::uint64_t size) const noexcept{
+        if (offset >= m_size){
+            return;
+        }
+
+        size = std::min(size, m_size - offset);
+#if defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        auto page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        auto begin = offset / page * page;
+        ::madvise(m_data + begin, static_cast<std::size_t>(offset + size - begin), MADV_WILLNEED);
+#elif !defined(TWPP_DETAIL_OS_WIN)
+#   error "MappedMemory prefetch for your platform here"
+#endif
+    }
+
+private:
+    void swap(MappedMemory& o) noexcept{
+        std::swap(m_data, o.m_data);
+        std::swap(m_size, o.m_size);
+#if defined(TWPP_DETAIL_OS_WIN)
+        std::swap(m_file, o.m_file);
+        std::swap(m_mapping, o.m_mapping);
+#endif
+    }
+
+    [[noreturn]] static void fail(int error){
+        throw std::system_error(error, std::system_category(), "MappedMemory");
+    }
+
+    void map(std::uint64_t size, const char* directory){
+        if (size > std::numeric_limits<std::size_t>::max()){
+            throw std::bad_alloc();
+        }
+
+#if defined(TWPP_DETAIL_OS_WIN)
+        char dir[MAX_PATH + 1];
+        if (directory == nullptr){
+            if (::GetTempPathA(sizeof(dir), dir) == 0){
+                fail(static_cast<int>(::GetLastError()));
+            }
+
+            directory = dir;
+        }
+
+        char path[MAX_PATH + 1];
+        if (::GetTempFileNameA(directory, "twp", 0, path) == 0){
+            fail(static_cast<int>(::GetLastError()));
+        }
+
+        m_file = ::CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE){
+            auto error = ::GetLastError();
+            ::DeleteFileA(path);
+            fail(static_cast<int>(error));
+        }
+
+        m_mapping = ::CreateFileMappingA(m_file, nullptr, PAGE_READWRITE,
+                                         static_cast<::DWORD>(size >> 32), static_cast<::DWORD>(size), nullptr);
+        if (m_mapping == nullptr){
+            auto error = ::GetLastError();
+            unmap();
+            fail(static_cast<int>(error));
+        }
+
+        m_data = static_cast<char*>(::MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, 0));
+        if (m_data == nullptr){
+            auto error = ::GetLastError();
+            unmap();
+            fail(static_cast<int>(error));
+        }
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        if (directory == nullptr){
+            directory = std::getenv("TMPDIR");
+            if (directory == nullptr || *directory == '\0'){
+                directory = "/tmp";
+            }
+        }
+
+        std::string path(directory);
+        path += "/twpp-XXXXXX";
+
+        int fd = ::mkstemp(&path[0]);
+        if (fd == -1){
+            fail(errno);
+        }
+
+        // the file lives only as long as the mapping
+        ::unlink(path.c_str());
+        if (::ftruncate(fd, static_cast<::off_t>(size)) != 0){
+            auto error = errno;
+            ::close(fd);
+            fail(error);
+        }
+
+        void* data = ::mmap(nullptr, static_cast<std::size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        auto error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED){
+            fail(error);
+        }
+
+        m_data = static_cast<char*>(data);
+#else
+#   error "MappedMemory map for your platform here"
+#endif
+
+        m_size = size;
+    }
+
+    void unmap() noexcept{
+#if defined(TWPP_DETAIL_OS_WIN)
+        if (m_data != nullptr){
+            ::UnmapViewOfFile(m_data);
+        }
+
+        if (m_mapping != nullptr){
+            ::CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+
+        if (m_file != INVALID_HANDLE_VALUE){
+            ::CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        if (m_data != nullptr){
+            ::munmap(m_data, static_cast<std::size_t>(m_size));
+        }
+#else
+#   error "MappedMemory unmap for your platform here"
+#endif
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    char* m_data;
+    std::uint64_t m_size;
+
+#if defined(TWPP_DETAIL_OS_WIN)
+    ::HANDLE m_file;
+    ::HANDLE m_mapping;
+#endif
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_MAPPEDMEMORY_HPP
@@ -0,0 +1,768 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_MEMFILEENCODER_HPP
+#define TWPP_DETAIL_FILE_MEMFILEENCODER_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// FIFO of encoded bytes waiting to be transferred.
+class EncoderOutput {
+
+public:
+    EncoderOutput() noexcept :
+        m_capacity(0), m_begin(0), m_end(0){}
+
+    EncoderOutput(const EncoderOutput&) = delete;
+    EncoderOutput& operator=(const EncoderOutput&) = delete;
+
+    /// Number of pending bytes.
+    std::size_t size() const noexcept{
+        return m_end - m_begin;
+    }
+
+    /// Whether there are no pending bytes.
+    bool empty() const noexcept{
+        return m_begin == m_end;
+    }
+
+    /// Reserves space at the end of the queue.
+    /// The bytes become pending once committed.
+    /// \param size Number of bytes.
+    /// \return Pointer to at least `size` writable bytes, valid until the next call.
+    /// \throw std::bad_alloc
+    char* reserve(std::size_t size){
+        if (m_capacity - m_end < size){
+            grow(size);
+        }
+
+        return m_data.get() + m_end;
+    }
+
+    /// Appends reserved bytes to the queue.
+    /// \param size Number of bytes written to the reserved space.
+    void commit(std::size_t size) noexcept{
+        m_end += size;
+    }
+
+    /// Appends bytes to the queue.
+    /// \throw std::bad_alloc
+    void write(const void* data, std::size_t size){
+        std::memcpy(reserve(size), data, size);
+        commit(size);
+    }
+
+    /// Moves pending bytes out of the queue.
+    /// \param out Output buffer.
+    /// \param size Maximal number of bytes.
+    /// \return Number of bytes read.
+    std::size_t read(char* out, std::size_t size) noexcept{
+        size = std::min(size, this->size());
+        std::memcpy(out, m_data.get() + m_begin, size);
+        m_begin += size;
+        if (m_begin == m_end){
+            m_begin = m_end = 0;
+        }
+
+        return size;
+    }
+
+    /// Drops all pending bytes, keeps the allocated space.
+    void clear() noexcept{
+        m_begin = m_end = 0;
+    }
+
+private:
+    void grow(std::size_t size){
+        auto pending = this->size();
+        if (m_capacity - pending >= size && pending <= m_begin){
+            // enough space once the pending bytes are moved to the front
+            std::memcpy(m_data.get(), m_data.get() + m_begin, pending);
+        } else {
+            auto capacity = std::max<std::size_t>(std::max<std::size_t>(m_capacity * 2, 4096), pending + size);
+            std::unique_ptr<char[]> data(new char[capacity]);
+            if (pending != 0){
+                std::memcpy(data.get(), m_data.get() + m_begin, pending);
+            }
+
+            m_data = std::move(data);
+            m_capacity = capacity;
+        }
+
+        m_begin = 0;
+        m_end = pending;
+    }
+
+    std::unique_ptr<char[]> m_data;
+    std::size_t m_capacity;
+    std::size_t m_begin;
+    std::size_t m_end;
+
+};
+
+/// Incremental encoder of an image file, fed by rows as they are acquired.
+/// Rows are packed, without padding, in the format of uncompressed memory transfers.
+class FileEncoder {
+
+public:
+    virtual ~FileEncoder() = default;
+
+    /// Compression reported to the application.
+    virtual Compression compression() const noexcept = 0;
+
+    /// Starts a new file.
+    /// \param info Image layout.
+    /// \param columns Image width.
+    /// \param rows Image height.
+    /// \param out Output of the encoded bytes.
+    /// \return Whether the layout is supported.
+    /// \throw std::bad_alloc
+    virtual bool begin(const ImageInfo& info, UInt32 columns, UInt32 rows, EncoderOutput& out) = 0;
+
+    /// Encodes consecutive rows.
+    /// \param data Packed rows.
+    /// \param bytesPerRow Number of bytes of each row.
+    /// \param rows Number of rows.
+    /// \param out Output of the encoded bytes.
+    /// \throw std::bad_alloc
+    virtual void encode(const char* data, UInt32 bytesPerRow, UInt32 rows, EncoderOutput& out) = 0;
+
+    /// Finishes the file, all rows have been encoded.
+    /// \param out Output of the encoded bytes.
+    /// \throw std::bad_alloc
+    virtual void end(EncoderOutput& out) = 0;
+
+};
+
+/// Base of JPEG encoders, e.g. wrapping libjpeg, configured by the negotiated JpegCompression.
+/// The library does not encode JPEG itself, derived classes implement FileEncoder methods.
+class JpegFileEncoder : public FileEncoder {
+
+public:
+    virtual Compression compression() const noexcept override{
+        return Compression::Jpeg;
+    }
+
+    /// Parameters of the encoder.
+    const JpegCompression& parameters() const noexcept{
+        return m_params;
+    }
+
+    /// Sets parameters of the encoder, e.g. from `Msg::Set` of `Dat::JpegCompression`.
+    void setParameters(JpegCompression params) noexcept{
+        m_params = std::move(params);
+    }
+
+protected:
+    JpegFileEncoder() noexcept{}
+
+    explicit JpegFileEncoder(JpegCompression params) noexcept :
+        m_params(std::move(params)){}
+
+private:
+    JpegCompression m_params;
+
+};
+
+/// Encoder of single-strip TIFF files, uncompressed or CCITT Group 4.
+/// Uncompressed rows are emitted as soon as they are encoded.
+/// Group 4 data is kept until the page is finished, because its size precedes it
+/// in the header; only the compressed page is buffered.
+class TiffFileEncoder : public FileEncoder {
+
+public:
+    /// Creates an encoder.
+    /// \param group4 Whether to compress black and white images using CCITT Group 4.
+    explicit TiffFileEncoder(bool group4 = false) noexcept :
+        m_group4(group4), m_columns(0), m_rows(0), m_bits(0), m_bitCount(0), m_palette(), m_hasPalette(false){}
+
+    /// Sets the palette stored with uncompressed images of PixelType::Palette,
+    /// e.g. the one reported by the source for Dat::Palette8.
+    void setPalette(const Palette8& palette) noexcept{
+        m_palette = palette;
+        m_hasPalette = true;
+    }
+
+    virtual Compression compression() const noexcept override{
+        return m_group4 ? Compression::Group4 : Compression::None;
+    }
+
+    virtual bool begin(const ImageInfo& info, UInt32 columns, UInt32 rows, EncoderOutput& out) override{
+        Detail::TiffHeader header(info, m_group4 ? Detail::TiffHeader::Group4 : Detail::TiffHeader::Uncompressed,
+                                  m_hasPalette ? &m_palette : nullptr);
+        if (!header.isValid() || columns == 0 || rows == 0){
+            return false;
+        }
+
+        m_info = info;
+        m_columns = columns;
+        m_rows = rows;
+        if (!m_group4){
+            auto dataBytes = static_cast<std::uint64_t>(header.rowBytes(columns)) * rows;
+            if (header.size() + dataBytes > 0xFFFFFFFFu){
+                return false;
+            }
+
+            header.write(out.reserve(header.size()), columns, rows, header.size(), static_cast<UInt32>(dataBytes));
+            out.commit(header.size());
+            return true;
+        }
+
+        // reference line of the first row is white
+        auto lineBytes = (columns + 7) / 8;
+        m_line.reset(new unsigned char[lineBytes]);
+        m_ref.reset(new unsigned char[lineBytes]);
+        std::memset(m_ref.get(), 0, lineBytes);
+        m_data.clear();
+        m_bits = 0;
+        m_bitCount = 0;
+        return true;
+    }
+
+    virtual void encode(const char* data, UInt32 bytesPerRow, UInt32 rows, EncoderOutput& out) override{
+        if (!m_group4){
+            UInt32 rowBytes = Detail::TiffHeader(m_info).rowBytes(m_columns);
+            for (UInt32 i = 0; i < rows; i++){
+                out.write(data + static_cast<std::size_t>(i) * bytesPerRow, rowBytes);
+            }
+
+            return;
+        }
+
+        auto lineBytes = (m_columns + 7) / 8;
+        for (UInt32 i = 0; i < rows; i++){
+            // TWAIN zero is black, Group 4 uses white is zero
+            auto row = reinterpret_cast<const unsigned char*>(data) + static_cast<std::size_t>(i) * bytesPerRow;
+            for (UInt32 b = 0; b < lineBytes; b++){
+                m_line[b] = static_cast<unsigned char>(~row[b]);
+            }
+
+            if ((m_columns % 8) != 0){
+                m_line[lineBytes - 1] &= static_cast<unsigned char>(0xFF << (8 - m_columns % 8));
+            }
+
+            encodeRow();
+            std::swap(m_line, m_ref);
+        }
+    }
+
+    virtual void end(EncoderOutput& out) override{
+        if (!m_group4){
+            return;
+        }
+
+        // end of facsimile block: two EOLs
+        putBits(0x001, 12);
+        putBits(0x001, 12);
+        if (m_bitCount != 0){
+            putBits(0, 8 - m_bitCount);
+        }
+
+        Detail::TiffHeader header(m_info, Detail::TiffHeader::Group4);
+        auto size = header.size();
+        header.write(out.reserve(size), m_columns, m_rows, size, static_cast<UInt32>(m_data.size()));
+        out.commit(size);
+
+        auto bytes = m_data.size();
+        m_data.read(out.reserve(bytes), bytes);
+        out.commit(bytes);
+    }
+
+private:
+    struct Code {
+        UInt16 code;
+        UInt8 bits;
+    };
+
+    template<typename Dummy>
+    struct Tables {
+        // terminating codes 0-63, make-up codes 64-1728, extended make-up codes 1792-2560
+        static const Code white[104];
+        static const Code black[104];
+    };
+
+    static bool pixel(const unsigned char* line, UInt32 x) noexcept{
+        return ((line[x >> 3] >> (7 - (x & 7))) & 1) != 0;
+    }
+
+    // first position at or after `start` whose colour differs from `black`
+    UInt32 findDiff(const unsigned char* line, UInt32 start, bool black) const noexcept{
+        auto x = start;
+        unsigned char skip = black ? 0xFF : 0x00;
+        while (x < m_columns){
+            if ((x & 7) == 0 && line[x >> 3] == skip){
+                x += 8;
+                continue;
+            }
+
+            if (pixel(line, x) != black){
+                return x;
+            }
+
+            x++;
+        }
+
+        return m_columns;
+    }
+
+    UInt32 findDiff2(const unsigned char* line, UInt32 start, bool black) const noexcept{
+        return start < m_columns ? findDiff(line, start, black) : m_columns;
+    }
+
+    void encodeRow(){
+        auto line = m_line.get();
+        auto ref = m_ref.get();
+
+        UInt32 a0 = 0;
+        UInt32 a1 = pixel(line, 0) ? 0 : findDiff(line, 0, false);
+        UInt32 b1 = pixel(ref, 0) ? 0 : findDiff(ref, 0, false);
+        for (;;){
+            UInt32 b2 = findDiff2(ref, b1, b1 < m_columns && pixel(ref, b1));
+            if (b2 >= a1){
+                auto d = static_cast<Int32>(b1) - static_cast<Int32>(a1);
+                if (d < -3 || d > 3){
+                    // horizontal mode
+                    UInt32 a2 = findDiff2(line, a1, a1 < m_columns && pixel(line, a1));
+                    putBits(0x1, 3);
+                    if (a0 + a1 == 0 || !pixel(line, a0)){
+                        putRun(a1 - a0, Tables<void>::white);
+                        putRun(a2 - a1, Tables<void>::black);
+                    } else {
+                        putRun(a1 - a0, Tables<void>::black);
+                        putRun(a2 - a1, Tables<void>::white);
+                    }
+
+                    a0 = a2;
+                } else {
+                    // vertical mode, VR3 to VL3
+                    static const Code vertical[7] = {
+                        {0x03, 7}, {0x03, 6}, {0x03, 3}, {0x1, 1}, {0x02, 3}, {0x02, 6}, {0x02, 7}
+                    };
+
+                    putBits(vertical[d + 3].code, vertical[d + 3].bits);
+                    a0 = a1;
+                }
+            } else {
+                // pass mode
+                putBits(0x1, 4);
+                a0 = b2;
+            }
+
+            if (a0 >= m_columns){
+                break;
+            }
+
+            bool black = pixel(line, a0);
+            a1 = findDiff(line, a0, black);
+            b1 = findDiff(ref, a0, !black);
+            b1 = findDiff2(ref, b1, black);
+        }
+    }
+
+    void putRun(UInt32 run, const Code* table){
+        while (run >= 2624){
+            putBits(table[63 + (2560 >> 6)].code, table[63 + (2560 >> 6)].bits);
+            run -= 2560;
+        }
+
+        if (run >= 64){
+            auto& code = table[63 + (run >> 6)];
+            putBits(code.code, code.bits);
+            run -= (run >> 6) << 6;
+        }
+
+        putBits(table[run].code, table[run].bits);
+    }
+
+    void putBits(UInt32 code, UInt32 bits){
+        m_bits = (m_bits << bits) | code;
+        m_bitCount += bits;
+        while (m_bitCount >= 8){
+            m_bitCount -= 8;
+            auto byte = static_cast<char>((m_bits >> m_bitCount) & 0xFF);
+            m_data.write(&byte, 1);
+        }
+
+        m_bits &= (1u << m_bitCount) - 1;
+    }
+
+    bool m_group4;
+    ImageInfo m_info;
+    UInt32 m_columns;
+    UInt32 m_rows;
+    std::unique_ptr<unsigned char[]> m_line;
+    std::unique_ptr<unsigned char[]> m_ref;
+    EncoderOutput m_data;
+    UInt32 m_bits;
+    UInt32 m_bitCount;
+    Palette8 m_palette;
+    bool m_hasPalette;
+
+};
+
+template<typename Dummy>
+const TiffFileEncoder::Code TiffFileEncoder::Tables<Dummy>::white[104] = {
+        {0x035, 8}, {0x007, 6}, {0x007, 4}, {0x008, 4},
+        {0x00B, 4}, {0x00C, 4}, {0x00E, 4}, {0x00F, 4},
+        {0x013, 5}, {0x014, 5}, {0x007, 5}, {0x008, 5},
+        {0x008, 6}, {0x003, 6}, {0x034, 6}, {0x035, 6},
+        {0x02A, 6}, {0x02B, 6}, {0x027, 7}, {0x00C, 7},
+        {0x008, 7}, {0x017, 7}, {0x003, 7}, {0x004, 7},
+        {0x028, 7}, {0x02B, 7}, {0x013, 7}, {0x024, 7},
+        {0x018, 7}, {0x002, 8}, {0x003, 8}, {0x01A, 8},
+        {0x01B, 8}, {0x012, 8}, {0x013, 8}, {0x014, 8},
+        {0x015, 8}, {0x016, 8}, {0x017, 8}, {0x028, 8},
+        {0x029, 8}, {0x02A, 8}, {0x02B, 8}, {0x02C, 8},
+        {0x02D, 8}, {0x004, 8}, {0x005, 8}, {0x00A, 8},
+        {0x00B, 8}, {0x052, 8}, {0x053, 8}, {0x054, 8},
+        {0x055, 8}, {0x024, 8}, {0x025, 8}, {0x058, 8},
+        {0x059, 8}, {0x05A, 8}, {0x05B, 8}, {0x04A, 8},
+        {0x04B, 8}, {0x032, 8}, {0x033, 8}, {0x034, 8},
+        {0x01B, 5}, {0x012, 5}, {0x017, 6}, {0x037, 7},
+        {0x036, 8}, {0x037, 8}, {0x064, 8}, {0x065, 8},
+        {0x068, 8}, {0x067, 8}, {0x0CC, 9}, {0x0CD, 9},
+        {0x0D2, 9}, {0x0D3, 9}, {0x0D4, 9}, {0x0D5, 9},
+        {0x0D6, 9}, {0x0D7, 9}, {0x0D8, 9}, {0x0D9, 9},
+        {0x0DA, 9}, {0x0DB, 9}, {0x098, 9}, {0x099, 9},
+        {0x09A, 9}, {0x018, 6}, {0x09B, 9}, {0x008, 11},
+        {0x00C, 11}, {0x00D, 11}, {0x012, 12}, {0x013, 12},
+        {0x014, 12}, {0x015, 12}, {0x016, 12}, {0x017, 12},
+        {0x01C, 12}, {0x01D, 12}, {0x01E, 12}, {0x01F, 12},
+};
+
+template<typename Dummy>
+const TiffFileEncoder::Code TiffFileEncoder::Tables<Dummy>::black[104] = {
+        {0x037, 10}, {0x002, 3}, {0x003, 2}, {0x002, 2},
+        {0x003, 3}, {0x003, 4}, {0x002, 4}, {0x003, 5},
+        {0x005, 6}, {0x004, 6}, {0x004, 7}, {0x005, 7},
+        {0x007, 7}, {0x004, 8}, {0x007, 8}, {0x018, 9},
+        {0x017, 10}, {0x018, 10}, {0x008, 10}, {0x067, 11},
+        {0x068, 11}, {0x06C, 11}, {0x037, 11}, {0x028, 11},
+        {0x017, 11}, {0x018, 11}, {0x0CA, 12}, {0x0CB, 12},
+        {0x0CC, 12}, {0x0CD, 12}, {0x068, 12}, {0x069, 12},
+        {0x06A, 12}, {0x06B, 12}, {0x0D2, 12}, {0x0D3, 12},
+        {0x0D4, 12}, {0x0D5, 12}, {0x0D6, 12}, {0x0D7, 12},
+        {0x06C, 12}, {0x06D, 12}, {0x0DA, 12}, {0x0DB, 12},
+        {0x054, 12}, {0x055, 12}, {0x056, 12}, {0x057, 12},
+        {0x064, 12}, {0x065, 12}, {0x052, 12}, {0x053, 12},
+        {0x024, 12}, {0x037, 12}, {0x038, 12}, {0x027, 12},
+        {0x028, 12}, {0x058, 12}, {0x059, 12}, {0x02B, 12},
+        {0x02C, 12}, {0x05A, 12}, {0x066, 12}, {0x067, 12},
+        {0x00F, 10}, {0x0C8, 12}, {0x0C9, 12}, {0x05B, 12},
+        {0x033, 12}, {0x034, 12}, {0x035, 12}, {0x06C, 13},
+        {0x06D, 13}, {0x04A, 13}, {0x04B, 13}, {0x04C, 13},
+        {0x04D, 13}, {0x072, 13}, {0x073, 13}, {0x074, 13},
+        {0x075, 13}, {0x076, 13}, {0x077, 13}, {0x052, 13},
+        {0x053, 13}, {0x054, 13}, {0x055, 13}, {0x05A, 13},
+        {0x05B, 13}, {0x064, 13}, {0x065, 13}, {0x008, 11},
+        {0x00C, 11}, {0x00D, 11}, {0x012, 12}, {0x013, 12},
+        {0x014, 12}, {0x015, 12}, {0x016, 12}, {0x017, 12},
+        {0x01C, 12}, {0x01D, 12}, {0x01E, 12}, {0x01F, 12},
+};
+
+/// Encoder of top-down BMP files, black and white, grayscale or RGB images.
+class BmpFileEncoder : public FileEncoder {
+
+public:
+    BmpFileEncoder() noexcept :
+        m_columns(0), m_bitCount(0), m_stride(0){}
+
+    virtual Compression compression() const noexcept override{
+        return Compression::None;
+    }
+
+    virtual bool begin(const ImageInfo& info, UInt32 columns, UInt32 rows, EncoderOutput& out) override{
+        UInt32 colors;
+        switch (info.pixelType()){
+            case PixelType::BlackWhite:
+                m_bitCount = 1;
+                colors = 2;
+                break;
+
+            case PixelType::Gray:
+                m_bitCount = 8;
+                colors = 256;
+                break;
+
+            case PixelType::Rgb:
+                m_bitCount = 24;
+                colors = 0;
+                break;
+
+            default:
+                return false;
+        }
+
+        if (info.bitsPerPixel() != static_cast<Int16>(m_bitCount) || info.planar() ||
+                columns == 0 || rows == 0 || columns > 0x7FFFFFFF || rows > 0x7FFFFFFF){
+            return false;
+        }
+
+        m_columns = columns;
+        m_stride = ((columns * m_bitCount + 31) / 32) * 4;
+
+        auto dataOffset = 14 + 40 + colors * 4;
+        auto fileSize = dataOffset + static_cast<std::uint64_t>(m_stride) * rows;
+        if (fileSize > 0xFFFFFFFFu){
+            return false;
+        }
+
+        auto header = reinterpret_cast<unsigned char*>(out.reserve(dataOffset));
+        UInt32 pos = 0;
+        header[pos++] = 'B';
+        header[pos++] = 'M';
+        put32(header, pos, static_cast<UInt32>(fileSize));
+        put32(header, pos, 0); // reserved
+        put32(header, pos, dataOffset);
+
+        put32(header, pos, 40); // BITMAPINFOHEADER
+        put32(header, pos, columns);
+        put32(header, pos, static_cast<UInt32>(-static_cast<Int32>(rows))); // top-down
+        put16(header, pos, 1); // planes
+        put16(header, pos, static_cast<UInt16>(m_bitCount));
+        put32(header, pos, 0); // BI_RGB
+        put32(header, pos, static_cast<UInt32>(static_cast<std::uint64_t>(m_stride) * rows));
+        put32(header, pos, pixelsPerMeter(info.xResolution()));
+        put32(header, pos, pixelsPerMeter(info.yResolution()));
+        put32(header, pos, colors);
+        put32(header, pos, 0); // all colors important
+
+        for (UInt32 i = 0; i < colors; i++){
+            // TWAIN zero is black
+            auto level = static_cast<unsigned char>(colors == 2 ? i * 255 : i);
+            header[pos++] = level;
+            header[pos++] = level;
+            header[pos++] = level;
+            header[pos++] = 0;
+        }
+
+        out.commit(dataOffset);
+        return true;
+    }
+
+    virtual void encode(const char* data, UInt32 bytesPerRow, UInt32 rows, EncoderOutput& out) override{
+        auto rowBytes = (m_columns * m_bitCount + 7) / 8;
+        auto dst = out.reserve(static_cast<std::size_t>(m_stride) * rows);
+        for (UInt32 i = 0; i < rows; i++){
+            auto src = data + static_cast<std::size_t>(i) * bytesPerRow;
+            if (m_bitCount == 24){
+                // BMP stores BGR
+                for (UInt32 x = 0; x < m_columns; x++){
+                    dst[x * 3] = src[x * 3 + 2];
+                    dst[x * 3 + 1] = src[x * 3 + 1];
+                    dst[x * 3 + 2] = src[x * 3];
+                }
+            } else {
+                std::memcpy(dst, src, rowBytes);
+            }
+
+            std::memset(dst + rowBytes, 0, m_stride - rowBytes);
+            dst += m_stride;
+        }
+
+        out.commit(static_cast<std::size_t>(m_stride) * rows);
+    }
+
+    virtual void end(EncoderOutput&) override{
+        // sizes are known up front
+    }
+
+private:
+    static UInt32 pixelsPerMeter(Fix32 dpi) noexcept{
+        auto raw = dpi.raw();
+        if (raw <= 0){
+            return 2835; // 72 DPI
+        }
+
+        // dpi * 10000 / 254, rounded
+        return static_cast<UInt32>((static_cast<std::uint64_t>(raw) * 5000 + 127 * 65536) / (127 * 65536));
+    }
+
+    static void put16(unsigned char* out, UInt32& pos, UInt16 val) noexcept{
+        out[pos++] = static_cast<unsigned char>(val);
+        out[pos++] = static_cast<unsigned char>(val >> 8);
+    }
+
+    static void put32(unsigned char* out, UInt32& pos, UInt32 val) noexcept{
+        put16(out, pos, static_cast<UInt16>(val));
+        put16(out, pos, static_cast<UInt16>(val >> 16));
+    }
+
+    UInt32 m_columns;
+    UInt32 m_bitCount;
+    UInt32 m_stride;
+
+};
+
+/// Streams an image file through memory file transfers, encoding rows as they are read.
+/// Each `get` reads and encodes only as many rows as needed to fill the transfer buffer,
+/// so the first bytes reach the application right away and memory stays bounded by the buffer size,
+/// except for encoders that need the whole page (TIFF Group 4).
+///
+///     Result imageMemFileXferGet(const Identity&, ImageMemFileXfer& data){
+///         if (!m_fileStream.active()){
+///             std::unique_ptr<FileEncoder> encoder(new TiffFileEncoder());
+///             if (!m_fileStream.start(std::move(encoder), m_info, [this](char* out, UInt32 bpr, UInt32 rows){
+///                 return readRows(out, bpr, rows);
+///             })){
+///                 return badValue();
+///             }
+///         }
+///
+///         return m_fileStream.get(data);
+///     }
+///
+/// Not thread-safe.
+class MemFileStream {
+
+public:
+    /// Reads up to `rows` packed rows of `bytesPerRow` bytes, returns the number of rows read.
+    /// Returning 0 before the whole image has been read fails the transfer.
+    typedef std::function<UInt32(char* out, UInt32 bytesPerRow, UInt32 rows)> RowReader;
+
+    MemFileStream() noexcept :
+        m_bufferRows(0), m_bytesPerRow(0), m_rows(0), m_read(0), m_finished(false){}
+
+    /// Starts streaming a new file, any previous one is dropped.
+    /// \param encoder File encoder.
+    /// \param info Image layout, the width and height must be known.
+    /// \param reader Source of the rows.
+    /// \return Whether the encoder supports the layout.
+    /// \throw std::bad_alloc
+    bool start(std::unique_ptr<FileEncoder> encoder, const ImageInfo& info, RowReader reader){
+        reset();
+        if (!encoder || !reader || info.width() <= 0 || info.height() <= 0){
+            return false;
+        }
+
+        auto columns = static_cast<UInt32>(info.width());
+        auto rows = static_cast<UInt32>(info.height());
+        if (!encoder->begin(info, columns, rows, m_out)){
+            m_out.clear();
+            return false;
+        }
+
+        m_encoder = std::move(encoder);
+        m_reader = std::move(reader);
+        m_bytesPerRow = Detail::TiffHeader(info).rowBytes(columns);
+        m_rows = rows;
+        return true;
+    }
+
+    /// Whether a file is being streamed.
+    bool active() const noexcept{
+        return static_cast<bool>(m_encoder);
+    }
+
+    /// Handles Msg::Get of Dat::ImageMemFileXfer, fills the buffer with the next part of the file.
+    /// \param data Transfer structure, its memory is filled.
+    /// \return {XferDone with the last part of the file, Success with any other part,
+    ///          failure if there is no file or the reader failed.}
+    /// \throw std::bad_alloc
+    Result get(ImageMemFileXfer& data){
+        if (!m_encoder){
+            return {ReturnCode::Failure, ConditionCode::SeqError};
+        }
+
+        auto memSize = data.memory().size();
+        if (memSize == 0){
+            return {ReturnCode::Failure, ConditionCode::BadValue};
+        }
+
+        while (m_out.size() < memSize && !m_finished){
+            // read about as many rows as fit the transfer buffer
+            auto batch = std::max<UInt32>(1, memSize / std::max<UInt32>(m_bytesPerRow, 1));
+            batch = std::min(batch, m_rows - m_read);
+            if (batch != 0){
+                if (!m_buffer || m_bufferRows < batch){
+                    m_buffer.reset(new char[static_cast<std::size_t>(batch) * m_bytesPerRow]);
+                    m_bufferRows = batch;
+                }
+
+                auto read = std::min(m_reader(m_buffer.get(), m_bytesPerRow, batch), batch);
+                if (read == 0){
+                    reset();
+                    return {ReturnCode::Failure, ConditionCode::OperationError};
+                }
+
+                m_encoder->encode(m_buffer.get(), m_bytesPerRow, read, m_out);
+                m_read += read;
+            }
+
+            if (m_read >= m_rows){
+                m_encoder->end(m_out);
+                m_finished = true;
+            }
+        }
+
+        static const UInt32 dontCare = 0xFFFFFFFF;
+        auto lock = data.memory().data();
+        auto written = static_cast<UInt32>(m_out.read(lock.data(), memSize));
+        data.setCompression(m_encoder->compression());
+        data.setBytesPerRow(dontCare);
+        data.setColumns(dontCare);
+        data.setRows(dontCare);
+        data.setXOffset(dontCare);
+        data.setYOffset(dontCare);
+        data.setBytesWritten(written);
+
+        if (m_finished && m_out.empty()){
+            reset();
+            return {ReturnCode::XferDone, ConditionCode::Success};
+        }
+
+        return {ReturnCode::Success, ConditionCode::Success};
+    }
+
+    /// Drops the current file, e.g. when the transfer is reset.
+    void reset() noexcept{
+        m_encoder.reset();
+        m_reader = RowReader();
+        m_out.clear();
+        m_read = 0;
+        m_rows = 0;
+        m_finished = false;
+    }
+
+private:
+    std::unique_ptr<FileEncoder> m_encoder;
+    RowReader m_reader;
+    EncoderOutput m_out;
+    std::unique_ptr<char[]> m_buffer;
+    UInt32 m_bufferRows;
+    UInt32 m_bytesPerRow;
+    UInt32 m_rows;
+    UInt32 m_read;
+    bool m_finished;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_MEMFILEENCODER_HPP
@@ -31,6 +31,8 @@ SOFTWARE.
 
 namespace Twpp {
 
+class Memory;
+
 namespace Detail {
 
 namespace Flags {
@@ -54,12 +56,16 @@ static constexpr const UInt32 otherOwns = AppOwns;
 
 }
 
+static void setMemorySize(Memory& memory, UInt32 size) noexcept;
+
 }
 
 TWPP_DETAIL_PACK_BEGIN
 /// Holds and potentially owns a block of memory using either pointer or handle.
 class Memory {
 
+    friend void Detail::setMemorySize(Memory& memory, UInt32 size) noexcept;
+
 public:
     typedef Detail::MaybeLock<char> Data;
     typedef Detail::MaybeLock<const char> ConstData;
@@ -87,7 +93,12 @@ public:
     Memory(Handle h, UInt32 size, bool thisOwns = true) noexcept :
         m_flags((thisOwns ? Detail::Flags::thisOwns : Detail::Flags::otherOwns) | Detail::Flags::Handle),
         m_size(size),
-        m_data(h.raw()){}
+        m_data(h.raw()){
+
+        if (!thisOwns){
+            Detail::disown(h);
+        }
+    }
 
     /// Creates a memory object from container.
     /// The memory object does NOT take over the ownership of the data.
@@ -186,6 +197,14 @@ private:
 };
 TWPP_DETAIL_PACK_END
 
+namespace Detail {
+
+// reuses a block for a smaller transfer, `size` must not exceed the allocated size
+static inline void setMemorySize(Memory& memory, UInt32 size) noexcept{
+    memory.m_size = size;
+}
+
+}
 
 
 }
@@ -89,7 +89,7 @@ struct GlobalMemFuncs {
     static MemUnlock unlock;
 
 #if defined(TWPP_IS_DS)
-    static Handle doNotFreeHandle;
+    static thread_local Handle doNotFreeHandle; // per calling thread, sessions may run concurrently
 #endif
 
 };
@@ -124,10 +124,191 @@ MemUnlock GlobalMemFuncs<Dummy>::unlock = nullptr;
 
 #if defined(TWPP_IS_DS)
     template<typename Dummy>
-    Handle GlobalMemFuncs<Dummy>::doNotFreeHandle;
+    thread_local Handle GlobalMemFuncs<Dummy>::doNotFreeHandle;
 #endif
 
+/// Usage counters of the handle pool.
+struct HandlePoolStats {
+
+    /// Allocations served from the pool.
+    UInt32 hits;
+
+    /// Poolable allocations that had to call the memory functions.
+    UInt32 misses;
+
+    /// Frees that returned a handle into the pool.
+    UInt32 recycled;
+
+    /// Pooled handles that were handed over to the other side.
+    UInt32 disowned;
+
+};
+
+/// Size-classed cache of handles allocated and freed by this side of the connection.
+/// Handles are rounded up to a power of two, and kept in the pool until
+/// they are freed by the same side; handles passed to the other side
+/// of the connection are disowned and never recycled.
+/// Sources disown every handle placed into a structure of the application
+/// when the call returns, see Detail::handOver.
+/// Disabled by default, see Twpp::enableHandlePool.
+template<typename Dummy>
+struct HandlePool {
+
+    enum : UInt32 {
+        MinShift = 4, // 16 B
+        MaxShift = 16, // 64 KiB
+        ClassCount = MaxShift - MinShift + 1,
+        MaxDepth = 64
+    };
+
+    /// Tries to serve the allocation from the pool.
+    /// \param size Requested size in bytes.
+    /// \param out Allocated handle, null if the memory functions failed.
+    /// \return Whether the request was handled by the pool.
+    /// \throw std::bad_alloc
+    static bool acquire(UInt32 size, Handle::Raw& out){
+        UInt32 cls;
+        if (!enabled.load(std::memory_order_relaxed) || !sizeClass(size, cls)){
+            return false;
+        }
+
+        bool hit = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!enabled.load(std::memory_order_relaxed)){
+                return false;
+            }
+
+            if (count[cls] != 0){
+                out = cached[cls][--count[cls]];
+                hit = true;
+                stats.hits++;
+            } else {
+                out = GlobalMemFuncs<Dummy>::alloc(static_cast<UInt32>(1) << (cls + MinShift));
+                stats.misses++;
+                if (!out){
+                    return true;
+                }
+            }
+
+            try {
+                live[out] = cls;
+            } catch (...){
+                GlobalMemFuncs<Dummy>::free(out);
+                throw;
+            }
+        }
+
+        if (hit){
+            // fresh allocations are zeroed by the default functions, keep that
+            auto ptr = GlobalMemFuncs<Dummy>::lock(out);
+            std::memset(ptr, 0, size);
+            GlobalMemFuncs<Dummy>::unlock(out);
+        }
+
+        return true;
+    }
+
+    /// Returns a handle allocated by the pool back into it.
+    /// \return Whether the handle was taken over by the pool,
+    ///         the caller must free the handle otherwise.
+    static bool recycle(Handle::Raw handle) noexcept{
+        if (!enabled.load(std::memory_order_relaxed)){
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = live.find(handle);
+        if (it == live.end()){
+            return false;
+        }
+
+        auto cls = it->second;
+        live.erase(it);
+        if (count[cls] >= depth){
+            return false;
+        }
+
+        cached[cls][count[cls]++] = handle;
+        stats.recycled++;
+        return true;
+    }
+
+    /// Stops tracking the handle, it is going to be freed by the other side.
+    static void disown(Handle::Raw handle) noexcept{
+        if (!enabled.load(std::memory_order_relaxed)){
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (live.erase(handle) != 0){
+            stats.disowned++;
+        }
+    }
+
+    /// Frees all cached handles using the current memory functions,
+    /// and forgets handles that are still in use.
+    static void drain() noexcept{
+        std::lock_guard<std::mutex> lock(mutex);
+        for (UInt32 cls = 0; cls < ClassCount; cls++){
+            for (UInt32 i = 0; i < count[cls]; i++){
+                GlobalMemFuncs<Dummy>::free(cached[cls][i]);
+            }
+
+            count[cls] = 0;
+        }
+
+        live.clear();
+    }
+
+    static bool sizeClass(UInt32 size, UInt32& cls) noexcept{
+        if (size > (static_cast<UInt32>(1) << MaxShift)){
+            return false;
+        }
+
+        cls = 0;
+        while ((static_cast<UInt32>(1) << (cls + MinShift)) < size){
+            cls++;
+        }
+
+        return true;
+    }
+
+    static std::atomic<bool> enabled;
+    static UInt32 depth;
+    static std::mutex mutex;
+    static Handle::Raw cached[ClassCount][MaxDepth];
+    static UInt32 count[ClassCount];
+    static std::map<Handle::Raw, UInt32> live;
+    static HandlePoolStats stats;
+
+};
+
+template<typename Dummy>
+std::atomic<bool> HandlePool<Dummy>::enabled(false);
+
+template<typename Dummy>
+UInt32 HandlePool<Dummy>::depth = 0;
+
+template<typename Dummy>
+std::mutex HandlePool<Dummy>::mutex;
+
+template<typename Dummy>
+Handle::Raw HandlePool<Dummy>::cached[HandlePool<Dummy>::ClassCount][HandlePool<Dummy>::MaxDepth];
+
+template<typename Dummy>
+UInt32 HandlePool<Dummy>::count[HandlePool<Dummy>::ClassCount];
+
+template<typename Dummy>
+std::map<Handle::Raw, UInt32> HandlePool<Dummy>::live;
+
+template<typename Dummy>
+HandlePoolStats HandlePool<Dummy>::stats;
+
 inline static void setMemFuncs(MemAlloc alloc, MemFree free, MemLock lock, MemUnlock unlock) noexcept{
+    // cached handles belong to the previous memory functions
+    HandlePool<void>::drain();
+
     GlobalMemFuncs<void>::alloc = alloc;
     GlobalMemFuncs<void>::free = free;
     GlobalMemFuncs<void>::lock = lock;
@@ -135,6 +316,8 @@ inline static void setMemFuncs(MemAlloc alloc, MemFree free, MemLock lock, MemUn
 }
 
 inline static void resetMemFuncs() noexcept{
+    HandlePool<void>::drain();
+
 #if defined(TWPP_DETAIL_OS_WIN) || defined(TWPP_DETAIL_OS_MAC)
     GlobalMemFuncs<void>::alloc = GlobalMemFuncs<void>::defAlloc;
     GlobalMemFuncs<void>::free = GlobalMemFuncs<void>::defFree;
@@ -151,7 +334,11 @@ inline static void resetMemFuncs() noexcept{
 }
 
 inline static Handle alloc(UInt32 size){
-    auto h = GlobalMemFuncs<void>::alloc(size);
+    Handle::Raw h = Handle::Raw();
+    if (!HandlePool<void>::acquire(size, h)){
+        h = GlobalMemFuncs<void>::alloc(size);
+    }
+
     if (!h){
         throw std::bad_alloc();
     }
@@ -168,7 +355,15 @@ inline static void unlock(Handle handle) noexcept{
 }
 
 inline static void free(Handle handle) noexcept{
-    GlobalMemFuncs<void>::free(handle.raw());
+    if (!HandlePool<void>::recycle(handle.raw())){
+        GlobalMemFuncs<void>::free(handle.raw());
+    }
+}
+
+/// Marks the handle as passed to the other side of the connection,
+/// it is never going to be recycled by the handle pool.
+inline static void disown(Handle handle) noexcept{
+    HandlePool<void>::disown(handle.raw());
 }
 
 template<typename T>
@@ -176,8 +371,97 @@ static inline T* typeLock(Handle handle) noexcept{
     return static_cast<T*>(lock(handle));
 }
 
+#if defined(TWPP_DETAIL_OS_WIN)
+/// Per-thread table of handles locked by Lock and MaybeLock.
+/// Nested locks of an already locked handle reuse the pointer
+/// obtained by the outermost lock without calling the memory functions,
+/// the handle is unlocked once the last of its locks goes away.
+/// Each lock must be released by the thread that took it.
+/// Handles that do not fit into the table are locked and unlocked directly.
+/// Only Windows pins handles, locking is a plain access of the handle elsewhere.
+template<typename Dummy>
+struct LockPins {
+
+    enum : UInt32 {
+        MaxPins = 16
+    };
+
+    struct Pin {
+        Handle::Raw m_handle;
+        void* m_pointer;
+        UInt32 m_count;
+    };
+
+    struct Table {
+        Pin m_pins[MaxPins];
+        UInt32 m_used;
+    };
+
+    static void* lock(Handle handle) noexcept{
+        auto& table = g_table;
+        for (UInt32 i = 0; i < table.m_used; i++){
+            auto& pin = table.m_pins[i];
+            if (pin.m_handle == handle.raw()){
+                pin.m_count++;
+                return pin.m_pointer;
+            }
+        }
+
+        auto ptr = Detail::lock(handle);
+        if (ptr && table.m_used < MaxPins){
+            table.m_pins[table.m_used++] = Pin{handle.raw(), ptr, 1};
+        }
+
+        return ptr;
+    }
+
+    static void unlock(Handle handle) noexcept{
+        auto& table = g_table;
+        for (UInt32 i = 0; i < table.m_used; i++){
+            auto& pin = table.m_pins[i];
+            if (pin.m_handle == handle.raw()){
+                if (--pin.m_count == 0){
+                    pin = table.m_pins[--table.m_used];
+                    break;
+                }
+
+                return;
+            }
+        }
+
+        Detail::unlock(handle);
+    }
+
+    static thread_local Table g_table;
+
+};
+
+template<typename Dummy>
+thread_local typename LockPins<Dummy>::Table LockPins<Dummy>::g_table;
+
+template<typename T>
+static inline T* pinLock(Handle handle) noexcept{
+    return static_cast<T*>(LockPins<void>::lock(handle));
+}
+
+static inline void pinUnlock(Handle handle) noexcept{
+    LockPins<void>::unlock(handle);
+}
+#else
+template<typename T>
+static inline T* pinLock(Handle handle) noexcept{
+    return typeLock<T>(handle);
+}
+
+static inline void pinUnlock(Handle handle) noexcept{
+    unlock(handle);
+}
+#endif
+
 /// A lock that can contain either handle or raw pointer.
 /// Locks and unlocks handle, noop for pointer.
+/// Nested locks of the same handle are elided on Windows, see LockPins.
+/// Must be destroyed by the thread that created it.
 template<typename T>
 class MaybeLock {
 
@@ -186,7 +470,7 @@ public:
         m_handle(), m_pointer(nullptr){}
 
     MaybeLock(Handle h) noexcept :
-        m_handle(h), m_pointer(typeLock<T>(h)){}
+        m_handle(h), m_pointer(pinLock<T>(h)){}
 
     constexpr MaybeLock(T* ptr) noexcept :
         m_handle(), m_pointer(ptr){}
@@ -196,14 +480,14 @@ public:
     }
 
     MaybeLock(const MaybeLock& o) noexcept :
-        m_handle(o.m_handle), m_pointer(o.m_handle ? typeLock<T>(o.m_handle) : o.m_pointer){}
+        m_handle(o.m_handle), m_pointer(o.m_handle ? pinLock<T>(o.m_handle) : o.m_pointer){}
 
     MaybeLock& operator=(const MaybeLock& o) noexcept{
         if (&o != this){
             unlock();
 
             m_handle = o.m_handle;
-            m_pointer = m_handle ? typeLock<T>(m_handle) : o.m_pointer;
+            m_pointer = m_handle ? pinLock<T>(m_handle) : o.m_pointer;
         }
 
         return *this;
@@ -258,7 +542,7 @@ public:
 private:
     void unlock() noexcept{
         if (m_handle){
-            Detail::unlock(m_handle);
+            pinUnlock(m_handle);
         }
     }
 
@@ -269,6 +553,8 @@ private:
 
 /// Simple handle lock.
 /// Locks on creation and unlocks on destruction.
+/// Nested locks of the same handle are elided on Windows, see LockPins.
+/// Must be destroyed by the thread that created it.
 template<typename T>
 class Lock {
 
@@ -277,7 +563,7 @@ public:
         m_handle(), m_pointer(nullptr){}
 
     Lock(Handle h) noexcept :
-        m_handle(h), m_pointer(typeLock<T>(h)){}
+        m_handle(h), m_pointer(pinLock<T>(h)){}
 
     ~Lock(){
         unlock();
@@ -285,14 +571,14 @@ public:
 
 
     Lock(const Lock& o) noexcept :
-        m_handle(o.m_handle), m_pointer(typeLock<T>(o.m_handle)){}
+        m_handle(o.m_handle), m_pointer(pinLock<T>(o.m_handle)){}
 
     Lock& operator=(const Lock& o) noexcept{
         if (&o != this){
             unlock();
 
             m_handle = o.m_handle;
-            m_pointer = typeLock<T>(m_handle);
+            m_pointer = pinLock<T>(m_handle);
         }
 
         return *this;
@@ -348,7 +634,7 @@ public:
 private:
     void unlock() noexcept{
         if (m_handle){
-            Detail::unlock(m_handle);
+            pinUnlock(m_handle);
         }
     }
 
@@ -408,6 +694,7 @@ public:
     Handle release() noexcept{
         Handle ret = m_handle;
         m_handle = Handle();
+        Detail::disown(ret);
         return ret;
     }
 
@@ -433,6 +720,46 @@ private:
 
 }
 
+/// Enables recycling of handles allocated and freed by this side of the connection.
+/// Handles up to 64 KiB are rounded up to a power of two and kept for reuse,
+/// handles passed to the other side of the connection are never recycled.
+/// \param depth Maximal number of cached handles per size class, at most 64.
+inline static void enableHandlePool(UInt32 depth = 16) noexcept{
+    typedef Detail::HandlePool<void> Pool;
+
+    std::lock_guard<std::mutex> lock(Pool::mutex);
+    Pool::depth = depth < Pool::MaxDepth ? depth : static_cast<UInt32>(Pool::MaxDepth);
+    Pool::enabled.store(true);
+}
+
+/// Disables the handle pool, and frees all cached handles.
+inline static void disableHandlePool() noexcept{
+    typedef Detail::HandlePool<void> Pool;
+
+    {
+        std::lock_guard<std::mutex> lock(Pool::mutex);
+        Pool::enabled.store(false);
+    }
+
+    Pool::drain();
+}
+
+/// Usage counters of the handle pool.
+inline static Detail::HandlePoolStats handlePoolStats() noexcept{
+    typedef Detail::HandlePool<void> Pool;
+
+    std::lock_guard<std::mutex> lock(Pool::mutex);
+    return Pool::stats;
+}
+
+/// Resets usage counters of the handle pool.
+inline static void resetHandlePoolStats() noexcept{
+    typedef Detail::HandlePool<void> Pool;
+
+    std::lock_guard<std::mutex> lock(Pool::mutex);
+    Pool::stats = Detail::HandlePoolStats();
+}
+
 }
 
 #endif // TWPP_DETAIL_FILE_MEMORYOPS_HPP
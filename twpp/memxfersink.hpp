@@ -0,0 +1,549 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_MEMXFERSINK_HPP
+#define TWPP_DETAIL_FILE_MEMXFERSINK_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Write-only file, optionally bypassing the system cache.
+/// Unbuffered writes must be aligned to `MemXferSink::Alignment`, both in offset and size.
+class SinkFile {
+
+public:
+#if defined(TWPP_DETAIL_OS_WIN)
+    typedef ::HANDLE Raw;
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+    typedef int Raw;
+#else
+#   error "SinkFile handle for your platform here"
+#endif
+
+    SinkFile() noexcept :
+        m_file(invalid()), m_direct(false){}
+
+    ~SinkFile(){
+        close();
+    }
+
+    SinkFile(const SinkFile&) = delete;
+    SinkFile& operator=(const SinkFile&) = delete;
+
+    /// Creates or truncates the file.
+    /// Falls back to buffered writes if unbuffered are not supported.
+    bool open(const char* path, bool direct) noexcept{
+        close();
+
+#if defined(TWPP_DETAIL_OS_WIN)
+        ::DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if (direct){
+            m_file = ::CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                   flags | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+        }
+
+        m_direct = m_file != invalid();
+        if (!m_direct){
+            m_file = ::CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, flags, nullptr);
+        }
+#elif defined(TWPP_DETAIL_OS_LINUX)
+        int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#   if defined(O_DIRECT)
+        if (direct){
+            m_file = ::open(path, flags | O_DIRECT, 0644);
+        }
+#   endif
+
+        m_direct = m_file != invalid();
+        if (!m_direct){
+            m_file = ::open(path, flags, 0644);
+        }
+#elif defined(TWPP_DETAIL_OS_MAC)
+        m_file = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        m_direct = m_file != invalid() && direct && ::fcntl(m_file, F_NOCACHE, 1) != -1;
+#else
+#   error "SinkFile open for your platform here"
+#endif
+
+        return m_file != invalid();
+    }
+
+    bool isOpen() const noexcept{
+        return m_file != invalid();
+    }
+
+    /// Whether the writes bypass the system cache.
+    bool isDirect() const noexcept{
+        return m_direct;
+    }
+
+    /// Writes all data at the offset.
+    bool write(const char* data, std::size_t size, std::uint64_t offset) noexcept{
+        while (size != 0){
+#if defined(TWPP_DETAIL_OS_WIN)
+            ::OVERLAPPED ov;
+            std::memset(&ov, 0, sizeof(ov));
+            ov.Offset = static_cast<::DWORD>(offset);
+            ov.OffsetHigh = static_cast<::DWORD>(offset >> 32);
+
+            ::DWORD chunk = static_cast<::DWORD>(std::min<std::size_t>(size, 0x40000000));
+            ::DWORD written = 0;
+            if (!::WriteFile(m_file, data, chunk, &written, &ov) || written == 0){
+                return false;
+            }
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+            auto written = ::pwrite(m_file, data, std::min<std::size_t>(size, 0x40000000), static_cast<::off_t>(offset));
+            if (written < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+
+#   if defined(TWPP_DETAIL_OS_LINUX) && defined(O_DIRECT)
+                // some file systems accept O_DIRECT at open time only
+                if (errno == EINVAL && m_direct){
+                    m_direct = false;
+                    ::fcntl(m_file, F_SETFL, ::fcntl(m_file, F_GETFL) & ~O_DIRECT);
+                    continue;
+                }
+#   endif
+
+                return false;
+            }
+#else
+#   error "SinkFile write for your platform here"
+#endif
+            data += written;
+            size -= static_cast<std::size_t>(written);
+            offset += static_cast<std::uint64_t>(written);
+        }
+
+        return true;
+    }
+
+    /// Sets the file size.
+    bool truncate(std::uint64_t size) noexcept{
+#if defined(TWPP_DETAIL_OS_WIN)
+        ::LARGE_INTEGER li;
+        li.QuadPart = static_cast<::LONGLONG>(size);
+        return ::SetFilePointerEx(m_file, li, nullptr, FILE_BEGIN) && ::SetEndOfFile(m_file);
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        return ::ftruncate(m_file, static_cast<::off_t>(size)) == 0;
+#else
+#   error "SinkFile truncate for your platform here"
+#endif
+    }
+
+    bool close() noexcept{
+        if (!isOpen()){
+            return true;
+        }
+
+#if defined(TWPP_DETAIL_OS_WIN)
+        bool ok = ::CloseHandle(m_file) != 0;
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        bool ok = ::close(m_file) == 0;
+#else
+#   error "SinkFile close for your platform here"
+#endif
+        m_file = invalid();
+        return ok;
+    }
+
+private:
+    static Raw invalid() noexcept{
+#if defined(TWPP_DETAIL_OS_WIN)
+        return INVALID_HANDLE_VALUE;
+#elif defined(TWPP_DETAIL_OS_MAC) || defined(TWPP_DETAIL_OS_LINUX)
+        return -1;
+#else
+#   error "SinkFile invalid handle for your platform here"
+#endif
+    }
+
+    Raw m_file;
+    bool m_direct;
+
+};
+
+}
+
+/// Streams uncompressed memory transfer strips to a file or to a memory region,
+/// optionally prefixed by a TIFF header built from `ImageInfo`.
+///
+/// Strips are coalesced in an aligned buffer and written in large aligned blocks,
+/// bypassing the system cache where supported (O_DIRECT, F_NOCACHE, FILE_FLAG_NO_BUFFERING).
+/// Pass `stripMemory` to `ImageMemXfer` to let the source write directly into the buffer
+/// (or the region), `write` then does not copy the data at all:
+///
+///     MemXferSink sink;
+///     sink.open("page.tif", info);
+///     ReturnCode rc;
+///     do {
+///         ImageMemXfer strip(Compression::None, 0, 0, 0, 0, 0, 0, sink.stripMemory(setup.preferredSize()));
+///         rc = src.imageMemXfer(strip);
+///         if (success(rc)){
+///             sink.write(strip);
+///         }
+///     } while (rc == ReturnCode::Success);
+///
+///     sink.close();
+///
+/// TIFF rows are packed, row padding of the strips is removed.
+/// Raw format stores the strips as they are.
+class MemXferSink {
+
+public:
+    enum class Format {
+        Raw,
+        Tiff
+    };
+
+    enum : UInt32 {
+        Alignment = 4096,
+        DefaultBufferSize = 4 * 1024 * 1024
+    };
+
+    /// Creates a closed sink.
+    MemXferSink() noexcept :
+        m_format(Format::Raw), m_info(), m_dataOffset(0), m_dataBytes(0), m_rows(0), m_columns(0),
+        m_ok(false), m_open(false), m_buffer(nullptr), m_bufferSize(0), m_pending(0), m_fileOffset(0),
+        m_region(nullptr), m_regionSize(0), m_palette(), m_hasPalette(false){}
+
+    /// Finishes the stream, see `close`.
+    ~MemXferSink(){
+        close();
+    }
+
+    MemXferSink(const MemXferSink&) = delete;
+    MemXferSink& operator=(const MemXferSink&) = delete;
+
+    /// Sets the palette stored with TIFF images of PixelType::Palette,
+    /// e.g. obtained by `Source::palette8`. Applies to the following `open` calls.
+    void setPalette(const Palette8& palette) noexcept{
+        m_palette = palette;
+        m_hasPalette = true;
+    }
+
+    /// Opens a file target.
+    /// \param path File path, created or truncated.
+    /// \param info Image layout, used by TIFF header. Height may be unknown (-1).
+    /// \param format Output format.
+    /// \param direct Whether to bypass the system cache.
+    /// \param bufferSize Size of the coalescing buffer, rounded up to `Alignment`.
+    /// \return Whether the file was opened and the layout is supported by the format.
+    /// \throw std::bad_alloc
+    bool open(const char* path, const ImageInfo& info, Format format = Format::Tiff,
+              bool direct = true, UInt32 bufferSize = DefaultBufferSize){
+        close();
+
+        if (!start(info, format, Alignment)){
+            return false;
+        }
+
+        allocate(std::max<UInt32>(bufferSize, m_dataOffset + Alignment));
+        if (!m_file.open(path, direct)){
+            return false;
+        }
+
+        std::memset(m_buffer, 0, m_dataOffset); // header placeholder
+        m_pending = m_dataOffset;
+        m_ok = true;
+        m_open = true;
+        return true;
+    }
+
+    /// Opens a memory region target, e.g. a mapped file.
+    /// \param region The region, must outlive the sink.
+    /// \param size Size of the region in bytes.
+    /// \param info Image layout, used by TIFF header. Height may be unknown (-1).
+    /// \param format Output format.
+    /// \return Whether the region can hold at least the header and the layout is supported by the format.
+    bool open(void* region, std::size_t size, const ImageInfo& info, Format format = Format::Tiff) noexcept{
+        close();
+
+        if (!start(info, format, 8) || size < m_dataOffset){
+            return false;
+        }
+
+        m_region = static_cast<char*>(region);
+        m_regionSize = size;
+        std::memset(m_region, 0, m_dataOffset);
+        m_pending = m_dataOffset;
+        m_ok = true;
+        m_open = true;
+        return true;
+    }
+
+    /// Whether the sink is open.
+    bool isOpen() const noexcept{
+        return m_open;
+    }
+
+    /// Whether all writes so far succeeded.
+    bool isOk() const noexcept{
+        return m_ok;
+    }
+
+    /// Whether the file writes bypass the system cache.
+    bool isDirect() const noexcept{
+        return m_file.isDirect();
+    }
+
+    /// Number of image rows written so far.
+    UInt32 rows() const noexcept{
+        return m_rows;
+    }
+
+    /// Number of image data bytes written so far, headers excluded.
+    std::uint64_t dataBytes() const noexcept{
+        return m_dataBytes;
+    }
+
+    /// Memory for the next strip within the sink, does not own the data.
+    /// Valid until the next call of any non-const method.
+    /// Region targets return less memory if the region is almost full.
+    /// \param size Requested size in bytes.
+    /// \throw std::bad_alloc
+    Memory stripMemory(UInt32 size){
+        assert(isOpen());
+
+        if (m_region != nullptr){
+            auto left = m_regionSize - std::min<std::size_t>(m_pending, m_regionSize);
+            return Memory(m_region + m_pending, static_cast<UInt32>(std::min<std::size_t>(size, left)));
+        }
+
+        if (m_pending + size > m_bufferSize){
+            flush(false);
+            if (m_pending + size > m_bufferSize){
+                allocate(roundUp(m_pending + size, Alignment));
+            }
+        }
+
+        return Memory(m_buffer + m_pending, size);
+    }
+
+    /// Appends a transferred strip.
+    /// Strips transferred into `stripMemory` are not copied.
+    /// \param strip Uncompressed strip, full rows in TIFF format.
+    /// \return Whether the strip was stored.
+    bool write(const ImageMemXfer& strip) noexcept{
+        assert(isOpen());
+
+        if (!m_ok || strip.compression() != Compression::None){
+            return false;
+        }
+
+        auto lock = strip.memory().data();
+        const char* data = lock.data();
+        auto bytes = std::min(strip.bytesWritten(), strip.memory().size());
+
+        if (m_format == Format::Raw){
+            append(data, bytes);
+        } else {
+            if (m_columns == 0){
+                m_columns = m_info.width() > 0 ? static_cast<UInt32>(m_info.width()) : strip.columns();
+            }
+
+            if (strip.xOffset() != 0 || strip.columns() != m_columns || strip.bytesPerRow() == 0){
+                return false; // tiles are not supported
+            }
+
+            auto rowBytes = header().rowBytes(m_columns);
+            auto rows = std::min(strip.rows(), bytes / strip.bytesPerRow() + (bytes % strip.bytesPerRow() >= rowBytes ? 1 : 0));
+            for (UInt32 r = 0; r < rows && m_ok; r++){
+                append(data + static_cast<std::size_t>(r) * strip.bytesPerRow(), rowBytes);
+            }
+
+            m_rows += rows;
+        }
+
+        return m_ok;
+    }
+
+    /// Writes the remaining data, updates the header and closes the target.
+    /// \return Whether all writes succeeded.
+    bool close() noexcept{
+        if (!m_open){
+            return true;
+        }
+
+        m_open = false;
+        if (m_region != nullptr){
+            writeHeader(m_region);
+            m_region = nullptr;
+            return m_ok;
+        }
+
+        flush(true);
+        if (m_ok && m_dataOffset != 0){
+            std::memset(m_buffer, 0, m_dataOffset);
+            writeHeader(m_buffer);
+            m_ok = m_file.write(m_buffer, m_dataOffset, 0);
+        }
+
+        if (m_ok){
+            m_ok = m_file.truncate(m_dataOffset + m_dataBytes);
+        }
+
+        m_ok = m_file.close() && m_ok;
+        return m_ok;
+    }
+
+private:
+    static UInt32 roundUp(UInt32 value, UInt32 alignment) noexcept{
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool start(const ImageInfo& info, Format format, UInt32 alignment) noexcept{
+        m_format = format;
+        m_info = info;
+        m_rows = 0;
+        m_columns = 0;
+        m_dataBytes = 0;
+        m_fileOffset = 0;
+        m_pending = 0;
+        if (format == Format::Raw){
+            m_dataOffset = 0;
+            return true;
+        }
+
+        auto tiff = header();
+        m_dataOffset = roundUp(tiff.size(), alignment);
+        return tiff.isValid();
+    }
+
+    void allocate(UInt32 size){
+        size = roundUp(size, Alignment);
+        std::unique_ptr<char[]> storage(new char[size + Alignment]);
+        auto raw = reinterpret_cast<UIntPtr>(storage.get());
+        auto aligned = reinterpret_cast<char*>((raw + Alignment - 1) / Alignment * Alignment);
+        if (m_pending != 0){
+            std::memcpy(aligned, m_buffer, m_pending);
+        }
+
+        m_storage = std::move(storage);
+        m_buffer = aligned;
+        m_bufferSize = size;
+    }
+
+    void append(const char* data, UInt32 bytes) noexcept{
+        m_dataBytes += bytes;
+        if (m_region != nullptr){
+            if (m_pending + bytes > m_regionSize){
+                m_ok = false;
+                return;
+            }
+
+            if (data != m_region + m_pending){
+                std::memmove(m_region + m_pending, data, bytes);
+            }
+
+            m_pending += bytes;
+            return;
+        }
+
+        if (data == m_buffer + m_pending){
+            m_pending += bytes; // written in place by the source
+            return;
+        }
+
+        while (bytes != 0 && m_ok){
+            if (m_pending == m_bufferSize){
+                flush(false);
+            }
+
+            auto chunk = std::min<std::size_t>(bytes, m_bufferSize - m_pending);
+            std::memmove(m_buffer + m_pending, data, chunk);
+            m_pending += chunk;
+            data += chunk;
+            bytes -= static_cast<UInt32>(chunk);
+        }
+    }
+
+    // writes whole aligned blocks, or everything padded to alignment if final
+    void flush(bool final) noexcept{
+        std::size_t bytes = final ? roundUp(static_cast<UInt32>(m_pending), Alignment) : m_pending / Alignment * Alignment;
+        if (bytes == 0 || !m_ok){
+            return;
+        }
+
+        if (final){
+            std::memset(m_buffer + m_pending, 0, bytes - m_pending);
+        }
+
+        m_ok = m_file.write(m_buffer, bytes, m_fileOffset);
+        m_fileOffset += bytes;
+        if (!final){
+            std::memmove(m_buffer, m_buffer + bytes, m_pending - bytes);
+            m_pending -= bytes;
+        } else {
+            m_pending = 0;
+        }
+    }
+
+    void writeHeader(char* out) const noexcept{
+        if (m_format != Format::Tiff){
+            return;
+        }
+
+        auto columns = m_columns != 0 ? m_columns : static_cast<UInt32>(std::max<Int32>(m_info.width(), 0));
+        header().write(out, columns, m_rows, m_dataOffset, static_cast<UInt32>(m_dataBytes));
+    }
+
+    Detail::TiffHeader header() const noexcept{
+        return Detail::TiffHeader(m_info, Detail::TiffHeader::Uncompressed, m_hasPalette ? &m_palette : nullptr);
+    }
+
+    Format m_format;
+    ImageInfo m_info;
+    UInt32 m_dataOffset;
+    std::uint64_t m_dataBytes;
+    UInt32 m_rows;
+    UInt32 m_columns;
+    bool m_ok;
+    bool m_open;
+
+    Detail::SinkFile m_file;
+    std::unique_ptr<char[]> m_storage;
+    char* m_buffer;
+    UInt32 m_bufferSize;
+    std::size_t m_pending;
+    std::uint64_t m_fileOffset;
+
+    char* m_region;
+    std::size_t m_regionSize;
+
+    Palette8 m_palette;
+    bool m_hasPalette;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_MEMXFERSINK_HPP
@@ -0,0 +1,364 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_MEMXFERTUNER_HPP
+#define TWPP_DETAIL_FILE_MEMXFERTUNER_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+template<typename Dummy>
+struct CacheInfo {
+
+    /// Size of the L2 cache in bytes, queried once.
+    static UInt32 l2Size() noexcept{
+        static const UInt32 size = query();
+        return size;
+    }
+
+private:
+    static UInt32 query() noexcept{
+        static const UInt32 fallback = 256 * 1024;
+
+#if defined(TWPP_DETAIL_OS_WIN)
+        ::DWORD length = 0;
+        ::GetLogicalProcessorInformation(nullptr, &length);
+        if (length == 0){
+            return fallback;
+        }
+
+        auto count = length / sizeof(::SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+        std::unique_ptr<::SYSTEM_LOGICAL_PROCESSOR_INFORMATION[]> info(
+                    new (std::nothrow) ::SYSTEM_LOGICAL_PROCESSOR_INFORMATION[count]);
+
+        if (!info || !::GetLogicalProcessorInformation(info.get(), &length)){
+            return fallback;
+        }
+
+        for (decltype(count) i = 0; i < count; i++){
+            if (info[i].Relationship == ::RelationCache && info[i].Cache.Level == 2){
+                return static_cast<UInt32>(info[i].Cache.Size);
+            }
+        }
+
+        return fallback;
+#elif defined(TWPP_DETAIL_OS_MAC)
+        std::uint64_t size = 0;
+        std::size_t length = sizeof(size);
+        if (::sysctlbyname("hw.l2cachesize", &size, &length, nullptr, 0) != 0 || size == 0){
+            return fallback;
+        }
+
+        return static_cast<UInt32>(std::min<std::uint64_t>(size, 0x80000000u));
+#elif defined(TWPP_DETAIL_OS_LINUX)
+#   if defined(_SC_LEVEL2_CACHE_SIZE)
+        auto size = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (size > 0){
+            return static_cast<UInt32>(std::min<long>(size, 0x40000000L));
+        }
+#   endif
+
+        return fallback;
+#else
+#   error "CacheInfo::query for your platform here"
+#endif
+    }
+
+};
+
+}
+
+/// Size of the L2 cache in bytes, 256 KiB if unknown.
+static inline UInt32 l2CacheSize() noexcept{
+    return Detail::CacheInfo<void>::l2Size();
+}
+
+/// Creates memory transfer setup of a data source, for images of uncompressed rows.
+/// The preferred size is a whole number of rows and device blocks fitting
+/// into half of the L2 cache, so that a strip stays cached while it is being
+/// written by the source and read by the application.
+/// If no multiple of both fits, the size is a whole number of rows only.
+/// \param bytesPerRow Number of bytes of each row, the minimal size.
+/// \param rows Number of rows of the image, maximal size is the whole image.
+/// \param deviceBlock Size of the blocks read from the device, 0 if not applicable.
+/// \param cacheSize Target cache size, the L2 cache size by default.
+/// \return Setup with minSize <= preferredSize <= maxSize.
+static inline SetupMemXfer stripSetupMemXfer(UInt32 bytesPerRow, UInt32 rows,
+                                             UInt32 deviceBlock = 0, UInt32 cacheSize = 0) noexcept{
+    if (bytesPerRow == 0){
+        return SetupMemXfer();
+    }
+
+    auto max = static_cast<UInt32>(std::min<std::uint64_t>(
+                static_cast<std::uint64_t>(bytesPerRow) * (rows ? rows : 1), 0xFFFFFFFEu));
+
+    std::uint64_t target = (cacheSize ? cacheSize : l2CacheSize()) / 2;
+
+    // multiple of both rows and device blocks
+    std::uint64_t unit = bytesPerRow;
+    if (deviceBlock != 0){
+        std::uint64_t a = bytesPerRow;
+        std::uint64_t b = deviceBlock;
+        while (b != 0){
+            auto t = a % b;
+            a = b;
+            b = t;
+        }
+
+        auto lcm = static_cast<std::uint64_t>(bytesPerRow) / a * deviceBlock;
+        if (lcm <= target){
+            unit = lcm;
+        }
+    }
+
+    if (target < unit){
+        target = unit;
+    }
+
+    target -= target % unit;
+    auto pref = static_cast<UInt32>(std::min<std::uint64_t>(target, max));
+    return SetupMemXfer(bytesPerRow, max, pref);
+}
+
+/// Chooses the strip size of memory transfers from measured transfer times.
+/// The first strips of a session are transferred with sizes alternating between
+/// the preferred size and its half, and the per-call overhead and throughput
+/// are estimated from them. The chosen size keeps the overhead below the target
+/// fraction of each call, unless a call would take longer than the latency limit.
+///
+///     MemXferTuner& tuner = src.memXferTuner();
+///     tuner.setup(setup);
+///     ImageMemXfer strip(..., Memory(tuner.size()));
+///     auto start = std::chrono::steady_clock::now();
+///     rc = src.imageMemXfer(strip);
+///     tuner.record(strip.bytesWritten(), std::chrono::steady_clock::now() - start);
+///
+/// Not thread-safe.
+class MemXferTuner {
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const UInt32 dontCare = 0xFFFFFFFF;
+
+    /// Creates a tuner without setup.
+    /// \param samples Number of strips measured before the size is chosen, at least 2.
+    /// \param overheadPercent Target per-call overhead in percents of the call time, clamped to 1..99.
+    /// \param maxLatency Maximal time of a single call.
+    explicit MemXferTuner(UInt32 samples = 8, UInt32 overheadPercent = 5,
+                          std::chrono::microseconds maxLatency = std::chrono::milliseconds(50)) noexcept :
+        m_samples(samples < 2 ? 2 : samples), m_overhead(std::min<UInt32>(std::max<UInt32>(overheadPercent, 1), 99)),
+        m_maxLatency(maxLatency), m_setup(), m_pinned(0), m_chosen(0), m_base(0), m_count(0),
+        m_sumX(0), m_sumY(0), m_sumXX(0), m_sumXY(0), m_latency(0), m_throughput(0){}
+
+    /// Sets the limits reported by the source, restarts tuning if they changed.
+    /// \param setup Result of `Source::setupMemXfer`.
+    /// \return Whether the setup is usable.
+    bool setup(const SetupMemXfer& setup) noexcept{
+        if (setup.minSize() == m_setup.minSize() && setup.maxSize() == m_setup.maxSize() &&
+                setup.preferredSize() == m_setup.preferredSize() && m_base != 0){
+            return true;
+        }
+
+        m_setup = setup;
+        m_base = initialSize(setup);
+        reset();
+        return m_base != 0;
+    }
+
+    /// Restarts tuning with the current setup.
+    void reset() noexcept{
+        m_chosen = 0;
+        m_count = 0;
+        m_sumX = m_sumY = m_sumXX = m_sumXY = 0;
+        m_latency = m_throughput = 0;
+    }
+
+    /// Size of the next strip in bytes, 0 if there is no usable setup.
+    UInt32 size() const noexcept{
+        if (m_pinned != 0){
+            return clamp(m_pinned);
+        }
+
+        if (m_chosen != 0){
+            return m_chosen;
+        }
+
+        // probe two sizes, so that overhead and throughput can be told apart
+        return (m_count % 2) != 0 ? clamp(m_base / 2) : m_base;
+    }
+
+    /// Largest size of the next strips, buffers of this size fit all of them.
+    /// It is the larger one of the probed sizes until the size is chosen.
+    UInt32 capacity() const noexcept{
+        if (m_pinned != 0 || m_chosen != 0){
+            return size();
+        }
+
+        return std::max(m_base, clamp(m_base / 2));
+    }
+
+    /// Records a transferred strip.
+    /// \param bytes Number of bytes written by the source.
+    /// \param elapsed Duration of the call.
+    template<typename Duration>
+    void record(UInt32 bytes, Duration elapsed) noexcept{
+        if (m_chosen != 0 || bytes == 0){
+            return;
+        }
+
+        double x = bytes;
+        double y = std::chrono::duration_cast<std::chrono::duration<double> >(elapsed).count();
+        m_sumX += x;
+        m_sumY += y;
+        m_sumXX += x * x;
+        m_sumXY += x * y;
+        m_count++;
+
+        if (m_count >= m_samples){
+            choose();
+        }
+    }
+
+    /// Whether the size has been chosen from measurements.
+    bool tuned() const noexcept{
+        return m_chosen != 0;
+    }
+
+    /// Uses the supplied size regardless of measurements, clamped to the setup.
+    /// \param size Size in bytes, 0 to resume tuning.
+    void pin(UInt32 size) noexcept{
+        m_pinned = size;
+    }
+
+    /// Pinned size, 0 if not pinned.
+    UInt32 pinned() const noexcept{
+        return m_pinned;
+    }
+
+    /// Estimated per-call overhead in seconds, 0 until tuned.
+    double latency() const noexcept{
+        return m_latency;
+    }
+
+    /// Estimated throughput in bytes per second, 0 until tuned.
+    double throughput() const noexcept{
+        return m_throughput;
+    }
+
+private:
+    static UInt32 initialSize(const SetupMemXfer& setup) noexcept{
+        UInt32 size = setup.preferredSize();
+        if (size == 0 || size == dontCare){
+            size = setup.maxSize() != dontCare ? setup.maxSize() : setup.minSize();
+        }
+
+        return size == dontCare ? 0 : size;
+    }
+
+    UInt32 clamp(std::uint64_t size) const noexcept{
+        UInt32 min = m_setup.minSize() != dontCare ? m_setup.minSize() : 0;
+        UInt32 max = m_setup.maxSize() != dontCare && m_setup.maxSize() != 0 ? m_setup.maxSize() : dontCare - 1;
+        if (min > max){
+            min = max;
+        }
+
+        if (size > max){
+            size = max;
+        }
+
+        if (min != 0){
+            size -= size % min; // the minimum usually is a single row
+        }
+
+        if (size < min){
+            size = min;
+        }
+
+        return size ? static_cast<UInt32>(size) : m_base;
+    }
+
+    void choose() noexcept{
+        double n = m_count;
+        double varX = m_sumXX - m_sumX * m_sumX / n;
+        double covXY = m_sumXY - m_sumX * m_sumY / n;
+
+        // time = latency + bytes / throughput
+        double perByte = varX > 0 ? covXY / varX : 0;
+        double latency = (m_sumY - perByte * m_sumX) / n;
+        if (perByte <= 0){
+            // sizes did not differ (e.g. pages smaller than strips), or the time did not depend on them
+            perByte = m_sumX > 0 ? m_sumY / m_sumX : 0;
+            latency = 0;
+        }
+
+        if (latency < 0){
+            latency = 0;
+        }
+
+        m_latency = latency;
+        m_throughput = perByte > 0 ? 1 / perByte : 0;
+        if (perByte <= 0){
+            m_chosen = m_base;
+            return;
+        }
+
+        // overhead fraction: latency / (latency + size * perByte) <= overhead
+        // unmeasurable overhead gives no reason to leave the preferred size
+        double size = latency > 0 ? latency * (100 - m_overhead) / (m_overhead * perByte) : m_base;
+
+        double maxLatency = std::chrono::duration_cast<std::chrono::duration<double> >(m_maxLatency).count();
+        if (maxLatency > latency){
+            size = std::min(size, (maxLatency - latency) / perByte);
+        }
+
+        m_chosen = clamp(size > 0 ? static_cast<std::uint64_t>(std::min(size, 4294967295.0)) : 0);
+    }
+
+    UInt32 m_samples;
+    UInt32 m_overhead;
+    std::chrono::microseconds m_maxLatency;
+    SetupMemXfer m_setup;
+    UInt32 m_pinned;
+    UInt32 m_chosen;
+    UInt32 m_base;
+    UInt32 m_count;
+    double m_sumX;
+    double m_sumY;
+    double m_sumXX;
+    double m_sumXY;
+    double m_latency;
+    double m_throughput;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_MEMXFERTUNER_HPP
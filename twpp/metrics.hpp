@@ -0,0 +1,444 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_METRICS_HPP
+#define TWPP_DETAIL_FILE_METRICS_HPP
+
+#include "../twpp.hpp"
+
+// DSM call metrics are recorded only when TWPP_METRICS is defined before including twpp.hpp,
+// the calls are traced when TWPP_TRACE is defined, otherwise the probes compile to nothing.
+
+namespace Twpp {
+
+#if defined(TWPP_METRICS)
+
+/// Counters and latency histogram of a single (DataGroup, Dat, Msg) triplet.
+struct CallMetrics {
+
+    enum : UInt32 {
+        /// Number of histogram buckets.
+        /// Bucket `i` contains calls that took [2^i, 2^(i+1)) nanoseconds,
+        /// bucket 0 also contains calls shorter than 1 ns, the last bucket all longer calls.
+        Buckets = 40
+    };
+
+    /// Upper bound (exclusive) of a histogram bucket in nanoseconds.
+    static std::uint64_t bucketLimitNs(UInt32 bucket) noexcept{
+        return bucket + 1 < Buckets ? std::uint64_t(1) << (bucket + 1) : std::numeric_limits<std::uint64_t>::max();
+    }
+
+    /// Mean call latency in nanoseconds.
+    std::uint64_t meanNs() const noexcept{
+        return calls != 0 ? totalNs / calls : 0;
+    }
+
+    /// Upper bound of the latency of the requested fraction of calls in nanoseconds.
+    /// Resolution is limited to the histogram buckets.
+    /// \param fraction Fraction of calls, e.g. 0.99 for 99th percentile.
+    std::uint64_t percentileNs(double fraction) const noexcept{
+        if (calls == 0){
+            return 0;
+        }
+
+        auto target = fraction * static_cast<double>(calls);
+        auto wanted = static_cast<std::uint64_t>(target);
+        if (static_cast<double>(wanted) < target){
+            wanted++; // round up
+        }
+
+        std::uint64_t seen = 0;
+        for (UInt32 i = 0; i < Buckets; i++){
+            seen += histogram[i];
+            if (seen >= wanted && seen != 0){
+                return std::min(bucketLimitNs(i), maxNs);
+            }
+        }
+
+        return maxNs;
+    }
+
+    DataGroup dg;
+    Dat dat;
+    Msg msg;
+
+    /// Number of calls.
+    std::uint64_t calls;
+
+    /// Number of calls that returned `ReturnCode::Failure`.
+    std::uint64_t failures;
+
+    /// Sum of call latencies in nanoseconds.
+    std::uint64_t totalNs;
+
+    /// Longest call in nanoseconds.
+    std::uint64_t maxNs;
+
+    /// Transferred image data bytes,
+    /// `bytesWritten` of memory transfers and the image data of native transfers.
+    std::uint64_t bytes;
+
+    /// Latency histogram, see `Buckets`.
+    std::array<std::uint64_t, Buckets> histogram;
+
+};
+
+#endif
+
+namespace Detail {
+
+#if defined(TWPP_METRICS) || defined(TWPP_TRACE)
+
+/// Bytes of image data of a TIFF image, summed from its strip or tile byte counts.
+/// Every read is checked against the size, malformed or non-TIFF data is not counted.
+/// \param tiff TIFF image.
+/// \param size Number of readable bytes.
+static inline std::uint64_t tiffImageBytes(const unsigned char* tiff, std::uint64_t size) noexcept{
+    if (size < 8){
+        return 0;
+    }
+
+    bool little;
+    if (tiff[0] == 'I' && tiff[1] == 'I' && tiff[2] == 42 && tiff[3] == 0){
+        little = true;
+    } else if (tiff[0] == 'M' && tiff[1] == 'M' && tiff[2] == 0 && tiff[3] == 42){
+        little = false;
+    } else {
+        return 0;
+    }
+
+    // callers check that `off + 2` or `off + 4` does not exceed the size
+    auto get16 = [&](std::uint64_t off) -> UInt32 {
+        return little ? (tiff[off] | (tiff[off + 1] << 8)) : ((tiff[off] << 8) | tiff[off + 1]);
+    };
+
+    auto get32 = [&](std::uint64_t off) -> UInt32 {
+        return little ? (get16(off) | (get16(off + 2) << 16)) : ((get16(off) << 16) | get16(off + 2));
+    };
+
+    std::uint64_t ifd = get32(4);
+    if (ifd + 2 > size){
+        return 0;
+    }
+
+    UInt32 entries = get16(ifd);
+    if (ifd + 2 + entries * 12ull > size){
+        return 0;
+    }
+
+    std::uint64_t bytes = 0;
+    for (UInt32 i = 0; i < entries; i++){
+        std::uint64_t entry = ifd + 2 + i * 12ull;
+        UInt32 tag = get16(entry);
+        if (tag != 279 && tag != 325){ // StripByteCounts, TileByteCounts
+            continue;
+        }
+
+        UInt32 type = get16(entry + 2);
+        if (type != 3 && type != 4){ // Short or Long
+            return 0;
+        }
+
+        std::uint64_t count = get32(entry + 4);
+        std::uint64_t itemSize = type == 3 ? 2 : 4;
+        std::uint64_t values = count * itemSize <= 4 ? entry + 8 : get32(entry + 8);
+        if (values + count * itemSize > size){
+            return 0;
+        }
+
+        for (std::uint64_t j = 0; j < count; j++){
+            bytes += itemSize == 2 ? get16(values + j * 2) : get32(values + j * 4);
+        }
+    }
+
+    return bytes;
+}
+
+/// Bytes of image data in a native transfer handle.
+/// Windows handles report their size, Linux TIFF images are summed
+/// from their strip or tile byte counts, Mac OS pictures are not counted.
+/// Linux managers allocate handles with `calloc`, the readable size is that of the allocation.
+static inline std::uint64_t nativeImageBytes(Handle handle) noexcept{
+    if (!handle){
+        return 0;
+    }
+
+#if defined(TWPP_DETAIL_OS_WIN)
+    return ::GlobalSize(static_cast<HGLOBAL>(handle.raw()));
+#elif defined(TWPP_DETAIL_OS_LINUX)
+    Lock<const unsigned char> lock(handle);
+    const unsigned char* tiff = lock.data();
+    if (tiff == nullptr){
+        return 0;
+    }
+
+    return tiffImageBytes(tiff, ::malloc_usable_size(const_cast<unsigned char*>(tiff)));
+#elif defined(TWPP_DETAIL_OS_MAC)
+    return 0;
+#else
+#   error "nativeImageBytes for your platform here"
+#endif
+}
+
+/// Bytes of image data transferred by a successful call.
+static inline std::uint64_t xferBytes(Dat dat, ReturnCode rc, void* data) noexcept{
+    if (data == nullptr || (rc != ReturnCode::Success && rc != ReturnCode::XferDone)){
+        return 0;
+    }
+
+    switch (dat){
+        case Dat::ImageMemXfer:
+        case Dat::ImageMemFileXfer:
+            return static_cast<ImageMemXferImpl*>(data)->bytesWritten();
+
+        case Dat::ImageNativeXfer:
+            // ImageNativeXfer consists only of the handle
+            return rc == ReturnCode::XferDone ? nativeImageBytes(*alias_cast<Handle*>(data)) : 0;
+
+        default:
+            return 0;
+    }
+}
+
+#endif
+
+#if defined(TWPP_METRICS)
+
+/// Process-wide table of call metrics.
+/// Lock-free, slots are claimed by the first call of each triplet.
+template<typename Dummy>
+struct MetricsTable {
+
+    enum : UInt32 {
+        MaxTriplets = 256
+    };
+
+    struct Slot {
+        std::atomic<std::uint64_t> m_key;
+        std::atomic<std::uint64_t> m_calls;
+        std::atomic<std::uint64_t> m_failures;
+        std::atomic<std::uint64_t> m_totalNs;
+        std::atomic<std::uint64_t> m_maxNs;
+        std::atomic<std::uint64_t> m_bytes;
+        std::atomic<std::uint64_t> m_histogram[CallMetrics::Buckets];
+    };
+
+    static std::uint64_t key(DataGroup dg, Dat dat, Msg msg) noexcept{
+        // +1 keeps zero reserved for empty slots
+        return ((static_cast<std::uint64_t>(static_cast<UInt32>(dg)) << 32) |
+                (static_cast<std::uint64_t>(static_cast<UInt16>(dat)) << 16) |
+                static_cast<UInt16>(msg)) + 1;
+    }
+
+    static Slot* slot(std::uint64_t key) noexcept{
+        auto start = static_cast<UInt32>((key * 0x9E3779B97F4A7C15ULL) >> 56) % MaxTriplets;
+        for (UInt32 i = 0; i < MaxTriplets; i++){
+            Slot& s = g_slots[(start + i) % MaxTriplets];
+            auto current = s.m_key.load(std::memory_order_acquire);
+            if (current == 0){
+                std::uint64_t expected = 0;
+                if (s.m_key.compare_exchange_strong(expected, key, std::memory_order_acq_rel) || expected == key){
+                    return &s;
+                }
+            } else if (current == key){
+                return &s;
+            }
+        }
+
+        return nullptr;
+    }
+
+    static void record(DataGroup dg, Dat dat, Msg msg, ReturnCode rc, std::uint64_t ns, std::uint64_t bytes) noexcept{
+        Slot* s = slot(key(dg, dat, msg));
+        if (s == nullptr){
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        UInt32 bucket = 0;
+        for (auto v = ns >> 1; v != 0 && bucket + 1 < CallMetrics::Buckets; v >>= 1){
+            bucket++;
+        }
+
+        s->m_calls.fetch_add(1, std::memory_order_relaxed);
+        if (rc == ReturnCode::Failure){
+            s->m_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        s->m_totalNs.fetch_add(ns, std::memory_order_relaxed);
+        s->m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        s->m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+        auto max = s->m_maxNs.load(std::memory_order_relaxed);
+        while (ns > max && !s->m_maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)){
+            // max reloaded by compare_exchange_weak
+        }
+    }
+
+    static Slot g_slots[MaxTriplets];
+    static std::atomic<std::uint64_t> g_dropped;
+
+};
+
+template<typename Dummy>
+typename MetricsTable<Dummy>::Slot MetricsTable<Dummy>::g_slots[MetricsTable<Dummy>::MaxTriplets];
+
+template<typename Dummy>
+std::atomic<std::uint64_t> MetricsTable<Dummy>::g_dropped{0};
+
+#endif
+
+#if defined(TWPP_METRICS) || defined(TWPP_TRACE)
+
+/// Measures a single DSM call.
+class CallProbe {
+
+public:
+    CallProbe(DataGroup dg, Dat dat, Msg msg, void* data) noexcept :
+        m_dg(dg), m_dat(dat), m_msg(msg), m_data(data), m_start(std::chrono::steady_clock::now()){}
+
+    /// Records the call.
+    /// \param rc Return code of the call.
+    /// \return `rc`
+    ReturnCode done(ReturnCode rc) const noexcept{
+        auto end = std::chrono::steady_clock::now();
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+        auto duration = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+        auto bytes = xferBytes(m_dat, rc, m_data);
+
+#if defined(TWPP_METRICS)
+        MetricsTable<void>::record(m_dg, m_dat, m_msg, rc, duration, bytes);
+#endif
+#if defined(TWPP_TRACE)
+        auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(m_start.time_since_epoch()).count();
+        traceCall(static_cast<std::uint64_t>(start), duration, m_dg, m_dat, m_msg, rc, bytes);
+#endif
+
+        return rc;
+    }
+
+private:
+    DataGroup m_dg;
+    Dat m_dat;
+    Msg m_msg;
+    void* m_data;
+    std::chrono::steady_clock::time_point m_start;
+
+};
+
+#else
+
+/// Measures a single DSM call.
+/// Metrics and tracing are disabled, does nothing.
+class CallProbe {
+
+public:
+    constexpr CallProbe(DataGroup, Dat, Msg, void*) noexcept{}
+
+    constexpr ReturnCode done(ReturnCode rc) const noexcept{
+        return rc;
+    }
+
+};
+
+#endif
+
+}
+
+#if defined(TWPP_METRICS)
+
+/// Metrics of DSM calls made by this process,
+/// application calls in `Manager` and `Source`, or calls of `SourceFromThis::entry` in sources.
+/// Available only when TWPP_METRICS is defined.
+class Metrics {
+
+public:
+    /// Copies current metrics of all called triplets.
+    /// Calls made concurrently may be partially included.
+    /// \tparam Container Container of `CallMetrics`, e.g. `std::list<CallMetrics>`.
+    /// \param out Container the metrics are appended to.
+    /// \throw std::bad_alloc
+    template<typename Container>
+    static void snapshot(Container& out){
+        typedef Detail::MetricsTable<void> Table;
+        for (UInt32 i = 0; i < Table::MaxTriplets; i++){
+            auto& s = Table::g_slots[i];
+            auto key = s.m_key.load(std::memory_order_acquire);
+            if (key == 0){
+                continue;
+            }
+
+            key--;
+
+            CallMetrics m;
+            m.dg = static_cast<DataGroup>(static_cast<UInt32>(key >> 32));
+            m.dat = static_cast<Dat>(static_cast<UInt16>(key >> 16));
+            m.msg = static_cast<Msg>(static_cast<UInt16>(key));
+            m.calls = s.m_calls.load(std::memory_order_relaxed);
+            m.failures = s.m_failures.load(std::memory_order_relaxed);
+            m.totalNs = s.m_totalNs.load(std::memory_order_relaxed);
+            m.maxNs = s.m_maxNs.load(std::memory_order_relaxed);
+            m.bytes = s.m_bytes.load(std::memory_order_relaxed);
+            for (UInt32 b = 0; b < CallMetrics::Buckets; b++){
+                m.histogram[b] = s.m_histogram[b].load(std::memory_order_relaxed);
+            }
+
+            out.push_back(m);
+        }
+    }
+
+    /// Clears all counters.
+    /// Calls made concurrently may be partially counted.
+    static void reset() noexcept{
+        typedef Detail::MetricsTable<void> Table;
+        for (UInt32 i = 0; i < Table::MaxTriplets; i++){
+            auto& s = Table::g_slots[i];
+            s.m_calls.store(0, std::memory_order_relaxed);
+            s.m_failures.store(0, std::memory_order_relaxed);
+            s.m_totalNs.store(0, std::memory_order_relaxed);
+            s.m_maxNs.store(0, std::memory_order_relaxed);
+            s.m_bytes.store(0, std::memory_order_relaxed);
+            for (UInt32 b = 0; b < CallMetrics::Buckets; b++){
+                s.m_histogram[b].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        Table::g_dropped.store(0, std::memory_order_relaxed);
+    }
+
+    /// Number of calls that were not recorded, more distinct triplets were called
+    /// than `Detail::MetricsTable::MaxTriplets`.
+    static std::uint64_t dropped() noexcept{
+        return Detail::MetricsTable<void>::g_dropped.load(std::memory_order_relaxed);
+    }
+
+};
+
+#endif
+
+}
+
+#endif // TWPP_DETAIL_FILE_METRICS_HPP
@@ -0,0 +1,483 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_PAGEANALYZER_HPP
+#define TWPP_DETAIL_FILE_PAGEANALYZER_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Number of set bits in a buffer.
+static inline std::uint64_t popCount(const UInt8* data, UInt32 bytes) noexcept{
+    std::uint64_t count = 0;
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    for ( ; i + 16 <= bytes; i += 16){
+        uint8x16_t bits = vcntq_u8(vld1q_u8(data + i));
+        uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(bits)));
+        count += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+    }
+#elif defined(TWPP_DETAIL_SIMD_SSSE3)
+    // nibble lookup, summed by SAD
+    const __m128i lut = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 16 <= bytes; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, low));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+        __m128i sums = _mm_sad_epu8(_mm_add_epi8(lo, hi), zero);
+        count += static_cast<std::uint64_t>(_mm_cvtsi128_si32(sums)) +
+                static_cast<std::uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+    }
+#endif
+
+    for ( ; i + 8 <= bytes; i += 8){
+        std::uint64_t v;
+        std::memcpy(&v, data + i, 8);
+        v = v - ((v >> 1) & 0x5555555555555555ull);
+        v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        count += (v * 0x0101010101010101ull) >> 56;
+    }
+
+    for ( ; i < bytes; i++){
+        UInt8 b = data[i];
+        b = static_cast<UInt8>(b - ((b >> 1) & 0x55));
+        b = static_cast<UInt8>((b & 0x33) + ((b >> 2) & 0x33));
+        count += (b + (b >> 4)) & 0x0F;
+    }
+
+    return count;
+}
+
+/// Number of samples below the threshold, and the sum of all samples.
+static inline UInt32 countBelow(const UInt8* data, UInt32 count, UInt8 threshold, std::uint64_t& sum) noexcept{
+    UInt32 below = 0;
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    const uint8x16_t one = vdupq_n_u8(1);
+    for ( ; i + 16 <= count; i += 16){
+        uint8x16_t v = vld1q_u8(data + i);
+        uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(v)));
+        uint64x2_t b = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vandq_u8(vcltq_u8(v, t), one))));
+        sum += vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1);
+        below += static_cast<UInt32>(vgetq_lane_u64(b, 0) + vgetq_lane_u64(b, 1));
+    }
+#elif defined(TWPP_DETAIL_SIMD_SSE2)
+    if (threshold != 0){
+        // v < t  <=>  min(v, t - 1) == v
+        const __m128i t = _mm_set1_epi8(static_cast<char>(threshold - 1));
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i zero = _mm_setzero_si128();
+        for ( ; i + 16 <= count; i += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, t), v), one);
+            __m128i s = _mm_sad_epu8(v, zero);
+            __m128i b = _mm_sad_epu8(m, zero);
+            sum += static_cast<std::uint64_t>(_mm_cvtsi128_si32(s)) +
+                    static_cast<std::uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+            below += static_cast<UInt32>(_mm_cvtsi128_si32(b) + _mm_cvtsi128_si32(_mm_srli_si128(b, 8)));
+        }
+    }
+#endif
+
+    for ( ; i < count; i++){
+        sum += data[i];
+        below += data[i] < threshold ? 1 : 0;
+    }
+
+    return below;
+}
+
+/// Index of the first sample below the threshold, `count` if there is none.
+static inline UInt32 firstBelow(const UInt8* data, UInt32 count, UInt8 threshold) noexcept{
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_SSE2) && !defined(TWPP_DETAIL_SIMD_NEON)
+    if (threshold != 0){
+        const __m128i t = _mm_set1_epi8(static_cast<char>(threshold - 1));
+        for ( ; i + 16 <= count; i += 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, t), v)) != 0){
+                break; // found within these 16, located below
+            }
+        }
+    }
+#endif
+
+    for ( ; i < count; i++){
+        if (data[i] < threshold){
+            return i;
+        }
+    }
+
+    return count;
+}
+
+/// Index of the last sample below the threshold, `count` if there is none.
+static inline UInt32 lastBelow(const UInt8* data, UInt32 count, UInt8 threshold) noexcept{
+    UInt32 i = count;
+
+#if defined(TWPP_DETAIL_SIMD_SSE2) && !defined(TWPP_DETAIL_SIMD_NEON)
+    if (threshold != 0){
+        const __m128i t = _mm_set1_epi8(static_cast<char>(threshold - 1));
+        for ( ; i >= 16; i -= 16){
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i - 16));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, t), v)) != 0){
+                break;
+            }
+        }
+    }
+#endif
+
+    while (i > 0){
+        i--;
+        if (data[i] < threshold){
+            return i;
+        }
+    }
+
+    return count;
+}
+
+}
+
+/// Content found on a page, in pixels, right and bottom are exclusive.
+struct PageBounds {
+    UInt32 left;
+    UInt32 top;
+    UInt32 right;
+    UInt32 bottom;
+};
+
+/// Streaming analyser of scanned pages, for CapType::IAutoDiscardBlankPages
+/// and CapType::IAutomaticBorderDetection.
+/// Rows are analysed as they are produced, e.g. in the transfer path or on the device thread,
+/// collecting ink coverage, brightness and content bounds without buffering the page:
+///
+///     PageAnalyzer analyzer;
+///     analyzer.begin(info);
+///     while (readRows(page, rows)){
+///         analyzer.analyze(page.rowsData(), page.bytesPerRow(), rows);
+///     }
+///
+///     if (!analyzer.discard(m_discardBlankPages, page.bytes())){
+///         ring.push(std::move(page)); // blank pages are never counted in PendingXfers
+///     }
+///
+/// Supports uncompressed chunky 1-bit, 8-bit gray and 24-bit RGB images with PixelFlavor::Chocolate.
+/// Ink are pixels darker than the threshold, 1-bit black pixels, and RGB pixels with any channel darker.
+/// Not thread-safe.
+class PageAnalyzer {
+
+public:
+    /// Creates analyser.
+    /// \param inkThreshold Gray level below which pixels are ink.
+    /// \param margin Number of pixels at each edge excluded from the analysis,
+    ///               e.g. scanner background or shadows around the page.
+    /// \param noise Minimal number of ink pixels in a row to count it as content for the bounds.
+    /// \param histogram Whether to collect a histogram of gray levels.
+    explicit PageAnalyzer(UInt8 inkThreshold = 128, UInt32 margin = 0, UInt32 noise = 2, bool histogram = false) noexcept :
+        m_threshold(inkThreshold), m_margin(margin), m_noise(std::max<UInt32>(noise, 1)), m_collectHistogram(histogram),
+        m_width(0), m_height(0), m_bits(0), m_row(0), m_pixels(0), m_ink(0), m_sum(0), m_histogram(), m_bounds(){}
+
+    /// Starts a new page.
+    /// \param info Image information, the height may be unknown (-1),
+    ///             the bottom margin is not excluded in that case.
+    /// \return Whether the layout is supported.
+    /// \throw std::bad_alloc
+    bool begin(const ImageInfo& info){
+        m_bits = 0;
+        bool ok = !info.planar() && info.width() > 0 && info.compression() == Compression::None && (
+                    (info.pixelType() == PixelType::BlackWhite && info.bitsPerPixel() == 1) ||
+                    (info.pixelType() == PixelType::Gray && info.bitsPerPixel() == 8) ||
+                    (info.pixelType() == PixelType::Rgb && info.bitsPerPixel() == 24));
+
+        if (!ok){
+            return false;
+        }
+
+        m_width = static_cast<UInt32>(info.width());
+        m_height = info.height() > 0 ? static_cast<UInt32>(info.height()) : 0;
+        m_bits = static_cast<UInt32>(info.bitsPerPixel());
+        m_xres = info.xResolution();
+        m_yres = info.yResolution();
+        m_row = 0;
+        m_pixels = 0;
+        m_ink = 0;
+        m_sum = 0;
+        m_histogram.fill(0);
+        m_bounds = PageBounds{m_width, 0, 0, 0};
+        m_gray.reset(m_bits == 24 ? new UInt8[m_width] : nullptr);
+        return true;
+    }
+
+    /// Analyses consecutive rows.
+    /// \param data Packed rows.
+    /// \param bytesPerRow Number of bytes of each row.
+    /// \param rows Number of rows.
+    void analyze(const void* data, UInt32 bytesPerRow, UInt32 rows) noexcept{
+        if (m_bits == 0){
+            return;
+        }
+
+        auto in = static_cast<const UInt8*>(data);
+        UInt32 x0 = std::min(m_margin, m_width);
+        UInt32 x1 = m_width > m_margin ? std::max(m_width - m_margin, x0) : x0;
+        for (UInt32 i = 0; i < rows; i++, m_row++){
+            bool inside = m_row >= m_margin && (m_height == 0 || m_row + m_margin < m_height);
+            if (!inside || x0 == x1){
+                continue;
+            }
+
+            const UInt8* row = in + static_cast<std::size_t>(bytesPerRow) * i;
+            UInt32 ink;
+            UInt32 first;
+            UInt32 last;
+            if (m_bits == 1){
+                ink = analyzeBits(row, x0, x1, first, last);
+            } else {
+                const UInt8* gray = row;
+                if (m_bits == 24){
+                    toDarkest(row);
+                    gray = m_gray.get();
+                }
+
+                ink = analyzeGray(gray + x0, x1 - x0, first, last);
+                first += x0;
+                last += x0;
+            }
+
+            m_pixels += x1 - x0;
+            m_ink += ink;
+            if (ink >= m_noise){
+                if (m_bounds.right == 0){
+                    m_bounds.top = m_row;
+                }
+
+                m_bounds.left = std::min(m_bounds.left, first);
+                m_bounds.right = std::max(m_bounds.right, last + 1);
+                m_bounds.bottom = m_row + 1;
+            }
+        }
+    }
+
+    /// Analyses an uncompressed strip.
+    /// \param strip Memory transfer strip of the whole width.
+    /// \return Whether the strip was analysed, compressed strips and tiles are not.
+    bool analyze(const ImageMemXfer& strip) noexcept{
+        if (strip.compression() != Compression::None || strip.xOffset() != 0 ||
+                strip.columns() != m_width || strip.yOffset() != m_row){
+            return false;
+        }
+
+        auto lock = strip.memory().data();
+        analyze(lock.data(), strip.bytesPerRow(), strip.rows());
+        return true;
+    }
+
+    /// Number of analysed pixels, margins excluded.
+    std::uint64_t pixels() const noexcept{
+        return m_pixels;
+    }
+
+    /// Number of ink pixels.
+    std::uint64_t inkPixels() const noexcept{
+        return m_ink;
+    }
+
+    /// Fraction of ink pixels, 0 to 1.
+    double coverage() const noexcept{
+        return m_pixels != 0 ? static_cast<double>(m_ink) / m_pixels : 0;
+    }
+
+    /// Mean gray level of analysed pixels; of the darkest channel of RGB pixels.
+    double mean() const noexcept{
+        return m_pixels != 0 ? static_cast<double>(m_sum) / m_pixels : 0;
+    }
+
+    /// Histogram of gray levels, empty unless enabled.
+    const std::array<std::uint64_t, 256>& histogram() const noexcept{
+        return m_histogram;
+    }
+
+    /// Whether any content was found.
+    bool hasContent() const noexcept{
+        return m_bounds.right != 0;
+    }
+
+    /// Bounds of the content in pixels, valid if there is content.
+    PageBounds contentBounds() const noexcept{
+        return m_bounds;
+    }
+
+    /// Bounds of the content in inches, valid if there is content and the resolution is known.
+    Frame contentFrame() const noexcept{
+        return Frame(inches(m_bounds.left, m_xres), inches(m_bounds.top, m_yres),
+                     inches(m_bounds.right, m_xres), inches(m_bounds.bottom, m_yres));
+    }
+
+    /// Whether the page is blank.
+    /// \param maxCoverage Maximal fraction of ink pixels of a blank page.
+    bool isBlank(double maxCoverage = 0.002) const noexcept{
+        return m_bits != 0 && coverage() <= maxCoverage;
+    }
+
+    /// Whether to discard the page according to CapType::IAutoDiscardBlankPages.
+    /// \param mode Capability value.
+    /// \param imageBytes Size of the transferred image in bytes, compared with byte thresholds.
+    /// \param maxCoverage Maximal fraction of ink pixels of a blank page, for DiscardBlankPages::Auto.
+    bool discard(DiscardBlankPages mode, std::uint64_t imageBytes, double maxCoverage = 0.002) const noexcept{
+        switch (mode){
+            case DiscardBlankPages::Disabled:
+                return false;
+
+            case DiscardBlankPages::Auto:
+                return isBlank(maxCoverage);
+
+            default:
+                auto threshold = static_cast<Int32>(mode);
+                return threshold >= 0 && imageBytes < static_cast<std::uint64_t>(threshold);
+        }
+    }
+
+private:
+    UInt32 analyzeBits(const UInt8* row, UInt32 x0, UInt32 x1, UInt32& first, UInt32& last) noexcept{
+        // 1-bit MSB first, zero is black
+        UInt32 b0 = (x0 + 7) / 8;
+        UInt32 b1 = x1 / 8;
+        UInt32 ones = 0;
+        if (b0 < b1){
+            ones += static_cast<UInt32>(Detail::popCount(row + b0, b1 - b0));
+            for (UInt32 x = x0; x < b0 * 8; x++){
+                ones += bit(row, x);
+            }
+
+            for (UInt32 x = b1 * 8; x < x1; x++){
+                ones += bit(row, x);
+            }
+        } else {
+            for (UInt32 x = x0; x < x1; x++){
+                ones += bit(row, x);
+            }
+        }
+
+        UInt32 ink = (x1 - x0) - ones;
+        m_sum += static_cast<std::uint64_t>(ones) * 255;
+        if (m_collectHistogram){
+            m_histogram[0] += ink;
+            m_histogram[255] += ones;
+        }
+
+        first = x1;
+        last = x1;
+        if (ink >= m_noise){
+            first = x0;
+            while (first < x1 && bit(row, first)){
+                first += (first & 7) == 0 && first + 8 <= x1 && row[first >> 3] == 0xFF ? 8 : 1;
+            }
+
+            last = x1 - 1;
+            while (last > first && bit(row, last)){
+                last--;
+            }
+        }
+
+        return ink;
+    }
+
+    UInt32 analyzeGray(const UInt8* gray, UInt32 count, UInt32& first, UInt32& last) noexcept{
+        std::uint64_t sum = 0;
+        UInt32 ink = Detail::countBelow(gray, count, m_threshold, sum);
+        m_sum += sum;
+        if (m_collectHistogram){
+            for (UInt32 i = 0; i < count; i++){
+                m_histogram[gray[i]]++;
+            }
+        }
+
+        first = count;
+        last = count;
+        if (ink >= m_noise){
+            first = Detail::firstBelow(gray, count, m_threshold);
+            last = Detail::lastBelow(gray, count, m_threshold);
+        }
+
+        return ink;
+    }
+
+    void toDarkest(const UInt8* row) noexcept{
+        auto out = m_gray.get();
+        for (UInt32 x = 0; x < m_width; x++){
+            auto p = row + x * 3;
+            out[x] = std::min(p[0], std::min(p[1], p[2]));
+        }
+    }
+
+    static UInt32 bit(const UInt8* row, UInt32 x) noexcept{
+        return (row[x >> 3] >> (7 - (x & 7))) & 1;
+    }
+
+    static Fix32 inches(UInt32 pixels, Fix32 res) noexcept{
+        auto dpi = res.raw();
+        if (dpi <= 0){
+            return Fix32();
+        }
+
+        return Fix32::fromRaw(static_cast<Int32>(std::min<std::uint64_t>(
+                    (static_cast<std::uint64_t>(pixels) << 32) / static_cast<std::uint64_t>(dpi), 0x7FFFFFFF)));
+    }
+
+    UInt8 m_threshold;
+    UInt32 m_margin;
+    UInt32 m_noise;
+    bool m_collectHistogram;
+    UInt32 m_width;
+    UInt32 m_height;
+    UInt32 m_bits;
+    Fix32 m_xres;
+    Fix32 m_yres;
+    UInt32 m_row;
+    std::uint64_t m_pixels;
+    std::uint64_t m_ink;
+    std::uint64_t m_sum;
+    std::array<std::uint64_t, 256> m_histogram;
+    PageBounds m_bounds;
+    std::unique_ptr<UInt8[]> m_gray;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_PAGEANALYZER_HPP
@@ -59,6 +59,7 @@ struct FixedArrayData<Element8, arraySize, IndexList<i...> > {
 
 TWPP_DETAIL_PACK_BEGIN
 /// Palette information for memory transfers
+/// See `PaletteExpansion` for fast expansion of indexed pixels.
 class Palette8 {
 
 public:
@@ -0,0 +1,400 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_PASSTHROUGHCHANNEL_HPP
+#define TWPP_DETAIL_FILE_PASSTHROUGHCHANNEL_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Bulk payloads over Msg::PassThrough, e.g. firmware updates or diagnostics dumps.
+/// Payloads are split into chunks, one TWAIN call each, and the device command of every
+/// chunk is built by a callback:
+///
+///     UInt32 command(std::uint64_t offset, UInt32 length, char* out, UInt32 capacity); // returns command size
+///
+/// Payloads in memory are sent without copying, chunks point into the payload.
+/// Streamed payloads use a pool of buffers allocated once per channel: a worker thread
+/// reads the next chunks, or consumes received ones, while the calling thread keeps
+/// the device busy with TWAIN calls. At most `buffers` chunks are in flight.
+///
+///     PassThroughChannel channel(source);
+///     auto rc = channel.write(firmwareCommand, [&file](std::uint64_t offset, char* out, UInt32 length){
+///         return file.read(out, length).good();
+///     }, firmwareSize);
+///
+/// All TWAIN calls are made on the calling thread, only the callbacks run on the worker.
+class PassThroughChannel {
+
+public:
+    enum : UInt32 {
+        /// Default chunk size, 1 MiB.
+        DefaultChunkSize = 1024 * 1024,
+
+        /// Default number of pooled buffers.
+        DefaultBuffers = 3,
+
+        /// Default capacity of the command buffer.
+        DefaultCommandCapacity = 256
+    };
+
+    /// Creates a channel, buffers are allocated on first streamed transfer.
+    /// \param source Open source, must outlive the channel.
+    /// \param chunkSize Maximal payload bytes per TWAIN call.
+    /// \param buffers Number of pooled buffers, at least 2.
+    /// \param commandCapacity Maximal size of a device command.
+    explicit PassThroughChannel(Source& source, UInt32 chunkSize = DefaultChunkSize,
+                                UInt32 buffers = DefaultBuffers, UInt32 commandCapacity = DefaultCommandCapacity) noexcept :
+        m_source(&source), m_chunkSize(std::max<UInt32>(chunkSize, 1)), m_buffers(std::max<UInt32>(buffers, 2)),
+        m_cmdCapacity(commandCapacity), m_chunks(0), m_bytes(0),
+        m_produced(0), m_consumed(0), m_done(false), m_stop(false), m_rc(ReturnCode::Success){}
+
+    PassThroughChannel(const PassThroughChannel&) = delete;
+    PassThroughChannel& operator=(const PassThroughChannel&) = delete;
+
+    /// Sends a payload from memory, Direction::Set, without copying it.
+    /// \param command Command callback, see class description.
+    /// \param data Payload.
+    /// \param size Size of the payload in bytes.
+    /// \return Success, or the first failing return code.
+    /// \throw std::bad_alloc
+    /// \throw Anything thrown by the command callback.
+    template<typename CommandFn>
+    ReturnCode write(CommandFn command, const void* data, std::uint64_t size){
+        reset();
+        auto in = static_cast<const char*>(data);
+        for (std::uint64_t off = 0; off < size;){
+            auto len = chunkLength(off, size);
+            auto rc = call(command, off, PassThrough::Direction::Set, const_cast<char*>(in + off), len);
+            if (!success(rc)){
+                return rc;
+            }
+
+            off += len;
+        }
+
+        return ReturnCode::Success;
+    }
+
+    /// Sends a streamed payload, Direction::Set.
+    /// Chunks are read on a worker thread while previous chunks are being sent.
+    /// \param command Command callback, see class description.
+    /// \param reader Reads a chunk on the worker thread, `bool(std::uint64_t offset, char* out, UInt32 length)`,
+    ///             returns false to abort with Failure.
+    /// \param size Size of the payload in bytes.
+    /// \return Success, or the first failing return code.
+    /// \throw std::bad_alloc
+    /// \throw std::system_error
+    /// \throw Anything thrown by the callbacks.
+    template<typename CommandFn, typename ReadFn, typename = typename std::enable_if<!std::is_pointer<ReadFn>::value>::type>
+    ReturnCode write(CommandFn command, ReadFn reader, std::uint64_t size){
+        reset();
+        allocate();
+
+        auto chunks = chunkCount(size);
+        std::thread worker([&](){
+            work([&](){
+                for (std::uint64_t k = 0; k < chunks; k++){
+                    auto slot = acquire(k);
+                    if (slot < 0){
+                        return;
+                    }
+
+                    auto& s = m_slots[slot];
+                    s.m_offset = k * m_chunkSize;
+                    s.m_length = chunkLength(s.m_offset, size);
+                    if (!reader(s.m_offset, s.m_data.get(), s.m_length)){
+                        stop(ReturnCode::Failure);
+                        return;
+                    }
+
+                    produced();
+                }
+            });
+        });
+
+        ReturnCode rc = ReturnCode::Success;
+        try {
+            for (std::uint64_t k = 0; k < chunks && success(rc); k++){
+                auto slot = next(k);
+                if (slot < 0){
+                    break;
+                }
+
+                auto& s = m_slots[slot];
+                rc = call(command, s.m_offset, PassThrough::Direction::Set, s.m_data.get(), s.m_length);
+                consumed();
+            }
+        } catch (...){
+            stop(ReturnCode::Failure);
+            worker.join();
+            throw;
+        }
+
+        return finish(worker, rc);
+    }
+
+    /// Receives a payload, Direction::Get.
+    /// Received chunks are consumed on a worker thread while the next ones are being received.
+    /// The transfer ends at `size` bytes, or at the first chunk the source fills only partially.
+    /// \param command Command callback, see class description.
+    /// \param size Maximal size of the payload in bytes.
+    /// \param consumer Consumes a chunk on the worker thread, `bool(std::uint64_t offset, const char* data, UInt32 length)`,
+    ///                returns false to abort with Cancel.
+    /// \return Success, or the first failing return code.
+    /// \throw std::bad_alloc
+    /// \throw std::system_error
+    /// \throw Anything thrown by the callbacks.
+    template<typename CommandFn, typename ConsumeFn>
+    ReturnCode read(CommandFn command, std::uint64_t size, ConsumeFn consumer){
+        reset();
+        allocate();
+
+        std::thread worker([&](){
+            work([&](){
+                for (std::uint64_t k = 0;; k++){
+                    auto slot = next(k);
+                    if (slot < 0){
+                        return;
+                    }
+
+                    const auto& s = m_slots[slot];
+                    if (s.m_length != 0 && !consumer(s.m_offset, s.m_data.get(), s.m_length)){
+                        stop(ReturnCode::Cancel);
+                        return;
+                    }
+
+                    consumed();
+                }
+            });
+        });
+
+        ReturnCode rc = ReturnCode::Success;
+        try {
+            for (std::uint64_t k = 0, off = 0; off < size; k++){
+                auto slot = acquire(k);
+                if (slot < 0){
+                    break;
+                }
+
+                auto& s = m_slots[slot];
+                auto len = chunkLength(off, size);
+                s.m_offset = off;
+                rc = call(command, off, PassThrough::Direction::Get, s.m_data.get(), len, &s.m_length);
+                if (!success(rc)){
+                    break;
+                }
+
+                produced();
+                off += s.m_length;
+                if (s.m_length < len){
+                    break;
+                }
+            }
+        } catch (...){
+            stop(ReturnCode::Failure);
+            worker.join();
+            throw;
+        }
+
+        finishProducing();
+        return finish(worker, rc);
+    }
+
+    /// Number of TWAIN calls of the last transfer.
+    std::uint64_t chunks() const noexcept{
+        return m_chunks;
+    }
+
+    /// Number of payload bytes transferred by the last transfer.
+    std::uint64_t bytes() const noexcept{
+        return m_bytes;
+    }
+
+    /// Maximal payload bytes per TWAIN call.
+    UInt32 chunkSize() const noexcept{
+        return m_chunkSize;
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<char[]> m_data;
+        std::uint64_t m_offset;
+        UInt32 m_length;
+    };
+
+    UInt32 chunkLength(std::uint64_t offset, std::uint64_t size) const noexcept{
+        return static_cast<UInt32>(std::min<std::uint64_t>(m_chunkSize, size - offset));
+    }
+
+    std::uint64_t chunkCount(std::uint64_t size) const noexcept{
+        return (size + m_chunkSize - 1) / m_chunkSize;
+    }
+
+    void allocate(){
+        if (!m_slots){
+            std::unique_ptr<Slot[]> slots(new Slot[m_buffers]);
+            for (UInt32 i = 0; i < m_buffers; i++){
+                slots[i].m_data.reset(new char[m_chunkSize]);
+            }
+
+            m_slots = std::move(slots);
+        }
+    }
+
+    void reset() noexcept{
+        m_chunks = 0;
+        m_bytes = 0;
+        m_produced = 0;
+        m_consumed = 0;
+        m_done = false;
+        m_stop = false;
+        m_rc = ReturnCode::Success;
+        m_error = std::exception_ptr();
+    }
+
+    template<typename CommandFn>
+    ReturnCode call(CommandFn& command, std::uint64_t offset, PassThrough::Direction dir,
+                    char* data, UInt32 length, UInt32* xfered = nullptr){
+        if (!m_cmd){
+            m_cmd.reset(new char[std::max<UInt32>(m_cmdCapacity, 1)]);
+        }
+
+        UInt32 cmdSize = command(offset, length, m_cmd.get(), m_cmdCapacity);
+        PassThrough pt(m_cmd.get(), std::min(cmdSize, m_cmdCapacity), dir, data, length, 0);
+        auto rc = m_source->passThrough(pt);
+        if (success(rc)){
+            auto done = dir == PassThrough::Direction::Get ? std::min(pt.dataXfered(), length) : length;
+            if (xfered){
+                *xfered = done;
+            }
+
+            m_chunks++;
+            m_bytes += done;
+        }
+
+        return rc;
+    }
+
+    // slot for producing chunk k, -1 when stopped
+    int acquire(std::uint64_t k){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this, k](){
+            return m_stop || k - m_consumed < m_buffers;
+        });
+
+        return m_stop ? -1 : static_cast<int>(k % m_buffers);
+    }
+
+    // slot of produced chunk k, -1 when stopped or no more chunks are produced
+    int next(std::uint64_t k){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this, k](){
+            return m_stop || m_done || k < m_produced;
+        });
+
+        return m_stop || k >= m_produced ? -1 : static_cast<int>(k % m_buffers);
+    }
+
+    void produced(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_produced++;
+        m_cond.notify_all();
+    }
+
+    void consumed(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_consumed++;
+        m_cond.notify_all();
+    }
+
+    void finishProducing(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+        m_cond.notify_all();
+    }
+
+    void stop(ReturnCode rc){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_stop){
+            m_stop = true;
+            m_rc = rc;
+        }
+
+        m_cond.notify_all();
+    }
+
+    template<typename Fn>
+    void work(Fn fn) noexcept{
+        try {
+            fn();
+        } catch (...){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = std::current_exception();
+            m_stop = true;
+            m_rc = ReturnCode::Failure;
+            m_cond.notify_all();
+        }
+    }
+
+    ReturnCode finish(std::thread& worker, ReturnCode rc){
+        if (!success(rc)){
+            stop(rc);
+        }
+
+        worker.join();
+        if (m_error){
+            std::rethrow_exception(m_error);
+        }
+
+        return success(rc) && m_stop ? m_rc : rc;
+    }
+
+    Source* m_source;
+    UInt32 m_chunkSize;
+    UInt32 m_buffers;
+    UInt32 m_cmdCapacity;
+    std::unique_ptr<Slot[]> m_slots;
+    std::unique_ptr<char[]> m_cmd;
+    std::uint64_t m_chunks;
+    std::uint64_t m_bytes;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::uint64_t m_produced;
+    std::uint64_t m_consumed;
+    bool m_done;
+    bool m_stop;
+    ReturnCode m_rc;
+    std::exception_ptr m_error;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_PASSTHROUGHCHANNEL_HPP
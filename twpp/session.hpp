@@ -0,0 +1,514 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_SESSION_HPP
+#define TWPP_DETAIL_FILE_SESSION_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Outcome of a single scan job.
+class ScanJobResult {
+
+public:
+    /// Creates a result.
+    /// \param rc {XferDone when all pages were transferred, Cancel when cancelled,
+    ///            otherwise the failing return code.}
+    /// \param pages Number of transferred pages.
+    constexpr ScanJobResult(ReturnCode rc = ReturnCode::Failure, UInt32 pages = 0) noexcept :
+        m_rc(rc), m_pages(pages){}
+
+    /// Return code of the job.
+    /// XferDone when all requested pages were transferred.
+    constexpr ReturnCode returnCode() const noexcept{
+        return m_rc;
+    }
+
+    /// Number of transferred pages.
+    constexpr UInt32 pages() const noexcept{
+        return m_pages;
+    }
+
+    /// Whether at least one page was transferred and no error occured.
+    constexpr operator bool() const noexcept{
+        return m_rc == ReturnCode::XferDone && m_pages != 0;
+    }
+
+private:
+    ReturnCode m_rc;
+    UInt32 m_pages;
+
+};
+
+/// Description of a scan job processed by `ScanSession`.
+/// A job opens the source, negotiates capabilities, enables the source,
+/// transfers pages using native transfer mechanism, and finally disables
+/// and closes the source.
+/// Jobs with an audio consumer stream audio chunks instead, see `setAudio`.
+class ScanJob {
+
+public:
+    /// Called on the session thread after the source has been opened.
+    /// Use it to negotiate capabilities, e.g. with `Source::negotiate`.
+    typedef std::function<void(Source& source)> NegotiateCallBack;
+
+    /// Called on a worker thread for every transferred page.
+    /// The page may be moved out of the parameter.
+    typedef std::function<void(ImageNativeXfer& page, UInt32 index)> PageCallBack;
+
+    /// Called on a worker thread for every transferred audio chunk, in order with a single worker.
+    /// The chunk may be moved out of the parameter.
+    typedef std::function<void(AudioNativeXfer& chunk, UInt32 index)> AudioCallBack;
+
+    /// Creates a job scanning all pages from the default source, without GUI.
+    /// \param onPage Page consumer.
+    explicit ScanJob(PageCallBack onPage) :
+        m_onPage(std::move(onPage)), m_ui(false, false, Handle()), m_pageLimit(0){}
+
+    /// Selects the source by its product name and manufacturer.
+    /// Empty product name selects the default source.
+    ScanJob& setSource(const Str32& productName, const Str32& manufacturer){
+        m_productName = productName;
+        m_manufacturer = manufacturer;
+        return *this;
+    }
+
+    /// Sets capability negotiation callback.
+    ScanJob& setNegotiation(NegotiateCallBack negotiate){
+        m_negotiate = std::move(negotiate);
+        return *this;
+    }
+
+    /// Sets GUI settings used to enable the source.
+    ScanJob& setUserInterface(const UserInterface& ui) noexcept{
+        m_ui = ui;
+        return *this;
+    }
+
+    /// Streams audio instead of images.
+    /// DataGroup::Audio is set as the transfer group once the source is ready,
+    /// and chunks are transferred until the source reports no more of them,
+    /// continuous capture ends when the source stops it, or with the page limit.
+    /// \param onAudio Chunk consumer, empty transfers images.
+    ScanJob& setAudio(AudioCallBack onAudio){
+        m_onAudio = std::move(onAudio);
+        return *this;
+    }
+
+    /// Sets the maximal number of pages to transfer, zero transfers all pages.
+    /// Applies to audio chunks of audio jobs.
+    /// Remaining pending transfers are reset once the limit is reached.
+    ScanJob& setPageLimit(UInt32 pages) noexcept{
+        m_pageLimit = pages;
+        return *this;
+    }
+
+    /// Product name of the source, empty for the default source.
+    const Str32& productName() const noexcept{
+        return m_productName;
+    }
+
+    /// Manufacturer of the source.
+    const Str32& manufacturer() const noexcept{
+        return m_manufacturer;
+    }
+
+    /// Capability negotiation callback, might be empty.
+    const NegotiateCallBack& negotiation() const noexcept{
+        return m_negotiate;
+    }
+
+    /// Page consumer.
+    const PageCallBack& pageCallBack() const noexcept{
+        return m_onPage;
+    }
+
+    /// Audio chunk consumer, empty for image jobs.
+    const AudioCallBack& audioCallBack() const noexcept{
+        return m_onAudio;
+    }
+
+    /// GUI settings used to enable the source.
+    const UserInterface& userInterface() const noexcept{
+        return m_ui;
+    }
+
+    /// Maximal number of pages, zero means all pages.
+    UInt32 pageLimit() const noexcept{
+        return m_pageLimit;
+    }
+
+private:
+    PageCallBack m_onPage;
+    AudioCallBack m_onAudio;
+    NegotiateCallBack m_negotiate;
+    Str32 m_productName;
+    Str32 m_manufacturer;
+    UserInterface m_ui;
+    UInt32 m_pageLimit;
+
+};
+
+namespace Detail {
+
+/// Shared completion state of a submitted job.
+/// The job is complete once the session thread and all page callbacks are done.
+struct ScanJobState {
+    ScanJobState() :
+        m_outstanding(1){}
+
+    void acquire(){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_outstanding++;
+    }
+
+    void fail(std::exception_ptr error){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_error){
+            m_error = error;
+        }
+    }
+
+    void release(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (--m_outstanding != 0){
+            return;
+        }
+
+        lock.unlock();
+        if (m_error){
+            m_promise.set_exception(m_error);
+        } else {
+            m_promise.set_value(m_result);
+        }
+    }
+
+    std::mutex m_mutex;
+    std::promise<ScanJobResult> m_promise;
+    std::exception_ptr m_error;
+    ScanJobResult m_result;
+    UInt32 m_outstanding;
+};
+
+struct QueuedScanJob {
+    std::shared_ptr<ScanJob> m_job;
+    std::shared_ptr<ScanJobState> m_state;
+};
+
+/// Hands a transferred page over to a worker thread.
+static inline void deliverXfer(WorkerPool& workers, QueuedScanJob& queued, ImageNativeXfer img, UInt32 index){
+    auto page = std::make_shared<ImageNativeXfer>(std::move(img));
+    auto job = queued.m_job;
+    auto state = queued.m_state;
+
+    state->acquire();
+    workers.post([job, state, page, index]{
+        try {
+            job->pageCallBack()(*page, index);
+        } catch (...){
+            state->fail(std::current_exception());
+        }
+
+        state->release();
+    });
+}
+
+/// Hands a transferred audio chunk over to a worker thread.
+static inline void deliverXfer(WorkerPool& workers, QueuedScanJob& queued, AudioNativeXfer chunk, UInt32 index){
+    auto data = std::make_shared<AudioNativeXfer>(std::move(chunk));
+    auto job = queued.m_job;
+    auto state = queued.m_state;
+
+    state->acquire();
+    workers.post([job, state, data, index]{
+        try {
+            job->audioCallBack()(*data, index);
+        } catch (...){
+            state->fail(std::current_exception());
+        }
+
+        state->release();
+    });
+}
+
+}
+
+/// Asynchronous scanning session.
+/// The session owns a dedicated thread that loads and opens the manager,
+/// and performs every TWAIN call, as required on Windows where DSM windows
+/// and their message loop are bound to the thread that created them.
+/// Jobs are queued from any thread and processed one at a time in FIFO order,
+/// pages are handed over to a pool of worker threads so that processing
+/// of one page overlaps transfer of the next one.
+/// Jobs are serialised even if they target different sources,
+/// use `DevicePool` to scan with several sources concurrently.
+///
+/// As with `Manager`, at most one session (or valid manager) may exist at all times.
+/// All pages must be released before the session is destroyed,
+/// their memory belongs to the manager.
+/// On Mac OS the manager processes GUI events on the main thread only,
+/// use sources without GUI there.
+class ScanSession {
+
+public:
+    /// Creates a session and starts its threads.
+    /// \param appIdentity Application identity.
+    /// \param workers Number of page worker threads, zero runs page callbacks on the session thread.
+    /// \param preferOld Passed to `Manager::load`.
+    /// \throw std::system_error
+    explicit ScanSession(const Identity& appIdentity, UInt32 workers = 1, bool preferOld = false) :
+        m_appId(appIdentity), m_preferOld(preferOld), m_workers(workers),
+        m_stop(false), m_dsmRc(ReturnCode::Failure), m_dsmReady(false){
+
+        m_thread = std::thread(&ScanSession::run, this);
+    }
+
+    /// Waits for all queued jobs to finish, then closes the manager.
+    ~ScanSession(){
+        stop();
+    }
+
+    ScanSession(const ScanSession&) = delete;
+    ScanSession& operator=(const ScanSession&) = delete;
+
+    /// Queues a job.
+    /// Jobs submitted after `stop` complete immediately with Failure.
+    /// \return Future holding the job result, or an exception thrown
+    ///         by the negotiation or page callbacks.
+    /// \throw std::bad_alloc
+    std::future<ScanJobResult> submit(ScanJob job){
+        Detail::QueuedScanJob queued;
+        queued.m_job = std::make_shared<ScanJob>(std::move(job));
+        queued.m_state = std::make_shared<Detail::ScanJobState>();
+        auto future = queued.m_state->m_promise.get_future();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stop){
+            lock.unlock();
+            queued.m_state->release();
+            return future;
+        }
+
+        m_jobs.push_back(std::move(queued));
+        lock.unlock();
+
+        m_cond.notify_one();
+        return future;
+    }
+
+    /// Completes all jobs that have not been started yet with Cancel.
+    /// \return Number of cancelled jobs.
+    std::size_t cancelPending(){
+        std::list<Detail::QueuedScanJob> jobs;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            jobs.swap(m_jobs);
+        }
+
+        for (auto& queued : jobs){
+            queued.m_state->m_result = ScanJobResult(ReturnCode::Cancel);
+            queued.m_state->release();
+        }
+
+        return jobs.size();
+    }
+
+    /// Number of jobs that have not been started yet.
+    std::size_t pending() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    /// Blocks until the manager has been opened on the session thread.
+    /// \return Result of `Manager::open`, Failure if the manager could not be loaded.
+    ReturnCode waitManager() const{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_dsmReady; });
+        return m_dsmRc;
+    }
+
+    /// Stops accepting jobs, finishes the queued ones and joins the session thread.
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_cond.notify_all();
+        if (m_thread.joinable()){
+            m_thread.join();
+        }
+    }
+
+private:
+    void run(){
+        Manager mgr(m_appId);
+        auto rc = ReturnCode::Failure;
+        if (mgr.load(m_preferOld)){
+            rc = mgr.open();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_dsmRc = rc;
+            m_dsmReady = true;
+        }
+
+        m_cond.notify_all();
+
+        for (;;){
+            Detail::QueuedScanJob queued;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+                if (m_jobs.empty()){
+                    break; // stopped and drained
+                }
+
+                queued = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            if (success(rc)){
+                try {
+                    queued.m_state->m_result = runJob(mgr, queued);
+                } catch (...){
+                    queued.m_state->fail(std::current_exception());
+                }
+            }
+
+            queued.m_state->release();
+        }
+
+        // pages are freed by the manager memory functions
+        m_workers.stop();
+    }
+
+    ScanJobResult runJob(Manager& mgr, Detail::QueuedScanJob& queued){
+        const ScanJob& job = *queued.m_job;
+
+        Source src;
+        if (job.productName().length() == 0){
+            auto rc = mgr.defaultSource(src);
+            if (!success(rc)){
+                return ScanJobResult(rc);
+            }
+        } else {
+            src = mgr.createSource(job.productName(), job.manufacturer());
+        }
+
+        auto rc = src.open();
+        if (!success(rc)){
+            return ScanJobResult(rc);
+        }
+
+        if (job.negotiation()){
+            job.negotiation()(src);
+        }
+
+        rc = src.enable(job.userInterface());
+        if (!success(rc) && rc != ReturnCode::CheckStatus){
+            return ScanJobResult(rc);
+        }
+
+        do {
+            rc = src.waitReady();
+        } while (rc == ReturnCode::CheckStatus);
+
+        if (rc != ReturnCode::Success || src.state() != DsState::XferReady){
+            return ScanJobResult(rc == ReturnCode::Success ? ReturnCode::Failure : rc);
+        }
+
+        if (job.audioCallBack()){
+            DataGroup group = DataGroup::Audio;
+            rc = src.xferGroup(Msg::Set, group);
+            if (!success(rc)){
+                return ScanJobResult(rc);
+            }
+        }
+
+        UInt32 pages = 0;
+        PendingXfers pending;
+        do {
+            if (job.audioCallBack()){
+                AudioNativeXfer chunk;
+                rc = src.audioNativeXfer(chunk);
+                if (rc != ReturnCode::XferDone){
+                    break;
+                }
+
+                deliver(queued, std::move(chunk), pages++);
+            } else {
+                ImageNativeXfer img;
+                rc = src.imageNativeXfer(img);
+                if (rc != ReturnCode::XferDone){
+                    break; // source cleanup ends or resets the transfers
+                }
+
+                deliver(queued, std::move(img), pages++);
+            }
+
+            if (!success(src.pendingXfers(Msg::EndXfer, pending))){
+                rc = ReturnCode::Failure;
+                break;
+            }
+
+            if (job.pageLimit() != 0 && pages >= job.pageLimit() && pending.count() != 0){
+                src.pendingXfers(Msg::Reset, pending);
+                break;
+            }
+        } while (pending.count() != 0);
+
+        return ScanJobResult(rc, pages);
+    }
+
+    void deliver(Detail::QueuedScanJob& queued, ImageNativeXfer img, UInt32 index){
+        Detail::deliverXfer(m_workers, queued, std::move(img), index);
+    }
+
+    void deliver(Detail::QueuedScanJob& queued, AudioNativeXfer chunk, UInt32 index){
+        Detail::deliverXfer(m_workers, queued, std::move(chunk), index);
+    }
+
+    Identity m_appId;
+    bool m_preferOld;
+    Detail::WorkerPool m_workers;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cond;
+    std::list<Detail::QueuedScanJob> m_jobs;
+    bool m_stop;
+    ReturnCode m_dsmRc;
+    bool m_dsmReady;
+
+    std::thread m_thread;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_SESSION_HPP
@@ -33,6 +33,113 @@ namespace Twpp {
 
 namespace Detail {
 
+// 64-bit FNV-1a
+static inline std::uint64_t strHash(const char* data, std::size_t size, std::uint64_t seed = 14695981039346656037ull) noexcept{
+    for (std::size_t i = 0; i < size; i++){
+        seed ^= static_cast<unsigned char>(data[i]);
+        seed *= 1099511628211ull;
+    }
+
+    return seed;
+}
+
+}
+
+/// Non-owning view of TWAIN string characters.
+/// The length is computed once, when the view is created.
+/// Never null-terminated on Mac OS.
+class StrView {
+
+public:
+    typedef const char* const_iterator;
+
+    /// Creates an empty view.
+    constexpr StrView() noexcept :
+        m_data(""), m_size(0){}
+
+    /// Creates a view of `size` characters.
+    constexpr StrView(const char* data, UInt32 size) noexcept :
+        m_data(data), m_size(size){}
+
+    /// Pointer to the first character.
+    constexpr const char* data() const noexcept{
+        return m_data;
+    }
+
+    /// Number of characters.
+    constexpr UInt32 size() const noexcept{
+        return m_size;
+    }
+
+    /// Alias to size().
+    constexpr UInt32 length() const noexcept{
+        return m_size;
+    }
+
+    constexpr bool empty() const noexcept{
+        return m_size == 0;
+    }
+
+    constexpr char operator[](UInt32 i) const noexcept{
+        return m_data[i];
+    }
+
+    constexpr const_iterator begin() const noexcept{
+        return m_data;
+    }
+
+    constexpr const_iterator cbegin() const noexcept{
+        return m_data;
+    }
+
+    constexpr const_iterator end() const noexcept{
+        return m_data + m_size;
+    }
+
+    constexpr const_iterator cend() const noexcept{
+        return m_data + m_size;
+    }
+
+    /// Three-way comparison of the characters, like std::string::compare.
+    int compare(StrView o) const noexcept{
+        auto common = std::min(m_size, o.m_size);
+        auto rc = common != 0 ? std::memcmp(m_data, o.m_data, common) : 0;
+        if (rc != 0){
+            return rc;
+        }
+
+        return m_size < o.m_size ? -1 : (m_size > o.m_size ? 1 : 0);
+    }
+
+    /// Hash of the characters.
+    std::size_t hash() const noexcept{
+        return static_cast<std::size_t>(Detail::strHash(m_data, m_size));
+    }
+
+    std::string string() const{
+        return std::string(m_data, m_size);
+    }
+
+private:
+    const char* m_data;
+    UInt32 m_size;
+
+};
+
+static inline bool operator==(StrView a, StrView b) noexcept{
+    return a.size() == b.size() && (a.size() == 0 || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+static inline bool operator!=(StrView a, StrView b) noexcept{
+    return !(a == b);
+}
+
+static inline bool operator<(StrView a, StrView b) noexcept{
+    return a.compare(b) < 0;
+}
+
+namespace Detail {
+
 // specialization for twain strings
 // on mac os, these strings do not contain null terminator
 // instead, the first byte contains the length
@@ -249,6 +356,19 @@ public:
         return std::string(cbegin(), cend());
     }
 
+    /// Allocation-free view of the characters.
+    /// The length is bounded by the capacity, even for strings without terminator.
+    StrView view() const noexcept{
+#if defined(TWPP_DETAIL_OS_MAC)
+        return StrView(data(), std::min(length(), maxSize()));
+#elif defined(TWPP_DETAIL_OS_WIN) || defined(TWPP_DETAIL_OS_LINUX)
+        auto end = static_cast<const char*>(std::memchr(data(), '\0', maxSize()));
+        return StrView(data(), end ? static_cast<UInt32>(end - data()) : maxSize());
+#else
+#   error "String::view for your platform here"
+#endif
+    }
+
 };
 
 }
@@ -306,5 +426,16 @@ typedef Detail::Str<256> Str255;
 }
 
 
+namespace std {
+
+template<>
+struct hash<Twpp::StrView> {
+    std::size_t operator()(Twpp::StrView str) const noexcept{
+        return str.hash();
+    }
+};
+
+}
+
 #endif // TWPP_DETAIL_FILE_STRINGS_HPP
 
@@ -0,0 +1,332 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_STRIPDECODER_HPP
+#define TWPP_DETAIL_FILE_STRIPDECODER_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+/// Pipeline stage decoding compressed memory transfer strips on worker threads,
+/// delivering the decoded strips to a consumer in transfer order.
+///
+/// The actual decoding is done by the supplied decoder, that is called concurrently
+/// for independent strips. TWPP only contains the `packBits` decoder, JPEG and
+/// CCITT Group 3/4 strips are not decoded by TWPP, their decoders must come from a codec library.
+/// Uncompressed strips are passed through without decoding.
+///
+///     StripDecoder decoder(jpegDecode, consume);
+///     decoder.setJpegTables(std::move(tables)); // from Source::jpegCompression
+///     ReturnCode rc;
+///     do {
+///         ImageMemXfer strip(...);
+///         rc = src.imageMemXfer(strip);
+///         if (success(rc)){
+///             decoder.push(std::move(strip));
+///         }
+///     } while (rc == ReturnCode::Success);
+///
+///     decoder.finish();
+class StripDecoder {
+
+public:
+    /// Decodes a compressed strip, called from worker threads.
+    /// \param compressed The compressed strip.
+    /// \param tables JPEG tables, null if none were set.
+    /// \param decoded Decoded strip, the decoder sets its values and memory.
+    /// \return Whether the strip was decoded.
+    typedef std::function<bool(const ImageMemXfer& compressed, const JpegCompression* tables, ImageMemXfer& decoded)> Decoder;
+
+    /// Receives decoded strips in transfer order, one at a time, from worker threads.
+    /// \param strip Decoded strip.
+    /// \param index Index of the strip in the transfer, starting from zero.
+    typedef std::function<void(ImageMemXfer& strip, UInt32 index)> Consumer;
+
+    enum : UInt32 {
+        DefaultMaxInFlight = 16
+    };
+
+    /// Creates decoder stage.
+    /// \param decoder Strip decoder.
+    /// \param consumer Consumer of decoded strips.
+    /// \param threads Number of worker threads, zero uses hardware concurrency.
+    /// \param maxInFlight Maximal number of pushed strips not yet consumed, `push` blocks above it.
+    /// \throw std::system_error
+    StripDecoder(Decoder decoder, Consumer consumer, UInt32 threads = 0, UInt32 maxInFlight = DefaultMaxInFlight) :
+        m_decoder(std::move(decoder)), m_consumer(std::move(consumer)), m_hasTables(false),
+        m_maxInFlight(std::max<UInt32>(maxInFlight, 1)), m_pushed(0), m_next(0), m_inFlight(0),
+        m_delivering(false), m_failed(0){
+
+        // strips in flight never span more than `m_maxInFlight` consecutive indexes
+        m_ready.reset(new StripPtr[m_maxInFlight]);
+        m_isReady.reset(new bool[m_maxInFlight]());
+
+        if (threads == 0){
+            threads = std::max<UInt32>(std::thread::hardware_concurrency(), 1);
+        }
+
+        m_pool.start(threads);
+    }
+
+    /// Waits for all pushed strips.
+    ~StripDecoder(){
+        m_pool.stop();
+    }
+
+    StripDecoder(const StripDecoder&) = delete;
+    StripDecoder& operator=(const StripDecoder&) = delete;
+
+    /// Sets JPEG tables passed to the decoder.
+    /// Must not be called while strips are being decoded.
+    void setJpegTables(JpegCompression tables){
+        m_tables = std::move(tables);
+        m_hasTables = true;
+    }
+
+    /// Queues a strip, blocks while too many strips are in flight.
+    /// \param strip Transferred strip, the ownership of its memory is taken over.
+    /// \throw std::bad_alloc
+    void push(ImageMemXfer strip){
+        std::shared_ptr<ImageMemXfer> queued(new ImageMemXfer(std::move(strip)));
+
+        UInt32 index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]{ return m_inFlight < m_maxInFlight; });
+            index = m_pushed++;
+            m_inFlight++;
+        }
+
+        try {
+            m_pool.post([this, queued, index]{
+                decode(*queued, index);
+            });
+        } catch (...){
+            done(index, nullptr);
+            throw;
+        }
+    }
+
+    /// Waits until all pushed strips have been consumed.
+    /// \return Whether all strips were decoded since the last call.
+    bool finish(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_inFlight == 0; });
+
+        bool ok = m_failed == 0;
+        m_failed = 0;
+        m_pushed = 0;
+        m_next = 0;
+        return ok;
+    }
+
+    /// Number of strips the decoder failed to decode since the last `finish`.
+    UInt32 failed() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_failed;
+    }
+
+    /// PackBits decoder of strips of the chunky image described by `info`, see `Decoder`.
+    ///
+    ///     StripDecoder decoder(StripDecoder::packBits(info), consume);
+    ///
+    /// \param info Image layout, only the number of bits per pixel is used.
+    static Decoder packBits(const ImageInfo& info){
+        auto bitsPerPixel = static_cast<UInt32>(info.bitsPerPixel());
+        return [bitsPerPixel](const ImageMemXfer& compressed, const JpegCompression*, ImageMemXfer& decoded){
+            return packBits(compressed, bitsPerPixel, decoded);
+        };
+    }
+
+    /// Decodes a PackBits strip.
+    /// Like TIFF PackBits, every row is encoded on its own, to its unpadded width
+    /// of `columns * bitsPerPixel` bits. Decoded rows are stored `bytesPerRow` apart,
+    /// the decoded strip keeps the layout of the compressed one, and row padding is zeroed.
+    /// \param compressed The compressed strip.
+    /// \param bitsPerPixel Number of bits per pixel of the image.
+    /// \param decoded Decoded strip.
+    /// \return Whether the strip was PackBits compressed and decoded without errors.
+    /// \throw std::bad_alloc
+    static bool packBits(const ImageMemXfer& compressed, UInt32 bitsPerPixel, ImageMemXfer& decoded){
+        if (compressed.compression() != Compression::PackBits){
+            return false;
+        }
+
+        auto bytesPerRow = compressed.bytesPerRow();
+        auto rowBytes = (static_cast<std::uint64_t>(compressed.columns()) * bitsPerPixel + 7) / 8;
+        auto size = static_cast<std::uint64_t>(bytesPerRow) * compressed.rows();
+        if (rowBytes == 0 || rowBytes > bytesPerRow || size > std::numeric_limits<UInt32>::max()){
+            return false;
+        }
+
+        Memory memory(static_cast<UInt32>(size));
+        {
+            auto inLock = compressed.memory().data();
+            auto outLock = memory.data();
+            auto in = reinterpret_cast<const UInt8*>(inLock.data());
+            auto out = reinterpret_cast<UInt8*>(outLock.data());
+            auto inSize = std::min(compressed.bytesWritten(), compressed.memory().size());
+
+            UInt32 i = 0;
+            for (UInt32 row = 0; row < compressed.rows(); row++, out += bytesPerRow){
+                if (!packBitsRow(in, inSize, i, out, static_cast<UInt32>(rowBytes))){
+                    return false;
+                }
+
+                std::memset(out + rowBytes, 0, bytesPerRow - rowBytes);
+            }
+        }
+
+        decoded = ImageMemXfer(Compression::None, bytesPerRow, compressed.columns(), compressed.rows(),
+                               compressed.xOffset(), compressed.yOffset(), static_cast<UInt32>(size), std::move(memory));
+        return true;
+    }
+
+private:
+    typedef std::shared_ptr<ImageMemXfer> StripPtr;
+
+    // decodes a single row of exactly `outSize` bytes, runs may not cross rows
+    static bool packBitsRow(const UInt8* in, UInt32 inSize, UInt32& i, UInt8* out, UInt32 outSize) noexcept{
+        UInt32 o = 0;
+        while (o < outSize){
+            if (i == inSize){
+                return false;
+            }
+
+            auto n = static_cast<Int8>(in[i++]);
+            if (n >= 0){
+                UInt32 count = static_cast<UInt32>(n) + 1;
+                if (count > inSize - i || count > outSize - o){
+                    return false;
+                }
+
+                std::memcpy(out + o, in + i, count);
+                i += count;
+                o += count;
+            } else if (n != -128){
+                UInt32 count = 1 - static_cast<Int32>(n);
+                if (i == inSize || count > outSize - o){
+                    return false;
+                }
+
+                std::memset(out + o, in[i++], count);
+                o += count;
+            }
+        }
+
+        return true;
+    }
+
+    void decode(ImageMemXfer& strip, UInt32 index) noexcept{
+        StripPtr out;
+        try {
+            if (strip.compression() == Compression::None){
+                out.reset(new ImageMemXfer(std::move(strip)));
+            } else {
+                out.reset(new ImageMemXfer());
+                if (!m_decoder(strip, m_hasTables ? &m_tables : nullptr, *out)){
+                    out.reset();
+                }
+
+                strip.memory() = Memory(); // free compressed data as soon as possible
+            }
+        } catch (...){
+            out.reset();
+        }
+
+        done(index, std::move(out));
+    }
+
+    // stores the result and delivers all consecutive ready strips,
+    // only one thread delivers at a time to keep the order
+    void done(UInt32 index, StripPtr strip) noexcept{
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto slot = index % m_maxInFlight;
+        m_ready[slot] = std::move(strip);
+        m_isReady[slot] = true;
+        if (m_delivering){
+            return;
+        }
+
+        m_delivering = true;
+        for (;;){
+            auto nextSlot = m_next % m_maxInFlight;
+            if (!m_isReady[nextSlot]){
+                break;
+            }
+
+            StripPtr next = std::move(m_ready[nextSlot]);
+            m_isReady[nextSlot] = false;
+            auto nextIndex = m_next++;
+
+            lock.unlock();
+            bool ok = static_cast<bool>(next);
+            if (ok){
+                try {
+                    m_consumer(*next, nextIndex);
+                } catch (...){
+                    ok = false;
+                }
+            }
+
+            next.reset();
+            lock.lock();
+
+            if (!ok){
+                m_failed++;
+            }
+
+            m_inFlight--;
+            m_cond.notify_all();
+        }
+
+        m_delivering = false;
+    }
+
+    Decoder m_decoder;
+    Consumer m_consumer;
+    JpegCompression m_tables;
+    bool m_hasTables;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::unique_ptr<StripPtr[]> m_ready;
+    std::unique_ptr<bool[]> m_isReady;
+    UInt32 m_maxInFlight;
+    UInt32 m_pushed;
+    UInt32 m_next;
+    UInt32 m_inFlight;
+    bool m_delivering;
+    UInt32 m_failed;
+
+    Detail::WorkerPool m_pool;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_STRIPDECODER_HPP
@@ -0,0 +1,479 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#ifndef TWPP_DETAIL_FILE_THUMBNAIL_HPP
+#define TWPP_DETAIL_FILE_THUMBNAIL_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Adds 8-bit samples to 32-bit accumulators.
+static inline void accumulateRow(const UInt8* src, UInt32* acc, UInt32 count) noexcept{
+    UInt32 i = 0;
+
+#if defined(TWPP_DETAIL_SIMD_NEON)
+    for ( ; i + 16 <= count; i += 16){
+        uint8x16_t v = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8, vaddw_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+    }
+#else
+#   if defined(TWPP_DETAIL_SIMD_AVX2)
+    for ( ; i + 8 <= count; i += 8){
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), v));
+    }
+#   endif
+#   if defined(TWPP_DETAIL_SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 16 <= count; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#   endif
+#endif
+
+    for ( ; i < count; i++){
+        acc[i] += src[i];
+    }
+}
+
+static inline UInt32 dibRead32(const UInt8* p) noexcept{
+    return static_cast<UInt32>(p[0]) | (static_cast<UInt32>(p[1]) << 8) |
+            (static_cast<UInt32>(p[2]) << 16) | (static_cast<UInt32>(p[3]) << 24);
+}
+
+}
+
+/// Downsampled preview of an image, 8-bit gray or RGB with top-down rows.
+class Thumbnail {
+
+public:
+    /// Creates an empty thumbnail.
+    Thumbnail() noexcept :
+        m_width(0), m_height(0), m_channels(0){}
+
+    /// Whether there is no thumbnail.
+    bool empty() const noexcept{
+        return !m_data;
+    }
+
+    /// Width in pixels.
+    UInt32 width() const noexcept{
+        return m_width;
+    }
+
+    /// Height in pixels.
+    UInt32 height() const noexcept{
+        return m_height;
+    }
+
+    /// Number of channels, 1 (gray) or 3 (RGB).
+    UInt32 channels() const noexcept{
+        return m_channels;
+    }
+
+    /// Number of bytes of each row, rows are not padded.
+    UInt32 bytesPerRow() const noexcept{
+        return m_width * m_channels;
+    }
+
+    /// Pixel data, `height() * bytesPerRow()` bytes.
+    const UInt8* data() const noexcept{
+        return m_data.get();
+    }
+
+    /// Image information of the thumbnail, e.g. for thumbnail transfers
+    /// of data sources with CapType::ThumbnailsEnabled.
+    const ImageInfo& imageInfo() const noexcept{
+        return m_info;
+    }
+
+private:
+    friend class ThumbnailBuilder;
+
+    std::unique_ptr<UInt8[]> m_data;
+    ImageInfo m_info;
+    UInt32 m_width;
+    UInt32 m_height;
+    UInt32 m_channels;
+
+};
+
+/// Builds a thumbnail of an image incrementally, on a worker thread, as its strips arrive.
+/// The image is reduced by an integer box filter, rows are summed into accumulators
+/// as they arrive (vectorised), and each finished band of rows is reduced horizontally.
+/// Supports uncompressed chunky 1-bit, 8-bit gray and 24-bit RGB images,
+/// black and white images produce gray thumbnails.
+///
+///     ThumbnailBuilder thumbs(256, [](const Thumbnail& thumb){
+///         showPreview(thumb); // worker thread, once the last row arrived
+///     });
+///
+///     src.imageInfo(info);
+///     thumbs.begin(info);
+///     src.imageMemXferStream([&](const ImageMemXfer& strip){
+///         thumbs.push(strip);
+///         return process(strip);
+///     });
+///
+///     thumbs.finish();
+///
+/// Methods must be called from a single thread.
+class ThumbnailBuilder {
+
+public:
+    /// Called from the worker thread once the thumbnail is finished.
+    typedef std::function<void(const Thumbnail&)> ReadyCallBack;
+
+    /// Creates a thumbnail builder.
+    /// \param maxSize Maximal width and height of thumbnails.
+    /// \param ready Called once each thumbnail is finished, may be empty.
+    /// \param worker Whether to process strips on a worker thread, otherwise they are processed in `push`.
+    /// \throw std::system_error
+    explicit ThumbnailBuilder(UInt32 maxSize = 256, ReadyCallBack ready = ReadyCallBack(), bool worker = true) :
+        m_maxSize(std::max<UInt32>(maxSize, 1)), m_ready(std::move(ready)), m_width(0), m_height(0),
+        m_channels(0), m_factor(1), m_bits(0), m_zero(0x00), m_one(0xFF), m_order(BitOrder::MsbFirst),
+        m_bgr(false), m_nextRow(0), m_bandRows(0), m_done(false), m_failed(false){
+
+        if (worker){
+            m_pool.start(1); // single worker keeps strips in order
+        }
+    }
+
+    /// Waits for pushed strips.
+    ~ThumbnailBuilder(){
+        m_pool.stop();
+    }
+
+    ThumbnailBuilder(const ThumbnailBuilder&) = delete;
+    ThumbnailBuilder& operator=(const ThumbnailBuilder&) = delete;
+
+    /// Starts a new thumbnail, waits for the previous one.
+    /// \param info Image information of the transferred image, its size must be known.
+    /// \param order Bit order of 1-bit images, see CapType::IBitOrder.
+    /// \return Whether the image layout is supported.
+    /// \throw std::bad_alloc
+    bool begin(const ImageInfo& info, BitOrder order = BitOrder::MsbFirst){
+        wait();
+
+        UInt32 channels;
+        if (info.pixelType() == PixelType::BlackWhite && info.bitsPerPixel() == 1){
+            channels = 1;
+        } else if (info.pixelType() == PixelType::Gray && info.bitsPerPixel() == 8){
+            channels = 1;
+        } else if (info.pixelType() == PixelType::Rgb && info.bitsPerPixel() == 24 && !info.planar()){
+            channels = 3;
+        } else {
+            return false;
+        }
+
+        if (info.width() <= 0 || info.height() <= 0 || info.compression() != Compression::None){
+            return false;
+        }
+
+        start(static_cast<UInt32>(info.width()), static_cast<UInt32>(info.height()), channels,
+              static_cast<UInt32>(info.bitsPerPixel()), info.xResolution(), info.yResolution());
+
+        m_order = order;
+        m_zero = 0x00; // PixelFlavor::Chocolate
+        m_one = 0xFF;
+        m_bgr = false;
+        return true;
+    }
+
+    /// Queues a strip of uncompressed rows, the strip is copied.
+    /// \param strip Transferred strip.
+    /// \return Whether the strip was accepted, compressed strips and tiles are not.
+    /// \throw std::bad_alloc
+    bool push(const ImageMemXfer& strip){
+        if (!accepts(strip)){
+            return false;
+        }
+
+        auto bytes = static_cast<std::size_t>(strip.bytesPerRow()) * strip.rows();
+        std::shared_ptr<UInt8> copy(new UInt8[bytes], std::default_delete<UInt8[]>());
+        {
+            auto lock = strip.memory().data();
+            std::memcpy(copy.get(), lock.data(), bytes);
+        }
+
+        UInt32 bpr = strip.bytesPerRow();
+        UInt32 y = strip.yOffset();
+        UInt32 rows = strip.rows();
+        m_pool.post([this, copy, bpr, y, rows]{
+            processRows(copy.get(), bpr, y, rows);
+        });
+
+        return true;
+    }
+
+    /// Queues a strip of uncompressed rows, taking over its memory.
+    /// \param strip Transferred strip.
+    /// \return Whether the strip was accepted, compressed strips and tiles are not.
+    /// \throw std::bad_alloc
+    bool push(ImageMemXfer&& strip){
+        if (!accepts(strip)){
+            return false;
+        }
+
+        std::shared_ptr<ImageMemXfer> queued(new ImageMemXfer(std::move(strip)));
+        m_pool.post([this, queued]{
+            auto lock = queued->memory().data();
+            processRows(reinterpret_cast<const UInt8*>(lock.data()), queued->bytesPerRow(), queued->yOffset(), queued->rows());
+        });
+
+        return true;
+    }
+
+    /// Starts a new thumbnail of a DIB, e.g. a Windows native transfer.
+    /// Supports uncompressed 1-bit, 8-bit (gray palette) and 24-bit DIBs, bottom-up or top-down.
+    /// The DIB is read on the worker thread, it must stay valid until `finish` returns.
+    /// \param dib BITMAPINFOHEADER followed by the palette and pixels.
+    /// \param size Size of the DIB in bytes.
+    /// \return Whether the DIB is supported.
+    /// \throw std::bad_alloc
+    bool pushDib(const void* dib, UInt32 size){
+        wait();
+
+        auto in = static_cast<const UInt8*>(dib);
+        if (size < 40){
+            return false;
+        }
+
+        auto headerSize = Detail::dibRead32(in);
+        auto width = static_cast<Int32>(Detail::dibRead32(in + 4));
+        auto height = static_cast<Int32>(Detail::dibRead32(in + 8));
+        UInt32 bits = in[14] | (in[15] << 8);
+        auto compression = Detail::dibRead32(in + 16);
+        auto xppm = Detail::dibRead32(in + 24);
+        auto yppm = Detail::dibRead32(in + 28);
+        auto colorsUsed = Detail::dibRead32(in + 32);
+        if (headerSize < 40 || headerSize > size || width <= 0 || height == 0 || height == std::numeric_limits<Int32>::min() ||
+                compression != 0 || (bits != 1 && bits != 8 && bits != 24)){
+            return false;
+        }
+
+        UInt32 colors = bits <= 8 ? (colorsUsed ? colorsUsed : (1u << bits)) : 0;
+        auto rows = static_cast<UInt32>(height < 0 ? -height : height);
+        auto stride = ((static_cast<std::uint64_t>(width) * bits + 31) / 32) * 4;
+        auto offset = static_cast<std::uint64_t>(headerSize) + colors * 4;
+        if (offset + stride * rows > size){
+            return false;
+        }
+
+        auto res = [](UInt32 ppm){
+            return Fix32(static_cast<Int16>(std::min<UInt32>((ppm * 254 + 5000) / 10000, 0x7FFF)), 0);
+        };
+
+        start(static_cast<UInt32>(width), rows, bits == 24 ? 3 : 1, bits, res(xppm), res(yppm));
+        m_order = BitOrder::MsbFirst;
+        m_bgr = bits == 24;
+        if (bits == 1 && colors >= 2){
+            // the palette decides which bit is white
+            m_zero = in[headerSize + 1];
+            m_one = in[headerSize + 5];
+        }
+
+        auto first = in + offset;
+        auto step = static_cast<Int32>(stride);
+        if (height > 0){
+            // bottom-up
+            first += stride * (rows - 1);
+            step = -step;
+        }
+
+        m_pool.post([this, first, step, rows]{
+            for (UInt32 y = 0; y < rows; y++){
+                processRows(first + static_cast<std::ptrdiff_t>(step) * y, 0, y, 1);
+            }
+        });
+
+        return true;
+    }
+
+    /// Waits for all queued strips, and finishes the thumbnail.
+    /// \return Whether the thumbnail is complete.
+    bool finish(){
+        wait();
+        return m_done && !m_failed;
+    }
+
+    /// The last finished thumbnail, valid after `finish`.
+    const Thumbnail& thumbnail() const noexcept{
+        return m_thumb;
+    }
+
+private:
+    void wait(){
+        // a task posted last runs after all previous ones
+        std::promise<void> done;
+        auto future = done.get_future();
+        m_pool.post([&done]{
+            done.set_value();
+        });
+
+        future.wait();
+    }
+
+    bool accepts(const ImageMemXfer& strip) const noexcept{
+        return m_channels != 0 && strip.compression() == Compression::None &&
+                strip.xOffset() == 0 && strip.columns() == m_width &&
+                strip.bytesPerRow() >= (m_width * m_bits + 7) / 8 &&
+                strip.bytesWritten() >= strip.bytesPerRow() * strip.rows();
+    }
+
+    void start(UInt32 width, UInt32 height, UInt32 channels, UInt32 bits, Fix32 xres, Fix32 yres){
+        auto larger = std::max(width, height);
+        m_factor = (larger + m_maxSize - 1) / m_maxSize;
+        m_width = width;
+        m_height = height;
+        m_channels = channels;
+        m_bits = bits;
+        m_nextRow = 0;
+        m_bandRows = 0;
+        m_done = false;
+        m_failed = false;
+
+        m_acc.reset(new UInt32[static_cast<std::size_t>(width) * channels]());
+        m_unpacked.reset(bits == 1 ? new UInt8[width] : nullptr);
+
+        Thumbnail thumb;
+        thumb.m_width = (width + m_factor - 1) / m_factor;
+        thumb.m_height = (height + m_factor - 1) / m_factor;
+        thumb.m_channels = channels;
+        thumb.m_data.reset(new UInt8[static_cast<std::size_t>(thumb.m_width) * thumb.m_height * channels]);
+
+        const Int16 bps[8] = {8, static_cast<Int16>(channels == 3 ? 8 : 0), static_cast<Int16>(channels == 3 ? 8 : 0)};
+        thumb.m_info = ImageInfo(Fix32::fromRaw(xres.raw() / static_cast<Int32>(m_factor)),
+                                 Fix32::fromRaw(yres.raw() / static_cast<Int32>(m_factor)),
+                                 static_cast<Int32>(thumb.m_width), static_cast<Int32>(thumb.m_height),
+                                 static_cast<Int16>(channels), bps, static_cast<Int16>(channels * 8), false,
+                                 channels == 3 ? PixelType::Rgb : PixelType::Gray, Compression::None);
+
+        m_thumb = std::move(thumb);
+    }
+
+    // worker thread
+    void processRows(const UInt8* data, UInt32 bytesPerRow, UInt32 y, UInt32 rows) noexcept{
+        if (m_failed || m_done){
+            return;
+        }
+
+        if (y != m_nextRow){
+            m_failed = true; // strips must arrive in order
+            return;
+        }
+
+        auto samples = m_width * m_channels;
+        for (UInt32 i = 0; i < rows && m_nextRow < m_height; i++){
+            const UInt8* row = data + static_cast<std::size_t>(bytesPerRow) * i;
+            if (m_bits == 1){
+                unpackBits(row, m_unpacked.get(), m_width, m_order, m_zero, m_one);
+                row = m_unpacked.get();
+            }
+
+            Detail::accumulateRow(row, m_acc.get(), samples);
+            m_nextRow++;
+            if (++m_bandRows == m_factor || m_nextRow == m_height){
+                emitBand();
+            }
+        }
+
+        if (m_nextRow == m_height){
+            m_done = true;
+            if (m_ready){
+                try {
+                    m_ready(m_thumb);
+                } catch (...){
+                    // tasks must not throw
+                }
+            }
+        }
+    }
+
+    void emitBand() noexcept{
+        auto acc = m_acc.get();
+        auto out = m_thumb.m_data.get() + static_cast<std::size_t>((m_nextRow - 1) / m_factor) * m_thumb.bytesPerRow();
+        for (UInt32 ox = 0; ox < m_thumb.m_width; ox++){
+            auto x0 = ox * m_factor;
+            auto x1 = std::min(x0 + m_factor, m_width);
+            auto count = (x1 - x0) * m_bandRows;
+            for (UInt32 c = 0; c < m_channels; c++){
+                std::uint64_t sum = 0;
+                for (auto x = x0; x < x1; x++){
+                    sum += acc[x * m_channels + c];
+                }
+
+                auto dst = m_bgr ? m_channels - 1 - c : c;
+                out[ox * m_channels + dst] = static_cast<UInt8>((sum + count / 2) / count);
+            }
+        }
+
+        std::memset(acc, 0, static_cast<std::size_t>(m_width) * m_channels * sizeof(UInt32));
+        m_bandRows = 0;
+    }
+
+    Detail::WorkerPool m_pool;
+    UInt32 m_maxSize;
+    ReadyCallBack m_ready;
+    Thumbnail m_thumb;
+    std::unique_ptr<UInt32[]> m_acc;
+    std::unique_ptr<UInt8[]> m_unpacked;
+    UInt32 m_width;
+    UInt32 m_height;
+    UInt32 m_channels;
+    UInt32 m_factor;
+    UInt32 m_bits;
+    UInt8 m_zero;
+    UInt8 m_one;
+    BitOrder m_order;
+    bool m_bgr;
+    UInt32 m_nextRow;
+    UInt32 m_bandRows;
+    bool m_done;
+    bool m_failed;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_THUMBNAIL_HPP
@@ -0,0 +1,286 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_TIFF_HPP
+#define TWPP_DETAIL_FILE_TIFF_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Writer of baseline single-strip TIFF headers in native byte order.
+/// The header (IFD included) precedes the image data, whose offset is chosen by the caller.
+class TiffHeader {
+
+public:
+    enum : UInt16 {
+        Uncompressed = 1,
+        Group4 = 4 // white is zero
+    };
+
+    /// Creates a header of chunky image described by `info`.
+    /// \param info Image layout, the height may be unknown (-1).
+    /// \param compression TIFF compression of the image data, Uncompressed or Group4.
+    /// \param palette Palette of PixelType::Palette images, stored as ColorMap.
+    ///        Must outlive the header.
+    explicit TiffHeader(const ImageInfo& info, UInt16 compression = Uncompressed,
+                        const Palette8* palette = nullptr) noexcept :
+        m_info(info), m_compression(compression), m_palette(palette){}
+
+    /// Whether the layout can be stored as a baseline TIFF.
+    /// Palette images require a palette and 1, 2, 4 or 8 bits per pixel.
+    bool isValid() const noexcept{
+        auto spp = m_info.samplesPerPixel();
+        if (m_compression == Group4){
+            return spp == 1 && m_info.bitsPerPixel() == 1;
+        }
+
+        if (isPalette()){
+            auto bpp = m_info.bitsPerPixel();
+            return m_palette != nullptr && spp == 1 && !m_info.planar() &&
+                    (bpp == 1 || bpp == 2 || bpp == 4 || bpp == 8);
+        }
+
+        return m_compression == Uncompressed && spp > 0 && spp <= 8 && m_info.bitsPerPixel() > 0 && !m_info.planar();
+    }
+
+    /// Number of bytes of the header.
+    UInt32 size() const noexcept{
+        return 8 + 2 + tagCount() * 12 + 4 + extraSize();
+    }
+
+    /// Number of bytes of a single packed row.
+    UInt32 rowBytes(UInt32 columns) const noexcept{
+        return (columns * static_cast<UInt32>(m_info.bitsPerPixel()) + 7) / 8;
+    }
+
+    /// Writes the header.
+    /// \param out Buffer of at least `size()` bytes.
+    /// \param columns Image width.
+    /// \param rows Image height.
+    /// \param dataOffset Offset of the image data from the beginning of the file.
+    /// \param dataBytes Number of bytes of image data, `rows * rowBytes(columns)`.
+    void write(char* out, UInt32 columns, UInt32 rows, UInt32 dataOffset, UInt32 dataBytes) const noexcept{
+        UInt32 pos = 0;
+
+#if defined(TWPP_DETAIL_ENDIAN_LITTLE)
+        out[pos++] = 'I';
+        out[pos++] = 'I';
+#elif defined(TWPP_DETAIL_ENDIAN_BIG)
+        out[pos++] = 'M';
+        out[pos++] = 'M';
+#else
+#   error "TIFF byte order for your platform here"
+#endif
+        put16(out, pos, 42);
+        put32(out, pos, 8);
+
+        auto spp = static_cast<UInt16>(m_info.samplesPerPixel());
+        UInt32 extra = 8 + 2 + tagCount() * 12 + 4;
+        UInt32 bpsOffset = extra;
+        UInt32 xresOffset = bpsOffset + (spp > 2 ? spp * 2u : 0u);
+        UInt32 yresOffset = xresOffset + 8;
+        UInt32 mapOffset = yresOffset + 8;
+
+        put16(out, pos, static_cast<UInt16>(tagCount()));
+        tag(out, pos, 256, Long, 1, columns); // ImageWidth
+        tag(out, pos, 257, Long, 1, rows); // ImageLength
+        if (spp > 2){
+            tag(out, pos, 258, Short, spp, bpsOffset); // BitsPerSample
+        } else {
+            put16(out, pos, 258);
+            put16(out, pos, Short);
+            put32(out, pos, spp);
+            put16(out, pos, bitsPerSample(0));
+            put16(out, pos, spp > 1 ? bitsPerSample(1) : 0);
+        }
+
+        tag(out, pos, 259, Short, 1, m_compression); // Compression
+        tag(out, pos, 262, Short, 1, photometric()); // PhotometricInterpretation
+        tag(out, pos, 273, Long, 1, dataOffset); // StripOffsets
+        tag(out, pos, 277, Short, 1, spp); // SamplesPerPixel
+        tag(out, pos, 278, Long, 1, rows); // RowsPerStrip
+        tag(out, pos, 279, Long, 1, dataBytes); // StripByteCounts
+        tag(out, pos, 282, Rational, 1, xresOffset); // XResolution
+        tag(out, pos, 283, Rational, 1, yresOffset); // YResolution
+        tag(out, pos, 284, Short, 1, 1); // PlanarConfiguration: chunky
+        tag(out, pos, 296, Short, 1, 2); // ResolutionUnit: inch
+        if (isPalette()){
+            tag(out, pos, 320, Short, 3 * colorCount(), mapOffset); // ColorMap
+        }
+
+        if (hasAlpha()){
+            tag(out, pos, 338, Short, 1, 2); // ExtraSamples: unassociated alpha
+        }
+
+        put32(out, pos, 0); // no next IFD
+
+        if (spp > 2){
+            for (UInt16 i = 0; i < spp; i++){
+                put16(out, pos, bitsPerSample(i));
+            }
+        }
+
+        rational(out, pos, m_info.xResolution());
+        rational(out, pos, m_info.yResolution());
+        if (isPalette()){
+            colorMap(out, pos);
+        }
+    }
+
+private:
+    enum : UInt16 {
+        Short = 3,
+        Long = 4,
+        Rational = 5
+    };
+
+    bool hasAlpha() const noexcept{
+        return m_info.pixelType() == PixelType::Rgb && m_info.samplesPerPixel() == 4;
+    }
+
+    bool isPalette() const noexcept{
+        return m_compression == Uncompressed && m_info.pixelType() == PixelType::Palette;
+    }
+
+    // ColorMap entries per channel, 2 ^ bits per pixel
+    UInt32 colorCount() const noexcept{
+        auto bpp = m_info.bitsPerPixel();
+        return bpp > 0 && bpp <= 8 ? 1u << bpp : 0u;
+    }
+
+    UInt32 tagCount() const noexcept{
+        return 13 + (hasAlpha() ? 1 : 0) + (isPalette() ? 1 : 0);
+    }
+
+    UInt32 extraSize() const noexcept{
+        auto spp = static_cast<UInt32>(m_info.samplesPerPixel());
+        return (spp > 2 ? spp * 2 : 0) + 16 + (isPalette() ? 3 * colorCount() * 2 : 0);
+    }
+
+    // all red values, then green, then blue, 16 bits each; missing colours are black
+    void colorMap(char* out, UInt32& pos) const noexcept{
+        auto& colors = m_palette->colors();
+        auto size = std::min<UInt32>(m_palette->size(), 256);
+        for (UInt32 channel = 0; channel < 3; channel++){
+            for (UInt32 i = 0; i < colorCount(); i++){
+                UInt8 value = 0;
+                if (i < size){
+                    const Element8& e = colors[i];
+                    switch (m_palette->type()){
+                        case Palette8::Type::Gray:
+                            value = e.channel1();
+                            break;
+
+                        case Palette8::Type::Cmy:
+                            value = static_cast<UInt8>(255 - (channel == 0 ? e.channel1() : channel == 1 ? e.channel2() : e.channel3()));
+                            break;
+
+                        default:
+                            value = channel == 0 ? e.channel1() : channel == 1 ? e.channel2() : e.channel3();
+                            break;
+                    }
+                }
+
+                put16(out, pos, static_cast<UInt16>(value * 257));
+            }
+        }
+    }
+
+    UInt16 bitsPerSample(UInt16 i) const noexcept{
+        auto bps = m_info.bitsPerSample()[i];
+        return static_cast<UInt16>(bps > 0 ? bps : m_info.bitsPerPixel() / m_info.samplesPerPixel());
+    }
+
+    UInt16 photometric() const noexcept{
+        if (m_compression == Group4){
+            return 0; // white is zero
+        }
+
+        switch (m_info.pixelType()){
+            case PixelType::Rgb:
+                return 2;
+
+            case PixelType::Cmy:
+            case PixelType::Cmyk:
+                return 5; // separated
+
+            case PixelType::Palette:
+                return 3; // RGB palette, see ColorMap
+
+            default:
+                return 1; // black is zero, PixelFlavor::Chocolate
+        }
+    }
+
+    static void put16(char* out, UInt32& pos, UInt16 val) noexcept{
+        std::memcpy(out + pos, &val, 2);
+        pos += 2;
+    }
+
+    static void put32(char* out, UInt32& pos, UInt32 val) noexcept{
+        std::memcpy(out + pos, &val, 4);
+        pos += 4;
+    }
+
+    static void tag(char* out, UInt32& pos, UInt16 id, UInt16 type, UInt32 count, UInt32 value) noexcept{
+        put16(out, pos, id);
+        put16(out, pos, type);
+        put32(out, pos, count);
+        if (type == Short && count == 1){
+            // left-justified within the value field
+            put16(out, pos, static_cast<UInt16>(value));
+            put16(out, pos, 0);
+        } else {
+            put32(out, pos, value);
+        }
+    }
+
+    static void rational(char* out, UInt32& pos, Fix32 value) noexcept{
+        if (value.whole() <= 0){
+            // unknown resolution, readers do not like zero
+            put32(out, pos, 72);
+            put32(out, pos, 1);
+            return;
+        }
+
+        put32(out, pos, (static_cast<UInt32>(value.whole()) << 16) | value.frac());
+        put32(out, pos, 65536);
+    }
+
+    ImageInfo m_info;
+    UInt16 m_compression;
+    const Palette8* m_palette;
+
+};
+
+}
+
+}
+
+#endif // TWPP_DETAIL_FILE_TIFF_HPP
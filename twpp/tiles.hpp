@@ -0,0 +1,348 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_TILES_HPP
+#define TWPP_DETAIL_FILE_TILES_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+static inline UInt32 tileRowBytes(UInt32 columns, UInt32 bitsPerPixel) noexcept{
+    return static_cast<UInt32>((static_cast<std::uint64_t>(columns) * bitsPerPixel + 7) / 8);
+}
+
+}
+
+/// Iterates over tiles of an image in row-major order, for sources supporting `CapType::ITiles`.
+///
+///     TileIterator tiles(info, 256, 256);
+///     do {
+///         ImageMemXfer& xfer = ...;
+///         tiles.fill(xfer);
+///         tiles.copy(page, pageBytesPerRow, xfer.memory().data().data());
+///         ...
+///     } while (tiles.next());
+///
+/// Edge tiles are clipped to the image, tile rows are packed to whole bytes.
+class TileIterator {
+
+public:
+    /// Creates iterator positioned at the top-left tile.
+    /// \param info Image layout, width and height must be known, data must not be planar.
+    /// \param tileColumns Tile width in pixels, must span whole bytes.
+    /// \param tileRows Tile height in pixels.
+    /// \throw RangeException When the image or tile size is not supported.
+    TileIterator(const ImageInfo& info, UInt32 tileColumns, UInt32 tileRows) :
+        m_width(0), m_height(0), m_bpp(0), m_tileColumns(tileColumns), m_tileRows(tileRows),
+        m_x(0), m_y(0){
+
+        if (info.width() <= 0 || info.height() <= 0 || info.bitsPerPixel() <= 0 || info.planar() ||
+                tileColumns == 0 || tileRows == 0){
+            throw RangeException();
+        }
+
+        m_width = static_cast<UInt32>(info.width());
+        m_height = static_cast<UInt32>(info.height());
+        m_bpp = static_cast<UInt32>(info.bitsPerPixel());
+        if (tileColumns < m_width && (static_cast<std::uint64_t>(tileColumns) * m_bpp) % 8 != 0){
+            throw RangeException();
+        }
+    }
+
+    /// Moves to the next tile.
+    /// \return Whether there was a next tile.
+    bool next() noexcept{
+        if (atEnd()){
+            return false;
+        }
+
+        m_x += m_tileColumns;
+        if (m_x >= m_width){
+            m_x = 0;
+            m_y += m_tileRows;
+        }
+
+        return !atEnd();
+    }
+
+    /// Whether the iterator moved past the last tile.
+    bool atEnd() const noexcept{
+        return m_y >= m_height;
+    }
+
+    /// Moves back to the top-left tile.
+    void reset() noexcept{
+        m_x = 0;
+        m_y = 0;
+    }
+
+    /// Total number of tiles.
+    UInt32 count() const noexcept{
+        return ((m_width + m_tileColumns - 1) / m_tileColumns) * ((m_height + m_tileRows - 1) / m_tileRows);
+    }
+
+    /// X offset of the current tile in pixels.
+    UInt32 xOffset() const noexcept{
+        return m_x;
+    }
+
+    /// Y offset of the current tile in pixels.
+    UInt32 yOffset() const noexcept{
+        return m_y;
+    }
+
+    /// Width of the current tile in pixels.
+    UInt32 columns() const noexcept{
+        return std::min(m_tileColumns, m_width - m_x);
+    }
+
+    /// Height of the current tile in pixels.
+    UInt32 rows() const noexcept{
+        return atEnd() ? 0 : std::min(m_tileRows, m_height - m_y);
+    }
+
+    /// Number of bytes per single row of the current tile.
+    UInt32 bytesPerRow() const noexcept{
+        return Detail::tileRowBytes(columns(), m_bpp);
+    }
+
+    /// Number of bytes of the current tile.
+    UInt32 size() const noexcept{
+        return bytesPerRow() * rows();
+    }
+
+    /// Number of bytes of the largest tile, suitable for allocating transfer memory.
+    UInt32 maxSize() const noexcept{
+        return Detail::tileRowBytes(std::min(m_tileColumns, m_width), m_bpp) * std::min(m_tileRows, m_height);
+    }
+
+    /// Sets offset, dimensions and sizes of the current tile in the transfer structure.
+    /// Compression and memory are left unchanged.
+    void fill(Detail::ImageMemXferImpl& xfer) const noexcept{
+        xfer.setXOffset(xOffset());
+        xfer.setYOffset(yOffset());
+        xfer.setColumns(columns());
+        xfer.setRows(rows());
+        xfer.setBytesPerRow(bytesPerRow());
+        xfer.setBytesWritten(size());
+    }
+
+    /// Copies the current tile out of an uncompressed image.
+    /// \param image Whole image data.
+    /// \param imageBytesPerRow Number of bytes per single row of the image.
+    /// \param out Tile data, at least `size()` bytes.
+    void copy(const void* image, UInt32 imageBytesPerRow, void* out) const noexcept{
+        auto src = static_cast<const char*>(image) + static_cast<std::size_t>(m_y) * imageBytesPerRow +
+                m_x * static_cast<std::size_t>(m_bpp) / 8;
+
+        auto bpr = bytesPerRow();
+        auto dst = static_cast<char*>(out);
+        for (UInt32 r = rows(); r > 0; r--){
+            std::memcpy(dst, src, bpr);
+            src += imageBytesPerRow;
+            dst += bpr;
+        }
+    }
+
+private:
+    UInt32 m_width;
+    UInt32 m_height;
+    UInt32 m_bpp;
+    UInt32 m_tileColumns;
+    UInt32 m_tileRows;
+    UInt32 m_x;
+    UInt32 m_y;
+
+};
+
+/// Assembles tiles or strips of uncompressed memory transfers into a preallocated image.
+///
+/// Tiles may be written from several threads at once, either directly or through
+/// the assembler's own worker threads using `post`. Written regions are reported
+/// by the tile callback, so that a viewer may draw them while the scan continues.
+class TileAssembler {
+
+public:
+    /// Called after a region has been written, from the writing thread.
+    typedef std::function<void(UInt32 xOffset, UInt32 yOffset, UInt32 columns, UInt32 rows)> TileCallBack;
+
+    /// Creates assembler writing into a target buffer, does not own the buffer.
+    /// \param target Target image data, at least `bytesPerRow * info.height()` bytes.
+    /// \param bytesPerRow Number of bytes per single row of the target.
+    /// \param info Image layout, width and height must be known, data must not be planar.
+    /// \param threads Number of worker threads for `post`, zero writes posted tiles in place.
+    /// \throw RangeException When the layout is not supported.
+    /// \throw std::system_error
+    TileAssembler(void* target, UInt32 bytesPerRow, const ImageInfo& info, UInt32 threads = 0) :
+        m_target(static_cast<char*>(target)), m_bytesPerRow(bytesPerRow), m_width(0), m_height(0), m_bpp(0),
+        m_pixels(0), m_failed(0), m_queued(0){
+
+        if (info.width() <= 0 || info.height() <= 0 || info.bitsPerPixel() <= 0 || info.planar()){
+            throw RangeException();
+        }
+
+        m_width = static_cast<UInt32>(info.width());
+        m_height = static_cast<UInt32>(info.height());
+        m_bpp = static_cast<UInt32>(info.bitsPerPixel());
+        if (Detail::tileRowBytes(m_width, m_bpp) > bytesPerRow){
+            throw RangeException();
+        }
+
+        m_pool.start(threads);
+    }
+
+    /// Waits for posted tiles.
+    ~TileAssembler(){
+        m_pool.stop();
+    }
+
+    TileAssembler(const TileAssembler&) = delete;
+    TileAssembler& operator=(const TileAssembler&) = delete;
+
+    /// Sets the tile callback, must not be called while tiles are being written.
+    void setTileCallBack(TileCallBack callBack){
+        m_callBack = std::move(callBack);
+    }
+
+    /// Writes a tile into the target.
+    /// Thread-safe as long as concurrently written tiles do not overlap.
+    /// \param tile Uncompressed tile or strip, starting on a whole byte.
+    /// \return Whether the tile was valid and written.
+    bool write(const ImageMemXfer& tile) noexcept{
+        auto x = tile.xOffset();
+        auto y = tile.yOffset();
+        auto columns = tile.columns();
+        auto rows = tile.rows();
+        auto rowBytes = Detail::tileRowBytes(columns, m_bpp);
+        auto bpr = tile.bytesPerRow();
+
+        if (tile.compression() != Compression::None || x >= m_width || y >= m_height ||
+                columns > m_width - x || (static_cast<std::uint64_t>(x) * m_bpp) % 8 != 0 || bpr < rowBytes){
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // the last row of a transfer need not be padded
+        rows = std::min(rows, m_height - y);
+        if (rows != 0){
+            auto available = std::min(tile.bytesWritten(), tile.memory().size());
+            auto needed = static_cast<std::uint64_t>(rows - 1) * bpr + rowBytes;
+            if (needed > available){
+                rows = available < rowBytes ? 0 : (available - rowBytes) / bpr + 1;
+            }
+        }
+
+        if (rows != 0){
+            auto lock = tile.memory().data();
+            auto src = lock.data();
+            auto dst = m_target + static_cast<std::size_t>(y) * m_bytesPerRow + static_cast<std::uint64_t>(x) * m_bpp / 8;
+            for (UInt32 r = 0; r < rows; r++){
+                std::memcpy(dst, src, rowBytes);
+                src += bpr;
+                dst += m_bytesPerRow;
+            }
+
+            m_pixels.fetch_add(static_cast<std::uint64_t>(columns) * rows, std::memory_order_release);
+            if (m_callBack){
+                m_callBack(x, y, columns, rows);
+            }
+        }
+
+        return true;
+    }
+
+    /// Queues a tile to be written by a worker thread, or writes it in place if there are none.
+    /// \param tile Tile to write, the ownership of its memory is taken over.
+    /// \throw std::bad_alloc
+    void post(ImageMemXfer tile){
+        std::shared_ptr<ImageMemXfer> queued(new ImageMemXfer(std::move(tile)));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queued++;
+        }
+
+        try {
+            m_pool.post([this, queued]{
+                write(*queued);
+                finish();
+            });
+        } catch (...){
+            finish();
+            throw;
+        }
+    }
+
+    /// Waits until all posted tiles have been written.
+    void wait(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]{ return m_queued == 0; });
+    }
+
+    /// Number of pixels written so far.
+    std::uint64_t pixelsWritten() const noexcept{
+        return m_pixels.load(std::memory_order_acquire);
+    }
+
+    /// Number of rejected tiles.
+    UInt32 failed() const noexcept{
+        return m_failed.load(std::memory_order_relaxed);
+    }
+
+    /// Whether the whole image has been written, assuming tiles do not overlap.
+    bool isComplete() const noexcept{
+        return pixelsWritten() >= static_cast<std::uint64_t>(m_width) * m_height;
+    }
+
+private:
+    void finish() noexcept{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_queued == 0){
+            m_cond.notify_all();
+        }
+    }
+
+    char* m_target;
+    UInt32 m_bytesPerRow;
+    UInt32 m_width;
+    UInt32 m_height;
+    UInt32 m_bpp;
+    std::atomic<std::uint64_t> m_pixels;
+    std::atomic<UInt32> m_failed;
+    TileCallBack m_callBack;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::size_t m_queued;
+    Detail::WorkerPool m_pool;
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_TILES_HPP
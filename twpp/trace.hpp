@@ -0,0 +1,540 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_TRACE_HPP
+#define TWPP_DETAIL_FILE_TRACE_HPP
+
+#include "../twpp.hpp"
+
+// Timeline events are recorded only when TWPP_TRACE is defined before including twpp.hpp,
+// otherwise the hooks compile to nothing.
+
+namespace Twpp {
+
+namespace Detail {
+
+static inline std::uint64_t traceId(UInt32 id) noexcept{
+    return id;
+}
+
+static inline std::uint64_t traceId(void* id) noexcept{
+    return reinterpret_cast<UIntPtr>(id);
+}
+
+#if defined(TWPP_TRACE)
+
+/// Process-wide timeline of trace events.
+/// Every recording thread owns a ring buffer of the last `Capacity` events,
+/// writing is lock-free, the rings of finished threads are reused.
+template<typename Dummy>
+struct TraceLog {
+
+    enum : UInt32 {
+        Capacity = 8192
+    };
+
+    enum Kind : UInt32 {
+        Call,
+        State,
+        CallBack,
+        Scope,
+        Instant
+    };
+
+    // all fields are atomic, the slot may be overwritten while being dumped
+    struct Slot {
+        std::atomic<std::uint64_t> m_seq; // odd while being written
+        std::atomic<std::uint64_t> m_start;
+        std::atomic<std::uint64_t> m_duration;
+        std::atomic<const char*> m_name;
+        std::atomic<std::uint64_t> m_code; // dg << 32 | dat << 16 | msg, or the state
+        std::atomic<std::uint64_t> m_info; // kind << 56 | thread << 32 | return code
+        std::atomic<std::uint64_t> m_value; // bytes, or the source ID
+    };
+
+    struct Ring {
+        Ring() noexcept :
+            m_head(0), m_thread(0){}
+
+        std::atomic<std::uint64_t> m_head;
+        UInt32 m_thread;
+        Slot m_slots[Capacity];
+    };
+
+    /// Copy of a recorded event.
+    struct Event {
+        std::uint64_t m_start;
+        std::uint64_t m_duration;
+        const char* m_name;
+        std::uint64_t m_code;
+        std::uint64_t m_info;
+        std::uint64_t m_value;
+
+        Kind kind() const noexcept{
+            return static_cast<Kind>(m_info >> 56);
+        }
+
+        UInt32 thread() const noexcept{
+            return static_cast<UInt32>(m_info >> 32) & 0xFFFFFF;
+        }
+    };
+
+    // claims a free ring for the current thread, releases it once the thread ends
+    class Owner {
+
+    public:
+        Owner() noexcept :
+            m_ring(nullptr){
+
+            try {
+                std::lock_guard<std::mutex> lock(g_mutex);
+                for (auto& ring : g_rings){
+                    if (!ring.second){
+                        ring.second = true;
+                        m_ring = ring.first.get();
+                        break;
+                    }
+                }
+
+                if (m_ring == nullptr){
+                    std::unique_ptr<Ring> ring(new Ring());
+                    g_rings.emplace_back(std::move(ring), true);
+                    m_ring = g_rings.back().first.get();
+                }
+
+                m_ring->m_thread = ++g_threads;
+            } catch (...){
+                m_ring = nullptr; // not traced
+            }
+        }
+
+        ~Owner(){
+            if (m_ring != nullptr){
+                std::lock_guard<std::mutex> lock(g_mutex);
+                for (auto& ring : g_rings){
+                    if (ring.first.get() == m_ring){
+                        ring.second = false;
+                    }
+                }
+            }
+        }
+
+        Owner(const Owner&) = delete;
+        Owner& operator=(const Owner&) = delete;
+
+        Ring* m_ring;
+
+    };
+
+    static std::uint64_t now() noexcept{
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void push(Kind kind, std::uint64_t start, std::uint64_t duration, const char* name,
+                     std::uint64_t code, UInt32 rc, std::uint64_t value) noexcept{
+
+        static thread_local Owner owner;
+        Ring* ring = owner.m_ring;
+        if (ring == nullptr){
+            return;
+        }
+
+        // single writer, the owning thread
+        auto index = ring->m_head.load(std::memory_order_relaxed);
+        Slot& slot = ring->m_slots[index % Capacity];
+        slot.m_seq.store(index * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.m_start.store(start, std::memory_order_relaxed);
+        slot.m_duration.store(duration, std::memory_order_relaxed);
+        slot.m_name.store(name, std::memory_order_relaxed);
+        slot.m_code.store(code, std::memory_order_relaxed);
+        slot.m_info.store((static_cast<std::uint64_t>(kind) << 56) |
+                          (static_cast<std::uint64_t>(ring->m_thread & 0xFFFFFF) << 32) | rc,
+                          std::memory_order_relaxed);
+        slot.m_value.store(value, std::memory_order_relaxed);
+
+        slot.m_seq.store(index * 2 + 2, std::memory_order_release);
+        ring->m_head.store(index + 1, std::memory_order_release);
+    }
+
+    /// Copies events recorded since the last `clear`, ordered by thread, then by time.
+    /// Events being overwritten concurrently are skipped.
+    template<typename Container>
+    static void collect(Container& out){
+        auto since = g_since.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(g_mutex);
+        for (auto& r : g_rings){
+            Ring& ring = *r.first;
+            auto head = ring.m_head.load(std::memory_order_acquire);
+            for (auto i = head > Capacity ? head - Capacity : 0; i < head; i++){
+                Slot& slot = ring.m_slots[i % Capacity];
+                auto seq = slot.m_seq.load(std::memory_order_acquire);
+                if (seq != i * 2 + 2){
+                    continue;
+                }
+
+                Event e;
+                e.m_start = slot.m_start.load(std::memory_order_relaxed);
+                e.m_duration = slot.m_duration.load(std::memory_order_relaxed);
+                e.m_name = slot.m_name.load(std::memory_order_relaxed);
+                e.m_code = slot.m_code.load(std::memory_order_relaxed);
+                e.m_info = slot.m_info.load(std::memory_order_relaxed);
+                e.m_value = slot.m_value.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.m_seq.load(std::memory_order_relaxed) != seq || e.m_start < since){
+                    continue;
+                }
+
+                out.push_back(e);
+            }
+        }
+    }
+
+    static std::list<std::pair<std::unique_ptr<Ring>, bool> > g_rings; // ring, in use
+    static std::mutex g_mutex;
+    static UInt32 g_threads;
+    static std::atomic<std::uint64_t> g_since;
+
+};
+
+template<typename Dummy>
+std::list<std::pair<std::unique_ptr<typename TraceLog<Dummy>::Ring>, bool> > TraceLog<Dummy>::g_rings;
+
+template<typename Dummy>
+std::mutex TraceLog<Dummy>::g_mutex;
+
+template<typename Dummy>
+UInt32 TraceLog<Dummy>::g_threads = 0;
+
+template<typename Dummy>
+std::atomic<std::uint64_t> TraceLog<Dummy>::g_since{0};
+
+static inline void traceCall(std::uint64_t start, std::uint64_t duration, DataGroup dg, Dat dat, Msg msg,
+                             ReturnCode rc, std::uint64_t bytes) noexcept{
+    auto code = (static_cast<std::uint64_t>(static_cast<UInt32>(dg)) << 32) |
+            (static_cast<std::uint64_t>(static_cast<UInt16>(dat)) << 16) |
+            static_cast<UInt16>(msg);
+
+    TraceLog<void>::push(TraceLog<void>::Call, start, duration, nullptr, code,
+                         static_cast<UInt16>(rc), bytes);
+}
+
+static inline void traceState(Identity::Id source, DsState state) noexcept{
+    TraceLog<void>::push(TraceLog<void>::State, TraceLog<void>::now(), 0, nullptr,
+                         static_cast<UInt16>(state), 0, traceId(source));
+}
+
+static inline void traceCallBack(Identity::Id source, Msg msg) noexcept{
+    TraceLog<void>::push(TraceLog<void>::CallBack, TraceLog<void>::now(), 0, nullptr,
+                         static_cast<UInt16>(msg), 0, traceId(source));
+}
+
+static inline const char* datName(Dat dat) noexcept{
+    switch (dat){
+        case Dat::Null: return "Null";
+        case Dat::Capability: return "Capability";
+        case Dat::Event: return "Event";
+        case Dat::Identity: return "Identity";
+        case Dat::Parent: return "Parent";
+        case Dat::PendingXfers: return "PendingXfers";
+        case Dat::SetupMemXfer: return "SetupMemXfer";
+        case Dat::SetupFileXfer: return "SetupFileXfer";
+        case Dat::Status: return "Status";
+        case Dat::UserInterface: return "UserInterface";
+        case Dat::XferGroup: return "XferGroup";
+        case Dat::CustomData: return "CustomData";
+        case Dat::DeviceEvent: return "DeviceEvent";
+        case Dat::FileSystem: return "FileSystem";
+        case Dat::PassThrough: return "PassThrough";
+        case Dat::Callback: return "Callback";
+        case Dat::StatusUtf8: return "StatusUtf8";
+        case Dat::Callback2: return "Callback2";
+        case Dat::ImageInfo: return "ImageInfo";
+        case Dat::ImageLayout: return "ImageLayout";
+        case Dat::ImageMemXfer: return "ImageMemXfer";
+        case Dat::ImageNativeXfer: return "ImageNativeXfer";
+        case Dat::ImageFileXfer: return "ImageFileXfer";
+        case Dat::CieColor: return "CieColor";
+        case Dat::GrayResponse: return "GrayResponse";
+        case Dat::RgbResponse: return "RgbResponse";
+        case Dat::JpegCompression: return "JpegCompression";
+        case Dat::Palette8: return "Palette8";
+        case Dat::ExtImageInfo: return "ExtImageInfo";
+        case Dat::Filter: return "Filter";
+        case Dat::AudioFileXfer: return "AudioFileXfer";
+        case Dat::AudioInfo: return "AudioInfo";
+        case Dat::AudioNativeXfer: return "AudioNativeXfer";
+        case Dat::IccProfile: return "IccProfile";
+        case Dat::ImageMemFileXfer: return "ImageMemFileXfer";
+        case Dat::EntryPoint: return "EntryPoint";
+        default: return nullptr;
+    }
+}
+
+static inline const char* msgName(Msg msg) noexcept{
+    switch (msg){
+        case Msg::Null: return "Null";
+        case Msg::Get: return "Get";
+        case Msg::GetCurrent: return "GetCurrent";
+        case Msg::GetDefault: return "GetDefault";
+        case Msg::GetFirst: return "GetFirst";
+        case Msg::GetNext: return "GetNext";
+        case Msg::Set: return "Set";
+        case Msg::Reset: return "Reset";
+        case Msg::QuerySupport: return "QuerySupport";
+        case Msg::GetHelp: return "GetHelp";
+        case Msg::GetLabel: return "GetLabel";
+        case Msg::GetLabelEnum: return "GetLabelEnum";
+        case Msg::SetConstraint: return "SetConstraint";
+        case Msg::XferReady: return "XferReady";
+        case Msg::CloseDsReq: return "CloseDsReq";
+        case Msg::CloseDsOk: return "CloseDsOk";
+        case Msg::DeviceEvent: return "DeviceEvent";
+        case Msg::OpenDsm: return "OpenDsm";
+        case Msg::CloseDsm: return "CloseDsm";
+        case Msg::OpenDs: return "OpenDs";
+        case Msg::CloseDs: return "CloseDs";
+        case Msg::UserSelect: return "UserSelect";
+        case Msg::DisableDs: return "DisableDs";
+        case Msg::EnableDs: return "EnableDs";
+        case Msg::EnableDsUiOnly: return "EnableDsUiOnly";
+        case Msg::ProcessEvent: return "ProcessEvent";
+        case Msg::EndXfer: return "EndXfer";
+        case Msg::StopFeeder: return "StopFeeder";
+        case Msg::ChangeDir: return "ChangeDir";
+        case Msg::CreateDir: return "CreateDir";
+        case Msg::Delete: return "Delete";
+        case Msg::FormatMedia: return "FormatMedia";
+        case Msg::GetClose: return "GetClose";
+        case Msg::GetFirstFile: return "GetFirstFile";
+        case Msg::GetInfo: return "GetInfo";
+        case Msg::GetNextFile: return "GetNextFile";
+        case Msg::Rename: return "Rename";
+        case Msg::Copy: return "Copy";
+        case Msg::AutomaticCaptureDir: return "AutomaticCaptureDir";
+        case Msg::PassThrough: return "PassThrough";
+        case Msg::RegisterCallback: return "RegisterCallback";
+        case Msg::ResetAll: return "ResetAll";
+        default: return nullptr;
+    }
+}
+
+static inline void jsonString(std::string& out, const char* str){
+    out += '"';
+    for ( ; *str; str++){
+        auto c = static_cast<unsigned char>(*str);
+        if (c == '"' || c == '\\'){
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20){
+            static const char hex[] = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+
+    out += '"';
+}
+
+// appends a name or the hexadecimal value of an unknown enumeration item
+static inline void jsonName(std::string& out, const char* name, UInt32 value){
+    if (name != nullptr){
+        out += name;
+    } else {
+        static const char hex[] = "0123456789abcdef";
+        out += "0x";
+        for (int shift = 12; shift >= 0; shift -= 4){
+            out += hex[(value >> shift) & 0xF];
+        }
+    }
+}
+
+// trace timestamps are in microseconds
+static inline void jsonMicros(std::string& out, std::uint64_t ns){
+    auto frac = std::to_string(ns % 1000);
+    out += std::to_string(ns / 1000);
+    out += '.';
+    out.append(3 - frac.size(), '0');
+    out += frac;
+}
+
+#else
+
+static inline void traceCall(std::uint64_t, std::uint64_t, DataGroup, Dat, Msg, ReturnCode, std::uint64_t) noexcept{}
+
+static inline void traceState(Identity::Id, DsState) noexcept{}
+
+static inline void traceCallBack(Identity::Id, Msg) noexcept{}
+
+#endif
+
+}
+
+/// Timeline of DSM calls, source state transitions, callbacks and user events.
+/// Recording requires TWPP_TRACE to be defined, otherwise all events are discarded.
+/// May be used from any thread, e.g. worker threads processing transferred pages.
+class Trace {
+
+public:
+    /// Records the duration of a scope, e.g. processing of a page.
+    class Scope {
+
+    public:
+#if defined(TWPP_TRACE)
+        /// \param name Event name, must stay valid until the trace is dumped, e.g. a string literal.
+        explicit Scope(const char* name) noexcept :
+            m_name(name), m_start(Detail::TraceLog<void>::now()){}
+
+        ~Scope(){
+            auto end = Detail::TraceLog<void>::now();
+            Detail::TraceLog<void>::push(Detail::TraceLog<void>::Scope, m_start, end - m_start, m_name, 0, 0, 0);
+        }
+#else
+        /// \param name Event name, must stay valid until the trace is dumped, e.g. a string literal.
+        explicit Scope(const char* name) noexcept{
+            Detail::unused(name);
+        }
+#endif
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+#if defined(TWPP_TRACE)
+    private:
+        const char* m_name;
+        std::uint64_t m_start;
+#endif
+
+    };
+
+    /// Records an instant event.
+    /// \param name Event name, must stay valid until the trace is dumped, e.g. a string literal.
+    static void instant(const char* name) noexcept{
+#if defined(TWPP_TRACE)
+        Detail::TraceLog<void>::push(Detail::TraceLog<void>::Instant, Detail::TraceLog<void>::now(), 0, name, 0, 0, 0);
+#else
+        Detail::unused(name);
+#endif
+    }
+
+#if defined(TWPP_TRACE)
+    /// Discards all events recorded so far.
+    static void clear() noexcept{
+        Detail::TraceLog<void>::g_since.store(Detail::TraceLog<void>::now(), std::memory_order_relaxed);
+    }
+
+    /// Dumps the recorded events as Chrome trace JSON,
+    /// viewable in chrome://tracing or Perfetto UI.
+    /// DSM calls are complete events of category `dsm`, source state transitions
+    /// are `DsState` counters per source ID, callbacks are instant events of category `callback`.
+    /// Available only when TWPP_TRACE is defined.
+    /// \throw std::bad_alloc
+    static std::string chromeJson(){
+        typedef Detail::TraceLog<void> Log;
+
+        std::list<Log::Event> events;
+        Log::collect(events);
+
+        std::string out("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        bool first = true;
+        for (auto& e : events){
+            out += first ? "\n" : ",\n";
+            first = false;
+
+            out += "{\"pid\":1,\"tid\":";
+            out += std::to_string(e.thread());
+            out += ",\"ts\":";
+            Detail::jsonMicros(out, e.m_start);
+
+            switch (e.kind()){
+                case Log::Call: {
+                    auto dat = static_cast<Dat>(static_cast<UInt16>(e.m_code >> 16));
+                    auto msg = static_cast<Msg>(static_cast<UInt16>(e.m_code));
+                    out += ",\"ph\":\"X\",\"cat\":\"dsm\",\"dur\":";
+                    Detail::jsonMicros(out, e.m_duration);
+                    out += ",\"name\":\"";
+                    Detail::jsonName(out, Detail::datName(dat), static_cast<UInt16>(dat));
+                    out += ' ';
+                    Detail::jsonName(out, Detail::msgName(msg), static_cast<UInt16>(msg));
+                    out += "\",\"args\":{\"dg\":";
+                    out += std::to_string(e.m_code >> 32);
+                    out += ",\"rc\":";
+                    out += std::to_string(e.m_info & 0xFFFFFFFF);
+                    out += ",\"bytes\":";
+                    out += std::to_string(e.m_value);
+                    out += "}}";
+                    break;
+                }
+
+                case Log::State:
+                    out += ",\"ph\":\"C\",\"cat\":\"state\",\"name\":\"DsState\",\"id\":";
+                    out += std::to_string(e.m_value);
+                    out += ",\"args\":{\"state\":";
+                    out += std::to_string(e.m_code);
+                    out += "}}";
+                    break;
+
+                case Log::CallBack:
+                    out += ",\"ph\":\"i\",\"s\":\"t\",\"cat\":\"callback\",\"name\":\"";
+                    Detail::jsonName(out, Detail::msgName(static_cast<Msg>(e.m_code)), static_cast<UInt16>(e.m_code));
+                    out += "\",\"args\":{\"source\":";
+                    out += std::to_string(e.m_value);
+                    out += "}}";
+                    break;
+
+                case Log::Scope:
+                    out += ",\"ph\":\"X\",\"cat\":\"user\",\"dur\":";
+                    Detail::jsonMicros(out, e.m_duration);
+                    out += ",\"name\":";
+                    Detail::jsonString(out, e.m_name);
+                    out += '}';
+                    break;
+
+                case Log::Instant:
+                    out += ",\"ph\":\"i\",\"s\":\"t\",\"cat\":\"user\",\"name\":";
+                    Detail::jsonString(out, e.m_name);
+                    out += '}';
+                    break;
+            }
+        }
+
+        out += "\n]}\n";
+        return out;
+    }
+#endif
+
+};
+
+}
+
+#endif // TWPP_DETAIL_FILE_TRACE_HPP
@@ -0,0 +1,140 @@
+/*
+
+The MIT License (MIT)
+
+Copyright (c) 2015-2017 Martin Richter
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef TWPP_DETAIL_FILE_WORKERPOOL_HPP
+#define TWPP_DETAIL_FILE_WORKERPOOL_HPP
+
+#include "../twpp.hpp"
+
+namespace Twpp {
+
+namespace Detail {
+
+/// Fixed-size pool of worker threads executing queued tasks in FIFO order.
+/// Tasks must not throw, wrap them if they may.
+class WorkerPool {
+
+public:
+    typedef std::function<void()> Task;
+
+    /// Creates a pool with no threads, tasks are executed in `post`.
+    WorkerPool() noexcept :
+        m_stop(false){}
+
+    /// Creates a pool with `threads` worker threads.
+    /// \param threads Number of worker threads, zero executes tasks in `post`.
+    /// \throw std::system_error
+    explicit WorkerPool(UInt32 threads) :
+        m_stop(false){
+
+        start(threads);
+    }
+
+    ~WorkerPool(){
+        stop();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /// Starts additional worker threads.
+    /// \throw std::system_error
+    void start(UInt32 threads){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = false;
+        for (UInt32 i = 0; i < threads; i++){
+            m_threads.emplace_back(&WorkerPool::run, this);
+        }
+    }
+
+    /// Finishes all queued tasks and joins the worker threads.
+    void stop() noexcept{
+        std::list<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            threads.swap(m_threads);
+        }
+
+        m_cond.notify_all();
+        for (auto& thread : threads){
+            thread.join();
+        }
+    }
+
+    /// Number of worker threads.
+    std::size_t size() const{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_threads.size();
+    }
+
+    /// Queues a task, or executes it in place if there are no worker threads.
+    /// \throw std::bad_alloc
+    void post(Task task){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_threads.empty()){
+                m_tasks.push_back(std::move(task));
+                m_cond.notify_one();
+                return;
+            }
+        }
+
+        task();
+    }
+
+private:
+    void run() noexcept{
+        for (;;){
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]{ return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty()){
+                    return; // stopped and drained
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::list<Task> m_tasks;
+    std::list<std::thread> m_threads;
+    bool m_stop;
+
+};
+
+}
+
+}
+
+#endif // TWPP_DETAIL_FILE_WORKERPOOL_HPP